@@ -113,7 +113,7 @@ void V4L2Capture::stopCapture() {
     }
 }
 
-bool V4L2Capture::grabFrame(void** outData, size_t* outSize) {
+bool V4L2Capture::grabFrame(void** outData, size_t* outSize, uint64_t* outTimestampUs) {
     struct v4l2_buffer buf = {0};
     buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     buf.memory = V4L2_MEMORY_MMAP;
@@ -123,6 +123,9 @@ bool V4L2Capture::grabFrame(void** outData, size_t* outSize) {
     currentBufferIndex = buf.index;
     *outData = buffers[buf.index].start;
     *outSize = buf.bytesused;
+    if (outTimestampUs) {
+        *outTimestampUs = uint64_t(buf.timestamp.tv_sec) * 1000000 + buf.timestamp.tv_usec;
+    }
 
     return true;
 }
@@ -137,4 +140,11 @@ void V4L2Capture::releaseFrame() {
 ioctl(fd, VIDIOC_QBUF, &buf);
         currentBufferIndex = -1;
     }
-}
\ No newline at end of file
+}
+
+bool V4L2Capture::requestKeyFrame() {
+    struct v4l2_control ctrl = {0};
+    ctrl.id = V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME;
+    ctrl.value = 1;
+    return ioctl(fd, VIDIOC_S_CTRL, &ctrl) == 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <cstdint>
 
 struct Buffer {
     void* start;
@@ -22,11 +23,15 @@ public:
 
     // 프레임 한 장 가져오기 (타임아웃 적용)
     // 데이터는 내부 버퍼 포인터로 반환 (복사 비용 절약)
-    bool grabFrame(void** outData, size_t* outSize);
+    // outTimestampUs가 주어지면 드라이버가 기록한 캡처 시각(us)을 돌려줌 (없으면 0)
+    bool grabFrame(void** outData, size_t* outSize, uint64_t* outTimestampUs = nullptr);
     
     // 가져온 버퍼 반납 (필수)
     void releaseFrame();
 
+    // 다음 프레임을 IDR로 인코딩하도록 요청 (서버의 PLI 처리용)
+    bool requestKeyFrame();
+
 private:
     std::string deviceName;
     int fd = -1;
@@ -1,10 +1,15 @@
 #include "camera/V4L2Capture.h"
 #include "network/TcpClient.h"
+#include "network/RtpPusher.h"
+#include "network/UnixClient.h"
 #include <iostream>
 #include <unistd.h>
 #include <chrono>
 #include <vector>
+#include <functional>
 #include <cstring>
+#include <ctime>
+#include <csignal>
 
 // Helper function to find the next start code
 const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end) {
@@ -18,8 +23,12 @@ const uint8_t* findStartCode(const uint8_t* p, const uint8_t* end) {
     return end;
 }
 
-// Helper function to parse a buffer and send NAL units one by one
-void parseAndSendNalus(const uint8_t* data, size_t size, TcpClient& client) {
+// Helper function to parse a buffer and send NAL units one by one.
+// A V4L2 buffer holds one encoded picture, so the last NALU in it ends the
+// access unit and every NALU shares the buffer's capture timestamp.
+using NaluSink = std::function<void(const uint8_t* nalu, size_t size, const ingest::FrameHeader& meta)>;
+
+void parseAndSendNalus(const uint8_t* data, size_t size, uint64_t captureUs, const NaluSink& sink) {
     if (size == 0) return;
 
     const uint8_t* buffer_end = data + size;
@@ -31,23 +40,60 @@ void parseAndSendNalus(const uint8_t* data, size_t size, TcpClient& client) {
         const uint8_t* next_nalu_start = findStartCode(nalu_data_start, buffer_end);
         size_t nalu_size = next_nalu_start - nalu_start;
 
-        if (nalu_size > 0) {
-            client.sendData((void*)nalu_start, nalu_size);
+        if (nalu_size > (size_t)startCodeLen) {
+            ingest::FrameHeader meta;
+            meta.codec = ingest::kCodecH264;
+            meta.nalType = nalu_data_start[0] & 0x1F;
+            meta.captureUs = captureUs;
+            if (meta.nalType == 7 || meta.nalType == 8) {
+                meta.flags |= ingest::kFlagConfig | ingest::kFlagKeyframe;
+            } else if (meta.nalType == 5) {
+                meta.flags |= ingest::kFlagKeyframe;
+            }
+            if (next_nalu_start == buffer_end) {
+                meta.flags |= ingest::kFlagAuEnd;
+            }
+            sink(nalu_start, nalu_size, meta);
         }
         
         nalu_start = next_nalu_start;
     }
 }
 
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
 
-int main() {
+int main(int argc, char** argv) {
+    // 사용법: camera_sender [stream_id] [tcp|udp|unix] [unix 소켓 경로]
+    // 서버가 끊으면 프로세스가 죽지 않고 writev가 EPIPE를 반환하도록 함 (재연결)
+    signal(SIGPIPE, SIG_IGN);
     // 1. 설정
     std::string serverIp = "192.168.219.105"; // ★ PC(서버) IP로 변경 필수!
-    int serverPort = 8556;                // 서버 수신 포트
+    int serverPort = 8556;                // 서버 수신 포트 (TCP)
+    int rtpIngestPort = rtp_ingest::kDefaultPort; // 서버 수신 포트 (RTP/UDP)
+    // 스트림 ID: rtsp://<server>:8554/live/<id> 로 제공됨 (기본값: 호스트 이름)
+    std::string streamId;
+    if (argc > 1) {
+        streamId = argv[1];
+    } else {
+        char host[64] = {0};
+        if (gethostname(host, sizeof(host) - 1) == 0) streamId = host;
+    }
+    // udp: 손실이 있는 무선 업링크용. 재전송 대기로 지연이 튀지 않음
+    bool useUdp = argc > 2 && std::string(argv[2]) == "udp";
+    // unix: 서버와 같은 호스트(엣지 어플라이언스)에서 루프백 TCP 대신 SOCK_SEQPACKET으로 전송
+    bool useUnix = argc > 2 && std::string(argv[2]) == "unix";
+    std::string unixPath = argc > 3 ? argv[3] : unix_ingest::kDefaultPath;
 
     // 2. 객체 생성
     V4L2Capture camera("/dev/video0");
     TcpClient client;
+    RtpPusher pusher;
+    UnixClient unixClient;
 
     // 3. 카메라 초기화 (1920x1080)
     if (!camera.init(1920, 1080)) {
@@ -56,12 +102,35 @@ int main() {
     }
 
     // 4. 서버 연결
-    while (!client.connectToServer(serverIp, serverPort)) {
-        std::cout << "Waiting for server..." << std::endl;
-        sleep(2);
+    if (useUdp) {
+        if (!pusher.open(serverIp, rtpIngestPort, streamId)) {
+            std::cerr << "RTP push setup failed" << std::endl;
+            return -1;
+        }
+    } else if (useUnix) {
+        while (!unixClient.connectToServer(unixPath, streamId)) {
+            std::cout << "Waiting for server..." << std::endl;
+            sleep(2);
+        }
+    } else {
+        while (!client.connectToServer(serverIp, serverPort, streamId)) {
+            std::cout << "Waiting for server..." << std::endl;
+            sleep(2);
+        }
     }
     std::cout << "Server connected." << std::endl;
 
+    NaluSink sink;
+    if (useUdp) {
+        sink = [&pusher](const uint8_t* nalu, size_t size, const ingest::FrameHeader& meta) {
+            pusher.sendNalu(nalu, size, meta.captureUs, meta.flags & ingest::kFlagAuEnd);
+        };
+    } else {
+        sink = [&client](const uint8_t* nalu, size_t size, const ingest::FrameHeader& meta) {
+            client.sendData(nalu, size, meta);
+        };
+    }
+
     // 5. 캡처 시작
     if (!camera.startCapture()) {
         std::cerr << "Failed to start camera capture" << std::endl;
@@ -73,20 +142,47 @@ int main() {
     while (true) {
         void* frameData = nullptr;
         size_t frameSize = 0;
+        uint64_t captureUs = 0;
         
-        if (camera.grabFrame(&frameData, &frameSize)) {
-            if (frameSize > 0) {
-                parseAndSendNalus((const uint8_t*)frameData, frameSize, client);
+        if (camera.grabFrame(&frameData, &frameSize, &captureUs)) {
+            if (captureUs == 0) captureUs = monotonicUs(); // 드라이버가 타임스탬프를 안 채우는 경우
+            if (frameSize > 0 && useUnix) {
+                // 버퍼가 곧 액세스 유닛이므로 나누지 않고 그대로 보냄 (서버가 분리)
+                unixClient.sendAccessUnit((const uint8_t*)frameData, frameSize, captureUs);
+            } else if (frameSize > 0) {
+                parseAndSendNalus((const uint8_t*)frameData, frameSize, captureUs, sink);
             }
             camera.releaseFrame();
         } else {
             std::cerr << "Frame grab failed!" << std::endl;
             usleep(100000); // 0.1초 대기
         }
+
+        // TCP: 서버가 재시작되었거나 네트워크가 끊긴 경우 다시 연결하고,
+        // 새 연결의 시청자가 바로 디코딩할 수 있도록 IDR부터 보냄
+        if (useUnix && !unixClient.isConnected()) {
+            while (!unixClient.connectToServer(unixPath, streamId)) {
+                std::cout << "Reconnecting to server..." << std::endl;
+                sleep(2);
+            }
+            camera.requestKeyFrame();
+        }
+        if (!useUdp && !useUnix && !client.isConnected()) {
+            while (!client.connectToServer(serverIp, serverPort, streamId)) {
+                std::cout << "Reconnecting to server..." << std::endl;
+                sleep(2);
+            }
+            camera.requestKeyFrame();
+        }
+
+        // UDP: 서버가 요청한 재전송(NACK)을 보내고, 손실 복구를 포기한 경우(PLI) IDR 요청
+        if (useUdp && pusher.pollFeedback()) {
+            camera.requestKeyFrame();
+        }
         
         // 프레임레이트와 유사한 딜레이 (카메라 드라이버가 보통 맞춰줌)
         usleep(10000); 
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,179 @@
+#include "RtpPusher.h"
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/random.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+// 1500 MTU에서 IP/UDP/RTP 헤더와 터널 오버헤드를 빼고 여유를 둔 값
+static const size_t kMaxPayload = 1200;
+// 재전송용 이력: 서버 지터 버퍼 깊이보다 충분히 길게 (1080p IDR 몇 장 분량)
+static const size_t kHistorySize = 1024;
+static const uint64_t kReportIntervalUs = 1000000;
+
+RtpPusher::RtpPusher() {}
+RtpPusher::~RtpPusher() { close(); }
+
+bool RtpPusher::open(const std::string& ip, int port, const std::string& streamId) {
+    if (!ingest::isValidStreamId(streamId)) {
+        std::cerr << "[RTP] Invalid stream id '" << streamId << "'" << std::endl;
+        return false;
+    }
+    sockFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sockFd < 0) return false;
+
+    struct sockaddr_in servAddr;
+    memset(&servAddr, 0, sizeof(servAddr));
+    servAddr.sin_family = AF_INET;
+    servAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &servAddr.sin_addr) <= 0 ||
+        connect(sockFd, (struct sockaddr*)&servAddr, sizeof(servAddr)) < 0) {
+        perror("RTP connect failed");
+        close();
+        return false;
+    }
+
+    // SSRC와 시작 시퀀스는 RFC 3550 권장대로 랜덤
+    if (getrandom(&ssrc, sizeof(ssrc), 0) != sizeof(ssrc)) ssrc = static_cast<uint32_t>(time(nullptr));
+    if (getrandom(&seq, sizeof(seq), 0) != sizeof(seq)) seq = 0;
+    cname = streamId;
+    history.assign(kHistorySize, SentPacket());
+    packetCount = octetCount = 0;
+    lastReportUs = 0;
+
+    // 서버는 CNAME을 받은 뒤부터 RTP를 받아들이므로 먼저 한 번 보냄
+    sendReport(0);
+    std::cout << "[RTP] Pushing to " << ip << ":" << port << " as '" << streamId << "'" << std::endl;
+    return true;
+}
+
+void RtpPusher::close() {
+    if (sockFd != -1) {
+        // BYE: 서버가 타임아웃을 기다리지 않고 바로 스트림을 정리하게 함
+        uint8_t bye[8];
+        rtp_ingest::putRtcpHeader(bye, 1, rtp_ingest::kRtcpBye, sizeof(bye));
+        rtp_ingest::putBe32(bye + 4, ssrc);
+        send(sockFd, bye, sizeof(bye), MSG_DONTWAIT);
+        ::close(sockFd);
+        sockFd = -1;
+    }
+}
+
+void RtpPusher::sendPacket(const uint8_t* payload, size_t size, const uint8_t* prefix, size_t prefixSize,
+                           uint32_t timestamp, bool marker) {
+    SentPacket& pkt = history[seq % history.size()];
+    uint8_t* p = pkt.data;
+    p[0] = 0x80;
+    p[1] = (marker ? 0x80 : 0x00) | rtp_ingest::kPayloadType;
+    rtp_ingest::putBe16(p + 2, seq);
+    rtp_ingest::putBe32(p + 4, timestamp);
+    rtp_ingest::putBe32(p + 8, ssrc);
+    memcpy(p + 12, prefix, prefixSize);
+    memcpy(p + 12 + prefixSize, payload, size);
+    pkt.seq = seq;
+    pkt.size = 12 + prefixSize + size;
+
+    send(sockFd, pkt.data, pkt.size, 0);
+    seq++;
+    packetCount++;
+    octetCount += prefixSize + size;
+}
+
+bool RtpPusher::sendNalu(const uint8_t* nalu, size_t size, uint64_t captureUs, bool auEnd) {
+    if (sockFd == -1) return false;
+
+    // Start Code 제거
+    size_t startCodeLen = (size > 3 && nalu[2] == 1) ? 3 : 4;
+    if (size <= startCodeLen) return true;
+    nalu += startCodeLen;
+    size -= startCodeLen;
+
+    uint32_t timestamp = static_cast<uint32_t>(captureUs * rtp_ingest::kClockRate / 1000000);
+
+    if (size <= kMaxPayload) {
+        sendPacket(nalu, size, nullptr, 0, timestamp, auEnd);
+    } else {
+        // FU-A: [FU indicator][FU header][fragment]
+        uint8_t naluHeader = nalu[0];
+        const uint8_t* payload = nalu + 1;
+        size_t remaining = size - 1;
+        bool first = true;
+        while (remaining > 0) {
+            size_t len = remaining > kMaxPayload - 2 ? kMaxPayload - 2 : remaining;
+            bool last = (len == remaining);
+            uint8_t fu[2];
+            fu[0] = (naluHeader & 0xE0) | 28;
+            fu[1] = (naluHeader & 0x1F) | (first ? 0x80 : 0) | (last ? 0x40 : 0);
+            sendPacket(payload, len, fu, 2, timestamp, last && auEnd);
+            payload += len;
+            remaining -= len;
+            first = false;
+        }
+    }
+
+    if (captureUs - lastReportUs >= kReportIntervalUs) {
+        sendReport(timestamp);
+        lastReportUs = captureUs;
+    }
+    return true;
+}
+
+void RtpPusher::sendReport(uint32_t timestamp) {
+    // Compound RTCP: SR + SDES(CNAME = stream id)
+    uint8_t buf[28 + 12 + ingest::kMaxStreamIdLength];
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    uint64_t ntpSec = uint64_t(now.tv_sec) + 2208988800ULL;
+    uint64_t ntpFrac = (uint64_t(now.tv_nsec) << 32) / 1000000000ULL;
+
+    rtp_ingest::putRtcpHeader(buf, 0, rtp_ingest::kRtcpSr, 28);
+    rtp_ingest::putBe32(buf + 4, ssrc);
+    rtp_ingest::putBe32(buf + 8, static_cast<uint32_t>(ntpSec));
+    rtp_ingest::putBe32(buf + 12, static_cast<uint32_t>(ntpFrac));
+    rtp_ingest::putBe32(buf + 16, timestamp);
+    rtp_ingest::putBe32(buf + 20, packetCount);
+    rtp_ingest::putBe32(buf + 24, octetCount);
+
+    uint8_t* sdes = buf + 28;
+    size_t pos = 4;
+    rtp_ingest::putBe32(sdes + pos, ssrc);
+    pos += 4;
+    sdes[pos++] = rtp_ingest::kSdesCname;
+    sdes[pos++] = static_cast<uint8_t>(cname.size());
+    memcpy(sdes + pos, cname.data(), cname.size());
+    pos += cname.size();
+    // 아이템 목록 끝(0)과 32비트 정렬 패딩
+    do {
+        sdes[pos++] = 0;
+    } while (pos % 4 != 0);
+    rtp_ingest::putRtcpHeader(sdes, 1, rtp_ingest::kRtcpSdes, pos);
+
+    send(sockFd, buf, 28 + pos, 0);
+}
+
+bool RtpPusher::pollFeedback() {
+    if (sockFd == -1) return false;
+
+    bool keyframeRequested = false;
+    uint8_t buf[rtp_ingest::kMaxPacketSize];
+    while (true) {
+        ssize_t n = recv(sockFd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n <= 0) break;   // EAGAIN, 또는 서버 미실행 시 ECONNREFUSED
+        rtp_ingest::forEachRtcpPacket(buf, n, [&](uint8_t type, uint8_t fmt, const uint8_t* body, size_t size) {
+            if (type == rtp_ingest::kRtcpRtpfb && fmt == rtp_ingest::kFmtNack) {
+                rtp_ingest::forEachNackedSeq(body, size, [&](uint16_t lostSeq) {
+                    const SentPacket& pkt = history[lostSeq % history.size()];
+                    if (pkt.size > 0 && pkt.seq == lostSeq) {
+                        send(sockFd, pkt.data, pkt.size, 0);
+                    }
+                });
+            } else if (type == rtp_ingest::kRtcpPsfb && fmt == rtp_ingest::kFmtPli) {
+                keyframeRequested = true;
+            }
+        });
+    }
+    return keyframeRequested;
+}
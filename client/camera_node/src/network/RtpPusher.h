@@ -0,0 +1,44 @@
+#pragma once
+#include "RtpIngestProtocol.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <netinet/in.h>
+
+// 카메라 -> 서버 RTP/UDP push 전송 (common/RtpIngestProtocol.h 참고)
+// 손실이 있는 업링크(Wi-Fi)에서 TCP의 head-of-line blocking 없이 전송하고,
+// 서버가 NACK으로 요청한 패킷만 최근 전송 이력에서 다시 보냄
+class RtpPusher {
+public:
+    RtpPusher();
+    ~RtpPusher();
+
+    bool open(const std::string& ip, int port, const std::string& streamId);
+    void close();
+
+    // Start Code 포함 NAL 유닛 하나를 RTP 패킷(단일 또는 FU-A)으로 전송
+    bool sendNalu(const uint8_t* nalu, size_t size, uint64_t captureUs, bool auEnd);
+
+    // 서버 피드백(NACK/PLI)을 처리. PLI를 받았으면 true (IDR 요청)
+    bool pollFeedback();
+
+private:
+    struct SentPacket {
+        uint16_t seq = 0;
+        size_t size = 0;
+        uint8_t data[rtp_ingest::kMaxPacketSize];
+    };
+
+    void sendPacket(const uint8_t* payload, size_t size, const uint8_t* prefix, size_t prefixSize,
+                    uint32_t timestamp, bool marker);
+    void sendReport(uint32_t timestamp);
+
+    int sockFd = -1;
+    std::string cname;
+    uint32_t ssrc = 0;
+    uint16_t seq = 0;
+    uint32_t packetCount = 0;
+    uint32_t octetCount = 0;
+    uint64_t lastReportUs = 0;
+    std::vector<SentPacket> history;   // seq % history.size() 로 인덱싱
+};
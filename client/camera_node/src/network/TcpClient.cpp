@@ -1,16 +1,22 @@
 #include "TcpClient.h"
 #include <iostream>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
+#include <cerrno>
 #include <cstring>
 #include <netinet/in.h>   // IPPROTO_TCP를 위해 필요
 #include <netinet/tcp.h>  // TCP_NODELAY를 위해 필요
 
+// 구버전 서버는 Hello에 응답하지 않으므로 이 시간 안에 HelloAck가 없으면 레거시로 전환
+static const int kHelloAckTimeoutMs = 2000;
+
 TcpClient::TcpClient() {}
 TcpClient::~TcpClient() { disconnect(); }
 
-bool TcpClient::connectToServer(const std::string& ip, int port) {
+bool TcpClient::openSocket(const std::string& ip, int port) {
     sockFd = socket(AF_INET, SOCK_STREAM, 0);
     if (sockFd < 0) return false;
 
@@ -27,16 +33,73 @@ bool TcpClient::connectToServer(const std::string& ip, int port) {
     servAddr.sin_family = AF_INET;
     servAddr.sin_port = htons(port);
 
-    if (inet_pton(AF_INET, ip.c_str(), &servAddr.sin_addr) <= 0) return false;
+    if (inet_pton(AF_INET, ip.c_str(), &servAddr.sin_addr) <= 0) {
+        disconnect();
+        return false;
+    }
 
     if (connect(sockFd, (struct sockaddr*)&servAddr, sizeof(servAddr)) < 0) {
         perror("Connection Failed");
+        disconnect();
         return false;
     }
-    std::cout << "[Network] Connected to " << ip << ":" << port << std::endl;
     return true;
 }
 
+bool TcpClient::connectToServer(const std::string& ip, int port, const std::string& streamId) {
+    if (!openSocket(ip, port)) return false;
+    wireVersion = 1;
+    sequence = 0;
+
+    if (!streamId.empty()) {
+        int result = negotiate(streamId);
+        if (result == 1) {
+            disconnect();
+            return false;
+        }
+        if (result == 2) {
+            // Hello 바이트를 이미 보냈으므로 새 연결에서 레거시로 시작
+            std::cout << "[Network] Server did not answer ingest v2 Hello, using legacy format" << std::endl;
+            disconnect();
+            if (!openSocket(ip, port)) return false;
+        }
+    }
+    std::cout << "[Network] Connected to " << ip << ":" << port
+              << " (ingest v" << wireVersion << ")" << std::endl;
+    return true;
+}
+
+int TcpClient::negotiate(const std::string& streamId) {
+    if (!ingest::isValidStreamId(streamId)) {
+        std::cerr << "[Network] Invalid stream id '" << streamId << "'" << std::endl;
+        return 1;
+    }
+
+    uint8_t hello[ingest::kHelloFixedSize + ingest::kMaxStreamIdLength];
+    size_t helloSize = ingest::encodeHello(hello, ingest::kCodecH264, streamId);
+    if (send(sockFd, hello, helloSize, MSG_NOSIGNAL) != (ssize_t)helloSize) return 2;
+
+    uint8_t ack[ingest::kHelloAckSize];
+    size_t got = 0;
+    while (got < sizeof(ack)) {
+        struct pollfd pfd = {sockFd, POLLIN, 0};
+        int ready = poll(&pfd, 1, kHelloAckTimeoutMs);
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return 2;
+        ssize_t n = recv(sockFd, ack + got, sizeof(ack) - got, 0);
+        if (n <= 0) return 2;
+        got += n;
+    }
+    if (!ingest::isHelloMagic(ack)) return 2;
+    if (ack[5] != ingest::kAckOk) {
+        std::cerr << "[Network] Server rejected stream '" << streamId << "' (status "
+                  << (int)ack[5] << ")" << std::endl;
+        return 1;
+    }
+    wireVersion = ack[4];
+    return 0;
+}
+
 void TcpClient::disconnect() {
     if (sockFd != -1) {
         close(sockFd);
@@ -44,24 +107,52 @@ void TcpClient::disconnect() {
     }
 }
 
-bool TcpClient::sendData(const void* data, size_t size) {
+bool TcpClient::sendAll(struct iovec* iov, int iovCount) {
+    // 헤더와 데이터를 한 번의 시스템 콜로 보내고, 부분 전송이면 남은 부분만 이어서 보냄
+    while (iovCount > 0) {
+        ssize_t n = writev(sockFd, iov, iovCount);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        while (iovCount > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovCount--;
+        }
+        if (iovCount > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+bool TcpClient::sendData(const void* data, size_t size, ingest::FrameHeader meta) {
     if (sockFd == -1) return false;
 
-    // 1. 길이 헤더 전송 (Network Byte Order)
-    uint32_t netLen = htonl(static_cast<uint32_t>(size));
-    int sent = send(sockFd, &netLen, 4, 0);
-    if (sent != 4) return false;
-
-    // 2. 실제 데이터 전송
-    // 한 번에 다 못 보낼 수도 있으므로 루프 처리
-    const uint8_t* ptr = static_cast<const uint8_t*>(data);
-    size_t remaining = size;
-    
-    while (remaining > 0) {
-        int n = send(sockFd, ptr, remaining, 0);
-        if (n < 0) return false;
-        ptr += n;
-        remaining -= n;
+    uint8_t header[ingest::kFrameHeaderSize];
+    size_t headerSize;
+    if (wireVersion >= 2) {
+        meta.sequence = sequence++;
+        meta.payloadSize = static_cast<uint32_t>(size);
+        ingest::encodeFrameHeader(header, meta);
+        headerSize = ingest::kFrameHeaderSize;
+    } else {
+        // 길이 헤더 (Network Byte Order)
+        ingest::putBe32(header, static_cast<uint32_t>(size));
+        headerSize = 4;
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len = headerSize;
+    iov[1].iov_base = const_cast<void*>(data);
+    iov[1].iov_len = size;
+    if (!sendAll(iov, 2)) {
+        perror("[Network] Send failed");
+        disconnect();
+        return false;
     }
     return true;
-}
\ No newline at end of file
+}
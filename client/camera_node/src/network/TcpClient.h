@@ -1,4 +1,5 @@
 #pragma once
+#include "IngestProtocol.h"
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -8,12 +9,26 @@ public:
     TcpClient();
     ~TcpClient();
 
-    bool connectToServer(const std::string& ip, int port);
+    // streamId가 주어지면 ingest v2 Hello로 협상하고, 서버가 응답하지 않으면
+    // (구버전 서버) 다시 연결해 레거시 포맷으로 전송함
+    bool connectToServer(const std::string& ip, int port, const std::string& streamId = "");
     void disconnect();
-    
-    // [Length Header(4B)] + [Data Payload] 전송
-    bool sendData(const void* data, size_t size);
+
+    // v2: [FrameHeader(24B)] + [Data Payload], 레거시: [Length Header(4B)] + [Data Payload]
+    // meta의 sequence/payloadSize는 여기서 채움
+    // 전송 실패 시 연결을 닫으므로 호출자는 isConnected()로 재연결 여부를 판단
+    bool sendData(const void* data, size_t size, ingest::FrameHeader meta = {});
+    bool isConnected() const { return sockFd != -1; }
+
+    int protocolVersion() const { return wireVersion; }
 
 private:
+    bool openSocket(const std::string& ip, int port);
+    // 0: 협상 성공, 1: 서버 거절, 2: 응답 없음 (구버전 서버)
+    int negotiate(const std::string& streamId);
+    bool sendAll(struct iovec* iov, int iovCount);
+
     int sockFd = -1;
-};
\ No newline at end of file
+    int wireVersion = 1;
+    uint32_t sequence = 0;
+};
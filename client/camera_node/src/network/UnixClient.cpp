@@ -0,0 +1,125 @@
+#include "UnixClient.h"
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+
+UnixClient::UnixClient() {}
+UnixClient::~UnixClient() { disconnect(); }
+
+bool UnixClient::connectToServer(const std::string& path, const std::string& streamId) {
+    if (!ingest::isValidStreamId(streamId)) {
+        std::cerr << "[Unix] Invalid stream id '" << streamId << "'" << std::endl;
+        return false;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) return false;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    sockFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (sockFd < 0) return false;
+    if (connect(sockFd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("Unix connect failed");
+        disconnect();
+        return false;
+    }
+
+    // Hello/HelloAck은 TCP ingest v2와 같음. 메시지 경계가 보존되므로 recv 한 번이면 충분
+    uint8_t hello[ingest::kHelloFixedSize + ingest::kMaxStreamIdLength];
+    size_t helloSize = ingest::encodeHello(hello, ingest::kCodecH264, streamId);
+    uint8_t ack[ingest::kHelloAckSize];
+    if (send(sockFd, hello, helloSize, MSG_NOSIGNAL) != (ssize_t)helloSize ||
+        recv(sockFd, ack, sizeof(ack), 0) != (ssize_t)sizeof(ack) || !ingest::isHelloMagic(ack)) {
+        disconnect();
+        return false;
+    }
+    if (ack[5] != ingest::kAckOk) {
+        std::cerr << "[Unix] Server rejected stream '" << streamId << "' (status " << (int)ack[5] << ")" << std::endl;
+        disconnect();
+        return false;
+    }
+    sequence = 0;
+    std::cout << "[Unix] Connected to " << path << " as '" << streamId << "'" << std::endl;
+    return true;
+}
+
+void UnixClient::disconnect() {
+    if (sockFd != -1) {
+        close(sockFd);
+        sockFd = -1;
+    }
+}
+
+bool UnixClient::sendAccessUnit(const uint8_t* data, size_t size, uint64_t captureUs) {
+    if (sockFd == -1 || size == 0 || size > ingest::kMaxNaluSize) return false;
+
+    ingest::FrameHeader meta;
+    meta.codec = ingest::kCodecH264;
+    meta.flags = unix_ingest::kFlagAccessUnit | ingest::kFlagAuEnd;
+    meta.sequence = sequence++;
+    meta.captureUs = captureUs;
+    meta.payloadSize = static_cast<uint32_t>(size);
+    bool large = size >= unix_ingest::kMemfdThreshold;
+    if (large) meta.flags |= unix_ingest::kFlagMemfd;
+    uint8_t header[ingest::kFrameHeaderSize];
+    ingest::encodeFrameHeader(header, meta);
+
+    bool ok;
+    if (large) {
+        ok = sendMemfd(header, data, size);
+    } else {
+        // 헤더와 데이터를 메시지 하나로 (SEQPACKET은 부분 전송이 없음)
+        struct iovec iov[2];
+        iov[0].iov_base = header;
+        iov[0].iov_len = sizeof(header);
+        iov[1].iov_base = const_cast<uint8_t*>(data);
+        iov[1].iov_len = size;
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        ok = sendmsg(sockFd, &msg, MSG_NOSIGNAL) == (ssize_t)(sizeof(header) + size);
+    }
+    if (!ok) {
+        perror("[Unix] Send failed");
+        disconnect();
+    }
+    return ok;
+}
+
+bool UnixClient::sendMemfd(const uint8_t* header, const uint8_t* data, size_t size) {
+    // 픽처마다 새 memfd: 서버가 언제 다 읽었는지 알 수 없으므로 재사용하지 않음.
+    // 봉인(seal)해 두면 서버가 읽는 동안 내용이 바뀌지 않음이 보장됨
+    int fd = memfd_create("camera_au", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) return false;
+    bool ok = write(fd, data, size) == (ssize_t)size &&
+              fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+    if (ok) {
+        struct iovec iov;
+        iov.iov_base = const_cast<uint8_t*>(header);
+        iov.iov_len = ingest::kFrameHeaderSize;
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        ok = sendmsg(sockFd, &msg, MSG_NOSIGNAL) == (ssize_t)ingest::kFrameHeaderSize;
+    }
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "UnixIngestProtocol.h"
+#include <string>
+#include <cstdint>
+
+// 같은 호스트의 서버로 AF_UNIX SOCK_SEQPACKET 전송 (common/UnixIngestProtocol.h 참고)
+// V4L2 버퍼(픽처 하나)를 NAL 단위로 나누지 않고 메시지 하나로 보내며,
+// 큰 픽처는 memfd에 담아 파일 디스크립터만 넘김 (소켓 버퍼 크기 제한 회피)
+class UnixClient {
+public:
+    UnixClient();
+    ~UnixClient();
+
+    bool connectToServer(const std::string& path, const std::string& streamId);
+    void disconnect();
+
+    // Start Code가 포함된 액세스 유닛 하나를 전송
+    // 전송 실패 시 연결을 닫으므로 호출자는 isConnected()로 재연결 여부를 판단
+    bool sendAccessUnit(const uint8_t* data, size_t size, uint64_t captureUs);
+    bool isConnected() const { return sockFd != -1; }
+
+private:
+    bool sendMemfd(const uint8_t* header, const uint8_t* data, size_t size);
+
+    int sockFd = -1;
+    uint32_t sequence = 0;
+};
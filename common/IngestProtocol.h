@@ -0,0 +1,134 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+// Camera -> server ingest wire format, shared by camera_node and rtsp_server.
+//
+// Legacy (v1): repeated [4-byte big-endian length][NALU with start code].
+// Nothing else is sent; the server sniffs NAL types and guesses timing.
+//
+// v2: the camera opens with a Hello naming the protocol version and the
+// stream it publishes, the server answers with a HelloAck, and every NALU
+// is then preceded by a FrameHeader:
+//
+//   Hello     "RIV2" | u8 version | u8 codec | u16 idLen | idLen bytes of stream id
+//   HelloAck  "RIV2" | u8 version | u8 status
+//   Frame     FrameHeader (kFrameHeaderSize bytes) | NALU with start code
+//
+// All integers are big-endian. A v1 stream can never begin with the Hello
+// magic because its first word is a NALU length far below 0x52000000, so the
+// server tells the formats apart from the first four bytes. A v2 camera that
+// gets no HelloAck is talking to an old server and falls back to v1.
+namespace ingest {
+
+constexpr uint8_t kHelloMagic[4] = {'R', 'I', 'V', '2'};
+constexpr uint8_t kVersion2 = 2;
+constexpr size_t kHelloFixedSize = 8;
+constexpr size_t kHelloAckSize = 6;
+constexpr size_t kMaxStreamIdLength = 64;
+constexpr uint32_t kMaxNaluSize = 2000000;
+
+enum Codec : uint8_t {
+    kCodecH264 = 1,
+    kCodecH265 = 2,
+};
+
+enum AckStatus : uint8_t {
+    kAckOk = 0,
+    kAckBadRequest = 1,   // unsupported version/codec or invalid stream id
+    kAckStreamBusy = 2,   // another camera is publishing this stream id
+};
+
+enum FrameFlags : uint8_t {
+    kFlagKeyframe = 0x01,    // IDR, or a parameter set leading into one
+    kFlagAuEnd = 0x02,       // last NALU of its access unit (picture)
+    kFlagConfig = 0x04,      // SPS/PPS (VPS for H.265)
+};
+
+constexpr uint16_t kFrameMagic = 0x4E56; // "NV", resync anchor
+
+// FrameHeader layout (24 bytes):
+//   u16 magic | u8 flags | u8 codec | u8 nalType | u8 reserved
+//   u16 headerSize | u32 sequence | u64 captureUs | u32 payloadSize
+// headerSize lets later revisions append fields; receivers skip the excess.
+constexpr size_t kFrameHeaderSize = 24;
+
+struct FrameHeader {
+    uint8_t flags = 0;
+    uint8_t codec = kCodecH264;
+    uint8_t nalType = 0;
+    uint16_t headerSize = kFrameHeaderSize;
+    uint32_t sequence = 0;      // increments by one per NALU, wraps
+    uint64_t captureUs = 0;     // capture time in microseconds, camera clock
+    uint32_t payloadSize = 0;
+};
+
+inline void putBe16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+inline void putBe32(uint8_t* p, uint32_t v) { putBe16(p, v >> 16); putBe16(p + 2, v); }
+inline void putBe64(uint8_t* p, uint64_t v) { putBe32(p, v >> 32); putBe32(p + 4, v); }
+inline uint16_t getBe16(const uint8_t* p) { return uint16_t(p[0]) << 8 | p[1]; }
+inline uint32_t getBe32(const uint8_t* p) { return uint32_t(getBe16(p)) << 16 | getBe16(p + 2); }
+inline uint64_t getBe64(const uint8_t* p) { return uint64_t(getBe32(p)) << 32 | getBe32(p + 4); }
+
+inline bool isHelloMagic(const uint8_t* p) {
+    return std::memcmp(p, kHelloMagic, sizeof(kHelloMagic)) == 0;
+}
+
+// Stream ids become URL path segments (/live/<id>).
+inline bool isValidStreamId(const std::string& id) {
+    if (id.empty() || id.size() > kMaxStreamIdLength) return false;
+    for (char c : id) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                  c == '-' || c == '_' || c == '.';
+        if (!ok) return false;
+    }
+    return true;
+}
+
+// Writes a Hello into out (at least kHelloFixedSize + id.size() bytes) and
+// returns its size.
+inline size_t encodeHello(uint8_t* out, uint8_t codec, const std::string& id) {
+    std::memcpy(out, kHelloMagic, sizeof(kHelloMagic));
+    out[4] = kVersion2;
+    out[5] = codec;
+    putBe16(out + 6, static_cast<uint16_t>(id.size()));
+    std::memcpy(out + kHelloFixedSize, id.data(), id.size());
+    return kHelloFixedSize + id.size();
+}
+
+inline void encodeHelloAck(uint8_t* out, uint8_t version, uint8_t status) {
+    std::memcpy(out, kHelloMagic, sizeof(kHelloMagic));
+    out[4] = version;
+    out[5] = status;
+}
+
+inline void encodeFrameHeader(uint8_t* out, const FrameHeader& h) {
+    putBe16(out, kFrameMagic);
+    out[2] = h.flags;
+    out[3] = h.codec;
+    out[4] = h.nalType;
+    out[5] = 0;
+    putBe16(out + 6, kFrameHeaderSize);
+    putBe32(out + 8, h.sequence);
+    putBe64(out + 12, h.captureUs);
+    putBe32(out + 20, h.payloadSize);
+}
+
+// Decodes the fixed part of a frame header. Returns false if the bytes
+// cannot be a frame header (bad magic or sizes out of range).
+inline bool decodeFrameHeader(const uint8_t* p, FrameHeader& h) {
+    if (getBe16(p) != kFrameMagic) return false;
+    h.flags = p[2];
+    h.codec = p[3];
+    h.nalType = p[4];
+    h.headerSize = getBe16(p + 6);
+    h.sequence = getBe32(p + 8);
+    h.captureUs = getBe64(p + 12);
+    h.payloadSize = getBe32(p + 20);
+    return h.headerSize >= kFrameHeaderSize && h.headerSize <= 256 &&
+           h.payloadSize > 0 && h.payloadSize <= kMaxNaluSize;
+}
+
+} // namespace ingest
@@ -0,0 +1,110 @@
+#pragma once
+#include "IngestProtocol.h"
+#include <cstdint>
+#include <cstddef>
+
+// Camera -> server RTP/UDP push ingest, shared by camera_node and rtsp_server.
+//
+// The camera sends H.264 over RTP (RFC 6184, packetization-mode 1) to one
+// server UDP port, with RTCP multiplexed on the same port (RFC 5761). Every
+// RTCP compound it sends carries an SDES CNAME holding the stream id, which
+// is how the server maps an SSRC to /live/<id>; RTP from an SSRC whose CNAME
+// has not been seen yet is dropped. The server answers on the same socket
+// with Generic NACKs (RFC 4585) for missing packets and a PLI when it had to
+// give up on a packet, asking the camera for a fresh IDR.
+namespace rtp_ingest {
+
+constexpr int kDefaultPort = 8558;
+constexpr uint8_t kPayloadType = 96;
+constexpr uint32_t kClockRate = 90000;
+constexpr size_t kMaxPacketSize = 1500;
+
+enum RtcpType : uint8_t {
+    kRtcpSr = 200,
+    kRtcpRr = 201,
+    kRtcpSdes = 202,
+    kRtcpBye = 203,
+    kRtcpRtpfb = 205,   // transport feedback, FMT 1 = Generic NACK
+    kRtcpPsfb = 206,    // payload feedback, FMT 1 = PLI
+};
+constexpr uint8_t kSdesCname = 1;
+constexpr uint8_t kFmtNack = 1;
+constexpr uint8_t kFmtPli = 1;
+
+using ingest::putBe16;
+using ingest::putBe32;
+using ingest::getBe16;
+using ingest::getBe32;
+
+// RFC 5761 demultiplexing: RTCP packet types occupy 192-223 in the byte that
+// holds marker + payload type for RTP.
+inline bool isRtcp(const uint8_t* p, size_t size) {
+    return size >= 8 && (p[0] >> 6) == 2 && p[1] >= 192 && p[1] <= 223;
+}
+
+inline void putRtcpHeader(uint8_t* p, uint8_t countOrFmt, uint8_t type, size_t totalBytes) {
+    p[0] = 0x80 | (countOrFmt & 0x1F);
+    p[1] = type;
+    putBe16(p + 2, static_cast<uint16_t>(totalBytes / 4 - 1));
+}
+
+// Writes a Generic NACK for the given (ascending) sequence numbers into out,
+// which must hold 12 + 4 * count bytes. Returns the packet size.
+inline size_t buildNack(uint8_t* out, uint32_t senderSsrc, uint32_t mediaSsrc,
+                        const uint16_t* seqs, size_t count) {
+    size_t pos = 12;
+    size_t i = 0;
+    while (i < count) {
+        uint16_t pid = seqs[i++];
+        uint16_t blp = 0;
+        while (i < count && static_cast<uint16_t>(seqs[i] - pid) >= 1 &&
+               static_cast<uint16_t>(seqs[i] - pid) <= 16) {
+            blp |= 1 << (static_cast<uint16_t>(seqs[i] - pid) - 1);
+            i++;
+        }
+        putBe16(out + pos, pid);
+        putBe16(out + pos + 2, blp);
+        pos += 4;
+    }
+    putRtcpHeader(out, kFmtNack, kRtcpRtpfb, pos);
+    putBe32(out + 4, senderSsrc);
+    putBe32(out + 8, mediaSsrc);
+    return pos;
+}
+
+// Picture Loss Indication: always 12 bytes.
+inline size_t buildPli(uint8_t* out, uint32_t senderSsrc, uint32_t mediaSsrc) {
+    putRtcpHeader(out, kFmtPli, kRtcpPsfb, 12);
+    putBe32(out + 4, senderSsrc);
+    putBe32(out + 8, mediaSsrc);
+    return 12;
+}
+
+// Calls fn(type, fmtOrCount, body, bodySize) for each packet of an RTCP
+// compound; body starts after the 4-byte header. Stops at the first
+// malformed packet.
+template <typename Fn>
+inline void forEachRtcpPacket(const uint8_t* p, size_t size, Fn fn) {
+    while (size >= 4 && (p[0] >> 6) == 2) {
+        size_t length = (size_t(getBe16(p + 2)) + 1) * 4;
+        if (length > size) return;
+        fn(p[1], static_cast<uint8_t>(p[0] & 0x1F), p + 4, length - 4);
+        p += length;
+        size -= length;
+    }
+}
+
+// Calls fn(seq) for every sequence number requested by a Generic NACK body.
+template <typename Fn>
+inline void forEachNackedSeq(const uint8_t* body, size_t size, Fn fn) {
+    for (size_t pos = 8; pos + 4 <= size; pos += 4) {
+        uint16_t pid = getBe16(body + pos);
+        uint16_t blp = getBe16(body + pos + 2);
+        fn(pid);
+        for (int bit = 0; bit < 16; bit++) {
+            if (blp & (1 << bit)) fn(static_cast<uint16_t>(pid + bit + 1));
+        }
+    }
+}
+
+} // namespace rtp_ingest
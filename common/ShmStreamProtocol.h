@@ -0,0 +1,98 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Layout of the shared-memory stream rings rtsp_server exposes for local
+// consumers (--shm-size-mb), shared by the server's ShmOutput and
+// ShmStreamReader.
+//
+// Each stream is one POSIX shared memory object, /dev/shm/<objectName(id)>:
+//
+//   Header      kHeaderSize bytes at offset 0
+//   Descriptor  descriptorCount x 64 bytes at descriptorsOffset
+//   Arena       arenaSize bytes at arenaOffset, NALU bytes (start code included)
+//
+// There is exactly one writer, the server; readers map the object read-only
+// and never write anything, so any number of them can attach without the
+// writer knowing. Both counts are powers of two.
+//
+// NALU n goes into descriptor slot n % descriptorCount and, contiguously,
+// into the arena at position `offset` (a running byte count; the index is
+// offset % arenaSize). A NALU that would straddle the end of the arena starts
+// at the next lap instead. Publishing NALU n:
+//
+//   1. arenaTail = first arena position still intact after the copy;
+//      release fence
+//   2. copy the bytes to the arena
+//   3. slot.seq = kSeqWriting; release fence; fill the slot; slot.seq = n
+//   4. writeSeq = n + 1; notify += 1; FUTEX_WAKE on notify
+//
+// so a reader that finds slot.seq == n both before and after copying the
+// slot (a seqlock) has a consistent descriptor, and bytes at `offset` are
+// intact for as long as offset >= arenaTail. Readers sleep with FUTEX_WAIT
+// on `notify`, which only needs read access.
+//
+// The latest SPS/PPS are also kept in the header for consumers that attach
+// mid-GOP, under their own seqlock (paramSeq is odd while they change).
+namespace shm_stream {
+
+constexpr uint32_t kMagic = 0x4D485352;  // "RSHM"
+constexpr uint16_t kVersion = 1;
+constexpr size_t kHeaderSize = 4096;
+constexpr size_t kDescriptorSize = 64;
+constexpr size_t kMaxParameterSetSize = 1024;
+constexpr uint64_t kSeqWriting = ~0ull;
+
+enum Flags : uint8_t {
+    kFlagKeyframe = 0x01,     // IDR, or a parameter set leading into one
+    kFlagAuEnd = 0x02,        // last NALU of its access unit (frame info only)
+    kFlagFrameInfo = 0x04,    // captureUs/kFlagAuEnd come from the camera
+};
+
+// "/rtsp_server.<id>"; stream ids are already restricted to a safe charset.
+inline std::string objectName(const std::string& streamId) {
+    return "/rtsp_server." + streamId;
+}
+
+struct Header {
+    // Fixed once the writer has set magic (last, with release order).
+    std::atomic<uint32_t> magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t descriptorCount;
+    int32_t writerPid;
+    uint64_t arenaSize;
+    uint64_t descriptorsOffset;
+    uint64_t arenaOffset;
+
+    alignas(64) std::atomic<uint64_t> writeSeq;   // NALUs published so far
+    std::atomic<uint64_t> arenaTail;              // lowest arena position still intact
+    std::atomic<uint32_t> notify;                 // futex word, bumped on every publish
+    std::atomic<uint32_t> closed;                 // the writer is gone for good
+
+    alignas(64) std::atomic<uint64_t> paramSeq;
+    uint32_t spsSize;
+    uint32_t ppsSize;
+    uint8_t sps[kMaxParameterSetSize];
+    uint8_t pps[kMaxParameterSetSize];
+};
+static_assert(sizeof(Header) <= kHeaderSize, "shm header outgrew its page");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm atomics must be address-free");
+
+struct alignas(kDescriptorSize) Descriptor {
+    std::atomic<uint64_t> seq;  // NALU number, kSeqWriting while being rewritten
+    uint64_t offset;            // arena position of the first byte
+    uint32_t size;              // bytes, start code included
+    uint8_t type;               // nal_unit_type
+    uint8_t flags;
+    uint8_t startCodeLength;
+    uint8_t reserved;
+    uint64_t captureUs;         // camera clock (kFlagFrameInfo)
+    uint64_t receivedUs;        // CLOCK_MONOTONIC when the server took it in
+    uint32_t ingestSession;     // changes when the camera reconnects
+};
+static_assert(sizeof(Descriptor) == kDescriptorSize, "shm descriptor must stay 64 bytes");
+
+}  // namespace shm_stream
@@ -0,0 +1,220 @@
+#pragma once
+#include "ShmStreamProtocol.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Reads one stream's shared-memory ring (see ShmStreamProtocol.h) from
+// another process on the same host. Header-only so any local consumer
+// (analytics, a recorder, a test tool) can include it without linking
+// against the server.
+//
+// The object is mapped read-only and next() hands out frames pointing
+// straight into the mapping: no copy, no lock, no syscall while NALUs are
+// waiting. The writer never waits for readers, so a frame's bytes can be
+// overwritten once the writer has gone a whole arena further; check
+// intact(frame) after using the bytes (or copy them first) and drop the
+// result if it says false. A reader that falls behind by more than the ring
+// holds gets Result::Lapped once and then resumes at the next keyframe.
+//
+//   ShmStreamReader reader;
+//   if (!reader.open("cam1")) ...
+//   ShmStreamReader::Frame frame;
+//   while (reader.next(frame, 1000) != ShmStreamReader::Result::Closed) ...
+class ShmStreamReader {
+public:
+    struct Frame {
+        const uint8_t* data = nullptr;  // start code included
+        size_t size = 0;
+        uint64_t seq = 0;
+        uint64_t offset = 0;
+        uint8_t type = 0;
+        uint8_t flags = 0;
+        uint8_t startCodeLength = 0;
+        uint64_t captureUs = 0;
+        uint64_t receivedUs = 0;
+        uint32_t ingestSession = 0;
+
+        const uint8_t* payload() const { return data + startCodeLength; }
+        size_t payloadSize() const { return size - startCodeLength; }
+        bool isKeyframe() const { return (flags & shm_stream::kFlagKeyframe) != 0; }
+    };
+    enum class Result { Frame, Timeout, Lapped, Closed };
+
+    ShmStreamReader() = default;
+    ShmStreamReader(const ShmStreamReader&) = delete;
+    ShmStreamReader& operator=(const ShmStreamReader&) = delete;
+    ~ShmStreamReader() { close(); }
+
+    // Attaches to stream `streamId`. Reading starts at the newest keyframe
+    // still in the ring, or with the next one. False while the server has no
+    // such stream (or shared memory output is off).
+    bool open(const std::string& streamId) {
+        close();
+        int fd = shm_open(shm_stream::objectName(streamId).c_str(), O_RDONLY | O_CLOEXEC, 0);
+        if (fd < 0) return false;
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < shm_stream::kHeaderSize) {
+            ::close(fd);
+            return false;
+        }
+        void* base = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) return false;
+        base_ = static_cast<const uint8_t*>(base);
+        mappedSize_ = st.st_size;
+        header_ = reinterpret_cast<const shm_stream::Header*>(base_);
+
+        const shm_stream::Header& h = *header_;
+        uint32_t count = h.descriptorCount;
+        if (h.magic.load(std::memory_order_acquire) != shm_stream::kMagic || h.version != shm_stream::kVersion ||
+            count == 0 || (count & (count - 1)) != 0 || h.arenaSize == 0 || (h.arenaSize & (h.arenaSize - 1)) != 0 ||
+            h.descriptorsOffset + uint64_t(count) * shm_stream::kDescriptorSize > mappedSize_ ||
+            h.arenaOffset + h.arenaSize > mappedSize_) {
+            close();
+            return false;
+        }
+        descriptors_ = reinterpret_cast<const shm_stream::Descriptor*>(base_ + h.descriptorsOffset);
+        arena_ = base_ + h.arenaOffset;
+        descriptorMask_ = count - 1;
+        arenaMask_ = h.arenaSize - 1;
+        next_ = startSeq();
+        waitKeyframe_ = true;
+        return true;
+    }
+
+    void close() {
+        if (base_) munmap(const_cast<uint8_t*>(base_), mappedSize_);
+        base_ = nullptr;
+        header_ = nullptr;
+        mappedSize_ = 0;
+    }
+
+    bool isOpen() const { return header_ != nullptr; }
+
+    // The next NALU, waiting up to timeoutMs (-1: forever) for one.
+    Result next(Frame& out, int timeoutMs) {
+        if (!header_) return Result::Closed;
+        const shm_stream::Header& h = *header_;
+        for (;;) {
+            uint64_t head = h.writeSeq.load(std::memory_order_acquire);
+            if (next_ < head) {
+                if (!read(next_, out)) {
+                    lapped_++;
+                    next_ = head;
+                    waitKeyframe_ = true;
+                    return Result::Lapped;
+                }
+                next_++;
+                if (waitKeyframe_ && !out.isKeyframe()) continue;
+                waitKeyframe_ = false;
+                return Result::Frame;
+            }
+            if (h.closed.load(std::memory_order_acquire)) return Result::Closed;
+
+            uint32_t word = h.notify.load(std::memory_order_acquire);
+            if (h.writeSeq.load(std::memory_order_acquire) != head) continue;
+            if (timeoutMs == 0) return Result::Timeout;
+            struct timespec timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+            long rc = syscall(SYS_futex, &h.notify, FUTEX_WAIT, word, timeoutMs < 0 ? nullptr : &timeout,
+                              nullptr, 0);
+            if (rc != 0 && errno == ETIMEDOUT) {
+                // A server that died without closing leaves the ring behind.
+                if (h.writerPid > 0 && kill(h.writerPid, 0) != 0 && errno == ESRCH) return Result::Closed;
+                return Result::Timeout;
+            }
+        }
+    }
+
+    // True while the writer has not reused the bytes of `frame`; call it
+    // after consuming frame.data in place.
+    bool intact(const Frame& frame) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header_ && frame.offset >= header_->arenaTail.load(std::memory_order_relaxed);
+    }
+
+    // Copies the newest SPS/PPS (with start codes). False if there are none yet.
+    bool parameterSets(std::vector<uint8_t>& sps, std::vector<uint8_t>& pps) const {
+        if (!header_) return false;
+        const shm_stream::Header& h = *header_;
+        for (int attempt = 0; attempt < 100; attempt++) {
+            uint64_t before = h.paramSeq.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            uint32_t spsSize = std::min<uint32_t>(h.spsSize, shm_stream::kMaxParameterSetSize);
+            uint32_t ppsSize = std::min<uint32_t>(h.ppsSize, shm_stream::kMaxParameterSetSize);
+            sps.assign(h.sps, h.sps + spsSize);
+            pps.assign(h.pps, h.pps + ppsSize);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (h.paramSeq.load(std::memory_order_relaxed) == before) return spsSize > 0 && ppsSize > 0;
+        }
+        return false;
+    }
+
+    // Times next() returned Lapped.
+    uint64_t lapped() const { return lapped_; }
+
+private:
+    // Copies descriptor `seq` into `out`; false if the writer has moved past it.
+    bool read(uint64_t seq, Frame& out) const {
+        const shm_stream::Descriptor& d = descriptors_[seq & descriptorMask_];
+        if (d.seq.load(std::memory_order_acquire) != seq) return false;
+        out.seq = seq;
+        out.offset = d.offset;
+        out.size = d.size;
+        out.type = d.type;
+        out.flags = d.flags;
+        out.startCodeLength = d.startCodeLength;
+        out.captureUs = d.captureUs;
+        out.receivedUs = d.receivedUs;
+        out.ingestSession = d.ingestSession;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (d.seq.load(std::memory_order_relaxed) != seq) return false;
+        if (out.size > header_->arenaSize || (out.offset & arenaMask_) + out.size > header_->arenaSize) return false;
+        if (out.offset < header_->arenaTail.load(std::memory_order_acquire)) return false;
+        out.data = arena_ + (out.offset & arenaMask_);
+        return true;
+    }
+
+    // The newest keyframe still in the ring, or the head when there is none.
+    uint64_t startSeq() const {
+        uint64_t head = header_->writeSeq.load(std::memory_order_acquire);
+        uint64_t oldest = head > descriptorMask_ ? head - descriptorMask_ : 0;
+        Frame frame;
+        for (uint64_t seq = head; seq > oldest; seq--) {
+            if (!read(seq - 1, frame)) break;
+            if (!frame.isKeyframe()) continue;
+            // Back up over the parameter sets in front of the IDR.
+            uint64_t start = seq - 1;
+            while (start > oldest && read(start - 1, frame) && frame.isKeyframe()) {
+                start--;
+                if (frame.type == 7) break;
+            }
+            return start;
+        }
+        return head;
+    }
+
+    const uint8_t* base_ = nullptr;
+    size_t mappedSize_ = 0;
+    const shm_stream::Header* header_ = nullptr;
+    const shm_stream::Descriptor* descriptors_ = nullptr;
+    const uint8_t* arena_ = nullptr;
+    uint64_t descriptorMask_ = 0;
+    uint64_t arenaMask_ = 0;
+    uint64_t next_ = 0;
+    bool waitKeyframe_ = true;
+    uint64_t lapped_ = 0;
+};
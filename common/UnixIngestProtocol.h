@@ -0,0 +1,42 @@
+#pragma once
+#include "IngestProtocol.h"
+#include <cstdint>
+#include <cstddef>
+
+// Camera -> server ingest over an AF_UNIX SOCK_SEQPACKET socket, for
+// encoders on the same host as rtsp_server. Shared by camera_node and
+// rtsp_server.
+//
+// It is ingest v2 (IngestProtocol.h) with the socket doing the framing:
+//
+//   client  Hello message, exactly as on TCP
+//   server  HelloAck message
+//   client  one message per NALU or per access unit:
+//           FrameHeader | payload                         (inline)
+//           FrameHeader, SCM_RIGHTS memfd                 (kFlagMemfd)
+//
+// Message boundaries are preserved by the socket, so there is no length
+// prefix to read first, no resync, and one recvmsg() per message. With
+// kFlagAccessUnit the payload is a whole picture, Annex B NALUs back to
+// back (a V4L2 or encoder output buffer as is); nalType is then ignored and
+// every NALU gets captureUs, the last one kFlagAuEnd. With kFlagMemfd the
+// payload is not in the message but in the first payloadSize bytes of the
+// file descriptor passed alongside: a memfd the encoder wrote into and then
+// sealed with at least F_SEAL_SHRINK | F_SEAL_WRITE, or the frame is
+// dropped. The server maps it read-only and closes it once it has taken
+// the bytes. Large pictures should go that way: an inline message must fit the
+// sender's socket send buffer (net.core.wmem_max, 208 KiB by default).
+namespace unix_ingest {
+
+constexpr const char* kDefaultPath = "/tmp/rtsp_server_ingest.sock";
+
+// Inline payloads at or above this size are better sent as a memfd.
+constexpr size_t kMemfdThreshold = 64 * 1024;
+constexpr size_t kMaxMessageSize = ingest::kFrameHeaderSize + ingest::kMaxNaluSize;
+
+enum FrameFlags : uint8_t {
+    kFlagAccessUnit = 0x10,  // payload is a whole access unit, Annex B
+    kFlagMemfd = 0x20,       // payload is in the attached file descriptor
+};
+
+} // namespace unix_ingest
@@ -0,0 +1,153 @@
+// RTP fan-out cost per I/O engine: sendto() per packet vs batched
+// IORING_OP_SENDMSG.
+//
+//   cmake -S . -B build -DRTSP_BUILD_BENCH=ON && cmake --build build
+//   ./build/io_engine_bench [seconds] [viewers...]      (default: 3 100 1000 5000)
+//
+// Every viewer is a real RtpSender on its own thread, sending over loopback
+// to one UDP sink socket that is never read (the kernel drops the excess
+// after the send has been paid for). One stream is published at 30 fps:
+// a 40 KB IDR once per second and 6 KB P frames in between, so every frame
+// is fragmented the way camera video is. The figure of merit is CPU time per
+// packet sent, taken from getrusage over the whole run. Each run is repeated
+// with StageLatency recording attached ("+lat") to show what it costs.
+#include "media/StreamBuffer.h"
+#include "net/RtpSender.h"
+#include "utils/Log.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static constexpr int kFps = 30;
+static constexpr int kSinkPort = 19998;
+static constexpr int kPortMin = 20000;
+static constexpr int kPortMax = 40000;
+
+static NaluPtr makeNalu(uint8_t header, size_t size) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data.assign(size, 0x5A);
+    nalu->data[0] = 0;
+    nalu->data[1] = 0;
+    nalu->data[2] = 0;
+    nalu->data[3] = 1;
+    nalu->data[4] = header;
+    classifyNalu(*nalu);
+    return nalu;
+}
+
+static double cpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void run(IoEngine engine, int viewers, double seconds, bool timed) {
+    std::shared_ptr<StageLatency> latency = timed ? std::make_shared<StageLatency>("bench") : nullptr;
+    auto buffer = std::make_shared<StreamBuffer>();
+    buffer->setSps({0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xc0, 0x1f});
+    buffer->setPps({0x00, 0x00, 0x00, 0x01, 0x68, 0xce, 0x3c, 0x80});
+
+    std::vector<std::unique_ptr<RtpSender>> senders;
+    for (int i = 0; i < viewers; i++) {
+        auto sender = std::make_unique<RtpSender>(buffer, engine);
+        if (!sender->init("127.0.0.1", kSinkPort, kPortMin, kPortMax)) {
+            fprintf(stderr, "viewer %d: no port pair (raise ulimit -n?)\n", i);
+            break;
+        }
+        sender->setLatency(latency);
+        sender->start();
+        senders.push_back(std::move(sender));
+    }
+
+    NaluPtr idr = makeNalu(0x65, 40 * 1024);
+    NaluPtr slice = makeNalu(0x41, 6 * 1024);
+    NaluPtr sps = makeNalu(0x67, 12);
+    NaluPtr pps = makeNalu(0x68, 8);
+
+    // Stamped like Stream::publish does when the run is timed.
+    auto push = [&](const NaluPtr& nalu) {
+        if (!timed) return buffer->push(nalu);
+        auto copy = std::make_shared<Nalu>(*nalu);
+        copy->receivedUs = copy->enqueuedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        buffer->push(NaluPtr(std::move(copy)));
+    };
+
+    double cpuStart = cpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    auto frameTime = start;
+    int frames = static_cast<int>(seconds * kFps);
+    for (int i = 0; i < frames; i++) {
+        if (i % kFps == 0) {
+            push(sps);
+            push(pps);
+            push(idr);
+        } else {
+            push(slice);
+        }
+        frameTime += std::chrono::microseconds(1000000 / kFps);
+        std::this_thread::sleep_until(frameTime);
+    }
+
+    // Let the senders drain whatever they still hold.
+    uint64_t sent = 0;
+    for (int idle = 0; idle < 5;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        uint64_t total = 0;
+        for (auto& s : senders) total += s->packetsSent();
+        idle = (total == sent) ? idle + 1 : 0;
+        sent = total;
+    }
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() - 0.5;
+    double cpu = cpuSeconds() - cpuStart;
+
+    std::string label = std::string(ioEngineName(engine)) + (timed ? "+lat" : "");
+    printf("  %-12s %6zu viewers: %10llu packets in %6.2f s, cpu %7.2f s (%5.1f%%), %6.2f us cpu/packet\n",
+           label.c_str(), static_cast<size_t>(viewers), static_cast<unsigned long long>(sent),
+           wall, cpu, 100.0 * cpu / wall, sent ? cpu * 1e6 / sent : 0.0);
+    fflush(stdout);
+    // Not timed: every unsubscribe wakes all readers still blocked on the
+    // shared condition variable, so tearing down N viewers costs O(N^2).
+    senders.clear();
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    std::vector<int> counts;
+    for (int i = 2; i < argc; i++) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {100, 1000, 5000};
+
+    // RtpSender logs every start and stop at Info; without a running
+    // writer those records would only fill the ring.
+    logging::setLevel(logging::Level::Warn);
+    int sink = socket(AF_INET, SOCK_DGRAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kSinkPort);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (sink < 0 || bind(sink, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        perror("sink socket");
+        return 1;
+    }
+
+    bool uring = IoUring::supports({IORING_OP_SENDMSG});
+    printf("RTP fan-out benchmark, %.0f s at %d fps per run%s\n", seconds, kFps,
+           uring ? "" : " (io_uring unavailable, epoll only)");
+    for (int viewers : counts) {
+        for (bool timed : {false, true}) run(IoEngine::Epoll, viewers, seconds, timed);
+        if (uring) {
+            for (bool timed : {false, true}) run(IoEngine::IoUring, viewers, seconds, timed);
+        }
+    }
+    close(sink);
+    return 0;
+}
@@ -0,0 +1,82 @@
+// Cost of a log call on the calling thread, against the std::cout lines it
+// replaced.
+//
+//   cmake -S . -B build -DRTSP_BUILD_BENCH=ON && cmake --build build
+//   ./build/log_bench [rounds]      (default 2000)
+//
+// Each round times a burst of records shaped like the ingest path's (a
+// stream id, two integers) and then flushes them outside the timed part, so
+// the ring never fills and every call takes the normal path. The median
+// round is reported. The formatter's own cost is the time to flush a burst.
+// Log output goes to /dev/null; results are printed on stderr. Configure
+// with -DCMAKE_BUILD_TYPE=Release for meaningful numbers.
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr int kBurst = 200;
+
+static int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename F>
+static double perCallNs(int rounds, bool drain, F&& call) {
+    std::vector<double> samples;
+    for (int r = 0; r < rounds; r++) {
+        int64_t start = nowNs();
+        for (int i = 0; i < kBurst; i++) call(i);
+        samples.push_back(static_cast<double>(nowNs() - start) / kBurst);
+        if (drain) logging::flush();
+    }
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    if (!freopen("/dev/null", "w", stdout)) return 1;
+    const std::string id = "cam-entrance-01";
+
+    // Warm the ring's pages and the caches.
+    perCallNs(10, true, [&](int i) { LOG_INFO("[RECV] {} NALU #{} (size: {} bytes)", id, i, 6000); });
+
+    double info = perCallNs(rounds, true, [&](int i) {
+        LOG_INFO("[RECV] {} NALU #{} (size: {} bytes)", id, i, 6000);
+    });
+    double disabled = perCallNs(rounds, false, [&](int i) {
+        LOG_DEBUG("[RECV] {} NALU #{} (size: {} bytes)", id, i, 6000);
+    });
+    double limited = perCallNs(rounds, true, [&](int i) {
+        LOG_RATE_LIMITED(logging::Level::Info, 5, "[RECV] {}: {} NALUs lost before seq {}", id, 1, i);
+    });
+
+    // The formatter, per record: fill the ring, then drain it here.
+    double format = 0;
+    for (int r = 0; r < rounds / 10 + 1; r++) {
+        for (int i = 0; i < kBurst; i++) LOG_INFO("[RECV] {} NALU #{} (size: {} bytes)", id, i, 6000);
+        int64_t start = nowNs();
+        logging::flush();
+        format += static_cast<double>(nowNs() - start) / kBurst;
+    }
+    format /= rounds / 10 + 1;
+
+    std::ofstream devNull("/dev/null");
+    double stream = perCallNs(rounds / 10 + 1, false, [&](int i) {
+        devNull << "[RECV] " << id << " NALU #" << i << " (size: " << 6000 << " bytes)" << std::endl;
+    });
+
+    fprintf(stderr, "%-28s %8.1f ns/call\n", "LOG_INFO, 3 args", info);
+    fprintf(stderr, "%-28s %8.1f ns/call\n", "LOG_DEBUG below level", disabled);
+    fprintf(stderr, "%-28s %8.1f ns/call\n", "LOG_RATE_LIMITED, 5/s", limited);
+    fprintf(stderr, "%-28s %8.1f ns/record\n", "background format + write", format);
+    fprintf(stderr, "%-28s %8.1f ns/call\n", "ostream << ... << endl", stream);
+    return 0;
+}
@@ -0,0 +1,37 @@
+// libFuzzer harness for RtspParser.
+//
+//   CXX=clang++ cmake -S . -B build-fuzz -DRTSP_BUILD_FUZZ=ON && cmake --build build-fuzz
+//   ./build-fuzz/rtsp_parser_fuzz
+//
+// The first input byte selects a chunk size so the incremental path is
+// exercised as well as whole-buffer parsing.
+#include "net/RtspParser.h"
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <algorithm>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    if (size == 0) return 0;
+    size_t chunk = (data[0] % 32) + 1;
+    const char* input = reinterpret_cast<const char*>(data + 1);
+    size_t len = size - 1;
+
+    RtspParser parser;
+    RtspRequest req;
+    size_t reqStart = 0;
+    size_t available = 0;
+    while (reqStart < len && available < len) {
+        available = std::min(len, available + chunk);
+        size_t consumed = 0;
+        RtspParser::Result r = parser.parse(input + reqStart, available - reqStart, req, consumed);
+        if (r == RtspParser::Result::Error) break;
+        if (r == RtspParser::Result::Complete) {
+            if (consumed == 0 || reqStart + consumed > len) abort();
+            if (req.method.data() < input || req.body.data() + req.body.size() > input + len) abort();
+            reqStart += consumed;
+            parser.reset();
+        }
+    }
+    return 0;
+}
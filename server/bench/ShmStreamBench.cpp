@@ -0,0 +1,144 @@
+// Local consumption through the shared memory ring: publish-to-read latency
+// and reader cost per NALU.
+//
+//   cmake -S . -B build -DRTSP_BUILD_BENCH=ON && cmake --build build
+//   ./build/shm_stream_bench [seconds] [readers...]      (default: 3 1 4 16)
+//
+// One stream is published at 30 fps through a StreamBuffer into a ShmOutput,
+// the same path as the server: a 40 KB IDR with SPS/PPS once per second and
+// 6 KB P frames in between. Each reader is a separate process that maps the
+// ring read-only with ShmStreamReader, sleeps on the futex between frames
+// and checks every payload in place. Latency is measured from the moment the
+// NALU is pushed (Nalu::receivedUs, CLOCK_MONOTONIC, valid across
+// processes) to the moment next() returns it.
+#include "media/ShmOutput.h"
+#include "ShmStreamReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static constexpr int kFps = 30;
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::shared_ptr<Nalu> makeNalu(uint8_t header, size_t size) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data.assign(size, 0x5A);
+    nalu->data[0] = 0;
+    nalu->data[1] = 0;
+    nalu->data[2] = 0;
+    nalu->data[3] = 1;
+    nalu->data[4] = header;
+    classifyNalu(*nalu);
+    return nalu;
+}
+
+static double cpuSeconds() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Child process: reads until the ring closes, prints one result line.
+static int readerMain(const std::string& id, int index) {
+    ShmStreamReader reader;
+    for (int attempt = 0; !reader.open(id); attempt++) {
+        if (attempt == 100) return 1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::vector<uint32_t> latencies;
+    uint64_t nalus = 0, bytes = 0, corrupt = 0, torn = 0;
+    double cpuStart = cpuSeconds();
+    ShmStreamReader::Frame frame;
+    for (;;) {
+        ShmStreamReader::Result result = reader.next(frame, 1000);
+        if (result == ShmStreamReader::Result::Closed) break;
+        if (result != ShmStreamReader::Result::Frame) continue;
+        latencies.push_back(static_cast<uint32_t>(nowUs() - frame.receivedUs));
+        const uint8_t* payload = frame.payload();
+        bool ok = frame.payloadSize() > 1;
+        for (size_t i = 1; ok && i < frame.payloadSize(); i++) ok = payload[i] == 0x5A;
+        if (!reader.intact(frame)) {
+            torn++;
+        } else if (!ok) {
+            corrupt++;
+        }
+        nalus++;
+        bytes += frame.size;
+    }
+    double cpu = cpuSeconds() - cpuStart;
+    std::sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) {
+        return latencies.empty() ? 0u : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+    };
+    printf("    reader %2d: %6llu NALUs %8.1f MB, latency p50 %5u us p99 %5u us max %6u us, "
+           "%5.2f us cpu/NALU, lapped %llu, torn %llu, corrupt %llu\n",
+           index, static_cast<unsigned long long>(nalus), bytes / 1e6, pct(0.5), pct(0.99), pct(1.0),
+           nalus ? cpu * 1e6 / nalus : 0.0, static_cast<unsigned long long>(reader.lapped()),
+           static_cast<unsigned long long>(torn), static_cast<unsigned long long>(corrupt));
+    fflush(stdout);
+    return 0;
+}
+
+static void run(int readers, double seconds) {
+    std::string id = "shm_bench_" + std::to_string(getpid());
+    auto buffer = std::make_shared<StreamBuffer>();
+    auto output = std::make_unique<ShmOutput>(id, buffer, ShmConfig{});
+    if (!output->start()) return;
+
+    printf("  %d reader(s):\n", readers);
+    fflush(stdout);
+    std::vector<pid_t> children;
+    for (int i = 0; i < readers; i++) {
+        pid_t pid = fork();
+        if (pid == 0) _exit(readerMain(id, i));
+        if (pid > 0) children.push_back(pid);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    std::shared_ptr<Nalu> sps = makeNalu(0x67, 12);
+    std::shared_ptr<Nalu> pps = makeNalu(0x68, 8);
+    auto frameTime = std::chrono::steady_clock::now();
+    int frames = static_cast<int>(seconds * kFps);
+    for (int i = 0; i < frames; i++) {
+        std::vector<std::shared_ptr<Nalu>> unit;
+        if (i % kFps == 0) unit = {sps, pps, makeNalu(0x65, 40 * 1024)};
+        else unit = {makeNalu(0x41, 6 * 1024)};
+        for (auto& nalu : unit) {
+            auto copy = std::make_shared<Nalu>(*nalu);
+            copy->receivedUs = nowUs();
+            buffer->push(NaluPtr(std::move(copy)));
+        }
+        frameTime += std::chrono::microseconds(1000000 / kFps);
+        std::this_thread::sleep_until(frameTime);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    output.reset();     // marks the ring closed, the readers finish
+    for (pid_t pid : children) waitpid(pid, nullptr, 0);
+}
+
+int main(int argc, char** argv) {
+    double seconds = argc > 1 ? atof(argv[1]) : 3.0;
+    std::vector<int> counts;
+    for (int i = 2; i < argc; i++) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) counts = {1, 4, 16};
+
+    // ShmOutput logs its start; keep the report readable.
+    std::cout.rdbuf(nullptr);
+    printf("Shared memory ring benchmark, %.0f s at %d fps per run\n", seconds, kFps);
+    for (int readers : counts) run(readers, seconds);
+    return 0;
+}
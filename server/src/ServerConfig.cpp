@@ -0,0 +1,228 @@
+#include "ServerConfig.h"
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+static bool parseIntOption(const char* arg, const char* name, int& out) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+    out = atoi(arg + len + 1);
+    return true;
+}
+
+static bool parseStringOption(const char* arg, const char* name, std::string& out) {
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') return false;
+    out = arg + len + 1;
+    return true;
+}
+
+static bool parseFlag(const char* arg, const char* name, bool& out) {
+    if (strcmp(arg, name) != 0) return false;
+    out = true;
+    return true;
+}
+
+static bool parseTsOutputOption(const char* arg, std::vector<TsOutputSpec>& out, bool& valid) {
+    std::string value;
+    if (!parseStringOption(arg, "--ts-out", value)) return false;
+    size_t at = value.find('@');
+    size_t colon = value.rfind(':');
+    TsOutputSpec spec;
+    if (at != std::string::npos && colon != std::string::npos && colon > at) {
+        spec.streamId = value.substr(0, at);
+        spec.host = value.substr(at + 1, colon - at - 1);
+        spec.port = atoi(value.c_str() + colon + 1);
+    }
+    valid = !spec.streamId.empty() && !spec.host.empty() && spec.port > 0 && spec.port < 65536;
+    if (valid) out.push_back(spec);
+    return true;
+}
+
+static bool parsePullOption(const char* arg, std::vector<PullSpec>& out, bool& valid) {
+    std::string value;
+    if (!parseStringOption(arg, "--pull", value)) return false;
+    size_t eq = value.find('=');
+    PullSpec spec;
+    if (eq != std::string::npos) {
+        spec.streamId = value.substr(0, eq);
+        spec.url = value.substr(eq + 1);
+    }
+    valid = !spec.streamId.empty() && spec.url.compare(0, 7, "rtsp://") == 0;
+    if (valid) out.push_back(spec);
+    return true;
+}
+
+// --edges=host:port[,host:port...]
+static bool parseEdgesOption(const char* arg, std::vector<std::string>& out, bool& valid) {
+    std::string value;
+    if (!parseStringOption(arg, "--edges", value)) return false;
+    out.clear();
+    valid = true;
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t comma = value.find(',', start);
+        std::string edge = value.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        size_t colon = edge.rfind(':');
+        if (colon == std::string::npos || colon == 0 || atoi(edge.c_str() + colon + 1) <= 0) valid = false;
+        out.push_back(edge);
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return true;
+}
+
+const char* pullTransportName(PullTransport transport) {
+    switch (transport) {
+    case PullTransport::Udp: return "udp";
+    case PullTransport::Tcp: return "tcp";
+    default: return "auto";
+    }
+}
+
+static bool parsePullTransportOption(const char* arg, PullTransport& out, bool& valid) {
+    const char* name = "--pull-transport=";
+    if (strncmp(arg, name, strlen(name)) != 0) return false;
+    const char* value = arg + strlen(name);
+    valid = true;
+    if (strcmp(value, "auto") == 0) {
+        out = PullTransport::Auto;
+    } else if (strcmp(value, "udp") == 0) {
+        out = PullTransport::Udp;
+    } else if (strcmp(value, "tcp") == 0) {
+        out = PullTransport::Tcp;
+    } else {
+        valid = false;
+    }
+    return true;
+}
+
+const char* ioEngineName(IoEngine engine) {
+    return engine == IoEngine::IoUring ? "io_uring" : "epoll";
+}
+
+static bool parseIoEngineOption(const char* arg, IoEngine& out, bool& valid) {
+    const char* name = "--io-engine=";
+    if (strncmp(arg, name, strlen(name)) != 0) return false;
+    const char* value = arg + strlen(name);
+    valid = true;
+    if (strcmp(value, "epoll") == 0) {
+        out = IoEngine::Epoll;
+    } else if (strcmp(value, "io_uring") == 0) {
+        out = IoEngine::IoUring;
+    } else {
+        valid = false;
+    }
+    return true;
+}
+
+bool parseServerConfig(int argc, char** argv, ServerConfig& config) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (parseIntOption(arg, "--rtsp-port", config.rtspPort)) continue;
+        if (parseIntOption(arg, "--ingest-port", config.ingestPort)) continue;
+        if (parseIntOption(arg, "--ingest-threads", config.ingestThreads)) continue;
+        if (parseIntOption(arg, "--rtp-ingest-port", config.rtpIngestPort)) continue;
+        if (parseIntOption(arg, "--rtp-ingest-latency-ms", config.rtpIngestLatencyMs)) continue;
+        if (parseIntOption(arg, "--listen-backlog", config.listenBacklog)) continue;
+        if (parseIntOption(arg, "--describe-timeout-ms", config.describeTimeoutMs)) continue;
+        if (parseIntOption(arg, "--session-timeout", config.sessionTimeoutSec)) continue;
+        if (parseIntOption(arg, "--stream-idle-timeout", config.streamIdleTimeoutSec)) continue;
+        if (parseIntOption(arg, "--rtp-port-min", config.rtpPortMin)) continue;
+        if (parseIntOption(arg, "--rtp-port-max", config.rtpPortMax)) continue;
+        if (parseStringOption(arg, "--ingest-socket", config.ingestSocket)) continue;
+        if (parseStringOption(arg, "--record-dir", config.recordDir)) continue;
+        if (parseIntOption(arg, "--record-segment-sec", config.recordSegmentSec)) continue;
+        if (parseIntOption(arg, "--record-segment-mb", config.recordSegmentMb)) continue;
+        if (parseFlag(arg, "--record-direct-io", config.recordDirectIo)) continue;
+        if (parseIntOption(arg, "--hls-port", config.hlsPort)) continue;
+        if (parseIntOption(arg, "--hls-part-ms", config.hlsPartMs)) continue;
+        if (parseIntOption(arg, "--hls-segment-ms", config.hlsSegmentMs)) continue;
+        if (parseIntOption(arg, "--hls-window", config.hlsWindow)) continue;
+        if (parseIntOption(arg, "--shm-size-mb", config.shmSizeMb)) continue;
+        if (parseIntOption(arg, "--metrics-port", config.metricsPort)) continue;
+        if (parseIntOption(arg, "--latency-log-sec", config.latencyLogSec)) continue;
+        if (parseStringOption(arg, "--origin", config.originUrl)) {
+            if (config.originUrl.compare(0, 7, "rtsp://") == 0) continue;
+            std::cerr << "Origin must be an rtsp:// URL: " << arg << std::endl;
+            return false;
+        }
+        std::string logLevel;
+        if (parseStringOption(arg, "--log-level", logLevel)) {
+            if (logging::parseLevel(logLevel, config.logLevel)) continue;
+            std::cerr << "Unknown log level: " << arg << std::endl;
+            return false;
+        }
+        if (parseStringOption(arg, "--record-format", config.recordFormat)) {
+            if (config.recordFormat == "mp4" || config.recordFormat == "h264") continue;
+            std::cerr << "Unknown record format: " << arg << std::endl;
+            return false;
+        }
+
+        bool valid = false;
+        if (parseTsOutputOption(arg, config.tsOutputs, valid)) {
+            if (valid) continue;
+            std::cerr << "Bad TS output, expected --ts-out=<id>@<host>:<port>: " << arg << std::endl;
+            return false;
+        }
+        if (parsePullOption(arg, config.pulls, valid)) {
+            if (valid) continue;
+            std::cerr << "Bad pull source, expected --pull=<id>=rtsp://...: " << arg << std::endl;
+            return false;
+        }
+        if (parseEdgesOption(arg, config.edges, valid)) {
+            if (valid) continue;
+            std::cerr << "Bad edge list, expected --edges=<host>:<port>[,...]: " << arg << std::endl;
+            return false;
+        }
+        if (parsePullTransportOption(arg, config.pullTransport, valid)) {
+            if (valid) continue;
+            std::cerr << "Unknown pull transport: " << arg << std::endl;
+            return false;
+        }
+        if (parseIoEngineOption(arg, config.ioEngine, valid)) {
+            if (valid) continue;
+            std::cerr << "Unknown I/O engine: " << arg << std::endl;
+            return false;
+        }
+
+        std::cerr << "Unknown option: " << arg << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void printServerUsage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --rtsp-port=N             RTSP listen port (default 8554)\n"
+              << "  --ingest-port=N           camera ingest port (default 8556)\n"
+              << "  --ingest-threads=N        camera ingest worker threads (default 2)\n"
+              << "  --rtp-ingest-port=N       RTP/UDP camera ingest port, 0 disables (default 8558)\n"
+              << "  --rtp-ingest-latency-ms=N jitter buffer depth for RTP ingest (default 150)\n"
+              << "  --ingest-socket=PATH      unix SOCK_SEQPACKET ingest for encoders on this host (default off)\n"
+              << "  --listen-backlog=N        RTSP accept queue length (default 4096)\n"
+              << "  --io-engine=epoll|io_uring  ingest/egress I/O backend (default epoll)\n"
+              << "  --describe-timeout-ms=N   max wait for SPS/PPS before 503 (default 10000)\n"
+              << "  --session-timeout=N       reap sessions idle for N seconds (default 60)\n"
+              << "  --stream-idle-timeout=N   drop streams with no camera/viewers after N s (default 30)\n"
+              << "  --rtp-port-min=N          first server RTP/RTCP port (default 30000)\n"
+              << "  --rtp-port-max=N          last server RTP/RTCP port (default 30999)\n"
+              << "  --record-dir=PATH         record every stream under PATH/<id>/ (default off)\n"
+              << "  --record-segment-sec=N    start a new file every N seconds (default 60)\n"
+              << "  --record-segment-mb=N     ... or every N MiB (default 0, no limit)\n"
+              << "  --record-format=mp4|h264  fragmented MP4 with seek index, or raw Annex B (default mp4)\n"
+              << "  --record-direct-io        write recordings with O_DIRECT\n"
+              << "  --hls-port=N              serve LL-HLS and WebSocket fMP4 on port N, 0 disables (default 0)\n"
+              << "  --hls-part-ms=N           LL-HLS partial segment target (default 200)\n"
+              << "  --hls-segment-ms=N        LL-HLS segment target, cut at the next IDR (default 1000)\n"
+              << "  --hls-window=N            segments listed in the playlist (default 6)\n"
+              << "  --ts-out=ID@HOST:PORT     push stream ID as MPEG-TS over UDP (repeatable)\n"
+              << "  --pull=ID=rtsp://...      relay a remote RTSP stream as ID while it has viewers (repeatable)\n"
+              << "  --pull-transport=auto|udp|tcp  RTP transport for pulls; auto falls back to TCP (default auto)\n"
+              << "  --edges=HOST:PORT,...     origin mode: redirect viewers to edges by consistent hash of stream id\n"
+              << "  --origin=rtsp://HOST:PORT edge mode: pull requested streams from this origin while watched\n"
+              << "  --shm-size-mb=N           expose streams as shared memory rings of N MiB, 0 disables (default 0)\n"
+              << "  --metrics-port=N          serve Prometheus metrics at /metrics on port N, 0 disables (default 0)\n"
+              << "  --latency-log-sec=N       log per-stream ingest-to-send latency percentiles every N s, 0 disables (default 60)\n"
+              << "  --log-level=debug|info|warn|error  least severe log records written (default info)\n";
+}
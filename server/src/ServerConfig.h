@@ -0,0 +1,104 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "utils/Log.h"
+
+// Network I/O backend for camera ingest and RTP egress. Epoll is the plain
+// readiness + send/recv syscall path and the fallback whenever io_uring is
+// unavailable.
+enum class IoEngine { Epoll, IoUring };
+const char* ioEngineName(IoEngine engine);
+
+// --ts-out=<id>@<host>:<port>: push stream <id> as MPEG-TS over UDP.
+struct TsOutputSpec {
+    std::string streamId;
+    std::string host;
+    int port = 0;
+};
+
+// --pull=<id>=<rtsp-url>: stream <id> is played from a remote RTSP server
+// while it has viewers.
+struct PullSpec {
+    std::string streamId;
+    std::string url;
+};
+
+// How pulled streams ask for RTP. Auto tries UDP and falls back to RTP
+// interleaved on the RTSP connection when UDP is refused or stays silent.
+enum class PullTransport { Auto, Udp, Tcp };
+const char* pullTransportName(PullTransport transport);
+
+// Runtime options for rtsp_server. Defaults match the original hardcoded values;
+// main() overrides them from --key=value command line arguments.
+struct ServerConfig {
+    int rtspPort = 8554;         // RTSP signalling port (VLC etc.)
+    int ingestPort = 8556;       // camera_sender ingest port
+    int ingestThreads = 2;       // workers serving camera connections
+    int rtpIngestPort = 8558;    // RTP/UDP push ingest (0 disables)
+    int rtpIngestLatencyMs = 150; // max wait for a missing RTP ingest packet
+    std::string ingestSocket;    // AF_UNIX SOCK_SEQPACKET ingest for local encoders (empty: off)
+    int listenBacklog = 4096;    // RTSP accept queue (clamped by net.core.somaxconn)
+    IoEngine ioEngine = IoEngine::Epoll; // camera ingest / RTP egress backend
+
+    // How long a DESCRIBE may wait for SPS/PPS before we answer 503.
+    int describeTimeoutMs = 10000;
+
+    // Sessions with no RTSP request and no RTCP report for this long are
+    // reaped (advertised to clients as Session: <id>;timeout=N).
+    int sessionTimeoutSec = 60;
+
+    // Streams with no camera connected and no viewers are dropped from the
+    // registry after this long.
+    int streamIdleTimeoutSec = 30;
+
+    // Even/odd UDP port pairs handed out as server_port for RTP/RTCP.
+    int rtpPortMin = 30000;
+    int rtpPortMax = 30999;
+
+    // Per-stream recording to <recordDir>/<id>/ (empty: off). Files are cut
+    // at the first IDR after recordSegmentSec or recordSegmentMb.
+    std::string recordDir;
+    int recordSegmentSec = 60;
+    int recordSegmentMb = 0;     // 0: no size limit
+    bool recordDirectIo = false; // bypass the page cache (O_DIRECT)
+    std::string recordFormat = "mp4"; // "mp4" (fragmented, with .idx) or "h264"
+
+    // LL-HLS at http://<host>:<hlsPort>/live/<id>/index.m3u8 and fMP4 over
+    // WebSocket at ws://<host>:<hlsPort>/live/<id>/ws (0: off).
+    int hlsPort = 0;
+    int hlsPartMs = 200;         // partial segment target
+    int hlsSegmentMs = 1000;     // segments end at the first IDR after this
+    int hlsWindow = 6;           // complete segments in the playlist
+
+    // MPEG-TS over UDP for legacy receivers; repeatable.
+    std::vector<TsOutputSpec> tsOutputs;
+
+    // RTSP pull/relay sources; repeatable. Jitter buffer depth for pulled
+    // UDP media is rtpIngestLatencyMs.
+    std::vector<PullSpec> pulls;
+    PullTransport pullTransport = PullTransport::Auto;
+
+    // Origin/edge cascading. An origin with an edge list ("host:port" of
+    // each edge's RTSP port) redirects viewers to the edge that owns the
+    // stream; an edge pulls every requested stream from originUrl
+    // (rtsp://host:port) while it has viewers.
+    std::vector<std::string> edges;
+    std::string originUrl;
+
+    // Every stream as a POSIX shared memory ring of this many MiB of NALU
+    // data, /dev/shm/rtsp_server.<id>, for local readers (0: off).
+    int shmSizeMb = 0;
+
+    // Prometheus metrics at http://<host>:<metricsPort>/metrics (0: off).
+    int metricsPort = 0;
+    // Every N seconds, log p50/p99/p999 of each stream's ingest-to-send
+    // stages over the last N seconds (0: off).
+    int latencyLogSec = 60;
+
+    // Records below this level are dropped at the call site.
+    logging::Level logLevel = logging::Level::Info;
+};
+
+// Fills config from argv. Returns false on an unknown option.
+bool parseServerConfig(int argc, char** argv, ServerConfig& config);
+void printServerUsage(const char* prog);
@@ -1,6 +1,13 @@
 #include "net/TcpServer.h"
-#include "media/StreamBuffer.h"
+#include "media/StreamRegistry.h"
 #include "net/CameraReceiver.h"
+#include "net/RtpIngestReceiver.h"
+#include "net/UnixIngestReceiver.h"
+#include "net/IoUring.h"
+#include "net/HttpServer.h"
+#include "net/RtspRelay.h"
+#include "net/MetricsServer.h"
+#include "ServerConfig.h"
 #include <memory>
 #include <thread>
 #include <csignal>
@@ -8,6 +15,10 @@
 
 // For signal handler to access servers
 std::unique_ptr<CameraReceiver> g_pReceiver;
+std::unique_ptr<RtpIngestReceiver> g_pRtpIngest;
+std::unique_ptr<UnixIngestReceiver> g_pUnixIngest;
+std::unique_ptr<RtspRelay> g_pRelay;
+std::shared_ptr<StreamRegistry> g_pRegistry;
 // TcpServer is blocking on the main thread, so we can't stop it from here.
 // std::unique_ptr<TcpServer> g_pRtspServer;
 
@@ -19,27 +30,125 @@ void signalHandler(int signum) {
         std::cout << "Stopping Camera Receiver..." << std::endl;
         g_pReceiver->stop();
     }
+    if (g_pRtpIngest) {
+        g_pRtpIngest->stop();
+    }
+    if (g_pUnixIngest) {
+        // Also removes the socket file.
+        g_pUnixIngest->stop();
+    }
+    if (g_pRelay) {
+        // TEARDOWN upstream rather than leaving sessions to time out there.
+        g_pRelay->stop();
+    }
+    if (g_pRegistry) {
+        // Recordings keep up to a chunk in memory; get it onto disk.
+        g_pRegistry->stopRecorders();
+    }
     
-    // Since TcpServer blocks the main thread, we exit here.
+    // Since TcpServer blocks the main thread, we exit here. exit() also
+    // writes out whatever is still queued in the log rings.
     std::cout << "Exiting application." << std::endl;
     exit(signum);
 }
 
 
-int main() {
+int main(int argc, char** argv) {
+    ServerConfig config;
+    if (!parseServerConfig(argc, argv, config)) {
+        printServerUsage(argv[0]);
+        return 1;
+    }
+    logging::setLevel(config.logLevel);
+    logging::start();
+
+    if (config.ioEngine == IoEngine::IoUring &&
+        !IoUring::supports({IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_READ, IORING_OP_SENDMSG,
+                            IORING_OP_ASYNC_CANCEL, IORING_OP_PROVIDE_BUFFERS})) {
+        std::cerr << "Main: io_uring is not available here, using epoll." << std::endl;
+        config.ioEngine = IoEngine::Epoll;
+    }
+    std::cout << "Main: I/O engine " << ioEngineName(config.ioEngine) << std::endl;
+
     // Register signal handler for Ctrl+C
     signal(SIGINT, signalHandler);
 
-    // 1. Create the shared buffer
-    auto streamBuffer = std::make_shared<StreamBuffer>();
-    std::cout << "Main: StreamBuffer created." << std::endl;
+    // 1. Create the stream registry shared by ingest and RTSP
+    auto registry = std::make_shared<StreamRegistry>();
+    std::cout << "Main: StreamRegistry created." << std::endl;
+    g_pRegistry = registry;
+
+    if (!config.recordDir.empty()) {
+        RecorderConfig recorder;
+        recorder.dir = config.recordDir;
+        recorder.segmentSec = config.recordSegmentSec;
+        recorder.segmentBytes = static_cast<int64_t>(config.recordSegmentMb) * 1024 * 1024;
+        recorder.directIo = config.recordDirectIo;
+        recorder.format = config.recordFormat == "h264" ? RecordFormat::AnnexB : RecordFormat::Mp4;
+        registry->setRecorderConfig(recorder);
+        std::cout << "Main: recording streams to " << config.recordDir << std::endl;
+    }
+
+    // LL-HLS segmenters and WebSocket fragmenters attach to streams as they
+    // are created, so this goes before any ingest can register one.
+    std::unique_ptr<HttpServer> httpServer;
+    if (config.hlsPort > 0) {
+        HlsConfig hls;
+        hls.partMs = config.hlsPartMs;
+        hls.segmentMs = config.hlsSegmentMs;
+        hls.windowSegments = config.hlsWindow;
+        registry->setHlsConfig(hls);
+        registry->enableWebSocket();
+        httpServer = std::make_unique<HttpServer>(config, registry);
+        if (!httpServer->start()) return 1;
+    }
+
+    for (const TsOutputSpec& spec : config.tsOutputs) {
+        registry->addTsOutput(spec.streamId, TsOutputTarget{spec.host, spec.port});
+        std::cout << "Main: MPEG-TS of " << spec.streamId << " to udp://" << spec.host << ":" << spec.port
+                  << std::endl;
+    }
+
+    if (config.shmSizeMb > 0) {
+        ShmConfig shm;
+        shm.arenaBytes = static_cast<size_t>(config.shmSizeMb) * 1024 * 1024;
+        registry->enableShm(shm);
+        std::cout << "Main: shared memory rings of " << config.shmSizeMb << " MiB under /dev/shm" << std::endl;
+    }
+
+    std::unique_ptr<MetricsServer> metricsServer;
+    if (config.metricsPort > 0) {
+        metricsServer = std::make_unique<MetricsServer>(config.metricsPort);
+        if (!metricsServer->start()) return 1;
+    }
 
     // 2. Start the camera data receiver in a background thread
-    g_pReceiver = std::make_unique<CameraReceiver>(8556, streamBuffer);
+    g_pReceiver = std::make_unique<CameraReceiver>(config.ingestPort, registry, config.ingestThreads,
+                                                   config.ioEngine);
     g_pReceiver->start();
 
+    if (config.rtpIngestPort > 0) {
+        g_pRtpIngest = std::make_unique<RtpIngestReceiver>(config.rtpIngestPort, registry,
+                                                           config.rtpIngestLatencyMs);
+        g_pRtpIngest->start();
+    }
+
+    if (!config.ingestSocket.empty()) {
+        g_pUnixIngest = std::make_unique<UnixIngestReceiver>(config.ingestSocket, registry);
+        g_pUnixIngest->start();
+    }
+
+    if (!config.pulls.empty() || !config.originUrl.empty()) {
+        g_pRelay = std::make_unique<RtspRelay>(config, registry);
+        g_pRelay->start();
+    }
+
+    if (!config.edges.empty()) {
+        std::cout << "Main: origin for " << config.edges.size() << " edge(s), viewers are redirected" << std::endl;
+    }
+
     // 3. Start the RTSP server (this will block the main thread)
-    TcpServer rtspServer(8554, streamBuffer);
+    TcpServer rtspServer(config, registry);
     rtspServer.start(); 
 
     // --- The following code is unreachable because rtspServer.start() blocks ---
@@ -0,0 +1,49 @@
+#pragma once
+#include "media/Nalu.h"
+#include <vector>
+#include <utility>
+
+// One coded picture as containers store it: its NAL units without the
+// parameter sets (those go into the sample description) and one timestamp.
+struct AccessUnit {
+    std::vector<NaluPtr> nalus;
+    uint64_t timeUs = 0;    // capture clock for ingest v2, arrival otherwise
+    uint64_t receivedUs = 0;
+    bool keyframe = false;
+
+    size_t sampleSize() const {
+        size_t size = 0;
+        for (const NaluPtr& nalu : nalus) size += 4 + nalu->payloadSize();
+        return size;
+    }
+};
+
+// Groups a stream's NALUs into access units. Ingest v2 marks the last NALU
+// of every picture; for legacy cameras each VCL NALU is taken to end one,
+// the same assumption RtpSender makes for its marker bit.
+class AccessUnitBuilder {
+public:
+    // Returns true when `nalu` completed an access unit, which is moved to out.
+    bool push(const NaluPtr& nalu, AccessUnit& out) {
+        // Parameter sets and delimiters carry no picture data.
+        if (nalu->isParameterSet() || nalu->type == 9 || nalu->payloadSize() == 0) return false;
+
+        if (current_.nalus.empty()) {
+            current_.timeUs = nalu->hasFrameInfo ? nalu->captureUs : nalu->receivedUs;
+            current_.receivedUs = nalu->receivedUs;
+        }
+        current_.nalus.push_back(nalu);
+        current_.keyframe |= nalu->isKeyframe();
+
+        bool complete = nalu->hasFrameInfo ? nalu->accessUnitEnd : nalu->isVcl();
+        if (!complete) return false;
+        out = std::move(current_);
+        current_ = AccessUnit();
+        return true;
+    }
+
+    void reset() { current_ = AccessUnit(); }
+
+private:
+    AccessUnit current_;
+};
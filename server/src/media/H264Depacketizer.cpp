@@ -0,0 +1,72 @@
+#include "media/H264Depacketizer.h"
+#include "IngestProtocol.h"
+
+static const uint8_t kStartCode[4] = {0x00, 0x00, 0x00, 0x01};
+
+void H264Depacketizer::emit(const uint8_t* nal, size_t size, std::vector<std::vector<uint8_t>>& out) {
+    std::vector<uint8_t> nalu;
+    nalu.reserve(sizeof(kStartCode) + size);
+    nalu.insert(nalu.end(), kStartCode, kStartCode + sizeof(kStartCode));
+    nalu.insert(nalu.end(), nal, nal + size);
+    out.push_back(std::move(nalu));
+}
+
+void H264Depacketizer::push(const uint8_t* payload, size_t size, bool lostBefore,
+                            std::vector<std::vector<uint8_t>>& out) {
+    if (lostBefore && inFragment_) {
+        inFragment_ = false;
+        droppedNalus_++;
+    }
+    if (size < 1) return;
+
+    uint8_t type = payload[0] & 0x1F;
+    if (type >= 1 && type <= 23) {
+        emit(payload, size, out);
+        return;
+    }
+
+    if (type == 24) { // STAP-A: [hdr] ([size16][nal])*
+        size_t pos = 1;
+        while (pos + 2 <= size) {
+            size_t nalSize = (size_t(payload[pos]) << 8) | payload[pos + 1];
+            pos += 2;
+            if (nalSize == 0 || pos + nalSize > size) break;
+            emit(payload + pos, nalSize, out);
+            pos += nalSize;
+        }
+        return;
+    }
+
+    if (type == 28) { // FU-A: [indicator][fu header][fragment]
+        if (size < 2) return;
+        uint8_t fuHeader = payload[1];
+        bool startBit = fuHeader & 0x80;
+        bool endBit = fuHeader & 0x40;
+
+        if (startBit) {
+            if (inFragment_) droppedNalus_++;
+            fragment_.assign(kStartCode, kStartCode + sizeof(kStartCode));
+            fragment_.push_back((payload[0] & 0xE0) | (fuHeader & 0x1F));
+            inFragment_ = true;
+        } else if (!inFragment_) {
+            return; // the start of this NALU was lost
+        }
+
+        if (fragment_.size() + (size - 2) > ingest::kMaxNaluSize) {
+            // The end bit was lost or never comes; TCP ingest refuses
+            // NALUs this large as well.
+            fragment_.clear();
+            inFragment_ = false;
+            droppedNalus_++;
+            return;
+        }
+        fragment_.insert(fragment_.end(), payload + 2, payload + size);
+        if (endBit) {
+            out.push_back(std::move(fragment_));
+            fragment_.clear();
+            inFragment_ = false;
+        }
+        return;
+    }
+    // STAP-B, MTAP and FU-B are not used in non-interleaved mode.
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Rebuilds Annex B NAL units from in-order RTP/H.264 payloads (RFC 6184):
+// single NAL unit packets, STAP-A aggregates and FU-A fragments. Feed it the
+// output of a JitterBuffer; a fragmented NALU that lost a piece, or that
+// grows past ingest::kMaxNaluSize, is dropped rather than passed on.
+class H264Depacketizer {
+public:
+    // `lostBefore` is true when packets were skipped ahead of this one.
+    // Completed NALUs (4-byte start code included) are appended to out.
+    void push(const uint8_t* payload, size_t size, bool lostBefore,
+              std::vector<std::vector<uint8_t>>& out);
+
+    uint64_t droppedNalus() const { return droppedNalus_; }
+
+private:
+    void emit(const uint8_t* nal, size_t size, std::vector<std::vector<uint8_t>>& out);
+
+    std::vector<uint8_t> fragment_;
+    bool inFragment_ = false;
+    uint64_t droppedNalus_ = 0;
+};
@@ -0,0 +1,148 @@
+#include "media/H264Sps.h"
+#include <vector>
+
+namespace {
+
+// Exp-Golomb reader over an RBSP (emulation prevention bytes removed).
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+    bool ok() const { return !overrun_; }
+
+    uint32_t bit() {
+        if (pos_ >= size_ * 8) {
+            overrun_ = true;
+            return 0;
+        }
+        uint32_t b = (data_[pos_ / 8] >> (7 - pos_ % 8)) & 1;
+        pos_++;
+        return b;
+    }
+
+    uint32_t bits(int n) {
+        uint32_t v = 0;
+        while (n-- > 0) v = (v << 1) | bit();
+        return v;
+    }
+
+    uint32_t ue() {
+        int zeros = 0;
+        while (bit() == 0 && ok()) {
+            if (++zeros > 31) {
+                overrun_ = true;
+                return 0;
+            }
+        }
+        return ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int32_t se() {
+        uint32_t v = ue();
+        return (v & 1) ? static_cast<int32_t>((v + 1) / 2) : -static_cast<int32_t>(v / 2);
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+    size_t pos_ = 0;
+    bool overrun_ = false;
+};
+
+void skipScalingList(BitReader& br, int count) {
+    int32_t last = 8, next = 8;
+    for (int i = 0; i < count; i++) {
+        if (next != 0) {
+            next = (last + br.se() + 256) % 256;
+        }
+        last = (next == 0) ? last : next;
+    }
+}
+
+} // namespace
+
+bool parseSps(const uint8_t* nal, size_t size, SpsInfo& info) {
+    if (size < 4 || (nal[0] & 0x1F) != 7) return false;
+
+    // Strip emulation prevention (00 00 03 -> 00 00) after the NAL header.
+    std::vector<uint8_t> rbsp;
+    rbsp.reserve(size);
+    int zeros = 0;
+    for (size_t i = 1; i < size; i++) {
+        if (zeros >= 2 && nal[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nal[i] == 0 ? zeros + 1 : 0;
+        rbsp.push_back(nal[i]);
+    }
+
+    BitReader br(rbsp.data(), rbsp.size());
+    info.profileIdc = static_cast<uint8_t>(br.bits(8));
+    info.constraintFlags = static_cast<uint8_t>(br.bits(8));
+    info.levelIdc = static_cast<uint8_t>(br.bits(8));
+    br.ue(); // seq_parameter_set_id
+
+    uint32_t chromaFormatIdc = 1;
+    switch (info.profileIdc) {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+        chromaFormatIdc = br.ue();
+        if (chromaFormatIdc == 3) br.bit(); // separate_colour_plane_flag
+        info.bitDepthLuma = static_cast<uint8_t>(8 + br.ue());
+        info.bitDepthChroma = static_cast<uint8_t>(8 + br.ue());
+        br.bit();                           // qpprime_y_zero_transform_bypass_flag
+        if (br.bit()) {                     // seq_scaling_matrix_present_flag
+            int lists = chromaFormatIdc != 3 ? 8 : 12;
+            for (int i = 0; i < lists; i++) {
+                if (br.bit()) skipScalingList(br, i < 6 ? 16 : 64);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    br.ue(); // log2_max_frame_num_minus4
+    uint32_t pocType = br.ue();
+    if (pocType == 0) {
+        br.ue(); // log2_max_pic_order_cnt_lsb_minus4
+    } else if (pocType == 1) {
+        br.bit();
+        br.se();
+        br.se();
+        uint32_t cycle = br.ue();
+        if (cycle > 255) return false;
+        for (uint32_t i = 0; i < cycle; i++) br.se();
+    }
+    br.ue();  // max_num_ref_frames
+    br.bit(); // gaps_in_frame_num_value_allowed_flag
+
+    uint32_t widthMbs = br.ue() + 1;
+    uint32_t heightMapUnits = br.ue() + 1;
+    uint32_t frameMbsOnly = br.bit();
+    if (!frameMbsOnly) br.bit(); // mb_adaptive_frame_field_flag
+    br.bit();                    // direct_8x8_inference_flag
+
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+    if (br.bit()) {
+        cropLeft = br.ue();
+        cropRight = br.ue();
+        cropTop = br.ue();
+        cropBottom = br.ue();
+    }
+    if (!br.ok() || chromaFormatIdc > 3) return false;
+    info.chromaFormatIdc = static_cast<uint8_t>(chromaFormatIdc);
+
+    // Crop units depend on chroma subsampling (4:2:0 -> 2x2) and on field coding.
+    uint32_t cropUnitX = (chromaFormatIdc == 1 || chromaFormatIdc == 2) ? 2 : 1;
+    uint32_t cropUnitY = (chromaFormatIdc == 1 ? 2 : 1) * (2 - frameMbsOnly);
+    if (chromaFormatIdc == 0) cropUnitY = 2 - frameMbsOnly;
+
+    int width = static_cast<int>(widthMbs * 16 - (cropLeft + cropRight) * cropUnitX);
+    int height = static_cast<int>((2 - frameMbsOnly) * heightMapUnits * 16 - (cropTop + cropBottom) * cropUnitY);
+    if (width <= 0 || height <= 0) return false;
+    info.width = width;
+    info.height = height;
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+// The parts of an H.264 sequence parameter set that containers need: the
+// profile/level bytes (avcC, RFC 6381 codec strings) and the picture size.
+struct SpsInfo {
+    uint8_t profileIdc = 0;
+    uint8_t constraintFlags = 0;
+    uint8_t levelIdc = 0;
+    uint8_t chromaFormatIdc = 1;    // 4:2:0 unless a high profile says otherwise
+    uint8_t bitDepthLuma = 8;
+    uint8_t bitDepthChroma = 8;
+    int width = 0;
+    int height = 0;
+};
+
+// `nal` is the SPS without start code, starting at the NAL header byte.
+// Returns false if it is truncated or not an SPS.
+bool parseSps(const uint8_t* nal, size_t size, SpsInfo& info);
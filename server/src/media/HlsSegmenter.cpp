@@ -0,0 +1,377 @@
+#include "media/HlsSegmenter.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+static constexpr int kPollMs = 500;
+// A publisher that stopped sending gets its last segment closed after this
+// long, so players are not left waiting on it.
+static constexpr int64_t kIdleCloseMs = 2000;
+// Segments whose parts stay listed (and cached); older ones are served whole.
+static constexpr size_t kPartSegments = 3;
+// Without an IDR a segment is cut anyway at this many segment targets.
+static constexpr uint64_t kMaxSegmentTargets = 4;
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t utcFromSteadyUs(uint64_t steadyUs) {
+    using namespace std::chrono;
+    int64_t steadyNow = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    int64_t systemNow = duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+    return systemNow - (steadyNow - static_cast<int64_t>(steadyUs));
+}
+
+static bool sameBytes(const std::vector<uint8_t>& bytes, const NaluPtr& nalu) {
+    return nalu && std::equal(bytes.begin(), bytes.end(), nalu->payload(), nalu->payload() + nalu->payloadSize());
+}
+
+HlsSegmenter::HlsSegmenter(std::string streamId, std::shared_ptr<StreamBuffer> buffer, HlsConfig config,
+                           UpdateListener onUpdate)
+    : streamId_(std::move(streamId)), buffer_(std::move(buffer)), config_(config), onUpdate_(std::move(onUpdate)) {}
+
+HlsSegmenter::~HlsSegmenter() {
+    stop();
+}
+
+void HlsSegmenter::start() {
+    if (running_) return;
+    running_ = true;
+    reader_ = buffer_->subscribe();
+    thread_ = std::thread(&HlsSegmenter::segmentLoop, this);
+}
+
+void HlsSegmenter::stop() {
+    if (!running_) return;
+    running_ = false;
+    buffer_->unsubscribe(reader_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    reader_.reset();
+}
+
+void HlsSegmenter::segmentLoop() {
+    int64_t lastDataMs = steadyNowMs();
+    while (running_) {
+        NaluPtr nalu = buffer_->pop(*reader_, kPollMs);
+        if (nalu) {
+            lastDataMs = steadyNowMs();
+            if (nalu->payloadSize() > 0) handle(nalu);
+            continue;
+        }
+        if (inSegment_ && steadyNowMs() - lastDataMs >= kIdleCloseMs) {
+            closeSegment(lastUnitUs_ + frameUs_);
+        }
+    }
+}
+
+void HlsSegmenter::handle(const NaluPtr& nalu) {
+    // A new publisher brings its own clock and maybe its own encoder
+    // settings: end the segment here and continue behind a discontinuity.
+    if (haveSession_ && nalu->ingestSession != ingestSession_) {
+        closeSegment(lastUnitUs_ + frameUs_);
+        units_.reset();
+        lastSps_.reset();
+        lastPps_.reset();
+        lastUnitUs_ = 0;
+        haveInit_ = false;
+    }
+    ingestSession_ = nalu->ingestSession;
+    haveSession_ = true;
+
+    if (nalu->type == 7) lastSps_ = nalu;
+    if (nalu->type == 8) lastPps_ = nalu;
+
+    AccessUnit unit;
+    if (!units_.push(nalu, unit)) return;
+
+    // Same clamping as the recorder: decode times only move forward.
+    if (lastUnitUs_ != 0 && unit.timeUs <= lastUnitUs_) {
+        unit.timeUs = lastUnitUs_ + frameUs_;
+    } else if (lastUnitUs_ != 0 && unit.timeUs - lastUnitUs_ < 1000000) {
+        frameUs_ = unit.timeUs - lastUnitUs_;
+    }
+    lastUnitUs_ = unit.timeUs;
+
+    uint64_t segmentUs = static_cast<uint64_t>(config_.segmentMs) * 1000;
+    if (unit.keyframe) {
+        bool setsChanged = haveInit_ && ((lastSps_ && !sameBytes(initSps_, lastSps_)) ||
+                                         (lastPps_ && !sameBytes(initPps_, lastPps_)));
+        // Half a frame of slack: a GOP of exactly the target must not wait
+        // for the next IDR because of timestamp rounding.
+        if (inSegment_ && (setsChanged || unit.timeUs + frameUs_ / 2 - segmentStartUs_ >= segmentUs)) {
+            closeSegment(unit.timeUs);
+        }
+        if (!haveInit_ || setsChanged) {
+            if (!prepareInit(unit.timeUs)) return;
+        }
+        // Every IDR opens a part players can start from.
+        flushPart(unit.timeUs);
+        if (!inSegment_) startSegment(unit);
+    } else if (!inSegment_) {
+        return;     // waiting for the first IDR
+    } else if (unit.timeUs - segmentStartUs_ >= kMaxSegmentTargets * segmentUs) {
+        closeSegment(unit.timeUs);
+        startSegment(unit);
+    }
+
+    // Close the part before this picture would take it past the target.
+    uint64_t partUs = static_cast<uint64_t>(config_.partMs) * 1000;
+    if (!part_.empty() && unit.timeUs + frameUs_ - part_.front().timeUs > partUs) {
+        flushPart(unit.timeUs);
+    }
+    part_.push_back(std::move(unit));
+}
+
+bool HlsSegmenter::prepareInit(uint64_t firstUs) {
+    if (lastSps_ && lastPps_) {
+        initSps_.assign(lastSps_->payload(), lastSps_->payload() + lastSps_->payloadSize());
+        initPps_.assign(lastPps_->payload(), lastPps_->payload() + lastPps_->payloadSize());
+    } else {
+        Nalu sets[2];
+        buffer_->getParameterSets(sets[0].data, sets[1].data);
+        for (Nalu& set : sets) classifyNalu(set);
+        initSps_.assign(sets[0].payload(), sets[0].payload() + sets[0].payloadSize());
+        initPps_.assign(sets[1].payload(), sets[1].payload() + sets[1].payloadSize());
+    }
+    if (!muxer_.init(initSps_.data(), initSps_.size(), initPps_.data(), initPps_.size())) {
+        return false;
+    }
+
+    // Keep media time running across publishers; the discontinuity is for
+    // the decoder, not the timeline.
+    originUs_ = firstUs >= timelineEndUs_ ? firstUs - timelineEndUs_ : firstUs;
+    muxer_.setTimelineOrigin(originUs_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    inits_.emplace_back(nextInitId_++, std::make_shared<const std::vector<uint8_t>>(muxer_.initSegment()));
+    discontinuity_ = nextInitId_ > 1;
+    haveInit_ = true;
+    LOG_INFO("[HLS] {}: {}x{} {}", streamId_, muxer_.spsInfo().width, muxer_.spsInfo().height, muxer_.codecString());
+    return true;
+}
+
+void HlsSegmenter::startSegment(const AccessUnit& first) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Segment segment;
+        segment.msn = nextMsn_++;
+        segment.initId = nextInitId_ - 1;
+        segment.discontinuity = discontinuity_;
+        segment.utcUs = utcFromSteadyUs(first.receivedUs);
+        segments_.push_back(std::move(segment));
+
+        size_t complete = segments_.size() - 1;
+        while (complete > static_cast<size_t>(config_.windowSegments)) {
+            if (segments_.front().discontinuity) discontinuitySequence_++;
+            segments_.pop_front();
+            complete--;
+        }
+        for (size_t i = 0; i + kPartSegments < segments_.size(); i++) {
+            segments_[i].parts.clear();
+            segments_[i].parts.shrink_to_fit();
+        }
+        uint32_t oldestInit = segments_.front().initId;
+        inits_.erase(std::remove_if(inits_.begin(), inits_.end(),
+                                    [oldestInit](const std::pair<uint32_t, HlsBytes>& init) {
+                                        return init.first < oldestInit;
+                                    }),
+                     inits_.end());
+    }
+    discontinuity_ = false;
+    inSegment_ = true;
+    segmentStartUs_ = first.timeUs;
+}
+
+void HlsSegmenter::flushPart(uint64_t endUs, bool lastOfSegment) {
+    Part part;
+    if (!part_.empty()) {
+        size_t size = 0;
+        for (const AccessUnit& unit : part_) size += unit.sampleSize();
+        auto bytes = std::make_shared<std::vector<uint8_t>>();
+        bytes->reserve(size + 256);
+        muxer_.writeFragment(part_.data(), part_.size(), endUs, [&bytes](const uint8_t* data, size_t length) {
+            bytes->insert(bytes->end(), data, data + length);
+        });
+        part.data = std::move(bytes);
+        part.durationUs = endUs - part_.front().timeUs;
+        part.independent = part_.front().keyframe;
+        timelineEndUs_ = endUs - originUs_;
+        part_.clear();
+    } else if (!lastOfSegment) {
+        return;
+    }
+
+    // The segment's last part and its completion go out as one update, so
+    // no playlist ever hints at a part that will not come.
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Segment& segment = segments_.back();
+        if (part.data) {
+            segment.durationUs += part.durationUs;
+            segment.parts.push_back(std::move(part));
+        }
+        if (lastOfSegment) {
+            if (segment.parts.empty()) {
+                segments_.pop_back();
+                nextMsn_--;
+                return;
+            }
+            size_t size = 0;
+            for (const Part& p : segment.parts) size += p.data->size();
+            auto bytes = std::make_shared<std::vector<uint8_t>>();
+            bytes->reserve(size);
+            for (const Part& p : segment.parts) bytes->insert(bytes->end(), p.data->begin(), p.data->end());
+            segment.data = std::move(bytes);
+            segment.complete = true;
+        }
+        renderPlaylist();
+    }
+    if (onUpdate_) onUpdate_();
+}
+
+void HlsSegmenter::closeSegment(uint64_t endUs) {
+    if (!inSegment_) return;
+    inSegment_ = false;
+    flushPart(endUs, true);
+}
+
+void HlsSegmenter::renderPlaylist() {
+    uint64_t targetUs = static_cast<uint64_t>(config_.segmentMs) * 1000;
+    for (const Segment& segment : segments_) targetUs = std::max(targetUs, segment.durationUs);
+    double partTarget = config_.partMs / 1000.0;
+
+    std::string out;
+    out.reserve(4096);
+    char line[160];
+    auto add = [&out, &line](int n) { out.append(line, std::min<size_t>(n, sizeof(line) - 1)); };
+
+    out += "#EXTM3U\n#EXT-X-VERSION:6\n";
+    add(snprintf(line, sizeof(line), "#EXT-X-TARGETDURATION:%llu\n",
+                 static_cast<unsigned long long>((targetUs + 999999) / 1000000)));
+    add(snprintf(line, sizeof(line), "#EXT-X-PART-INF:PART-TARGET=%.3f\n", partTarget));
+    add(snprintf(line, sizeof(line), "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n",
+                 partTarget * 3));
+    add(snprintf(line, sizeof(line), "#EXT-X-MEDIA-SEQUENCE:%llu\n",
+                 static_cast<unsigned long long>(segments_.front().msn)));
+    if (discontinuitySequence_ > 0) {
+        add(snprintf(line, sizeof(line), "#EXT-X-DISCONTINUITY-SEQUENCE:%llu\n",
+                     static_cast<unsigned long long>(discontinuitySequence_)));
+    }
+
+    bool first = true;
+    uint32_t initId = 0;
+    for (const Segment& segment : segments_) {
+        if (!segment.complete && segment.parts.empty()) break;
+        if (segment.discontinuity && !first) out += "#EXT-X-DISCONTINUITY\n";
+        if (first || segment.initId != initId) {
+            add(snprintf(line, sizeof(line), "#EXT-X-MAP:URI=\"init%u.mp4\"\n", segment.initId));
+            initId = segment.initId;
+        }
+        first = false;
+
+        time_t seconds = static_cast<time_t>(segment.utcUs / 1000000);
+        struct tm utc;
+        gmtime_r(&seconds, &utc);
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &utc);
+        add(snprintf(line, sizeof(line), "#EXT-X-PROGRAM-DATE-TIME:%s.%03dZ\n", stamp,
+                     static_cast<int>(segment.utcUs / 1000 % 1000)));
+
+        for (size_t i = 0; i < segment.parts.size(); i++) {
+            const Part& part = segment.parts[i];
+            add(snprintf(line, sizeof(line), "#EXT-X-PART:DURATION=%.5f,URI=\"part%llu.%zu.m4s\"%s\n",
+                         part.durationUs / 1e6, static_cast<unsigned long long>(segment.msn), i,
+                         part.independent ? ",INDEPENDENT=YES" : ""));
+        }
+        if (segment.complete) {
+            add(snprintf(line, sizeof(line), "#EXTINF:%.5f,\nseg%llu.m4s\n", segment.durationUs / 1e6,
+                         static_cast<unsigned long long>(segment.msn)));
+        }
+    }
+
+    const Segment& last = segments_.back();
+    uint64_t hintMsn = last.complete ? last.msn + 1 : last.msn;
+    size_t hintPart = last.complete ? 0 : last.parts.size();
+    add(snprintf(line, sizeof(line), "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"part%llu.%zu.m4s\"\n",
+                 static_cast<unsigned long long>(hintMsn), hintPart));
+
+    playlist_ = std::make_shared<const std::vector<uint8_t>>(out.begin(), out.end());
+}
+
+const HlsSegmenter::Segment* HlsSegmenter::findSegment(uint64_t msn) const {
+    if (segments_.empty() || msn < segments_.front().msn || msn > segments_.back().msn) return nullptr;
+    return &segments_[msn - segments_.front().msn];
+}
+
+HlsSegmenter::Wait HlsSegmenter::playlistState(int64_t msn, int part) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!playlist_) return Wait::Pending;
+    if (msn < 0) return Wait::Ready;
+
+    uint64_t target = static_cast<uint64_t>(msn);
+    const Segment& last = segments_.back();
+    if (target > last.msn + 2) return Wait::Gone;
+    if (target < segments_.front().msn) return Wait::Ready;
+    // Anything published after the requested part satisfies the request.
+    if (last.msn > target && (last.complete || !last.parts.empty())) return Wait::Ready;
+    const Segment* segment = findSegment(target);
+    if (!segment) return Wait::Pending;
+    if (segment->complete) {
+        // "Part P or later": past the segment's last part means the next
+        // segment's first one.
+        return part < 0 || static_cast<size_t>(part) < segment->parts.size() || segment->parts.empty()
+                   ? Wait::Ready
+                   : Wait::Pending;
+    }
+    return part >= 0 && static_cast<size_t>(part) < segment->parts.size() ? Wait::Ready : Wait::Pending;
+}
+
+HlsBytes HlsSegmenter::playlist() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return playlist_;
+}
+
+HlsBytes HlsSegmenter::initSegment(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& init : inits_) {
+        if (init.first == id) return init.second;
+    }
+    return nullptr;
+}
+
+HlsBytes HlsSegmenter::segment(uint64_t msn) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Segment* segment = findSegment(msn);
+    return segment && segment->complete ? segment->data : nullptr;
+}
+
+HlsSegmenter::Wait HlsSegmenter::partState(uint64_t msn, uint32_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Segment* segment = findSegment(msn);
+    if (segment) {
+        if (index < segment->parts.size()) return Wait::Ready;
+        return segment->complete ? Wait::Gone : Wait::Pending;
+    }
+    // The first part of the segment that has not started yet.
+    bool nextSegment = segments_.empty() ? msn == nextMsn_ : msn == segments_.back().msn + 1;
+    return nextSegment && index == 0 ? Wait::Pending : Wait::Gone;
+}
+
+HlsBytes HlsSegmenter::part(uint64_t msn, uint32_t index) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const Segment* segment = findSegment(msn);
+    return segment && index < segment->parts.size() ? segment->parts[index].data : nullptr;
+}
+
+int HlsSegmenter::blockTimeoutMs() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t targetUs = static_cast<uint64_t>(config_.segmentMs) * 1000;
+    for (const Segment& segment : segments_) targetUs = std::max(targetUs, segment.durationUs);
+    return static_cast<int>(3 * ((targetUs + 999999) / 1000000) * 1000);
+}
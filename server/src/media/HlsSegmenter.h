@@ -0,0 +1,129 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/AccessUnit.h"
+#include "media/Mp4Muxer.h"
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+struct HlsConfig {
+    int partMs = 200;           // EXT-X-PART-INF PART-TARGET
+    int segmentMs = 1000;       // segments are cut at the first IDR after this long
+    int windowSegments = 6;     // complete segments kept in the playlist
+};
+
+// Immutable bytes handed to any number of HTTP clients at once.
+using HlsBytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Low-latency HLS for one stream, built straight from the StreamBuffer.
+//
+// Like StreamRecorder this is a buffer reader with its own thread. Access
+// units go through Mp4Muxer into CMAF partial segments (one moof/mdat each,
+// at most partMs long); a segment is the concatenation of its parts and is
+// cut in front of an IDR (only an encoder with a very long GOP gets cuts
+// elsewhere), and every IDR starts an INDEPENDENT part. A new
+// publisher or new SPS/PPS starts a new init segment behind an
+// EXT-X-DISCONTINUITY.
+//
+// Everything HTTP clients get is cached here: the init segments, the last
+// windowSegments segments, the parts of the newest few and the playlist,
+// which is rendered once per part rather than once per request. The
+// update listener fires after every new part so HttpServer can answer
+// blocked playlist reloads (_HLS_msn/_HLS_part) and preload-hinted part
+// requests.
+class HlsSegmenter {
+public:
+    using UpdateListener = std::function<void()>;
+
+    HlsSegmenter(std::string streamId, std::shared_ptr<StreamBuffer> buffer, HlsConfig config,
+                 UpdateListener onUpdate);
+    ~HlsSegmenter();
+
+    void start();
+    void stop();
+
+    // What a blocking request is waiting for. msn < 0 waits for any content.
+    enum class Wait { Ready, Pending, Gone };
+
+    // Playlist reload: Ready once the playlist holds part `part` of segment
+    // `msn` or later (part < 0: the whole segment). Gone if msn is too far
+    // ahead to wait for.
+    Wait playlistState(int64_t msn, int part);
+    HlsBytes playlist();
+
+    HlsBytes initSegment(uint32_t id);
+    HlsBytes segment(uint64_t msn);
+    // Pending for the part about to be produced, so a preload hint can be
+    // requested before it exists.
+    Wait partState(uint64_t msn, uint32_t index);
+    HlsBytes part(uint64_t msn, uint32_t index);
+
+    // Longest time a blocking request should wait (three target durations).
+    int blockTimeoutMs();
+
+private:
+    struct Part {
+        HlsBytes data;
+        uint64_t durationUs = 0;
+        bool independent = false;
+    };
+    struct Segment {
+        uint64_t msn = 0;
+        uint32_t initId = 0;
+        bool discontinuity = false;
+        int64_t utcUs = 0;          // EXT-X-PROGRAM-DATE-TIME
+        uint64_t durationUs = 0;
+        std::vector<Part> parts;    // dropped once the segment leaves the part window
+        HlsBytes data;              // set when complete
+        bool complete = false;
+    };
+
+    void segmentLoop();
+    void handle(const NaluPtr& nalu);
+    bool prepareInit(uint64_t firstUs);
+    void flushPart(uint64_t endUs, bool lastOfSegment = false);
+    void closeSegment(uint64_t endUs);
+    void startSegment(const AccessUnit& first);
+    void renderPlaylist();
+    const Segment* findSegment(uint64_t msn) const;
+
+    const std::string streamId_;
+    std::shared_ptr<StreamBuffer> buffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
+    const HlsConfig config_;
+    UpdateListener onUpdate_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    // Segmenter thread only.
+    Mp4Muxer muxer_;
+    AccessUnitBuilder units_;
+    std::vector<AccessUnit> part_;      // access units of the part being collected
+    NaluPtr lastSps_, lastPps_;
+    std::vector<uint8_t> initSps_, initPps_;
+    bool haveInit_ = false;
+    bool inSegment_ = false;
+    bool discontinuity_ = false;
+    uint64_t segmentStartUs_ = 0;
+    uint64_t lastUnitUs_ = 0;
+    uint64_t frameUs_ = 33333;
+    uint64_t originUs_ = 0;             // AccessUnit time of media time 0
+    uint64_t timelineEndUs_ = 0;        // media time the next init continues from
+    uint32_t ingestSession_ = 0;
+    bool haveSession_ = false;
+
+    // Shared with the HTTP thread.
+    std::mutex mutex_;
+    std::deque<Segment> segments_;      // oldest first; the last may be in progress
+    std::vector<std::pair<uint32_t, HlsBytes>> inits_;
+    uint32_t nextInitId_ = 0;
+    uint64_t nextMsn_ = 0;
+    uint64_t discontinuitySequence_ = 0;
+    HlsBytes playlist_;
+};
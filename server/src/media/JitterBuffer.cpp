@@ -0,0 +1,102 @@
+#include "media/JitterBuffer.h"
+#include <algorithm>
+
+JitterBuffer::JitterBuffer(int latencyMs, size_t capacity)
+    : latencyMs_(latencyMs), slots_(capacity) {}
+
+void JitterBuffer::reset() {
+    for (Slot& s : slots_) {
+        s = Slot();
+    }
+    started_ = false;
+    next_ = 0;
+    highest_ = 0;
+}
+
+int64_t JitterBuffer::unwrap(uint16_t seq) const {
+    // Pick the extended value closest to the highest sequence seen so far.
+    int16_t delta = static_cast<int16_t>(seq - static_cast<uint16_t>(highest_));
+    return highest_ + delta;
+}
+
+bool JitterBuffer::insert(Packet&& packet, int64_t nowMs) {
+    // Offset keeps extended numbers positive when the first seq is small.
+    int64_t ext = started_ ? unwrap(packet.seq) : (int64_t(1) << 32) + packet.seq;
+
+    if (!started_ || ext - next_ >= static_cast<int64_t>(slots_.size())) {
+        // First packet, or a jump too large to bridge (sender restart or a
+        // long outage): start over at this packet.
+        if (started_) reset();
+        started_ = true;
+        next_ = highest_ = ext;
+    }
+    if (ext < next_) return false;
+
+    Slot& s = slot(ext);
+    if (s.present) return false;
+
+    if (ext > highest_) {
+        for (int64_t missing = highest_ + 1; missing < ext; missing++) {
+            Slot& m = slot(missing);
+            m = Slot();
+            m.missingSinceMs = nowMs;
+        }
+        highest_ = ext;
+    }
+
+    packet.arrivalMs = nowMs;
+    s.present = true;
+    s.nackCount = 0;
+    s.packet = std::move(packet);
+    return true;
+}
+
+int64_t JitterBuffer::firstAfterGap() const {
+    for (int64_t ext = next_ + 1; ext <= highest_; ext++) {
+        if (slot(ext).present) return ext;
+    }
+    return -1;
+}
+
+bool JitterBuffer::pop(int64_t nowMs, Packet& out, uint32_t& lost) {
+    if (!started_ || next_ > highest_) return false;
+
+    lost = 0;
+    Slot* s = &slot(next_);
+    if (!s->present) {
+        int64_t ext = firstAfterGap();
+        if (ext < 0 || nowMs < slot(ext).packet.arrivalMs + latencyMs_) return false;
+        lost = static_cast<uint32_t>(ext - next_);
+        next_ = ext;
+        s = &slot(next_);
+    }
+
+    out = std::move(s->packet);
+    s->present = false;
+    next_++;
+    return true;
+}
+
+void JitterBuffer::collectNacks(int64_t nowMs, std::vector<uint16_t>& out) {
+    if (!started_) return;
+    for (int64_t ext = next_; ext < highest_; ext++) {
+        Slot& s = slot(ext);
+        if (s.present || s.nackCount >= 2) continue;
+        int64_t due = s.missingSinceMs + (s.nackCount == 0 ? 0 : latencyMs_ / 2);
+        if (nowMs < due) continue;
+        s.nackCount++;
+        out.push_back(static_cast<uint16_t>(ext));
+    }
+}
+
+int64_t JitterBuffer::nextDeadlineMs() const {
+    if (!started_ || next_ > highest_ || slot(next_).present) return -1;
+    int64_t ext = firstAfterGap();
+    if (ext < 0) return -1;
+    int64_t deadline = slot(ext).packet.arrivalMs + latencyMs_;
+    const Slot& gap = slot(next_);
+    if (gap.nackCount == 1) {
+        deadline = std::min(deadline, gap.missingSinceMs + latencyMs_ / 2);
+    }
+    return deadline;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Reorder buffer for one incoming RTP stream.
+//
+// Packets are released strictly in sequence order. In-order traffic passes
+// straight through; only a gap holds delivery back, and never for longer
+// than latencyMs measured from the arrival of the first packet behind the
+// gap. After that the missing packets are declared lost and skipped, so a
+// lost packet costs at most latencyMs of extra delay instead of a stall.
+// While a gap is open, collectNacks() reports the missing sequence numbers
+// so the receiver can ask the sender to retransmit them.
+class JitterBuffer {
+public:
+    struct Packet {
+        uint16_t seq = 0;
+        uint32_t timestamp = 0;
+        bool marker = false;
+        std::vector<uint8_t> payload;
+        int64_t arrivalMs = 0;
+    };
+
+    explicit JitterBuffer(int latencyMs, size_t capacity = 1024);
+
+    // Returns false for duplicates and packets that arrive after their slot
+    // was already delivered or skipped.
+    bool insert(Packet&& packet, int64_t nowMs);
+
+    // Pops the next deliverable packet. `lost` is set to the number of
+    // sequence numbers skipped directly before it.
+    bool pop(int64_t nowMs, Packet& out, uint32_t& lost);
+
+    // Appends missing sequence numbers that are due for a (re)transmission
+    // request: once when the gap is seen, once more halfway to the deadline.
+    void collectNacks(int64_t nowMs, std::vector<uint16_t>& out);
+
+    // Earliest time pop() or collectNacks() could produce something new
+    // without further input; -1 if nothing is pending.
+    int64_t nextDeadlineMs() const;
+
+    void reset();
+
+private:
+    struct Slot {
+        bool present = false;
+        int nackCount = 0;
+        int64_t missingSinceMs = 0;
+        Packet packet;
+    };
+
+    int64_t unwrap(uint16_t seq) const;
+    Slot& slot(int64_t ext) { return slots_[ext % slots_.size()]; }
+    const Slot& slot(int64_t ext) const { return slots_[ext % slots_.size()]; }
+    // First present packet after a gap starting at next_, or -1.
+    int64_t firstAfterGap() const;
+
+    int latencyMs_;
+    std::vector<Slot> slots_;
+    bool started_ = false;
+    int64_t next_ = 0;      // extended seq of the next packet to deliver
+    int64_t highest_ = 0;   // highest extended seq seen
+};
@@ -0,0 +1,135 @@
+#include "media/KeyframeIndex.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char kMagic[4] = {'K', 'I', 'D', 'X'};
+static constexpr uint32_t kVersion = 1;
+static constexpr size_t kHeaderSize = 16;
+static constexpr size_t kEntrySize = 24;
+
+static void putLe(uint8_t* p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = static_cast<uint8_t>(v >> (8 * i));
+}
+
+static uint64_t getLe(const uint8_t* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool KeyframeIndexWriter::open(const std::string& path, uint32_t timescale) {
+    close();
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) return false;
+
+    uint8_t header[kHeaderSize];
+    memcpy(header, kMagic, 4);
+    putLe(header + 4, kVersion, 4);
+    putLe(header + 8, timescale, 4);
+    putLe(header + 12, kEntrySize, 4);
+    if (!writeAll(fd_, header, sizeof(header))) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool KeyframeIndexWriter::append(const KeyframeEntry& entry) {
+    if (fd_ < 0) return false;
+    // One write per entry: a concurrent reader sees whole entries only.
+    uint8_t record[kEntrySize];
+    putLe(record, entry.dts, 8);
+    putLe(record + 8, static_cast<uint64_t>(entry.utcUs), 8);
+    putLe(record + 16, entry.offset, 8);
+    if (!writeAll(fd_, record, sizeof(record))) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void KeyframeIndexWriter::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+bool KeyframeIndex::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || static_cast<size_t>(st.st_size) < kHeaderSize) {
+        ::close(fd);
+        return false;
+    }
+    void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    map_ = static_cast<const uint8_t*>(map);
+    mapSize_ = st.st_size;
+    if (memcmp(map_, kMagic, 4) != 0 || getLe(map_ + 4, 4) != kVersion || getLe(map_ + 12, 4) != kEntrySize) {
+        close();
+        return false;
+    }
+    timescale_ = static_cast<uint32_t>(getLe(map_ + 8, 4));
+    count_ = (mapSize_ - kHeaderSize) / kEntrySize;
+    return true;
+}
+
+void KeyframeIndex::close() {
+    if (map_) {
+        munmap(const_cast<uint8_t*>(map_), mapSize_);
+        map_ = nullptr;
+    }
+    mapSize_ = 0;
+    count_ = 0;
+}
+
+KeyframeEntry KeyframeIndex::entry(size_t i) const {
+    const uint8_t* p = map_ + kHeaderSize + i * kEntrySize;
+    KeyframeEntry e;
+    e.dts = getLe(p, 8);
+    e.utcUs = static_cast<int64_t>(getLe(p + 8, 8));
+    e.offset = getLe(p + 16, 8);
+    return e;
+}
+
+ptrdiff_t KeyframeIndex::findByDts(uint64_t dts) const {
+    // First entry later than dts, minus one.
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (getLe(map_ + kHeaderSize + mid * kEntrySize, 8) <= dts) lo = mid + 1;
+        else hi = mid;
+    }
+    return static_cast<ptrdiff_t>(lo) - 1;
+}
+
+ptrdiff_t KeyframeIndex::findByUtc(int64_t utcUs) const {
+    size_t lo = 0, hi = count_;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (static_cast<int64_t>(getLe(map_ + kHeaderSize + mid * kEntrySize + 8, 8)) <= utcUs) lo = mid + 1;
+        else hi = mid;
+    }
+    return static_cast<ptrdiff_t>(lo) - 1;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+// Seek index written next to each MP4 recording (<file>.idx): one entry per
+// fragment, i.e. per keyframe. The file is a 16-byte header ("KIDX",
+// version, timescale, entry size) followed by fixed-size little-endian
+// entries in time order, so a reader can mmap it and binary-search without
+// parsing anything, even while the recorder is still appending.
+struct KeyframeEntry {
+    uint64_t dts = 0;       // decode time of the keyframe, timescale ticks
+    int64_t utcUs = 0;      // wall clock when it arrived
+    uint64_t offset = 0;    // file offset of the fragment's moof
+};
+
+class KeyframeIndexWriter {
+public:
+    KeyframeIndexWriter() = default;
+    ~KeyframeIndexWriter() { close(); }
+    KeyframeIndexWriter(const KeyframeIndexWriter&) = delete;
+    KeyframeIndexWriter& operator=(const KeyframeIndexWriter&) = delete;
+
+    bool open(const std::string& path, uint32_t timescale);
+    bool append(const KeyframeEntry& entry);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+
+private:
+    int fd_ = -1;
+};
+
+class KeyframeIndex {
+public:
+    KeyframeIndex() = default;
+    ~KeyframeIndex() { close(); }
+    KeyframeIndex(const KeyframeIndex&) = delete;
+    KeyframeIndex& operator=(const KeyframeIndex&) = delete;
+
+    // Maps the whole file. Entries appended later need a reopen.
+    bool open(const std::string& path);
+    void close();
+
+    size_t size() const { return count_; }
+    uint32_t timescale() const { return timescale_; }
+    KeyframeEntry entry(size_t i) const;
+
+    // Index of the last keyframe at or before the given time, or -1 if the
+    // recording starts later.
+    ptrdiff_t findByDts(uint64_t dts) const;
+    ptrdiff_t findByUtc(int64_t utcUs) const;
+
+private:
+    const uint8_t* map_ = nullptr;
+    size_t mapSize_ = 0;
+    size_t count_ = 0;
+    uint32_t timescale_ = 0;
+};
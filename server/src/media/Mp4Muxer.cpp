@@ -0,0 +1,272 @@
+#include "media/Mp4Muxer.h"
+#include <cstdio>
+
+namespace {
+
+// Big-endian box serializer. open() returns the box start so close() can
+// patch the size once the contents are known.
+class BoxWriter {
+public:
+    explicit BoxWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+    void u8(uint32_t v) { out_.push_back(static_cast<uint8_t>(v)); }
+    void u16(uint32_t v) { u8(v >> 8); u8(v); }
+    void u24(uint32_t v) { u8(v >> 16); u16(v); }
+    void u32(uint32_t v) { u16(v >> 16); u16(v); }
+    void u64(uint64_t v) { u32(static_cast<uint32_t>(v >> 32)); u32(static_cast<uint32_t>(v)); }
+    void zeros(size_t n) { out_.insert(out_.end(), n, 0); }
+    void bytes(const uint8_t* data, size_t size) { out_.insert(out_.end(), data, data + size); }
+    void fourcc(const char* type) { bytes(reinterpret_cast<const uint8_t*>(type), 4); }
+
+    size_t open(const char* type) {
+        size_t start = out_.size();
+        u32(0);
+        fourcc(type);
+        return start;
+    }
+    size_t openFull(const char* type, uint8_t version, uint32_t flags) {
+        size_t start = open(type);
+        u8(version);
+        u24(flags);
+        return start;
+    }
+    void close(size_t start) { patch32(start, static_cast<uint32_t>(out_.size() - start)); }
+
+    size_t position() const { return out_.size(); }
+    void patch32(size_t at, uint32_t v) {
+        out_[at] = static_cast<uint8_t>(v >> 24);
+        out_[at + 1] = static_cast<uint8_t>(v >> 16);
+        out_[at + 2] = static_cast<uint8_t>(v >> 8);
+        out_[at + 3] = static_cast<uint8_t>(v);
+    }
+
+    // Unity transformation matrix used by mvhd and tkhd.
+    void matrix() {
+        static const uint32_t kUnity[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+        for (uint32_t v : kUnity) u32(v);
+    }
+
+private:
+    std::vector<uint8_t>& out_;
+};
+
+constexpr uint32_t kTrackId = 1;
+// sample_depends_on = 2 (I picture) / 1 plus sample_is_non_sync_sample.
+constexpr uint32_t kSyncSampleFlags = 0x02000000;
+constexpr uint32_t kNonSyncSampleFlags = 0x01010000;
+
+} // namespace
+
+bool Mp4Muxer::init(const uint8_t* sps, size_t spsSize, const uint8_t* pps, size_t ppsSize) {
+    if (!parseSps(sps, spsSize, sps_) || ppsSize == 0 || spsSize > 0xFFFF || ppsSize > 0xFFFF) return false;
+
+    init_.clear();
+    BoxWriter w(init_);
+
+    size_t ftyp = w.open("ftyp");
+    w.fourcc("isom");
+    w.u32(0x200);
+    for (const char* brand : {"isom", "iso6", "avc1", "mp41"}) w.fourcc(brand);
+    w.close(ftyp);
+
+    size_t moov = w.open("moov");
+    {
+        size_t mvhd = w.openFull("mvhd", 0, 0);
+        w.u32(0);               // creation_time
+        w.u32(0);               // modification_time
+        w.u32(1000);            // timescale
+        w.u32(0);               // duration: unknown, it's in the fragments
+        w.u32(0x00010000);      // rate 1.0
+        w.u16(0x0100);          // volume 1.0
+        w.zeros(10);
+        w.matrix();
+        w.zeros(24);            // pre_defined
+        w.u32(kTrackId + 1);    // next_track_ID
+        w.close(mvhd);
+
+        size_t trak = w.open("trak");
+        {
+            size_t tkhd = w.openFull("tkhd", 0, 0x000003);  // enabled, in movie
+            w.u32(0);
+            w.u32(0);
+            w.u32(kTrackId);
+            w.u32(0);
+            w.u32(0);           // duration
+            w.zeros(8);
+            w.u16(0);           // layer
+            w.u16(0);           // alternate_group
+            w.u16(0);           // volume: video
+            w.u16(0);
+            w.matrix();
+            w.u32(static_cast<uint32_t>(sps_.width) << 16);
+            w.u32(static_cast<uint32_t>(sps_.height) << 16);
+            w.close(tkhd);
+
+            size_t mdia = w.open("mdia");
+            {
+                size_t mdhd = w.openFull("mdhd", 0, 0);
+                w.u32(0);
+                w.u32(0);
+                w.u32(kTimescale);
+                w.u32(0);
+                w.u16(0x55C4);  // language "und"
+                w.u16(0);
+                w.close(mdhd);
+
+                size_t hdlr = w.openFull("hdlr", 0, 0);
+                w.u32(0);
+                w.fourcc("vide");
+                w.zeros(12);
+                static const char kName[] = "VideoHandler";
+                w.bytes(reinterpret_cast<const uint8_t*>(kName), sizeof(kName));
+                w.close(hdlr);
+
+                size_t minf = w.open("minf");
+                {
+                    size_t vmhd = w.openFull("vmhd", 0, 1);
+                    w.zeros(8);     // graphicsmode, opcolor
+                    w.close(vmhd);
+
+                    size_t dinf = w.open("dinf");
+                    size_t dref = w.openFull("dref", 0, 0);
+                    w.u32(1);
+                    w.close(w.openFull("url ", 0, 1));  // media is in this file
+                    w.close(dref);
+                    w.close(dinf);
+
+                    size_t stbl = w.open("stbl");
+                    {
+                        size_t stsd = w.openFull("stsd", 0, 0);
+                        w.u32(1);
+                        size_t avc1 = w.open("avc1");
+                        w.zeros(6);
+                        w.u16(1);           // data_reference_index
+                        w.zeros(16);
+                        w.u16(static_cast<uint32_t>(sps_.width));
+                        w.u16(static_cast<uint32_t>(sps_.height));
+                        w.u32(0x00480000);  // 72 dpi
+                        w.u32(0x00480000);
+                        w.u32(0);
+                        w.u16(1);           // frame_count
+                        w.zeros(32);        // compressorname
+                        w.u16(0x0018);      // depth
+                        w.u16(0xFFFF);      // pre_defined = -1
+
+                        size_t avcC = w.open("avcC");
+                        w.u8(1);            // configurationVersion
+                        w.u8(sps_.profileIdc);
+                        w.u8(sps_.constraintFlags);
+                        w.u8(sps_.levelIdc);
+                        w.u8(0xFF);         // lengthSizeMinusOne = 3
+                        w.u8(0xE1);         // one SPS
+                        w.u16(static_cast<uint32_t>(spsSize));
+                        w.bytes(sps, spsSize);
+                        w.u8(1);            // one PPS
+                        w.u16(static_cast<uint32_t>(ppsSize));
+                        w.bytes(pps, ppsSize);
+                        if (sps_.profileIdc == 100 || sps_.profileIdc == 110 ||
+                            sps_.profileIdc == 122 || sps_.profileIdc == 244) {
+                            w.u8(0xFC | sps_.chromaFormatIdc);
+                            w.u8(0xF8 | (sps_.bitDepthLuma - 8));
+                            w.u8(0xF8 | (sps_.bitDepthChroma - 8));
+                            w.u8(0);        // no SPS extensions
+                        }
+                        w.close(avcC);
+                        w.close(avc1);
+                        w.close(stsd);
+
+                        // The sample tables stay empty; samples live in moofs.
+                        for (const char* table : {"stts", "stsc", "stco"}) {
+                            size_t box = w.openFull(table, 0, 0);
+                            w.u32(0);
+                            w.close(box);
+                        }
+                        size_t stsz = w.openFull("stsz", 0, 0);
+                        w.u32(0);
+                        w.u32(0);
+                        w.close(stsz);
+                    }
+                    w.close(stbl);
+                }
+                w.close(minf);
+            }
+            w.close(mdia);
+        }
+        w.close(trak);
+
+        size_t mvex = w.open("mvex");
+        size_t trex = w.openFull("trex", 0, 0);
+        w.u32(kTrackId);
+        w.u32(1);               // default_sample_description_index
+        w.u32(0);
+        w.u32(0);
+        w.u32(0);
+        w.close(trex);
+        w.close(mvex);
+    }
+    w.close(moov);
+    return true;
+}
+
+std::string Mp4Muxer::codecString() const {
+    char codec[16];
+    snprintf(codec, sizeof(codec), "avc1.%02X%02X%02X", sps_.profileIdc, sps_.constraintFlags, sps_.levelIdc);
+    return codec;
+}
+
+size_t Mp4Muxer::writeFragment(const AccessUnit* units, size_t count, uint64_t endUs, const Sink& sink) {
+    if (count == 0) return 0;
+
+    moof_.clear();
+    BoxWriter w(moof_);
+    uint64_t mdatSize = 8;
+
+    size_t moof = w.open("moof");
+    size_t mfhd = w.openFull("mfhd", 0, 0);
+    w.u32(++sequence_);
+    w.close(mfhd);
+
+    size_t traf = w.open("traf");
+    size_t tfhd = w.openFull("tfhd", 0, 0x020000);   // default-base-is-moof
+    w.u32(kTrackId);
+    w.close(tfhd);
+
+    size_t tfdt = w.openFull("tfdt", 1, 0);
+    w.u64(toTicks(units[0].timeUs));
+    w.close(tfdt);
+
+    // data-offset, sample-duration, sample-size and sample-flags present.
+    size_t trun = w.openFull("trun", 0, 0x000701);
+    w.u32(static_cast<uint32_t>(count));
+    size_t dataOffset = w.position();
+    w.u32(0);
+    for (size_t i = 0; i < count; i++) {
+        uint64_t start = toTicks(units[i].timeUs);
+        uint64_t end = toTicks(i + 1 < count ? units[i + 1].timeUs : endUs);
+        size_t size = units[i].sampleSize();
+        w.u32(end > start ? static_cast<uint32_t>(end - start) : 1);
+        w.u32(static_cast<uint32_t>(size));
+        w.u32(units[i].keyframe ? kSyncSampleFlags : kNonSyncSampleFlags);
+        mdatSize += size;
+    }
+    w.close(trun);
+    w.close(traf);
+    w.close(moof);
+
+    // Samples start right after the mdat header.
+    w.patch32(dataOffset, static_cast<uint32_t>(moof_.size() + 8));
+    w.u32(static_cast<uint32_t>(mdatSize));
+    w.fourcc("mdat");
+    sink(moof_.data(), moof_.size());
+
+    for (size_t i = 0; i < count; i++) {
+        for (const NaluPtr& nalu : units[i].nalus) {
+            uint32_t length = static_cast<uint32_t>(nalu->payloadSize());
+            uint8_t prefix[4] = {static_cast<uint8_t>(length >> 24), static_cast<uint8_t>(length >> 16),
+                                 static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(length)};
+            sink(prefix, sizeof(prefix));
+            sink(nalu->payload(), length);
+        }
+    }
+    return moof_.size() + mdatSize - 8;
+}
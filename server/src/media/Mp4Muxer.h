@@ -0,0 +1,47 @@
+#pragma once
+#include "media/AccessUnit.h"
+#include "media/H264Sps.h"
+#include <functional>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Fragmented MP4 (ISO/IEC 14496-12) for a single H.264 track.
+//
+// The init segment (ftyp + moov with an empty sample table and mvex) comes
+// from the stream's SPS/PPS; each writeFragment() then emits one moof + mdat
+// pair. Sample data is streamed to the sink straight from the NALU payloads
+// with 4-byte length prefixes, so the muxer itself never copies media bytes;
+// only the box headers are built in a scratch buffer.
+class Mp4Muxer {
+public:
+    static constexpr uint32_t kTimescale = 90000;
+
+    using Sink = std::function<void(const uint8_t* data, size_t size)>;
+
+    // sps/pps start at the NAL header (no start code). Returns false if the
+    // SPS can't be parsed.
+    bool init(const uint8_t* sps, size_t spsSize, const uint8_t* pps, size_t ppsSize);
+
+    const std::vector<uint8_t>& initSegment() const { return init_; }
+    const SpsInfo& spsInfo() const { return sps_; }
+    // "avc1.PPCCLL" for HLS/DASH manifests and MSE.
+    std::string codecString() const;
+
+    // Decode times are counted from this point of the AccessUnit clock.
+    void setTimelineOrigin(uint64_t timeUs) { originUs_ = timeUs; }
+    uint64_t toTicks(uint64_t timeUs) const {
+        return timeUs > originUs_ ? (timeUs - originUs_) * 9 / 100 : 0;
+    }
+
+    // Writes `count` access units as one fragment. Each sample lasts until the
+    // next one starts, the last until `endUs`. Returns the bytes written.
+    size_t writeFragment(const AccessUnit* units, size_t count, uint64_t endUs, const Sink& sink);
+
+private:
+    SpsInfo sps_;
+    std::vector<uint8_t> init_;
+    std::vector<uint8_t> moof_;   // reused between fragments
+    uint64_t originUs_ = 0;
+    uint32_t sequence_ = 0;
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+// One H.264 NAL unit as received from the camera (Annex B, start code
+// included). Once pushed into a StreamBuffer it is immutable and shared by
+// every consumer of the stream, so fan-out never copies payload bytes.
+struct Nalu {
+    std::vector<uint8_t> data;
+    uint8_t type = 0;           // nal_unit_type (SPS=7, PPS=8, IDR=5, ...)
+    size_t startCodeLength = 0; // 3 or 4, 0 if the camera sent none
+
+    // Set only when the camera speaks ingest protocol v2; legacy cameras
+    // leave timing and access unit boundaries to be guessed downstream.
+    bool hasFrameInfo = false;
+    bool accessUnitEnd = false;
+    uint64_t captureUs = 0;     // camera capture clock, microseconds
+
+    // steady_clock microseconds when the server took the NALU in
+    // (Stream::publish); the only timing legacy cameras give us.
+    uint64_t receivedUs = 0;
+    // steady_clock microseconds just before it went into the StreamBuffer;
+    // with receivedUs, the start of the StageLatency stamps.
+    uint64_t enqueuedUs = 0;
+
+    // Which publisher of the stream produced this NALU (Stream::ingestSession).
+    // A change tells consumers the camera reconnected: its clock, parameter
+    // sets and reference pictures may all be new.
+    uint32_t ingestSession = 0;
+
+    const uint8_t* payload() const { return data.data() + startCodeLength; }
+    size_t payloadSize() const { return data.size() - startCodeLength; }
+
+    bool isVcl() const { return type >= 1 && type <= 5; }
+    bool isKeyframe() const { return type == 5; }
+    bool isParameterSet() const { return type == 7 || type == 8; }
+};
+
+using NaluPtr = std::shared_ptr<const Nalu>;
+
+// Finds the Annex B start code and fills in type/startCodeLength.
+inline void classifyNalu(Nalu& nalu) {
+    const std::vector<uint8_t>& d = nalu.data;
+    if (d.size() > 4 && d[0] == 0 && d[1] == 0 && d[2] == 0 && d[3] == 1) {
+        nalu.startCodeLength = 4;
+    } else if (d.size() > 3 && d[0] == 0 && d[1] == 0 && d[2] == 1) {
+        nalu.startCodeLength = 3;
+    } else {
+        nalu.startCodeLength = 0;
+    }
+    nalu.type = d.size() > nalu.startCodeLength ? (d[nalu.startCodeLength] & 0x1F) : 0;
+}
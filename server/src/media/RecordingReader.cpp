@@ -0,0 +1,253 @@
+#include "media/RecordingReader.h"
+#include "media/KeyframeIndex.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t kMaxMoovSize = 1 << 20;
+static constexpr size_t kMaxMoofSize = 4 << 20;
+
+static uint32_t be32(const uint8_t* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+static uint64_t be64(const uint8_t* p) {
+    return (uint64_t(be32(p)) << 32) | be32(p + 4);
+}
+
+// Finds the first child box of `type` among the boxes in [data, data + size)
+// and narrows data/size to its contents.
+static bool findBox(const uint8_t*& data, size_t& size, const char* type) {
+    size_t pos = 0;
+    while (pos + 8 <= size) {
+        uint64_t boxSize = be32(data + pos);
+        size_t header = 8;
+        if (boxSize == 1) {
+            if (pos + 16 > size) return false;
+            boxSize = be64(data + pos + 8);
+            header = 16;
+        } else if (boxSize == 0) {
+            boxSize = size - pos;
+        }
+        if (boxSize < header || boxSize > size - pos) return false;
+        if (memcmp(data + pos + 4, type, 4) == 0) {
+            data += pos + header;
+            size = boxSize - header;
+            return true;
+        }
+        pos += boxSize;
+    }
+    return false;
+}
+
+static NaluPtr makeNalu(const uint8_t* data, size_t size) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data.assign(data, data + size);
+    nalu->type = data[0] & 0x1F;
+    return nalu;
+}
+
+bool RecordingFile::open(const std::string& path) {
+    close();
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) return false;
+    path_ = path;
+
+    // ftyp, then moov.
+    uint64_t offset = 0;
+    uint8_t header[8];
+    std::vector<uint8_t> moov;
+    while (moov.empty()) {
+        if (!readAt(offset, header, sizeof(header))) break;
+        uint32_t size = be32(header);
+        if (size < 8) break;
+        if (memcmp(header + 4, "moov", 4) == 0) {
+            if (size > kMaxMoovSize) break;
+            moov.resize(size - 8);
+            if (!readAt(offset + 8, moov.data(), moov.size())) moov.clear();
+        }
+        offset += size;
+        if (moov.empty() && offset > kMaxMoovSize) break;
+    }
+    firstFragment_ = offset;
+
+    // moov/trak/mdia/minf/stbl/stsd/avc1/avcC
+    const uint8_t* p = moov.data();
+    size_t n = moov.size();
+    bool found = !moov.empty() && findBox(p, n, "trak") && findBox(p, n, "mdia") && findBox(p, n, "minf") &&
+                 findBox(p, n, "stbl") && findBox(p, n, "stsd") && n > 8;
+    if (found) {
+        p += 8;     // version/flags, entry_count
+        n -= 8;
+        found = findBox(p, n, "avc1") && n > 78;
+    }
+    if (found) {
+        p += 78;    // VisualSampleEntry fields
+        n -= 78;
+        found = findBox(p, n, "avcC") && n >= 8;
+    }
+    if (found) {
+        size_t spsSize = (p[6] << 8) | p[7];
+        size_t ppsAt = 8 + spsSize;
+        if ((p[5] & 0x1F) >= 1 && spsSize > 0 && ppsAt + 3 <= n) {
+            size_t ppsSize = (p[ppsAt + 1] << 8) | p[ppsAt + 2];
+            if (p[ppsAt] >= 1 && ppsSize > 0 && ppsAt + 3 + ppsSize <= n) {
+                sps_ = makeNalu(p + 8, spsSize);
+                pps_ = makeNalu(p + ppsAt + 3, ppsSize);
+            }
+        }
+    }
+    if (!sps_ || !pps_) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void RecordingFile::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    sps_.reset();
+    pps_.reset();
+}
+
+bool RecordingFile::readAt(uint64_t offset, void* data, size_t size) {
+    uint8_t* out = static_cast<uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = pread(fd_, out, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        out += n;
+        offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool RecordingFile::readFragment(uint64_t offset, Fragment& fragment) {
+    struct stat st;
+    if (fd_ < 0 || fstat(fd_, &st) < 0) return false;
+    uint64_t fileSize = st.st_size;
+
+    uint8_t header[8];
+    if (offset + 8 > fileSize || !readAt(offset, header, sizeof(header))) return false;
+    uint32_t moofSize = be32(header);
+    if (memcmp(header + 4, "moof", 4) != 0 || moofSize < 8 || moofSize > kMaxMoofSize) return false;
+    if (offset + moofSize + 8 > fileSize || !readAt(offset + moofSize, header, sizeof(header))) return false;
+    uint32_t mdatSize = be32(header);
+    if (memcmp(header + 4, "mdat", 4) != 0 || mdatSize < 8) return false;
+    if (offset + moofSize + mdatSize > fileSize) return false;
+
+    scratch_.resize(moofSize - 8);
+    if (!readAt(offset + 8, scratch_.data(), scratch_.size())) return false;
+
+    const uint8_t* traf = scratch_.data();
+    size_t trafSize = scratch_.size();
+    if (!findBox(traf, trafSize, "traf")) return false;
+
+    const uint8_t* p = traf;
+    size_t n = trafSize;
+    uint64_t baseDts = 0;
+    if (findBox(p, n, "tfdt") && n >= 8) {
+        baseDts = p[0] == 1 && n >= 12 ? be64(p + 4) : be32(p + 4);
+    }
+
+    p = traf;
+    n = trafSize;
+    if (!findBox(p, n, "trun") || n < 8) return false;
+    uint32_t flags = be32(p) & 0xFFFFFF;
+    uint32_t count = be32(p + 4);
+    size_t pos = 8;
+    int32_t dataOffset = 0;
+    if (flags & 0x001) {
+        if (pos + 4 > n) return false;
+        dataOffset = static_cast<int32_t>(be32(p + pos));
+        pos += 4;
+    }
+    if (flags & 0x004) pos += 4;   // first_sample_flags
+    size_t fieldSize = 4 * (((flags & 0x100) != 0) + ((flags & 0x200) != 0) + ((flags & 0x400) != 0) +
+                            ((flags & 0x800) != 0));
+    if (pos > n || count > (n - pos) / std::max<size_t>(fieldSize, 1)) return false;
+
+    fragment.offset = offset;
+    fragment.nextOffset = offset + moofSize + mdatSize;
+    fragment.dataOffset = offset + dataOffset;
+    fragment.samples.clear();
+    uint64_t dts = baseDts;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        Sample sample;
+        sample.dts = dts;
+        if (flags & 0x100) { sample.duration = be32(p + pos); pos += 4; }
+        if (flags & 0x200) { sample.size = be32(p + pos); pos += 4; }
+        if (flags & 0x400) { sample.keyframe = (be32(p + pos) & 0x00010000) == 0; pos += 4; }
+        if (flags & 0x800) pos += 4;
+        dts += sample.duration;
+        total += sample.size;
+        fragment.samples.push_back(sample);
+    }
+    return fragment.dataOffset + total <= fragment.nextOffset;
+}
+
+bool RecordingFile::readSamples(const Fragment& fragment, size_t first, size_t count,
+                                std::vector<std::vector<NaluPtr>>& out) {
+    uint64_t offset = fragment.dataOffset;
+    for (size_t i = 0; i < first; i++) offset += fragment.samples[i].size;
+    size_t total = 0;
+    for (size_t i = first; i < first + count; i++) total += fragment.samples[i].size;
+
+    // One read for the whole run, then split at the 4-byte length prefixes.
+    scratch_.resize(total);
+    if (!readAt(offset, scratch_.data(), total)) return false;
+    const uint8_t* p = scratch_.data();
+    for (size_t i = first; i < first + count; i++) {
+        const uint8_t* end = p + fragment.samples[i].size;
+        std::vector<NaluPtr> nalus;
+        while (end - p >= 5) {
+            uint32_t length = be32(p);
+            p += 4;
+            if (length == 0 || length > static_cast<size_t>(end - p)) break;
+            nalus.push_back(makeNalu(p, length));
+            p += length;
+        }
+        p = end;
+        out.push_back(std::move(nalus));
+    }
+    return true;
+}
+
+bool RecordingCatalog::scan(const std::string& dir) {
+    files_.clear();
+    DIR* d = opendir(dir.c_str());
+    if (!d) return false;
+    while (dirent* ent = readdir(d)) {
+        std::string name = ent->d_name;
+        static const std::string kSuffix = ".mp4.idx";
+        if (name.size() <= kSuffix.size() || name.compare(name.size() - kSuffix.size(), kSuffix.size(), kSuffix) != 0) {
+            continue;
+        }
+        KeyframeIndex index;
+        if (!index.open(dir + "/" + name) || index.size() == 0) continue;
+        Entry entry;
+        entry.path = dir + "/" + name.substr(0, name.size() - 4);
+        entry.firstUtcUs = index.entry(0).utcUs;
+        entry.lastUtcUs = index.entry(index.size() - 1).utcUs;
+        files_.push_back(std::move(entry));
+    }
+    closedir(d);
+    std::sort(files_.begin(), files_.end(),
+              [](const Entry& a, const Entry& b) { return a.firstUtcUs < b.firstUtcUs; });
+    return !files_.empty();
+}
+
+size_t RecordingCatalog::locate(int64_t utcUs) const {
+    auto it = std::upper_bound(files_.begin(), files_.end(), utcUs,
+                               [](int64_t t, const Entry& e) { return t < e.firstUtcUs; });
+    return it == files_.begin() ? 0 : static_cast<size_t>(it - files_.begin()) - 1;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include "media/Nalu.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Read side of the MP4 files StreamRecorder writes: the parameter sets from
+// the init segment and, fragment by fragment, the sample table and data.
+// Everything is read with pread(), so a file that is still being recorded
+// can be followed: a fragment only counts once it is complete on disk.
+class RecordingFile {
+public:
+    struct Sample {
+        uint64_t dts = 0;       // 90 kHz
+        uint32_t duration = 0;
+        uint32_t size = 0;
+        bool keyframe = false;
+    };
+
+    struct Fragment {
+        uint64_t offset = 0;        // of the moof
+        uint64_t nextOffset = 0;    // where the following fragment starts
+        uint64_t dataOffset = 0;    // first sample's bytes
+        std::vector<Sample> samples;
+    };
+
+    RecordingFile() = default;
+    ~RecordingFile() { close(); }
+    RecordingFile(const RecordingFile&) = delete;
+    RecordingFile& operator=(const RecordingFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return fd_ >= 0; }
+    const std::string& path() const { return path_; }
+
+    // SPS and PPS from the avcC box, as NALUs ready to send.
+    NaluPtr sps() const { return sps_; }
+    NaluPtr pps() const { return pps_; }
+    uint64_t firstFragmentOffset() const { return firstFragment_; }
+
+    // Parses the moof at `offset`. False if there is none (yet) or it and its
+    // mdat are not completely on disk.
+    bool readFragment(uint64_t offset, Fragment& fragment);
+    // Reads samples [first, first + count) of `fragment` and splits them
+    // into NALUs, appended to `out` (one vector per sample).
+    bool readSamples(const Fragment& fragment, size_t first, size_t count,
+                     std::vector<std::vector<NaluPtr>>& out);
+
+private:
+    bool readAt(uint64_t offset, void* data, size_t size);
+
+    int fd_ = -1;
+    std::string path_;
+    NaluPtr sps_, pps_;
+    uint64_t firstFragment_ = 0;
+    std::vector<uint8_t> scratch_;
+};
+
+// The recordings of one stream (<record dir>/<id>/*.mp4 with their .idx),
+// ordered by the wall clock time of their first keyframe.
+class RecordingCatalog {
+public:
+    struct Entry {
+        std::string path;       // the .mp4
+        int64_t firstUtcUs = 0;
+        int64_t lastUtcUs = 0;  // last indexed keyframe
+    };
+
+    // Rescans the directory. Returns false if it holds no usable recording.
+    bool scan(const std::string& dir);
+
+    const std::vector<Entry>& files() const { return files_; }
+    bool empty() const { return files_.empty(); }
+    // The file covering utcUs: the last one starting at or before it, or
+    // the first file if utcUs is older than everything.
+    size_t locate(int64_t utcUs) const;
+
+private:
+    std::vector<Entry> files_;
+};
@@ -0,0 +1,72 @@
+#include "media/SdpCache.h"
+#include "utils/base64.h"
+#include "utils/Log.h"
+#include <cstdio>
+
+SdpCache::SdpCache(std::shared_ptr<StreamBuffer> streamBuffer)
+    : streamBuffer_(streamBuffer) {}
+
+std::shared_ptr<const SdpDescription> SdpCache::get() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t version = streamBuffer_->parameterSetVersion();
+    if (!cached_ || cached_->version != version) {
+        cached_ = render();
+    }
+    return cached_;
+}
+
+static void stripStartCode(const std::vector<uint8_t>& nalu, const uint8_t*& data, size_t& len) {
+    data = nalu.data();
+    len = nalu.size();
+    if (len > 4 && data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == 1) {
+        data += 4;
+        len -= 4;
+    } else if (len > 3 && data[0] == 0 && data[1] == 0 && data[2] == 1) {
+        data += 3;
+        len -= 3;
+    }
+}
+
+std::shared_ptr<const SdpDescription> SdpCache::render() {
+    std::vector<uint8_t> sps, pps;
+    uint64_t version = streamBuffer_->getParameterSets(sps, pps);
+    if (sps.empty() || pps.empty()) return nullptr;
+
+    const uint8_t* spsData; size_t spsLen;
+    const uint8_t* ppsData; size_t ppsLen;
+    stripStartCode(sps, spsData, spsLen);
+    stripStartCode(pps, ppsData, ppsLen);
+
+    auto desc = std::make_shared<SdpDescription>();
+    desc->version = version;
+
+    // profile-level-id is the three bytes after the SPS NAL header.
+    char profileLevelId[7] = "42c01f";
+    if (spsLen >= 4) {
+        snprintf(profileLevelId, sizeof(profileLevelId), "%02x%02x%02x", spsData[1], spsData[2], spsData[3]);
+    }
+
+    std::string& sdp = desc->sdp;
+    sdp.reserve(256 + (spsLen + ppsLen) * 2);
+    sdp += "v=0\r\n";
+    sdp += "o=- 12345 " + std::to_string(version) + " IN IP4 0.0.0.0\r\n";
+    sdp += "s=Live H.264 Stream\r\n"
+           "c=IN IP4 0.0.0.0\r\n"
+           "t=0 0\r\n"
+           "m=video 0 RTP/AVP 96\r\n"
+           "a=rtpmap:96 H264/90000\r\n"
+           "a=fmtp:96 packetization-mode=1;profile-level-id=";
+    sdp += profileLevelId;
+    sdp += ";sprop-parameter-sets=";
+    sdp += base64_encode(spsData, spsLen);
+    sdp += ",";
+    sdp += base64_encode(ppsData, ppsLen);
+    sdp += ";\r\n"
+           "a=control:trackID=0\r\n";
+
+    desc->describeTail = "Content-Type: application/sdp\r\n"
+                         "Content-Length: " + std::to_string(sdp.size()) + "\r\n\r\n" + sdp;
+
+    LOG_INFO("[RTSP] SDP rendered for parameter set version {}", version);
+    return desc;
+}
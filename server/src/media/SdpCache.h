@@ -0,0 +1,32 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Rendered DESCRIBE payload for one stream.
+struct SdpDescription {
+    uint64_t version = 0;
+    std::string sdp;
+    // "Content-Type: ...\r\nContent-Length: N\r\n\r\n<sdp>", appended verbatim
+    // after the status line and CSeq of a DESCRIBE reply.
+    std::string describeTail;
+};
+
+// Caches the SDP of a stream, keyed on StreamBuffer::parameterSetVersion().
+// SPS/PPS are stripped and base64 encoded only when the camera actually sends
+// different parameter sets; every other DESCRIBE reuses the same bytes.
+class SdpCache {
+public:
+    explicit SdpCache(std::shared_ptr<StreamBuffer> streamBuffer);
+
+    // Returns nullptr while the stream has no SPS/PPS yet.
+    std::shared_ptr<const SdpDescription> get();
+
+private:
+    std::shared_ptr<const SdpDescription> render();
+
+    std::shared_ptr<StreamBuffer> streamBuffer_;
+    std::shared_ptr<const SdpDescription> cached_;
+    std::mutex mutex_;
+};
@@ -0,0 +1,189 @@
+#include "media/ShmOutput.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static constexpr int kPollMs = 500;
+
+static uint64_t roundUpPow2(uint64_t value) {
+    uint64_t out = 1;
+    while (out < value) out <<= 1;
+    return out;
+}
+
+ShmOutput::ShmOutput(std::string streamId, std::shared_ptr<StreamBuffer> buffer, ShmConfig config)
+    : streamId_(std::move(streamId)), name_(shm_stream::objectName(streamId_)), buffer_(std::move(buffer)),
+      config_(config) {
+    config_.arenaBytes = roundUpPow2(std::max<size_t>(config_.arenaBytes, 64 * 1024));
+    config_.descriptorCount = static_cast<uint32_t>(roundUpPow2(std::max<uint32_t>(config_.descriptorCount, 64)));
+}
+
+ShmOutput::~ShmOutput() {
+    stop();
+    if (!base_) return;
+    header_->closed.store(1, std::memory_order_release);
+    wake();
+    munmap(base_, mappedSize_);
+
+    // The stream may already have been re-created under the same name by a
+    // newer ShmOutput; only remove the object if it is still ours.
+    int fd = shm_open(name_.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd >= 0) {
+        struct stat st{};
+        bool ours = fstat(fd, &st) == 0 && st.st_ino == inode_;
+        close(fd);
+        if (ours) shm_unlink(name_.c_str());
+    }
+}
+
+bool ShmOutput::start() {
+    if (running_) return true;
+    if (!base_ && !create()) return false;
+
+    running_ = true;
+    reader_ = buffer_->subscribe();
+    thread_ = std::thread(&ShmOutput::outputLoop, this);
+    LOG_INFO("[SHM] {}: shared memory ring /dev/shm{} ({} KiB, {} NALUs)", streamId_, name_, config_.arenaBytes / 1024,
+             config_.descriptorCount);
+    return true;
+}
+
+void ShmOutput::stop() {
+    if (!running_) return;
+    running_ = false;
+    buffer_->unsubscribe(reader_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    reader_.reset();
+}
+
+bool ShmOutput::create() {
+    size_t descriptorsOffset = shm_stream::kHeaderSize;
+    size_t arenaOffset = descriptorsOffset + size_t(config_.descriptorCount) * shm_stream::kDescriptorSize;
+    size_t total = arenaOffset + config_.arenaBytes;
+
+    // A leftover from a server that didn't shut down cleanly is replaced;
+    // readers still mapping it keep their (dead) copy until they reopen.
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("[SHM] {}: shm_open {}: {}", streamId_, name_, strerror(errno));
+        return false;
+    }
+    struct stat st{};
+    if (ftruncate(fd, static_cast<off_t>(total)) != 0 || fstat(fd, &st) != 0) {
+        LOG_ERROR("[SHM] {}: ftruncate {}: {}", streamId_, name_, strerror(errno));
+        close(fd);
+        shm_unlink(name_.c_str());
+        return false;
+    }
+    void* base = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        LOG_ERROR("[SHM] {}: mmap {}: {}", streamId_, name_, strerror(errno));
+        shm_unlink(name_.c_str());
+        return false;
+    }
+    inode_ = st.st_ino;
+    base_ = static_cast<uint8_t*>(base);
+    mappedSize_ = total;
+
+    // ftruncate zero-fills, so every descriptor starts out with seq 0 and is
+    // only trusted once writeSeq has passed it.
+    header_ = new (base_) shm_stream::Header();
+    header_->version = shm_stream::kVersion;
+    header_->headerSize = static_cast<uint16_t>(shm_stream::kHeaderSize);
+    header_->descriptorCount = config_.descriptorCount;
+    header_->writerPid = static_cast<int32_t>(getpid());
+    header_->arenaSize = config_.arenaBytes;
+    header_->descriptorsOffset = descriptorsOffset;
+    header_->arenaOffset = arenaOffset;
+    descriptors_ = reinterpret_cast<shm_stream::Descriptor*>(base_ + descriptorsOffset);
+    arena_ = base_ + arenaOffset;
+    header_->magic.store(shm_stream::kMagic, std::memory_order_release);
+    return true;
+}
+
+void ShmOutput::outputLoop() {
+    while (running_) {
+        NaluPtr nalu = buffer_->pop(*reader_, kPollMs);
+        if (nalu && nalu->payloadSize() > 0) write(*nalu);
+    }
+}
+
+void ShmOutput::write(const Nalu& nalu) {
+    const uint64_t arenaSize = config_.arenaBytes;
+    const uint64_t size = nalu.data.size();
+    if (size > arenaSize) {
+        if (!tooLargeReported_) {
+            LOG_WARN("[SHM] {}: {} byte NALU does not fit the {} byte ring, skipped", streamId_, size, arenaSize);
+            tooLargeReported_ = true;
+        }
+        return;
+    }
+    if (nalu.isParameterSet()) setParameterSet(nalu);
+
+    // Keep every NALU contiguous: one that would wrap starts the next lap.
+    uint64_t pos = writePos_;
+    uint64_t index = pos & (arenaSize - 1);
+    if (index + size > arenaSize) pos += arenaSize - index;
+    uint64_t end = pos + size;
+
+    // Retire the bytes about to be overwritten before touching them, so a
+    // reader that sees new bytes also sees the new tail (ShmStreamProtocol.h).
+    if (end > arenaSize) {
+        header_->arenaTail.store(end - arenaSize, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+    memcpy(arena_ + (pos & (arenaSize - 1)), nalu.data.data(), size);
+    writePos_ = end;
+
+    shm_stream::Descriptor& d = descriptors_[seq_ & (config_.descriptorCount - 1)];
+    d.seq.store(shm_stream::kSeqWriting, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    d.offset = pos;
+    d.size = static_cast<uint32_t>(size);
+    d.type = nalu.type;
+    d.flags = (nalu.isKeyframe() || nalu.isParameterSet() ? shm_stream::kFlagKeyframe : 0) |
+              (nalu.hasFrameInfo ? shm_stream::kFlagFrameInfo : 0) |
+              (nalu.hasFrameInfo && nalu.accessUnitEnd ? shm_stream::kFlagAuEnd : 0);
+    d.startCodeLength = static_cast<uint8_t>(nalu.startCodeLength);
+    d.captureUs = nalu.captureUs;
+    d.receivedUs = nalu.receivedUs;
+    d.ingestSession = nalu.ingestSession;
+    d.seq.store(seq_, std::memory_order_release);
+
+    header_->writeSeq.store(++seq_, std::memory_order_release);
+    wake();
+}
+
+void ShmOutput::setParameterSet(const Nalu& nalu) {
+    if (nalu.data.size() > shm_stream::kMaxParameterSetSize) return;
+    uint64_t version = header_->paramSeq.load(std::memory_order_relaxed);
+    header_->paramSeq.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    if (nalu.type == 7) {
+        memcpy(header_->sps, nalu.data.data(), nalu.data.size());
+        header_->spsSize = static_cast<uint32_t>(nalu.data.size());
+    } else {
+        memcpy(header_->pps, nalu.data.data(), nalu.data.size());
+        header_->ppsSize = static_cast<uint32_t>(nalu.data.size());
+    }
+    header_->paramSeq.store(version + 2, std::memory_order_release);
+}
+
+void ShmOutput::wake() {
+    // Shared (not FUTEX_PRIVATE) so waiters in other processes match.
+    header_->notify.fetch_add(1, std::memory_order_release);
+    syscall(SYS_futex, &header_->notify, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
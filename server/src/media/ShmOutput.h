@@ -0,0 +1,60 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "ShmStreamProtocol.h"
+#include <sys/types.h>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+struct ShmConfig {
+    size_t arenaBytes = 16 * 1024 * 1024;  // rounded up to a power of two
+    uint32_t descriptorCount = 8192;       // NALUs the ring remembers
+};
+
+// Exposes one stream as a POSIX shared memory ring that local processes map
+// read-only with ShmStreamReader (layout in ShmStreamProtocol.h).
+//
+// Another StreamBuffer reader on its own thread, like TsOutput. Each NALU is
+// copied once into the arena and described in the descriptor ring; readers
+// follow the ring at their own pace without locks and without this thread
+// ever waiting for them. Sleeping readers are woken through a futex in the
+// header. The object is created when the stream is, replacing any leftover
+// of the same name, and unlinked with it.
+class ShmOutput {
+public:
+    ShmOutput(std::string streamId, std::shared_ptr<StreamBuffer> buffer, ShmConfig config);
+    ~ShmOutput();
+
+    // Returns false if the shared memory object can't be created.
+    bool start();
+    void stop();
+
+private:
+    bool create();
+    void outputLoop();
+    void write(const Nalu& nalu);
+    void setParameterSet(const Nalu& nalu);
+    void wake();
+
+    const std::string streamId_;
+    const std::string name_;
+    std::shared_ptr<StreamBuffer> buffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
+    ShmConfig config_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    uint8_t* base_ = nullptr;
+    size_t mappedSize_ = 0;
+    ino_t inode_ = 0;
+    shm_stream::Header* header_ = nullptr;
+    shm_stream::Descriptor* descriptors_ = nullptr;
+    uint8_t* arena_ = nullptr;
+
+    // Output thread only.
+    uint64_t seq_ = 0;
+    uint64_t writePos_ = 0;         // arena position of the next NALU
+    bool tooLargeReported_ = false;
+};
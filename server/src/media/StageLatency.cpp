@@ -0,0 +1,32 @@
+#include "media/StageLatency.h"
+#include "utils/Log.h"
+
+static const char* const kStageNames[StageLatency::kStageCount] = {
+    "publish", "queue", "packetize", "send", "total",
+};
+
+StageLatency::StageLatency(std::string streamId) : streamId_(std::move(streamId)) {
+    for (int i = 0; i < kStageCount; i++) {
+        stages_[i] = metrics::Registry::instance().logHistogram(
+            "rtsp_latency_seconds", "Time NALUs spend in each stage from ingest to the RTP socket, per viewer.",
+            1e-6, {{"stream", streamId_}, {"stage", kStageNames[i]}});
+    }
+}
+
+void StageLatency::logSummary() {
+    std::lock_guard<std::mutex> lock(summaryMutex_);
+    metrics::LogHistogram::Snapshot now[kStageCount];
+    for (int i = 0; i < kStageCount; i++) now[i] = stages_[i]->snapshot();
+    metrics::LogHistogram::Snapshot total = now[Total].since(lastSummary_[Total]);
+    uint64_t count = total.total();
+    if (count > 0) {
+        // A line per stage: the records hold a bounded amount of arguments.
+        LOG_INFO("[Latency] {}: {} NALUs, p50/p99/p999 us", streamId_, count);
+        for (int i = 0; i < kStageCount; i++) {
+            metrics::LogHistogram::Snapshot delta = now[i].since(lastSummary_[i]);
+            LOG_INFO("[Latency] {}:   {} {}/{}/{}", streamId_, kStageNames[i], delta.percentile(0.5),
+                     delta.percentile(0.99), delta.percentile(0.999));
+        }
+    }
+    for (int i = 0; i < kStageCount; i++) lastSummary_[i] = std::move(now[i]);
+}
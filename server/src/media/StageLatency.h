@@ -0,0 +1,53 @@
+#pragma once
+#include "media/Nalu.h"
+#include "utils/Metrics.h"
+#include <memory>
+#include <string>
+#include <mutex>
+#include <cstdint>
+
+// Where the time goes between a NALU arriving and its last RTP packet
+// leaving, for one stream. Each NALU is stamped at
+//
+//   ingest      Stream::publish takes it in            (Nalu::receivedUs)
+//   enqueue     just before StreamBuffer::push          (Nalu::enqueuedUs)
+//   dequeue     an RtpSender's pop() returns it
+//   packetize   the sender has queued its last packet
+//   send        the last packet's send has completed
+//
+// and every viewer's RtpSender records the deltas: "publish" (ingest to
+// enqueue), "queue" (enqueue to dequeue), "packetize", "send" and "total"
+// (ingest to send). With the epoll engine each packet is sendto()'d as it is
+// built, so "packetize" includes the syscalls and "send" is close to zero;
+// with io_uring "send" is the batch submission and its completions.
+//
+// Deltas go into log-linear histograms (metrics::LogHistogram) exported as
+// rtsp_latency_seconds{stream,stage}; logSummary() prints the percentiles
+// of the interval since its previous call. Recording costs three clock
+// reads and ten relaxed atomic adds (a bucket and the sum for each of the
+// five stages) per NALU per viewer.
+class StageLatency {
+public:
+    enum Stage { Publish, Queue, Packetize, Send, Total, kStageCount };
+
+    explicit StageLatency(std::string streamId);
+
+    void record(const Nalu& nalu, uint64_t dequeuedUs, uint64_t packetizedUs, uint64_t sentUs) {
+        stages_[Publish]->observe(nalu.enqueuedUs - nalu.receivedUs);
+        stages_[Queue]->observe(dequeuedUs - nalu.enqueuedUs);
+        stages_[Packetize]->observe(packetizedUs - dequeuedUs);
+        stages_[Send]->observe(sentUs - packetizedUs);
+        stages_[Total]->observe(sentUs - nalu.receivedUs);
+    }
+
+    // p50/p99/p999 of every stage over the NALUs recorded since the last
+    // call, one line per stage under a header line; nothing if there were
+    // none.
+    void logSummary();
+
+private:
+    const std::string streamId_;
+    std::shared_ptr<metrics::LogHistogram> stages_[kStageCount];
+    std::mutex summaryMutex_;
+    metrics::LogHistogram::Snapshot lastSummary_[kStageCount];
+};
@@ -1,40 +1,177 @@
 #include "media/StreamBuffer.h"
+#include <algorithm>
+#include <chrono>
 
-void StreamBuffer::push(std::vector<uint8_t>&& nalu) {
+StreamBuffer::StreamBuffer(size_t capacity) : ring_(capacity) {}
+
+void StreamBuffer::push(std::vector<uint8_t>&& data) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data = std::move(data);
+    classifyNalu(*nalu);
+    push(NaluPtr(std::move(nalu)));
+}
+
+void StreamBuffer::push(NaluPtr nalu) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t seq = nextSeq_++;
+
+    // A random access point is the SPS/PPS run directly in front of an IDR
+    // (or the IDR itself if the camera didn't repeat the parameter sets).
+    if (nalu->isParameterSet()) {
+        if (!pendingRap_) {
+            pendingRap_ = true;
+            pendingRapSeq_ = seq;
+        }
+    } else if (nalu->isKeyframe()) {
+        randomAccessSeq_ = pendingRap_ ? pendingRapSeq_ : seq;
+        hasRandomAccess_ = true;
+        pendingRap_ = false;
+    } else if (nalu->isVcl()) {
+        pendingRap_ = false;
+    }
+
+    ring_[seq % ring_.size()] = std::move(nalu);
+    cv_.notify_all(); // 데이터가 추가되었음을 알림
+}
+
+std::shared_ptr<StreamBuffer::Reader> StreamBuffer::subscribe() {
+    auto reader = std::make_shared<Reader>();
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool rapInRing = hasRandomAccess_ && nextSeq_ - randomAccessSeq_ <= ring_.size();
+    reader->next_ = rapInRing ? randomAccessSeq_ : nextSeq_;
+    subscribers_++;
+    readers_.push_back(reader);
+    return reader;
+}
+
+std::shared_ptr<StreamBuffer::Reader> StreamBuffer::subscribeAt(uint64_t receivedUs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t oldest = nextSeq_ > ring_.size() ? nextSeq_ - ring_.size() : 0;
+    for (uint64_t seq = nextSeq_; seq-- > oldest;) {
+        const NaluPtr& nalu = ring_[seq % ring_.size()];
+        if (!nalu || !nalu->isKeyframe() || nalu->receivedUs > receivedUs) continue;
+        // Back up to the first slice of the IDR and the parameter sets sent
+        // in front of it.
+        uint64_t start = seq;
+        while (start > oldest) {
+            const NaluPtr& prev = ring_[(start - 1) % ring_.size()];
+            if (!prev || !(prev->isKeyframe() || prev->isParameterSet())) break;
+            start--;
+        }
+        auto reader = std::make_shared<Reader>();
+        reader->next_ = start;
+        subscribers_++;
+        readers_.push_back(reader);
+        return reader;
+    }
+    return nullptr;
+}
+
+void StreamBuffer::unsubscribe(const std::shared_ptr<Reader>& reader) {
+    if (!reader) return;
+    close(*reader);
+    std::lock_guard<std::mutex> lock(mutex_);
+    subscribers_--;
+    for (auto it = readers_.begin(); it != readers_.end(); ++it) {
+        if (it->lock() == reader) {
+            readers_.erase(it);
+            break;
+        }
+    }
+}
+
+size_t StreamBuffer::subscriberCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return subscribers_;
+}
+
+StreamBuffer::Stats StreamBuffer::stats() {
     std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.push_back(std::move(nalu));
-    cv_.notify_one(); // 데이터가 추가되었음을 알림
+    Stats stats;
+    stats.subscribers = subscribers_;
+    stats.dropped = dropped_;
+    for (auto it = readers_.begin(); it != readers_.end();) {
+        std::shared_ptr<Reader> reader = it->lock();
+        if (!reader) {
+            it = readers_.erase(it);
+            continue;
+        }
+        uint64_t behind = nextSeq_ > reader->next_ ? nextSeq_ - reader->next_ : 0;
+        stats.backlog = std::max<uint64_t>(stats.backlog, std::min<uint64_t>(behind, ring_.size()));
+        ++it;
+    }
+    return stats;
 }
 
-std::vector<uint8_t> StreamBuffer::pop() {
+NaluPtr StreamBuffer::pop(Reader& reader, int timeoutMs) {
     std::unique_lock<std::mutex> lock(mutex_);
-    // 버퍼가 비어있으면 데이터가 들어올 때까지 대기
-    cv_.wait(lock, [this] { return !buffer_.empty(); });
+    auto ready = [&] { return reader.closed_ || reader.next_ < nextSeq_; };
+    while (true) {
+        // 읽을 데이터가 없으면 새 데이터가 들어올 때까지 대기
+        if (timeoutMs < 0) {
+            cv_.wait(lock, ready);
+        } else if (!cv_.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready)) {
+            return nullptr;
+        }
+        if (reader.closed_) return nullptr;
 
-    std::vector<uint8_t> nalu = std::move(buffer_.front());
-    buffer_.pop_front();
-    return nalu;
+        if (nextSeq_ - reader.next_ > ring_.size()) {
+            // Overrun: the slot we wanted was already overwritten. Skip ahead
+            // to the newest random access point so the decoder resyncs cleanly.
+            uint64_t target = nextSeq_ - 1;
+            if (hasRandomAccess_ && nextSeq_ - randomAccessSeq_ <= ring_.size()) {
+                target = randomAccessSeq_;
+            }
+            reader.dropped_ += target - reader.next_;
+            dropped_ += target - reader.next_;
+            reader.next_ = target;
+        }
+
+        NaluPtr nalu = ring_[reader.next_++ % ring_.size()];
+        if (nalu) return nalu; // empty slots only exist after clear()
+    }
+}
+
+void StreamBuffer::close(Reader& reader) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    reader.closed_ = true;
+    cv_.notify_all();
 }
 
 void StreamBuffer::clear() {
     std::lock_guard<std::mutex> lock(mutex_);
-    buffer_.clear();
+    for (auto& slot : ring_) slot.reset();
+    hasRandomAccess_ = false;
+    pendingRap_ = false;
 
     std::lock_guard<std::mutex> sps_lock(sps_pps_mutex_);
     sps_.clear();
     pps_.clear();
+    parameterSetVersion_++;
 }
 
 // --- New implementations ---
 
-void StreamBuffer::setSps(const std::vector<uint8_t>& sps) {
-    std::lock_guard<std::mutex> lock(sps_pps_mutex_);
-    sps_ = sps;
+bool StreamBuffer::setSps(const std::vector<uint8_t>& sps) {
+    {
+        std::lock_guard<std::mutex> lock(sps_pps_mutex_);
+        if (sps_ == sps) return false; // cameras repeat SPS before every IDR
+        sps_ = sps;
+        parameterSetVersion_++;
+    }
+    notifyParameterSets();
+    return true;
 }
 
-void StreamBuffer::setPps(const std::vector<uint8_t>& pps) {
-    std::lock_guard<std::mutex> lock(sps_pps_mutex_);
-    pps_ = pps;
+bool StreamBuffer::setPps(const std::vector<uint8_t>& pps) {
+    {
+        std::lock_guard<std::mutex> lock(sps_pps_mutex_);
+        if (pps_ == pps) return false;
+        pps_ = pps;
+        parameterSetVersion_++;
+    }
+    notifyParameterSets();
+    return true;
 }
 
 std::vector<uint8_t> StreamBuffer::getSps() {
@@ -51,3 +188,42 @@ bool StreamBuffer::hasSpsPps() {
     std::lock_guard<std::mutex> lock(sps_pps_mutex_);
     return !sps_.empty() && !pps_.empty();
 }
+
+uint64_t StreamBuffer::parameterSetVersion() {
+    std::lock_guard<std::mutex> lock(sps_pps_mutex_);
+    return parameterSetVersion_;
+}
+
+uint64_t StreamBuffer::getParameterSets(std::vector<uint8_t>& sps, std::vector<uint8_t>& pps) {
+    std::lock_guard<std::mutex> lock(sps_pps_mutex_);
+    sps = sps_;
+    pps = pps_;
+    return parameterSetVersion_;
+}
+
+int StreamBuffer::addParameterSetListener(ParameterSetListener listener) {
+    std::lock_guard<std::mutex> lock(listener_mutex_);
+    int id = nextListenerId_++;
+    listeners_.emplace_back(id, std::move(listener));
+    return id;
+}
+
+void StreamBuffer::removeParameterSetListener(int id) {
+    std::lock_guard<std::mutex> lock(listener_mutex_);
+    for (auto it = listeners_.begin(); it != listeners_.end(); ++it) {
+        if (it->first == id) {
+            listeners_.erase(it);
+            return;
+        }
+    }
+}
+
+void StreamBuffer::notifyParameterSets() {
+    if (!hasSpsPps()) return;
+
+    // 리스너는 eventfd write 정도의 가벼운 작업만 하므로 lock을 잡은 채 호출한다.
+    std::lock_guard<std::mutex> lock(listener_mutex_);
+    for (auto& entry : listeners_) {
+        entry.second();
+    }
+}
@@ -1,30 +1,109 @@
 #pragma once
+#include "media/Nalu.h"
 #include <vector>
-#include <list>
 #include <mutex>
 #include <condition_variable>
 #include <cstdint>
+#include <functional>
+#include <atomic>
 
+// Single-producer, multi-consumer NALU fan-out for one stream.
+//
+// The ingest side push()es NAL units into a bounded ring. Each consumer
+// (RtpSender, later recorders/muxers) owns a Reader with its own cursor, so
+// every consumer sees every NALU and a slow one never blocks the producer or
+// the others: when a reader falls more than a ring's worth behind, it is
+// moved forward to the newest random access point (SPS/PPS + IDR) and its
+// drop counter is bumped.
 class StreamBuffer {
 public:
+    class Reader {
+    public:
+        uint64_t dropped() const { return dropped_; }
+    private:
+        friend class StreamBuffer;
+        uint64_t next_ = 0;
+        uint64_t dropped_ = 0;
+        std::atomic<bool> closed_{false};
+    };
+
+    explicit StreamBuffer(size_t capacity = 512);
+
     void push(std::vector<uint8_t>&& nalu);
-    std::vector<uint8_t> pop();
+    void push(NaluPtr nalu);
+
+    // Readers start at the most recent random access point so a new viewer
+    // can decode immediately.
+    std::shared_ptr<Reader> subscribe();
+    // Timeshift: a reader starting at the newest random access point that
+    // arrived (Nalu::receivedUs) at or before receivedUs. nullptr, and not
+    // subscribed, if the ring no longer reaches that far back.
+    std::shared_ptr<Reader> subscribeAt(uint64_t receivedUs);
+    void unsubscribe(const std::shared_ptr<Reader>& reader);
+    size_t subscriberCount();
+
+    // For monitoring: how far the slowest reader is behind the producer, in
+    // NALUs (at most the capacity), and how many NALUs readers have skipped
+    // on overrun since the buffer was created.
+    struct Stats {
+        size_t subscribers = 0;
+        uint64_t backlog = 0;
+        uint64_t dropped = 0;
+    };
+    Stats stats();
+
+    // Blocks until the reader has a NALU, or for at most timeoutMs when it is
+    // not negative. Returns nullptr on timeout and once close(reader) has
+    // been called.
+    NaluPtr pop(Reader& reader, int timeoutMs = -1);
+    // Wakes a blocked pop() on this reader and makes it return nullptr.
+    void close(Reader& reader);
+
     void clear();
 
     // New methods for SPS/PPS
-    void setSps(const std::vector<uint8_t>& sps);
-    void setPps(const std::vector<uint8_t>& pps);
+    // Return true if the content differs from what was stored.
+    bool setSps(const std::vector<uint8_t>& sps);
+    bool setPps(const std::vector<uint8_t>& pps);
     std::vector<uint8_t> getSps();
     std::vector<uint8_t> getPps();
     bool hasSpsPps();
 
+    // Bumped every time the SPS or PPS content changes. Consumers that derive
+    // data from the parameter sets (e.g. the SDP) cache against this value.
+    uint64_t parameterSetVersion();
+    // Consistent snapshot of both parameter sets and their version.
+    uint64_t getParameterSets(std::vector<uint8_t>& sps, std::vector<uint8_t>& pps);
+
+    // Called (from the ingest thread) whenever a complete SPS/PPS pair is published.
+    // Listeners must be cheap and non-blocking, e.g. writing to an eventfd.
+    using ParameterSetListener = std::function<void()>;
+    int addParameterSetListener(ParameterSetListener listener);
+    void removeParameterSetListener(int id);
+
 private:
-    std::list<std::vector<uint8_t>> buffer_;
+    std::vector<NaluPtr> ring_;
+    uint64_t nextSeq_ = 0;        // sequence number the next push gets
+    uint64_t randomAccessSeq_ = 0;
+    bool hasRandomAccess_ = false;
+    uint64_t pendingRapSeq_ = 0;  // first parameter set since the last VCL NALU
+    bool pendingRap_ = false;
+    size_t subscribers_ = 0;
+    uint64_t dropped_ = 0;
+    // Subscribed readers, for stats(); expired entries are pruned there.
+    std::vector<std::weak_ptr<Reader>> readers_;
     std::mutex mutex_;
     std::condition_variable cv_;
 
     // New members for SPS/PPS
     std::vector<uint8_t> sps_;
     std::vector<uint8_t> pps_;
+    uint64_t parameterSetVersion_ = 0;
     std::mutex sps_pps_mutex_; // Separate mutex for SPS/PPS
+
+    void notifyParameterSets();
+
+    std::vector<std::pair<int, ParameterSetListener>> listeners_;
+    int nextListenerId_ = 0;
+    std::mutex listener_mutex_;
 };
@@ -0,0 +1,362 @@
+#include "media/StreamRecorder.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static constexpr size_t kChunkSize = 1 << 20;
+static constexpr size_t kAlignment = 4096;     // O_DIRECT offset/length granularity
+static constexpr int kPollMs = 500;
+static constexpr int64_t kIdleCloseMs = 5000;
+static constexpr size_t kMaxFragmentUnits = 300;
+static const uint8_t kStartCode[4] = {0x00, 0x00, 0x00, 0x01};
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t systemNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+StreamRecorder::StreamRecorder(std::string streamId, std::shared_ptr<StreamBuffer> buffer, RecorderConfig config)
+    : streamId_(std::move(streamId)), buffer_(std::move(buffer)), config_(std::move(config)) {
+    void* chunk = nullptr;
+    if (posix_memalign(&chunk, kAlignment, kChunkSize) == 0) {
+        chunk_ = static_cast<uint8_t*>(chunk);
+    }
+}
+
+StreamRecorder::~StreamRecorder() {
+    stop();
+    free(chunk_);
+}
+
+void StreamRecorder::start() {
+    if (running_ || !chunk_) return;
+    running_ = true;
+    reader_ = buffer_->subscribe();
+    thread_ = std::thread(&StreamRecorder::recordLoop, this);
+}
+
+void StreamRecorder::stop() {
+    if (!running_) return;
+    running_ = false;
+    buffer_->unsubscribe(reader_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    reader_.reset();
+}
+
+void StreamRecorder::recordLoop() {
+    while (running_) {
+        NaluPtr nalu = buffer_->pop(*reader_, kPollMs);
+        if (nalu) {
+            if (nalu->payloadSize() > 0) handle(nalu);
+            continue;
+        }
+        // The publisher went away (or is between reconnects): finish the
+        // file rather than holding its tail in memory.
+        if (fd_ >= 0 && steadyNowMs() - lastDataMs_ >= kIdleCloseMs) {
+            closeFile();
+        }
+    }
+    closeFile();
+}
+
+void StreamRecorder::handle(const NaluPtr& nalu) {
+    int64_t now = steadyNowMs();
+    lastDataMs_ = now;
+
+    // A new publisher may come with a different resolution or encoder
+    // settings; give it its own file.
+    if (haveSession_ && nalu->ingestSession != ingestSession_) {
+        closeFile();
+        pendingSets_.clear();
+        units_.reset();
+        lastSps_.reset();
+        lastPps_.reset();
+        lastUnitUs_ = 0;    // its capture clock starts over too
+    }
+    ingestSession_ = nalu->ingestSession;
+    haveSession_ = true;
+
+    if (config_.format == RecordFormat::Mp4) {
+        handleMp4(nalu, now);
+    } else {
+        handleAnnexB(nalu, now);
+    }
+}
+
+bool StreamRecorder::segmentFull(int64_t now) const {
+    return (config_.segmentSec > 0 && now - fileStartMs_ >= config_.segmentSec * 1000LL) ||
+           (config_.segmentBytes > 0 && fileBytes_ + static_cast<int64_t>(chunkUsed_) >= config_.segmentBytes);
+}
+
+void StreamRecorder::handleAnnexB(const NaluPtr& nalu, int64_t now) {
+    // Parameter sets are held back until we know whether an IDR follows,
+    // since a new file may have to start in front of them.
+    if (nalu->isParameterSet()) {
+        pendingSets_.push_back(nalu);
+        return;
+    }
+
+    if (nalu->isKeyframe()) {
+        if (fd_ >= 0 && segmentFull(now)) {
+            closeFile();
+        }
+        if (fd_ < 0) {
+            if (!openFile()) {
+                pendingSets_.clear();
+                return;
+            }
+            if (pendingSets_.empty()) {
+                // The camera doesn't repeat SPS/PPS before every IDR; use the
+                // stored ones so the file still decodes on its own.
+                std::vector<uint8_t> sets[2];
+                buffer_->getParameterSets(sets[0], sets[1]);
+                for (std::vector<uint8_t>& set : sets) {
+                    Nalu ps;
+                    ps.data = std::move(set);
+                    classifyNalu(ps);
+                    if (ps.payloadSize() > 0) appendNalu(ps);
+                }
+            }
+        }
+    } else if (fd_ < 0) {
+        // Not recording until the next IDR.
+        pendingSets_.clear();
+        return;
+    }
+
+    for (const NaluPtr& set : pendingSets_) {
+        appendNalu(*set);
+    }
+    pendingSets_.clear();
+    appendNalu(*nalu);
+}
+
+void StreamRecorder::handleMp4(const NaluPtr& nalu, int64_t now) {
+    if (nalu->type == 7) lastSps_ = nalu;
+    if (nalu->type == 8) lastPps_ = nalu;
+
+    AccessUnit unit;
+    if (!units_.push(nalu, unit)) return;
+
+    // Decode times must increase; a camera clock step must not make a
+    // sample run backwards.
+    if (lastUnitUs_ != 0 && unit.timeUs <= lastUnitUs_) {
+        unit.timeUs = lastUnitUs_ + frameUs_;
+    } else if (lastUnitUs_ != 0 && unit.timeUs - lastUnitUs_ < 1000000) {
+        frameUs_ = unit.timeUs - lastUnitUs_;
+    }
+    lastUnitUs_ = unit.timeUs;
+
+    if (unit.keyframe) {
+        flushFragment(unit.timeUs);
+        if (fd_ >= 0) {
+            // New SPS/PPS need a new init segment, hence a new file.
+            bool setsChanged =
+                (lastSps_ && !std::equal(fileSps_.begin(), fileSps_.end(), lastSps_->payload(),
+                                         lastSps_->payload() + lastSps_->payloadSize())) ||
+                (lastPps_ && !std::equal(filePps_.begin(), filePps_.end(), lastPps_->payload(),
+                                         lastPps_->payload() + lastPps_->payloadSize()));
+            if (setsChanged || segmentFull(now)) closeFile();
+        }
+        if (fd_ < 0) {
+            if (!prepareMp4() || !openFile()) return;
+            muxer_.setTimelineOrigin(unit.timeUs);
+            append(muxer_.initSegment().data(), muxer_.initSegment().size());
+            if (!index_.open(path_ + ".idx", Mp4Muxer::kTimescale)) {
+                LOG_ERROR("[REC] {}: cannot create {}.idx: {}", streamId_, path_, strerror(errno));
+            }
+        }
+    } else if (fd_ < 0) {
+        // Not recording until the next IDR.
+        return;
+    }
+
+    fragment_.push_back(std::move(unit));
+    // An encoder with a very long GOP (or none) still gets bounded fragments;
+    // only the ones starting at a keyframe go into the index.
+    if (fragment_.size() >= kMaxFragmentUnits) {
+        flushFragment(lastUnitUs_ + frameUs_);
+    }
+}
+
+bool StreamRecorder::prepareMp4() {
+    // The sets last seen in the stream belong to this IDR; the buffer's copy
+    // may already be a newer publisher's if we're behind.
+    fileSps_.clear();
+    filePps_.clear();
+    if (lastSps_ && lastPps_) {
+        fileSps_.assign(lastSps_->payload(), lastSps_->payload() + lastSps_->payloadSize());
+        filePps_.assign(lastPps_->payload(), lastPps_->payload() + lastPps_->payloadSize());
+    } else {
+        Nalu sets[2];
+        buffer_->getParameterSets(sets[0].data, sets[1].data);
+        for (Nalu& set : sets) classifyNalu(set);
+        fileSps_.assign(sets[0].payload(), sets[0].payload() + sets[0].payloadSize());
+        filePps_.assign(sets[1].payload(), sets[1].payload() + sets[1].payloadSize());
+    }
+
+    if (!muxer_.init(fileSps_.data(), fileSps_.size(), filePps_.data(), filePps_.size())) {
+        if (!openFailed_) {
+            LOG_WARN("[REC] {}: no usable SPS/PPS yet, not recording", streamId_);
+        }
+        openFailed_ = true;
+        return false;
+    }
+    return true;
+}
+
+void StreamRecorder::flushFragment(uint64_t endUs) {
+    if (fragment_.empty()) return;
+    if (fd_ >= 0) {
+        const AccessUnit& first = fragment_.front();
+        uint64_t offset = fileBytes_ + chunkUsed_;
+        muxer_.writeFragment(fragment_.data(), fragment_.size(), endUs,
+                             [this](const uint8_t* data, size_t size) { append(data, size); });
+        // Hand each GOP to the kernel right away (one write per GOP) so
+        // timeshift playback can read it; the index entry follows the data.
+        writeOut(false);
+        if (first.keyframe && fd_ >= 0) {
+            KeyframeEntry entry;
+            entry.dts = muxer_.toTicks(first.timeUs);
+            entry.utcUs = systemNowUs() - (steadyNowUs() - static_cast<int64_t>(first.receivedUs));
+            entry.offset = offset;
+            index_.append(entry);
+        }
+    }
+    fragment_.clear();
+}
+
+bool StreamRecorder::openFile() {
+    std::string dir = config_.dir + "/" + streamId_;
+    mkdir(config_.dir.c_str(), 0755);
+    mkdir(dir.c_str(), 0755);
+
+    char stamp[32];
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+    std::string base = dir + "/" + streamId_ + "-" + stamp;
+
+    int flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+    for (int attempt = 0; attempt < 100; attempt++) {
+        // Two files in one second (a reconnect right after a cut) get a suffix.
+        path_ = base + (attempt ? "-" + std::to_string(attempt) : "") +
+                (config_.format == RecordFormat::Mp4 ? ".mp4" : ".h264");
+        directIo_ = config_.directIo;
+        fd_ = open(path_.c_str(), flags | (directIo_ ? O_DIRECT : 0), 0644);
+        if (fd_ < 0 && directIo_ && errno == EINVAL) {
+            // tmpfs and some network filesystems refuse O_DIRECT.
+            directIo_ = false;
+            fd_ = open(path_.c_str(), flags, 0644);
+        }
+        if (fd_ >= 0 || errno != EEXIST) break;
+    }
+    if (fd_ < 0) {
+        if (!openFailed_) {
+            LOG_ERROR("[REC] {}: cannot create {}: {}", streamId_, path_, strerror(errno));
+        }
+        openFailed_ = true;
+        return false;
+    }
+    openFailed_ = false;
+    fileStartMs_ = steadyNowMs();
+    fileBytes_ = 0;
+    chunkUsed_ = 0;
+    LOG_INFO("[REC] {}: recording to {}{}", streamId_, path_, directIo_ ? " (O_DIRECT)" : "");
+    return true;
+}
+
+void StreamRecorder::closeFile() {
+    if (fd_ < 0) {
+        fragment_.clear();
+        return;
+    }
+    // The last GOP has no following IDR to end it.
+    flushFragment(lastUnitUs_ + frameUs_);
+    index_.close();
+    writeOut(true);
+    if (fd_ < 0) return;    // the final write failed and already closed it
+    close(fd_);
+    fd_ = -1;
+
+    uint64_t dropped = reader_ ? reader_->dropped() : 0;
+    if (dropped > droppedReported_) {
+        LOG_WARN("[REC] {}: closed {} ({} bytes, {} NALUs skipped by a slow disk)", streamId_, path_, fileBytes_,
+                 dropped - droppedReported_);
+        droppedReported_ = dropped;
+    } else {
+        LOG_INFO("[REC] {}: closed {} ({} bytes)", streamId_, path_, fileBytes_);
+    }
+}
+
+void StreamRecorder::appendNalu(const Nalu& nalu) {
+    // Files are normalized to 4-byte start codes whatever the camera sent.
+    append(kStartCode, sizeof(kStartCode));
+    append(nalu.payload(), nalu.payloadSize());
+}
+
+void StreamRecorder::append(const uint8_t* data, size_t size) {
+    while (size > 0 && fd_ >= 0) {
+        size_t n = std::min(size, kChunkSize - chunkUsed_);
+        memcpy(chunk_ + chunkUsed_, data, n);
+        chunkUsed_ += n;
+        data += n;
+        size -= n;
+        if (chunkUsed_ == kChunkSize) writeOut(false);
+    }
+}
+
+bool StreamRecorder::writeOut(bool final) {
+    size_t length = chunkUsed_;
+    if (directIo_ && length % kAlignment != 0) {
+        if (!final) {
+            // Keep the unaligned tail for the next chunk.
+            length -= length % kAlignment;
+        } else {
+            // The last block of a file is the only short one; write it
+            // through the page cache.
+            fcntl(fd_, F_SETFL, fcntl(fd_, F_GETFL) & ~O_DIRECT);
+            directIo_ = false;
+        }
+    }
+
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = write(fd_, chunk_ + done, length - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            LOG_ERROR("[REC] {}: write to {} failed: {}, file closed", streamId_, path_,
+                      (n < 0 ? strerror(errno) : "no space"));
+            close(fd_);
+            fd_ = -1;
+            chunkUsed_ = 0;
+            return false;
+        }
+        done += n;
+    }
+    memmove(chunk_, chunk_ + length, chunkUsed_ - length);
+    chunkUsed_ -= length;
+    fileBytes_ += length;
+    bytesWritten_ += length;
+    return true;
+}
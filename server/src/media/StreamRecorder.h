@@ -0,0 +1,104 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/AccessUnit.h"
+#include "media/Mp4Muxer.h"
+#include "media/KeyframeIndex.h"
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+enum class RecordFormat {
+    Mp4,    // fragmented MP4 plus a keyframe index
+    AnnexB  // raw .h264
+};
+
+struct RecorderConfig {
+    std::string dir;            // empty disables recording
+    RecordFormat format = RecordFormat::Mp4;
+    int segmentSec = 60;        // start a new file after this long (0: never)
+    int64_t segmentBytes = 0;   // ... or once a file reaches this size (0: no limit)
+    bool directIo = false;      // O_DIRECT, where the filesystem allows it
+};
+
+// Records one stream to <dir>/<id>/<id>-YYYYmmdd-HHMMSS.mp4 (or .h264).
+//
+// The recorder is just another StreamBuffer reader with its own thread, so
+// the disk never sits on the ingest or send path: if writes stall, this
+// reader falls behind and the buffer moves it forward to the next random
+// access point like any slow viewer, and the file gets a gap instead of the
+// viewers getting one.
+//
+// MP4 files are fragmented: the NALUs are grouped into access units and
+// each GOP is written as one moof/mdat fragment when the next IDR arrives,
+// with a KeyframeIndex entry (<file>.idx) pointing at it. A file that was
+// cut off still plays up to its last complete fragment. Annex B files get
+// the NALUs as they come.
+//
+// Bytes are gathered in a page-aligned buffer and written in chunks of up
+// to 1 MiB (MP4: at least once per GOP, so TimeshiftReader can follow the
+// file); that copy out of the shared NALUs is the only one. Files are cut only in
+// front of an IDR (with the parameter sets first or in the init segment),
+// so every file decodes on its own. A new publisher on the stream, changed
+// parameter sets (MP4) and a few seconds without data also close the
+// current file.
+class StreamRecorder {
+public:
+    StreamRecorder(std::string streamId, std::shared_ptr<StreamBuffer> buffer, RecorderConfig config);
+    ~StreamRecorder();
+
+    void start();
+    // Flushes and closes the current file. Blocks for at most one write.
+    void stop();
+
+    uint64_t bytesWritten() const { return bytesWritten_; }
+
+private:
+    void recordLoop();
+    void handle(const NaluPtr& nalu);
+    void handleAnnexB(const NaluPtr& nalu, int64_t now);
+    void handleMp4(const NaluPtr& nalu, int64_t now);
+    bool segmentFull(int64_t now) const;
+    bool prepareMp4();
+    void flushFragment(uint64_t endUs);
+    bool openFile();
+    void closeFile();
+    void append(const uint8_t* data, size_t size);
+    void appendNalu(const Nalu& nalu);
+    bool writeOut(bool final);
+
+    const std::string streamId_;
+    std::shared_ptr<StreamBuffer> buffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
+    const RecorderConfig config_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    int fd_ = -1;
+    bool directIo_ = false;     // O_DIRECT actually in effect for fd_
+    bool openFailed_ = false;   // reported once until a file opens again
+    uint64_t droppedReported_ = 0;
+    std::string path_;
+    int64_t fileStartMs_ = 0;
+    int64_t fileBytes_ = 0;
+    int64_t lastDataMs_ = 0;
+    uint8_t* chunk_ = nullptr;  // page-aligned staging buffer
+    size_t chunkUsed_ = 0;
+
+    std::vector<NaluPtr> pendingSets_;  // SPS/PPS waiting to see what follows
+
+    // MP4 only
+    Mp4Muxer muxer_;
+    KeyframeIndexWriter index_;
+    AccessUnitBuilder units_;
+    std::vector<AccessUnit> fragment_;  // the GOP being collected
+    NaluPtr lastSps_, lastPps_;         // as seen in the stream
+    std::vector<uint8_t> fileSps_, filePps_;
+    uint64_t lastUnitUs_ = 0;
+    uint64_t frameUs_ = 33333;          // last frame interval, for the final sample
+    uint32_t ingestSession_ = 0;
+    bool haveSession_ = false;
+    std::atomic<uint64_t> bytesWritten_{0};
+};
@@ -0,0 +1,319 @@
+#include "media/StreamRegistry.h"
+#include "utils/Log.h"
+#include <mutex>
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Stream::Stream(std::string streamId)
+    : id(std::move(streamId)),
+      buffer(std::make_shared<StreamBuffer>()),
+      sdp(std::make_shared<SdpCache>(buffer)),
+      ingestBytes(metrics::Registry::instance().counter(
+          "rtsp_ingest_bytes_total", "NALU bytes received from publishers, start codes included.", {{"stream", id}})),
+      ingestNalus(metrics::Registry::instance().counter(
+          "rtsp_ingest_nalus_total", "NALUs received from publishers.", {{"stream", id}})),
+      ingestFrames(metrics::Registry::instance().counter(
+          "rtsp_ingest_frames_total", "Pictures received from publishers.", {{"stream", id}})),
+      latency(std::make_shared<StageLatency>(id)) {
+    touch();
+}
+
+void Stream::exportMetrics() {
+    metrics::Registry& registry = metrics::Registry::instance();
+    metrics::Labels labels = {{"stream", id}};
+    metricHandles_.push_back(registry.gaugeCallback(
+        "rtsp_ingest_fps", "Pictures received per second, over the last whole second.", labels, [this] {
+            // Zero once the publisher has gone quiet for a while.
+            uint64_t windowUs = fpsLastWindowUs_.load(std::memory_order_relaxed);
+            return steadyNowMs() * 1000 - static_cast<int64_t>(windowUs) > 3000000 ? 0.0 : fps_.load();
+        }));
+    metricHandles_.push_back(registry.gaugeCallback(
+        "rtsp_buffer_depth", "NALUs the slowest subscriber of the stream buffer is behind.", labels,
+        [this] { return static_cast<double>(buffer->stats().backlog); }));
+    metricHandles_.push_back(registry.counterCallback(
+        "rtsp_buffer_dropped_nalus_total", "NALUs skipped by stream buffer subscribers that fell behind.", labels,
+        [this] { return static_cast<double>(buffer->stats().dropped); }));
+    metricHandles_.push_back(registry.gaugeCallback(
+        "rtsp_buffer_subscribers", "Stream buffer subscribers, viewers and internal outputs alike.", labels,
+        [this] { return static_cast<double>(buffer->subscriberCount()); }));
+    metricHandles_.push_back(registry.gaugeCallback(
+        "rtsp_stream_viewers", "RTSP and WebSocket viewers of the stream.", labels,
+        [this] { return static_cast<double>(viewerCount()); }));
+    metricHandles_.push_back(registry.gaugeCallback(
+        "rtsp_stream_publishers", "Ingest connections feeding the stream.", labels,
+        [this] { return static_cast<double>(ingestConnections.load()); }));
+}
+
+void Stream::touch() {
+    lastActiveMs = steadyNowMs();
+}
+
+size_t Stream::viewerCount() {
+    size_t count = buffer->subscriberCount();
+    size_t internal = (recorder ? 1 : 0) + (hls ? 1 : 0) + (ws ? 1 : 0) + tsOutputs.size() + (shm ? 1 : 0);
+    size_t viewers = count > internal ? count - internal : 0;
+    return viewers + (ws ? ws->clientCount() : 0);
+}
+
+bool Stream::isIdle(int64_t nowMs, int64_t idleMs) {
+    if (ingestConnections > 0 || viewerCount() > 0) {
+        touch();
+        return false;
+    }
+    return nowMs - lastActiveMs > idleMs;
+}
+
+uint32_t Stream::claimIngest(const std::string& peer) {
+    std::lock_guard<std::mutex> lock(ingestMutex_);
+    int64_t nowUs = steadyNowMs() * 1000;
+    bool attached = ingestConnections.load() > 0;
+    if (attached && nowUs - lastIngestUs_.load(std::memory_order_relaxed) < kTakeoverQuietMs * 1000) return 0;
+    ingestConnections++;
+    // Counts as sending until its first NALU, so a second Hello right
+    // behind this one is still turned away.
+    lastIngestUs_.store(nowUs, std::memory_order_relaxed);
+    touch();
+    uint32_t session = ++ingestSession;
+    if (attached) {
+        LOG_INFO("[Stream] {}: publisher {} took over from a silent one (session {}, {} viewers kept)", id, peer,
+                 session, viewerCount());
+    } else if (session > 1) {
+        LOG_INFO("[Stream] {}: publisher {} resumed the stream (session {}, {} viewers kept)", id, peer, session,
+                 viewerCount());
+    }
+    return session;
+}
+
+void Stream::releaseIngest() {
+    ingestConnections--;
+    touch();
+}
+
+void Stream::publish(std::shared_ptr<Nalu> nalu) {
+    bool changed = false;
+    bool hadSets = nalu->isParameterSet() && buffer->hasSpsPps();
+    if (nalu->type == 7) { // SPS
+        changed = buffer->setSps(nalu->data);
+    } else if (nalu->type == 8) { // PPS
+        changed = buffer->setPps(nalu->data);
+    }
+    if (changed && hadSets) {
+        LOG_INFO("[Stream] {}: {} changed, viewers get it in-band before the next IDR", id,
+                 nalu->type == 7 ? "SPS" : "PPS");
+    }
+    nalu->ingestSession = ingestSession;
+    nalu->receivedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    lastIngestUs_.store(static_cast<int64_t>(nalu->receivedUs), std::memory_order_relaxed);
+
+    ingestBytes->inc(nalu->data.size());
+    ingestNalus->inc();
+    // The first slice of a picture has first_mb_in_slice == 0, coded as a
+    // single 1 bit right after the NAL header.
+    if (nalu->isVcl() && nalu->payloadSize() > 1 && (nalu->payload()[1] & 0x80)) {
+        ingestFrames->inc();
+        fpsWindowFrames_++;
+        if (nalu->receivedUs - fpsWindowStartUs_ >= 1000000) {
+            if (fpsWindowStartUs_ != 0) {
+                fps_ = fpsWindowFrames_ * 1e6 / (nalu->receivedUs - fpsWindowStartUs_);
+                fpsLastWindowUs_.store(nalu->receivedUs, std::memory_order_relaxed);
+            }
+            fpsWindowStartUs_ = nalu->receivedUs;
+            fpsWindowFrames_ = 0;
+        }
+    }
+    nalu->enqueuedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    buffer->push(NaluPtr(std::move(nalu)));
+}
+
+std::shared_ptr<Stream> StreamRegistry::acquire(const std::string& id) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    while (true) {
+        auto it = streams_.find(id);
+        if (it != streams_.end()) {
+            it->second->touch();
+            return it->second;
+        }
+        if (!creating_.count(id)) break;
+        created_.wait(lock);    // another caller is setting this one up
+    }
+
+    // Starting the outputs opens files and sockets, maps shared memory and
+    // spawns threads; lookups of other streams must not wait for that.
+    creating_.insert(id);
+    RecorderConfig recorderConfig = recorderConfig_;
+    std::optional<HlsConfig> hlsConfig;
+    if (hlsEnabled_) hlsConfig = hlsConfig_;
+    bool wsEnabled = wsEnabled_;
+    std::vector<TsOutputTarget> tsTargets;
+    auto targets = tsTargets_.find(id);
+    if (targets != tsTargets_.end()) tsTargets = targets->second;
+    std::optional<ShmConfig> shmConfig;
+    if (shmEnabled_) shmConfig = shmConfig_;
+    lock.unlock();
+
+    auto stream = std::make_shared<Stream>(id);
+    std::shared_ptr<ListenerSlot> slot = listenerSlot_;
+    stream->buffer->addParameterSetListener([slot]() {
+        std::lock_guard<std::mutex> lock(slot->mutex);
+        if (slot->listener) slot->listener();
+    });
+    if (!recorderConfig.dir.empty()) {
+        stream->recorder = std::make_unique<StreamRecorder>(id, stream->buffer, recorderConfig);
+        stream->recorder->start();
+    }
+    std::shared_ptr<ListenerSlot> httpSlot = httpSlot_;
+    auto notifyHttp = [httpSlot]() {
+        std::lock_guard<std::mutex> lock(httpSlot->mutex);
+        if (httpSlot->listener) httpSlot->listener();
+    };
+    if (hlsConfig) {
+        stream->hls = std::make_unique<HlsSegmenter>(id, stream->buffer, *hlsConfig, notifyHttp);
+        stream->hls->start();
+    }
+    if (wsEnabled) {
+        stream->ws = std::make_unique<WsFragmenter>(id, stream->buffer, notifyHttp);
+        stream->ws->start();
+    }
+    for (const TsOutputTarget& target : tsTargets) {
+        auto output = std::make_unique<TsOutput>(id, stream->buffer, target);
+        if (output->start()) stream->tsOutputs.push_back(std::move(output));
+    }
+    if (shmConfig) {
+        auto shm = std::make_unique<ShmOutput>(id, stream->buffer, *shmConfig);
+        if (shm->start()) stream->shm = std::move(shm);
+    }
+    stream->exportMetrics();
+
+    lock.lock();
+    creating_.erase(id);
+    streams_.emplace(id, stream);
+    lock.unlock();
+    created_.notify_all();
+    LOG_INFO("[Registry] Stream registered: {}/{}", kMountPrefix, id);
+    return stream;
+}
+
+std::shared_ptr<Stream> StreamRegistry::find(std::string_view id) {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    auto it = streams_.find(std::string(id));
+    return it != streams_.end() ? it->second : nullptr;
+}
+
+std::string_view StreamRegistry::streamIdFromUri(std::string_view uri) {
+    // Drop scheme and authority: rtsp://host:port/path -> /path
+    size_t scheme = uri.find("://");
+    if (scheme != std::string_view::npos) {
+        size_t pathStart = uri.find('/', scheme + 3);
+        uri = pathStart == std::string_view::npos ? std::string_view() : uri.substr(pathStart);
+    }
+    size_t query = uri.find('?');
+    if (query != std::string_view::npos) uri = uri.substr(0, query);
+
+    if (uri.substr(0, kMountPrefix.size()) != kMountPrefix) return {};
+    uri.remove_prefix(kMountPrefix.size());
+    if (uri.empty() || uri.front() != '/') return {};
+    uri.remove_prefix(1);
+
+    // The id is the next path segment; anything after it (trackID=0) is the
+    // per-track control suffix from the SDP.
+    size_t slash = uri.find('/');
+    std::string_view id = uri.substr(0, slash);
+    if (id.substr(0, 8) == "trackID=") return {};
+    return id;
+}
+
+std::shared_ptr<Stream> StreamRegistry::resolve(std::string_view uri) {
+    std::string_view id = streamIdFromUri(uri);
+    if (!id.empty()) return find(id);
+
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (streams_.size() == 1) return streams_.begin()->second;
+    return nullptr;
+}
+
+void StreamRegistry::setParameterSetListener(StreamBuffer::ParameterSetListener listener) {
+    std::lock_guard<std::mutex> lock(listenerSlot_->mutex);
+    listenerSlot_->listener = std::move(listener);
+}
+
+void StreamRegistry::setRecorderConfig(const RecorderConfig& config) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    recorderConfig_ = config;
+}
+
+void StreamRegistry::stopRecorders() {
+    for (const std::shared_ptr<Stream>& stream : snapshot()) {
+        if (stream->recorder) stream->recorder->stop();
+    }
+}
+
+void StreamRegistry::setHlsConfig(const HlsConfig& config) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    hlsConfig_ = config;
+    hlsEnabled_ = true;
+}
+
+void StreamRegistry::enableWebSocket() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    wsEnabled_ = true;
+}
+
+void StreamRegistry::setHttpUpdateListener(std::function<void()> listener) {
+    std::lock_guard<std::mutex> lock(httpSlot_->mutex);
+    httpSlot_->listener = std::move(listener);
+}
+
+void StreamRegistry::addTsOutput(const std::string& id, const TsOutputTarget& target) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    tsTargets_[id].push_back(target);
+}
+
+void StreamRegistry::enableShm(const ShmConfig& config) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    shmConfig_ = config;
+    shmEnabled_ = true;
+}
+
+void StreamRegistry::setSourceRequester(std::function<void(const std::string&)> requester) {
+    std::lock_guard<std::mutex> lock(sourceMutex_);
+    sourceRequester_ = std::move(requester);
+}
+
+void StreamRegistry::requestSource(std::string_view id) {
+    std::lock_guard<std::mutex> lock(sourceMutex_);
+    if (sourceRequester_ && !id.empty()) sourceRequester_(std::string(id));
+}
+
+std::vector<std::shared_ptr<Stream>> StreamRegistry::collectIdle(int idleSec) {
+    int64_t now = steadyNowMs();
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::shared_ptr<Stream>> removed;
+    for (auto it = streams_.begin(); it != streams_.end();) {
+        if (it->second->isIdle(now, static_cast<int64_t>(idleSec) * 1000)) {
+            LOG_INFO("[Registry] Stream idle, removing: {}/{}", kMountPrefix, it->first);
+            removed.push_back(std::move(it->second));
+            it = streams_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+std::vector<std::shared_ptr<Stream>> StreamRegistry::snapshot() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    std::vector<std::shared_ptr<Stream>> out;
+    out.reserve(streams_.size());
+    for (auto& entry : streams_) out.push_back(entry.second);
+    return out;
+}
+
+size_t StreamRegistry::size() {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return streams_.size();
+}
@@ -0,0 +1,192 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/SdpCache.h"
+#include "media/StreamRecorder.h"
+#include "media/HlsSegmenter.h"
+#include "media/TsOutput.h"
+#include "media/WsFragmenter.h"
+#include "media/ShmOutput.h"
+#include "media/StageLatency.h"
+#include "utils/Metrics.h"
+#include <string>
+#include <string_view>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <optional>
+#include <condition_variable>
+#include <shared_mutex>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+// One live stream: its NALU fan-out buffer plus per-stream caches. Served at
+// rtsp://<host>:<port>/live/<id>.
+struct Stream {
+    explicit Stream(std::string streamId);
+
+    const std::string id;
+    const std::shared_ptr<StreamBuffer> buffer;
+    const std::shared_ptr<SdpCache> sdp;
+    // Set when the registry has recording enabled; lives as long as the stream.
+    std::unique_ptr<StreamRecorder> recorder;
+    // Set when HLS output is enabled; fed from the buffer like the recorder.
+    std::unique_ptr<HlsSegmenter> hls;
+    // Set when WebSocket output is enabled; same again, for fMP4 over WebSocket.
+    std::unique_ptr<WsFragmenter> ws;
+    // MPEG-TS/UDP pushes configured for this stream id.
+    std::vector<std::unique_ptr<TsOutput>> tsOutputs;
+    // Set when shared memory output is enabled: the stream's ring for local readers.
+    std::unique_ptr<ShmOutput> shm;
+
+    // Number of ingest connections attached to this stream, a superseded
+    // publisher that has not closed yet included.
+    std::atomic<int> ingestConnections{0};
+    // Bumped by claimIngest() every time a publisher attaches; the current
+    // publisher is the one holding the latest value.
+    std::atomic<uint32_t> ingestSession{0};
+    // steady_clock milliseconds of the last time the stream had an ingest
+    // connection or a subscriber; used for lazy idle teardown.
+    std::atomic<int64_t> lastActiveMs{0};
+
+    void touch();
+    bool isIdle(int64_t nowMs, int64_t idleMs);
+    // Subscribers of the buffer other than the recorder, the HLS segmenter,
+    // the WebSocket fragmenter, the TS outputs and the shared memory ring,
+    // plus WebSocket clients.
+    size_t viewerCount();
+
+    // Makes `peer` the stream's publisher and returns its ingest session,
+    // or 0 while another publisher is attached and still sending. One that
+    // has sent nothing for kTakeoverQuietMs, typically the half-open
+    // connection of the camera that is reconnecting now, is superseded: it
+    // stays counted until it closes, but isPublisher() no longer holds for
+    // it. Viewers stay subscribed across publishers; the new session number
+    // tells their senders to bridge the gap (see RtpSender).
+    uint32_t claimIngest(const std::string& peer);
+    bool isPublisher(uint32_t session) const { return ingestSession.load() == session; }
+    // Undoes a successful claimIngest(), superseded or not.
+    void releaseIngest();
+
+    // Entry point for every ingest path: records SPS/PPS, stamps the current
+    // ingest session and queues the NALU for the stream's consumers.
+    void publish(std::shared_ptr<Nalu> nalu);
+
+    // Registers the scrape-time series (buffer depth, drops, viewers, fps)
+    // labelled with this stream. Called by the registry once the stream's
+    // outputs are attached.
+    void exportMetrics();
+
+    // Ingest counters, updated by publish().
+    const std::shared_ptr<metrics::Counter> ingestBytes;
+    const std::shared_ptr<metrics::Counter> ingestNalus;
+    const std::shared_ptr<metrics::Counter> ingestFrames;
+    // Per-stage latency, recorded by every viewer's RtpSender.
+    const std::shared_ptr<StageLatency> latency;
+
+private:
+    static constexpr int64_t kTakeoverQuietMs = 2000;
+
+    std::mutex ingestMutex_;                        // serializes claimIngest()
+    std::atomic<int64_t> lastIngestUs_{0};          // steady_clock, set by publish()
+
+    // Frame rate over the last whole second, kept by publish() (one
+    // publisher at a time) and read by the fps gauge.
+    uint64_t fpsWindowStartUs_ = 0;
+    uint32_t fpsWindowFrames_ = 0;
+    std::atomic<uint64_t> fpsLastWindowUs_{0};
+    std::atomic<double> fps_{0};
+
+    // Declared last: released first, so no scrape still reads a member
+    // that is being destroyed.
+    std::vector<metrics::CallbackHandle> metricHandles_;
+};
+
+// All streams known to the server, keyed by stream id.
+//
+// Ingest connections acquire() their stream by id (creating it on first use);
+// RTSP sessions resolve a request URI with find()/resolve(). Lookups are a
+// single hash probe under a shared lock; a new stream's outputs are started
+// outside the lock. Streams are never destroyed eagerly: collectIdle() drops
+// entries that have had neither ingest nor subscribers for a while, and
+// objects still referenced by a session stay alive until that session lets
+// go.
+class StreamRegistry {
+public:
+    static constexpr std::string_view kMountPrefix = "/live";
+
+    std::shared_ptr<Stream> acquire(const std::string& id);
+    std::shared_ptr<Stream> find(std::string_view id);
+
+    // Maps an RTSP URI (rtsp://host[:port]/live/<id>[/trackID=N]) to a stream.
+    // A bare /live mount resolves to the only stream when exactly one exists,
+    // which keeps single-camera setups working with their old URL.
+    std::shared_ptr<Stream> resolve(std::string_view uri);
+    static std::string_view streamIdFromUri(std::string_view uri);
+
+    // Invoked when any stream, current or future, publishes SPS/PPS (see
+    // StreamBuffer::addParameterSetListener). Pass nullptr to detach.
+    void setParameterSetListener(StreamBuffer::ParameterSetListener listener);
+
+    // Streams created from now on are recorded with this configuration.
+    void setRecorderConfig(const RecorderConfig& config);
+    // Flushes and closes every recording (shutdown).
+    void stopRecorders();
+
+    // Streams created from now on are also segmented for HLS.
+    void setHlsConfig(const HlsConfig& config);
+    // Streams created from now on also get fMP4 fragments for WebSocket clients.
+    void enableWebSocket();
+    // Invoked after any stream's segmenter publishes a part or its
+    // WebSocket fragmenter a fragment. Like the parameter set listener it
+    // must not block. Pass nullptr to detach.
+    void setHttpUpdateListener(std::function<void()> listener);
+
+    // Stream `id`, whenever it is created from now on, is also pushed as
+    // MPEG-TS to `target`. May be called several times per id.
+    void addTsOutput(const std::string& id, const TsOutputTarget& target);
+
+    // Streams created from now on are also exposed as shared memory rings.
+    void enableShm(const ShmConfig& config);
+
+    // Called with the stream id of every viewer request (RTSP DESCRIBE, HTTP)
+    // before the stream is looked up, so an on-demand source such as
+    // RtspRelay can start feeding it. Must not block. Pass nullptr to detach.
+    void setSourceRequester(std::function<void(const std::string&)> requester);
+    void requestSource(std::string_view id);
+
+    // Removes streams idle for longer than idleSec and returns them. The
+    // caller decides where the last references go: destroying a stream
+    // stops its outputs, which joins threads and flushes recordings.
+    std::vector<std::shared_ptr<Stream>> collectIdle(int idleSec);
+
+    std::vector<std::shared_ptr<Stream>> snapshot();
+    size_t size();
+
+private:
+    // Shared with every stream's buffer (or HTTP output stage) so the listener can be
+    // swapped or detached without touching each stream.
+    struct ListenerSlot {
+        std::mutex mutex;
+        std::function<void()> listener;
+    };
+
+    std::unordered_map<std::string, std::shared_ptr<Stream>> streams_;
+    std::shared_ptr<ListenerSlot> listenerSlot_ = std::make_shared<ListenerSlot>();
+    std::shared_ptr<ListenerSlot> httpSlot_ = std::make_shared<ListenerSlot>();
+    RecorderConfig recorderConfig_;
+    bool hlsEnabled_ = false;
+    HlsConfig hlsConfig_;
+    bool wsEnabled_ = false;
+    std::unordered_map<std::string, std::vector<TsOutputTarget>> tsTargets_;
+    bool shmEnabled_ = false;
+    ShmConfig shmConfig_;
+    std::shared_mutex mutex_;
+    // Ids whose stream acquire() is building outside mutex_; a second
+    // acquire() of one waits on created_ instead of building it again.
+    std::unordered_set<std::string> creating_;
+    std::condition_variable_any created_;
+    std::mutex sourceMutex_;
+    std::function<void(const std::string&)> sourceRequester_;
+};
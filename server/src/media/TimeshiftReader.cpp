@@ -0,0 +1,357 @@
+#include "media/TimeshiftReader.h"
+#include "media/KeyframeIndex.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+
+static constexpr size_t kReadAheadBytes = 8 << 20;
+static constexpr int kPollMs = 100;
+// How close to its due time a NALU that is not on disk yet may get before
+// playback gives up on the recordings.
+static constexpr int64_t kLiveEdgeMarginUs = 300000;
+// Keyframe-only playback sends at most one picture per this much wall time.
+static constexpr int64_t kKeyframeIntervalUs = 100000;
+
+static int64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t systemNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static int64_t utcFromSteady(int64_t steadyUs) {
+    return systemNowUs() - (steadyNowUs() - steadyUs);
+}
+
+static int64_t steadyFromUtc(int64_t utcUs) {
+    return steadyNowUs() - (systemNowUs() - utcUs);
+}
+
+TimeshiftReader::TimeshiftReader(std::string recordDir, std::shared_ptr<StreamBuffer> live)
+    : dir_(std::move(recordDir)), live_(std::move(live)) {}
+
+TimeshiftReader::~TimeshiftReader() {
+    stop();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (memory_) {
+        live_->unsubscribe(memory_);
+    }
+}
+
+void TimeshiftReader::startAtUtc(int64_t utcUs, double scale) {
+    start(false, utcUs, scale);
+}
+
+void TimeshiftReader::startAtOffset(int64_t offsetUs, double scale) {
+    start(true, offsetUs, scale);
+}
+
+void TimeshiftReader::start(bool fromOldest, int64_t value, double scale) {
+    if (thread_.joinable()) return;
+    scale_ = scale;
+    thread_ = std::thread(&TimeshiftReader::readAheadLoop, this, fromOldest, value);
+}
+
+void TimeshiftReader::stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopped_ = true;
+    if (memory_) {
+        live_->close(*memory_);
+    }
+    cv_.notify_all();
+}
+
+void TimeshiftReader::readAheadLoop(bool fromOldest, int64_t value) {
+    bool haveRecordings = !dir_.empty() && catalog_.scan(dir_);
+    int64_t target = value;
+    if (fromOldest) {
+        target = haveRecordings ? catalog_.files().front().firstUtcUs + value : INT64_MAX;
+    }
+
+    if (target < systemNowUs() && haveRecordings) {
+        size_t file = catalog_.locate(target);
+        KeyframeIndex index;
+        if (index.open(catalog_.files()[file].path + ".idx") && index.size() > 0) {
+            KeyframeEntry entry = index.entry(std::max<ptrdiff_t>(index.findByUtc(target), 0));
+            LOG_INFO("[DVR] Playing {} from {} ms ago at scale {}", catalog_.files()[file].path,
+                     (systemNowUs() - entry.utcUs) / 1000, scale_);
+            // Fragments only play forwards: any rewind, even a slow one,
+            // steps back through the keyframes.
+            if (scale_ > 1 || scale_ < 0) {
+                readKeyframes(file, entry.utcUs);
+            } else {
+                readFullRate(file, entry.offset);
+            }
+            return;
+        }
+    }
+
+    // Nothing on disk: only the last seconds in memory can serve this.
+    Queued queued;
+    queued.marker = target < systemNowUs() && scale_ == 1 ? Marker::ToMemory : Marker::ToLive;
+    queued.utcUs = target;
+    queued.seamUtcUs = INT64_MIN;
+    push(std::move(queued));
+}
+
+bool TimeshiftReader::openFile(size_t file, int64_t& utc0, uint64_t& dts0) {
+    const std::string& path = catalog_.files()[file].path;
+    KeyframeIndex index;
+    if (!file_.open(path) || !index.open(path + ".idx") || index.size() == 0) {
+        LOG_ERROR("[DVR] Cannot read recording {}", path);
+        return false;
+    }
+    // Sample times are placed on the wall clock relative to the file's first
+    // keyframe.
+    utc0 = index.entry(0).utcUs;
+    dts0 = index.entry(0).dts;
+    return true;
+}
+
+void TimeshiftReader::anchorToKeyframe(size_t file, uint64_t dts, int64_t& utc0, uint64_t& dts0) {
+    KeyframeIndex index;
+    if (!index.open(catalog_.files()[file].path + ".idx")) return;
+    ptrdiff_t e = index.findByDts(dts);
+    if (e >= 0 && index.entry(e).dts == dts) {
+        utc0 = index.entry(e).utcUs;
+        dts0 = dts;
+    }
+}
+
+bool TimeshiftReader::findNextFile(size_t& file) {
+    std::string current = catalog_.files()[file].path;
+    catalog_.scan(dir_);
+    for (size_t i = 0; i + 1 < catalog_.files().size(); i++) {
+        if (catalog_.files()[i].path == current) {
+            file = i + 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TimeshiftReader::readFullRate(size_t file, uint64_t offset) {
+    int64_t utc0 = 0;
+    uint64_t dts0 = 0;
+    if (!openFile(file, utc0, dts0)) {
+        push(Queued{nullptr, 0, false, Marker::ToLive});
+        return;
+    }
+
+    RecordingFile::Fragment fragment;
+    std::vector<std::vector<NaluPtr>> samples;
+    int64_t lastUtc = 0;
+    int64_t lastDurationUs = 0;
+    bool sent = false;
+    unsigned polls = 0;
+    while (true) {
+        if (file_.readFragment(offset, fragment)) {
+            polls = 0;
+            samples.clear();
+            if (!file_.readSamples(fragment, 0, fragment.samples.size(), samples)) break;
+            if (!fragment.samples.empty() && fragment.samples[0].keyframe) {
+                // Re-anchor on every indexed keyframe so a camera clock that
+                // drifts against the server's never adds up across a file.
+                anchorToKeyframe(file, fragment.samples[0].dts, utc0, dts0);
+            }
+            for (size_t i = 0; i < samples.size(); i++) {
+                const RecordingFile::Sample& sample = fragment.samples[i];
+                int64_t utc = utc0 + static_cast<int64_t>(sample.dts - dts0) * 100 / 9;
+                if (!pushSample(samples[i], sample.keyframe, utc)) return;
+                lastUtc = utc;
+                lastDurationUs = static_cast<int64_t>(sample.duration) * 100 / 9;
+                sent = true;
+            }
+            offset = fragment.nextOffset;
+            continue;
+        }
+
+        // End of what this file has on disk. Look for the next file now and
+        // then; the recorder finishes one before it starts the next.
+        size_t next = file;
+        if (polls++ % 5 == 0 && findNextFile(next)) {
+            if (file_.readFragment(offset, fragment)) continue;
+            file = next;
+            if (!openFile(file, utc0, dts0)) break;
+            offset = file_.firstFragmentOffset();
+            continue;
+        }
+        // Still recording and we are about to need what isn't written yet.
+        if (scale_ == 1 && sent && nearLiveEdge(lastUtc + lastDurationUs)) {
+            Queued queued;
+            queued.marker = Marker::ToMemory;
+            queued.utcUs = lastUtc;
+            queued.seamUtcUs = lastUtc + lastDurationUs / 2;
+            push(std::move(queued));
+            return;
+        }
+        if (!pause(kPollMs)) return;
+    }
+    push(Queued{nullptr, 0, false, Marker::ToLive});
+}
+
+void TimeshiftReader::readKeyframes(size_t file, int64_t utcUs) {
+    bool forward = scale_ > 0;
+    int64_t step = static_cast<int64_t>(std::fabs(scale_) * kKeyframeIntervalUs);
+
+    KeyframeIndex index;
+    auto openAt = [&](int64_t utc) -> ptrdiff_t {
+        const std::string& path = catalog_.files()[file].path;
+        if (!file_.open(path) || !index.open(path + ".idx")) return -1;
+        ptrdiff_t e = index.findByUtc(utc);
+        return forward ? std::max<ptrdiff_t>(e, 0) : e;
+    };
+
+    RecordingFile::Fragment fragment;
+    std::vector<std::vector<NaluPtr>> samples;
+    int64_t target = utcUs;
+    ptrdiff_t e = openAt(target);
+    unsigned polls = 0;
+    while (true) {
+        if (e >= 0 && e < static_cast<ptrdiff_t>(index.size())) {
+            KeyframeEntry entry = index.entry(e);
+            samples.clear();
+            if (file_.readFragment(entry.offset, fragment) && !fragment.samples.empty() &&
+                file_.readSamples(fragment, 0, 1, samples)) {
+                if (!pushSample(samples[0], true, entry.utcUs)) return;
+            }
+            // The keyframe closest to one interval of playback further on.
+            target = entry.utcUs + (forward ? step : -step);
+            ptrdiff_t next = index.findByUtc(target);
+            e = forward ? std::max(next, e + 1) : std::min(next, e - 1);
+            polls = 0;
+            continue;
+        }
+
+        if (!forward) {
+            if (file == 0) return;  // the oldest recording: hold the last picture
+            file--;
+            e = openAt(target);
+            if (e < 0 && index.size() > 0) e = index.size() - 1;
+            continue;
+        }
+
+        // Past the last keyframe indexed so far.
+        if (index.open(catalog_.files()[file].path + ".idx") && e < static_cast<ptrdiff_t>(index.size())) continue;
+        if (polls++ % 5 == 0 && findNextFile(file)) {
+            e = openAt(target);
+            continue;
+        }
+        if (nearLiveEdge(target)) {
+            push(Queued{nullptr, 0, false, Marker::ToLive});
+            return;
+        }
+        if (!pause(kPollMs)) return;
+    }
+}
+
+bool TimeshiftReader::pushSample(const std::vector<NaluPtr>& nalus, bool keyframe, int64_t utcUs) {
+    if (nalus.empty()) return true;
+    // The recording keeps the parameter sets in its init segment; viewers
+    // need them in band in front of every keyframe we jump to.
+    if (keyframe) {
+        if (!push(Queued{file_.sps(), utcUs, false, Marker::None})) return false;
+        if (!push(Queued{file_.pps(), utcUs, false, Marker::None})) return false;
+    }
+    for (size_t i = 0; i < nalus.size(); i++) {
+        if (!push(Queued{nalus[i], utcUs, i + 1 == nalus.size(), Marker::None})) return false;
+    }
+    return true;
+}
+
+bool TimeshiftReader::push(Queued queued) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [&] { return stopped_ || queuedBytes_ < kReadAheadBytes; });
+    if (stopped_) return false;
+    queuedBytes_ += queued.nalu ? queued.nalu->data.size() : 0;
+    queue_.push_back(std::move(queued));
+    cv_.notify_all();
+    return true;
+}
+
+bool TimeshiftReader::pause(int ms) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, std::chrono::milliseconds(ms), [&] { return stopped_; });
+    return !stopped_;
+}
+
+bool TimeshiftReader::nearLiveEdge(int64_t utcUs) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!anchored_) return true;
+    int64_t due = anchorPlayUs_ + static_cast<int64_t>((utcUs - anchorUtcUs_) / scale_);
+    return due <= steadyNowUs() + kLiveEdgeMarginUs;
+}
+
+TimeshiftReader::Result TimeshiftReader::next(Item& item) {
+    while (true) {
+        std::shared_ptr<StreamBuffer::Reader> memory;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopped_) return Result::Stopped;
+            memory = memory_;
+        }
+
+        if (memory) {
+            NaluPtr nalu = live_->pop(*memory, kPollMs);
+            if (!nalu || nalu->payloadSize() == 0) continue;
+            int64_t utc = utcFromSteady(static_cast<int64_t>(nalu->receivedUs));
+            if (utc <= seamUtcUs_) continue;
+            item.nalu = nalu;
+            item.accessUnitEnd = nalu->hasFrameInfo ? nalu->accessUnitEnd : nalu->isVcl();
+            return deliver(utc, item);
+        }
+
+        Queued queued;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [&] { return stopped_ || !queue_.empty(); });
+            if (stopped_) return Result::Stopped;
+            queued = std::move(queue_.front());
+            queue_.pop_front();
+            queuedBytes_ -= queued.nalu ? queued.nalu->data.size() : 0;
+            cv_.notify_all();
+        }
+
+        if (queued.marker == Marker::ToLive) {
+            return Result::Live;
+        }
+        if (queued.marker == Marker::ToMemory) {
+            std::shared_ptr<StreamBuffer::Reader> reader = live_->subscribeAt(steadyFromUtc(queued.utcUs));
+            if (!reader) {
+                LOG_INFO("[DVR] Stream history no longer reaches back that far, going live");
+                return Result::Live;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            memory_ = std::move(reader);
+            seamUtcUs_ = queued.seamUtcUs;
+            if (stopped_) live_->close(*memory_);
+            continue;
+        }
+        item.nalu = std::move(queued.nalu);
+        item.accessUnitEnd = queued.accessUnitEnd;
+        return deliver(queued.utcUs, item);
+    }
+}
+
+TimeshiftReader::Result TimeshiftReader::deliver(int64_t utcUs, Item& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!anchored_) {
+        anchored_ = true;
+        anchorUtcUs_ = utcUs;
+        anchorPlayUs_ = steadyNowUs();
+    }
+    double offset = (utcUs - anchorUtcUs_) / scale_;
+    int64_t due = anchorPlayUs_ + static_cast<int64_t>(std::max(offset, 0.0));
+    cv_.wait_until(lock, std::chrono::steady_clock::time_point(std::chrono::microseconds(due)),
+                   [&] { return stopped_; });
+    if (stopped_) return Result::Stopped;
+    item.playUs = static_cast<uint64_t>(due);
+    return Result::Item;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/RecordingReader.h"
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstdint>
+
+// Plays a stream back from a point in the past for one RtpSender (DVR).
+//
+// A read-ahead thread finds the start through the recordings' keyframe
+// indexes and reads fragments with pread() into a bounded queue; next()
+// hands NALUs out at the pace of the original stream, divided by `scale`.
+// At scale > 1, and for any negative scale, only keyframes are read, at
+// most ten per second of playback, straight from the index. When 1x
+// playback reaches the part of the stream that is not on disk yet, it
+// continues from the StreamBuffer's in-memory history with the same delay;
+// fast forward that reaches the end of the recordings returns to live.
+//
+// All times are wall clock (UTC) microseconds, the clock the keyframe index
+// is written in.
+class TimeshiftReader {
+public:
+    struct Item {
+        NaluPtr nalu;
+        uint64_t playUs = 0;        // steady_clock time it is due; drives the RTP clock
+        bool accessUnitEnd = false;
+    };
+
+    enum class Result {
+        Item,       // `item` is due now
+        Live,       // caught up: continue with the live stream
+        Stopped,
+    };
+
+    // `recordDir` is the stream's recording directory (<record dir>/<id>);
+    // empty means only the in-memory history is available.
+    TimeshiftReader(std::string recordDir, std::shared_ptr<StreamBuffer> live);
+    ~TimeshiftReader();
+
+    // Starts at the keyframe at or before utcUs...
+    void startAtUtc(int64_t utcUs, double scale);
+    // ...or offsetUs after the beginning of the oldest recording (npt).
+    void startAtOffset(int64_t offsetUs, double scale);
+    // Makes next() return Stopped; may be called from any thread.
+    void stop();
+
+    // Blocks until the next NALU is due.
+    Result next(Item& item);
+
+private:
+    enum class Marker { None, ToMemory, ToLive };
+    struct Queued {
+        NaluPtr nalu;
+        int64_t utcUs = 0;
+        bool accessUnitEnd = false;
+        Marker marker = Marker::None;
+        int64_t seamUtcUs = 0;      // ToMemory
+    };
+
+    void start(bool fromOldest, int64_t value, double scale);
+    void readAheadLoop(bool fromOldest, int64_t value);
+    void readFullRate(size_t file, uint64_t offset);
+    void readKeyframes(size_t file, int64_t utcUs);
+    bool openFile(size_t file, int64_t& utc0, uint64_t& dts0);
+    void anchorToKeyframe(size_t file, uint64_t dts, int64_t& utc0, uint64_t& dts0);
+    bool findNextFile(size_t& file);
+    bool pushSample(const std::vector<NaluPtr>& nalus, bool keyframe, int64_t utcUs);
+    bool push(Queued queued);
+    bool pause(int ms);
+    bool nearLiveEdge(int64_t utcUs);
+    Result deliver(int64_t utcUs, Item& item);
+
+    const std::string dir_;
+    std::shared_ptr<StreamBuffer> live_;
+    double scale_ = 1.0;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopped_ = false;
+    std::deque<Queued> queue_;
+    size_t queuedBytes_ = 0;
+    // Playback clock, set by the first NALU handed out.
+    bool anchored_ = false;
+    int64_t anchorUtcUs_ = 0;
+    uint64_t anchorPlayUs_ = 0;
+
+    // In-memory history, after the recordings ran out. NALUs up to seam
+    // were already sent from disk.
+    std::shared_ptr<StreamBuffer::Reader> memory_;
+    int64_t seamUtcUs_ = 0;
+
+    // Read-ahead thread only.
+    RecordingCatalog catalog_;
+    RecordingFile file_;
+};
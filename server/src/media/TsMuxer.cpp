@@ -0,0 +1,193 @@
+#include "media/TsMuxer.h"
+#include <algorithm>
+
+namespace {
+
+constexpr uint8_t kSyncByte = 0x47;
+constexpr size_t kHeaderSize = 4;
+constexpr size_t kPayloadSize = TsMuxer::kPacketSize - kHeaderSize;
+constexpr uint64_t kTicks33 = 1ULL << 33;
+
+const uint8_t kStartCode[4] = {0x00, 0x00, 0x00, 0x01};
+// Access unit delimiter, primary_pic_type 7 (any slice type). H.264 in
+// MPEG-2 TS requires one at the start of every access unit.
+const uint8_t kAud[6] = {0x00, 0x00, 0x00, 0x01, 0x09, 0xF0};
+
+struct Stuffing {
+    uint8_t bytes[TsMuxer::kPacketSize];
+    Stuffing() { std::fill(bytes, bytes + sizeof(bytes), 0xFF); }
+};
+const Stuffing kStuffing;
+
+// CRC-32/MPEG-2: polynomial 0x04C11DB7, no reflection, no final xor.
+uint32_t crc32Mpeg(const uint8_t* data, size_t size) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= static_cast<uint32_t>(data[i]) << 24;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+} // namespace
+
+void TsMuxer::Packets::clear() {
+    arena.clear();
+    pieces_.clear();
+    starts_.clear();
+    iov_.clear();
+}
+
+void TsMuxer::Packets::arenaPiece(size_t offset) {
+    pieces_.push_back(Piece{nullptr, offset, arena.size() - offset});
+}
+
+void TsMuxer::Packets::piece(const uint8_t* data, size_t size) {
+    pieces_.push_back(Piece{data, 0, size});
+}
+
+void TsMuxer::Packets::finish() {
+    // The arena may have moved while it grew; resolve offsets only now.
+    iov_.resize(pieces_.size());
+    for (size_t i = 0; i < pieces_.size(); i++) {
+        const Piece& p = pieces_[i];
+        const uint8_t* base = p.data ? p.data : arena.data() + p.offset;
+        iov_[i].iov_base = const_cast<uint8_t*>(base);
+        iov_[i].iov_len = p.size;
+    }
+}
+
+void TsMuxer::writeSection(uint16_t pid, uint8_t& continuity, const uint8_t* section, size_t size,
+                           Packets& out) {
+    out.starts_.push_back(out.pieces_.size());
+    size_t start = out.arena.size();
+    out.arena.push_back(kSyncByte);
+    out.arena.push_back(0x40 | (pid >> 8));     // payload_unit_start_indicator
+    out.arena.push_back(pid & 0xFF);
+    out.arena.push_back(0x10 | (continuity++ & 0x0F));
+    out.arena.push_back(0x00);                  // pointer_field
+    out.arena.insert(out.arena.end(), section, section + size);
+    uint32_t crc = crc32Mpeg(section, size);
+    for (int shift = 24; shift >= 0; shift -= 8) out.arena.push_back(static_cast<uint8_t>(crc >> shift));
+    out.arenaPiece(start);
+    out.piece(kStuffing.bytes, kPacketSize - (out.arena.size() - start));
+}
+
+void TsMuxer::writeTables(Packets& out) {
+    const uint8_t pat[] = {
+        0x00, 0xB0, 0x0D,                       // table_id, section_length 13
+        0x00, 0x01, 0xC1, 0x00, 0x00,           // transport_stream_id 1, version 0, current
+        0x00, 0x01,                             // program_number 1 ...
+        static_cast<uint8_t>(0xE0 | (kPmtPid >> 8)), kPmtPid & 0xFF,  // ... -> PMT PID
+    };
+    const uint8_t pmt[] = {
+        0x02, 0xB0, 0x12,                       // table_id, section_length 18
+        0x00, 0x01, 0xC1, 0x00, 0x00,           // program_number 1, version 0, current
+        static_cast<uint8_t>(0xE0 | (kVideoPid >> 8)), kVideoPid & 0xFF,  // PCR_PID
+        0xF0, 0x00,                             // program_info_length 0
+        0x1B,                                   // stream_type: H.264
+        static_cast<uint8_t>(0xE0 | (kVideoPid >> 8)), kVideoPid & 0xFF,
+        0xF0, 0x00,                             // ES_info_length 0
+    };
+    writeSection(0x0000, patContinuity_, pat, sizeof(pat), out);
+    writeSection(kPmtPid, pmtContinuity_, pmt, sizeof(pmt), out);
+}
+
+void TsMuxer::writeAccessUnit(const AccessUnit& unit, const NaluPtr& sps, const NaluPtr& pps, uint64_t timeUs,
+                              Packets& out) {
+    // PES header: stream_id 0xE0, unbounded length (allowed for video),
+    // PTS only.
+    uint64_t pts = ((timeUs + kPtsDelayUs) * 9 / 100) % kTicks33;
+    size_t pesOffset = out.arena.size();
+    const uint8_t pes[14] = {
+        0x00, 0x00, 0x01, 0xE0, 0x00, 0x00, 0x80, 0x80, 0x05,
+        static_cast<uint8_t>(0x21 | ((pts >> 29) & 0x0E)),
+        static_cast<uint8_t>(pts >> 22),
+        static_cast<uint8_t>(((pts >> 14) & 0xFE) | 0x01),
+        static_cast<uint8_t>(pts >> 7),
+        static_cast<uint8_t>(((pts << 1) & 0xFE) | 0x01),
+    };
+    out.arena.insert(out.arena.end(), pes, pes + sizeof(pes));
+
+    // The PES payload as a list of slices; the TS packets cut across them.
+    slices_.clear();
+    slices_.push_back(Slice{nullptr, sizeof(pes)});
+    slices_.push_back(Slice{kAud, sizeof(kAud)});
+    if (unit.keyframe && sps && pps) {
+        for (const NaluPtr& set : {sps, pps}) {
+            slices_.push_back(Slice{kStartCode, sizeof(kStartCode)});
+            slices_.push_back(Slice{set->payload(), set->payloadSize()});
+        }
+    }
+    for (const NaluPtr& nalu : unit.nalus) {
+        slices_.push_back(Slice{kStartCode, sizeof(kStartCode)});
+        slices_.push_back(Slice{nalu->payload(), nalu->payloadSize()});
+    }
+    size_t remaining = 0;
+    for (const Slice& s : slices_) remaining += s.size;
+
+    uint64_t pcr = timeUs * 27;     // 27 MHz
+    uint64_t pcrBase = (pcr / 300) % kTicks33;
+    uint32_t pcrExt = static_cast<uint32_t>(pcr % 300);
+
+    size_t slice = 0;
+    size_t sliceOffset = 0;
+    bool first = true;
+    while (remaining > 0) {
+        out.starts_.push_back(out.pieces_.size());
+        size_t header = out.arena.size();
+
+        // Adaptation field: PCR on the first packet, stuffing on the last.
+        size_t fieldSize = first ? 8 : 0;
+        size_t stuffing = 0;
+        if (remaining < kPayloadSize - fieldSize) {
+            stuffing = kPayloadSize - fieldSize - remaining;
+            if (fieldSize == 0) {
+                fieldSize = stuffing;   // length byte (+ flags) come out of the stuffing
+                stuffing = stuffing >= 2 ? stuffing - 2 : 0;
+            }
+        }
+        size_t payload = kPayloadSize - (first ? 8 + stuffing : fieldSize);
+
+        out.arena.push_back(kSyncByte);
+        out.arena.push_back((first ? 0x40 : 0x00) | (kVideoPid >> 8));
+        out.arena.push_back(kVideoPid & 0xFF);
+        out.arena.push_back((fieldSize > 0 ? 0x30 : 0x10) | (videoContinuity_++ & 0x0F));
+        if (first) {
+            out.arena.push_back(static_cast<uint8_t>(7 + stuffing));     // adaptation_field_length
+            out.arena.push_back(unit.keyframe ? 0x50 : 0x10);           // random_access, PCR_flag
+            out.arena.push_back(static_cast<uint8_t>(pcrBase >> 25));
+            out.arena.push_back(static_cast<uint8_t>(pcrBase >> 17));
+            out.arena.push_back(static_cast<uint8_t>(pcrBase >> 9));
+            out.arena.push_back(static_cast<uint8_t>(pcrBase >> 1));
+            out.arena.push_back(static_cast<uint8_t>(((pcrBase & 1) << 7) | 0x7E | (pcrExt >> 8)));
+            out.arena.push_back(static_cast<uint8_t>(pcrExt));
+        } else if (fieldSize > 0) {
+            out.arena.push_back(static_cast<uint8_t>(fieldSize - 1));
+            if (fieldSize > 1) out.arena.push_back(0x00);
+        }
+        out.arenaPiece(header);
+        if (stuffing > 0) out.piece(kStuffing.bytes, stuffing);
+
+        // Payload, straight from the slices.
+        remaining -= payload;
+        while (payload > 0) {
+            const Slice& s = slices_[slice];
+            size_t n = std::min(payload, s.size - sliceOffset);
+            if (s.data) {
+                out.piece(s.data + sliceOffset, n);
+            } else {
+                out.pieces_.push_back(Packets::Piece{nullptr, pesOffset + sliceOffset, n});
+            }
+            payload -= n;
+            sliceOffset += n;
+            if (sliceOffset == s.size) {
+                slice++;
+                sliceOffset = 0;
+            }
+        }
+        first = false;
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "media/AccessUnit.h"
+#include <sys/uio.h>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// MPEG-2 transport stream (ISO/IEC 13818-1) with a single H.264 program.
+//
+// Every access unit becomes one PES packet (access unit delimiter, SPS/PPS
+// in front of IDRs, then the NALUs with 4-byte start codes), cut into
+// 188-byte TS packets. The PCR rides in the adaptation field of each PES's
+// first packet, taken from the access unit's timestamp; PTS = DTS (no
+// B-frames from our cameras) lead it by kPtsDelayUs.
+//
+// Output is scatter/gather: a TS packet is a run of iovecs pointing at
+// header bytes in Packets::arena, at constant tables, and straight into
+// the shared NALU buffers, so payload bytes are never copied into packets.
+class TsMuxer {
+public:
+    static constexpr size_t kPacketSize = 188;
+    static constexpr uint16_t kPmtPid = 0x1000;
+    static constexpr uint16_t kVideoPid = 0x100;
+    static constexpr uint64_t kPtsDelayUs = 100000;
+
+    // TS packets produced since the last clear(). The iovecs are built by
+    // finish() and stay valid until the next clear(), as long as the NALUs
+    // passed in are kept alive.
+    class Packets {
+    public:
+        void clear();
+        void finish();
+        size_t count() const { return starts_.size(); }
+        // iovecs of packets [first, first + n)
+        struct iovec* iov(size_t first) { return iov_.data() + starts_[first]; }
+        size_t iovCount(size_t first, size_t n) const {
+            size_t end = first + n < starts_.size() ? starts_[first + n] : iov_.size();
+            return end - starts_[first];
+        }
+
+    private:
+        friend class TsMuxer;
+        struct Piece {
+            const uint8_t* data;    // nullptr: `offset` into arena
+            size_t offset;
+            size_t size;
+        };
+        void arenaPiece(size_t offset);     // from offset to the arena's end
+        void piece(const uint8_t* data, size_t size);
+
+        std::vector<uint8_t> arena;         // TS/PES headers and tables
+        std::vector<Piece> pieces_;
+        std::vector<size_t> starts_;        // first piece/iovec of each packet
+        std::vector<struct iovec> iov_;
+    };
+
+    // PAT and PMT, one packet each.
+    void writeTables(Packets& out);
+    // `timeUs` is the stream's media time, which must not go backwards.
+    // sps/pps, when given, are sent in-band ahead of a keyframe.
+    void writeAccessUnit(const AccessUnit& unit, const NaluPtr& sps, const NaluPtr& pps, uint64_t timeUs,
+                         Packets& out);
+
+private:
+    struct Slice {
+        const uint8_t* data;    // nullptr: the PES header in the arena
+        size_t size;
+    };
+
+    void writeSection(uint16_t pid, uint8_t& continuity, const uint8_t* section, size_t size, Packets& out);
+
+    uint8_t patContinuity_ = 0;
+    uint8_t pmtContinuity_ = 0;
+    uint8_t videoContinuity_ = 0;
+    std::vector<Slice> slices_;     // scratch for writeAccessUnit
+};
@@ -0,0 +1,147 @@
+#include "media/TsOutput.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+static constexpr int kPollMs = 500;
+static constexpr size_t kPacketsPerDatagram = 7;   // 1316 bytes, fits any Ethernet MTU
+static constexpr unsigned kSendBatch = 64;         // datagrams per sendmmsg()
+static constexpr uint64_t kTableIntervalUs = 400000;
+
+TsOutput::TsOutput(std::string streamId, std::shared_ptr<StreamBuffer> buffer, TsOutputTarget target)
+    : streamId_(std::move(streamId)), buffer_(std::move(buffer)), target_(std::move(target)) {}
+
+TsOutput::~TsOutput() {
+    stop();
+    if (fd_ >= 0) close(fd_);
+}
+
+bool TsOutput::start() {
+    if (running_) return true;
+
+    struct addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo* result = nullptr;
+    int rc = getaddrinfo(target_.host.c_str(), nullptr, &hints, &result);
+    if (rc != 0 || !result) {
+        LOG_ERROR("[TS] {}: cannot resolve {}: {}", streamId_, target_.host, gai_strerror(rc));
+        return false;
+    }
+    dest_ = *reinterpret_cast<struct sockaddr_in*>(result->ai_addr);
+    dest_.sin_port = htons(target_.port);
+    freeaddrinfo(result);
+
+    if (fd_ < 0) fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        LOG_ERROR("[TS] {}: socket: {}", streamId_, strerror(errno));
+        return false;
+    }
+
+    running_ = true;
+    reader_ = buffer_->subscribe();
+    thread_ = std::thread(&TsOutput::outputLoop, this);
+    LOG_INFO("[TS] {}: sending MPEG-TS to {}:{}", streamId_, target_.host, target_.port);
+    return true;
+}
+
+void TsOutput::stop() {
+    if (!running_) return;
+    running_ = false;
+    buffer_->unsubscribe(reader_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    reader_.reset();
+}
+
+void TsOutput::outputLoop() {
+    while (running_) {
+        NaluPtr nalu = buffer_->pop(*reader_, kPollMs);
+        if (nalu && nalu->payloadSize() > 0) handle(nalu);
+    }
+}
+
+void TsOutput::handle(const NaluPtr& nalu) {
+    // A new publisher starts over from its first IDR; its capture clock has
+    // nothing to do with the last one's, so the offset is taken again there.
+    if (haveSession_ && nalu->ingestSession != ingestSession_) {
+        units_.reset();
+        lastSps_.reset();
+        lastPps_.reset();
+        lastUnitUs_ = 0;
+        started_ = false;
+    }
+    ingestSession_ = nalu->ingestSession;
+    haveSession_ = true;
+
+    if (nalu->type == 7) lastSps_ = nalu;
+    if (nalu->type == 8) lastPps_ = nalu;
+
+    AccessUnit unit;
+    if (!units_.push(nalu, unit)) return;
+
+    // Same clamping as the recorder: decode times only move forward.
+    if (lastUnitUs_ != 0 && unit.timeUs <= lastUnitUs_) {
+        unit.timeUs = lastUnitUs_ + frameUs_;
+    } else if (lastUnitUs_ != 0 && unit.timeUs - lastUnitUs_ < 1000000) {
+        frameUs_ = unit.timeUs - lastUnitUs_;
+    }
+    lastUnitUs_ = unit.timeUs;
+
+    if (!started_) {
+        if (!unit.keyframe) return;
+        started_ = true;
+        offsetUs_ = static_cast<int64_t>(mediaUs_ + frameUs_) - static_cast<int64_t>(unit.timeUs);
+    }
+    mediaUs_ = static_cast<uint64_t>(static_cast<int64_t>(unit.timeUs) + offsetUs_);
+
+    packets_.clear();
+    if (unit.keyframe || mediaUs_ - lastTablesUs_ >= kTableIntervalUs) {
+        muxer_.writeTables(packets_);
+        lastTablesUs_ = mediaUs_;
+    }
+    // SPS/PPS go in-band before every IDR so a receiver can join at any of
+    // them; without ones seen in the stream the IDR goes out alone.
+    muxer_.writeAccessUnit(unit, lastSps_, lastPps_, mediaUs_, packets_);
+    send();
+}
+
+void TsOutput::send() {
+    packets_.finish();
+    size_t count = packets_.count();
+    messages_.clear();
+    for (size_t first = 0; first < count; first += kPacketsPerDatagram) {
+        size_t n = std::min(kPacketsPerDatagram, count - first);
+        struct mmsghdr message{};
+        message.msg_hdr.msg_name = &dest_;
+        message.msg_hdr.msg_namelen = sizeof(dest_);
+        message.msg_hdr.msg_iov = packets_.iov(first);
+        message.msg_hdr.msg_iovlen = packets_.iovCount(first, n);
+        messages_.push_back(message);
+    }
+
+    // The socket is blocking: a full send buffer paces this thread, and
+    // the buffer then drops this reader to the next IDR if it falls behind.
+    size_t sent = 0;
+    while (sent < messages_.size() && running_) {
+        unsigned batch = static_cast<unsigned>(std::min<size_t>(kSendBatch, messages_.size() - sent));
+        int n = sendmmsg(fd_, messages_.data() + sent, batch, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (!sendFailed_) {
+                LOG_RATE_LIMITED(logging::Level::Error, 5, "[TS] {}: send to {}:{} failed: {}", streamId_, target_.host,
+                                 target_.port, strerror(errno));
+            }
+            sendFailed_ = true;
+            return;
+        }
+        sent += n;
+        datagramsSent_ += n;
+        sendFailed_ = false;
+    }
+}
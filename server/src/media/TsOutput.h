@@ -0,0 +1,74 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/AccessUnit.h"
+#include "media/TsMuxer.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+// A UDP destination for a stream's MPEG-TS (unicast or multicast).
+struct TsOutputTarget {
+    std::string host;
+    int port = 0;
+};
+
+// Pushes one stream as MPEG-TS over UDP to a fixed destination, for legacy
+// set-top boxes, encoders and IPTV gear that take nothing else.
+//
+// Another StreamBuffer reader on its own thread, like the recorder: access
+// units are muxed by TsMuxer and sent as datagrams of up to 7 TS packets
+// (1316 bytes), many datagrams per sendmmsg() call. Each datagram is
+// gathered from the muxer's iovecs, so the NALU payloads go from the
+// shared buffers to the socket without a copy in between.
+//
+// Output starts at the first IDR. PAT/PMT go out in front of every IDR and
+// at least every kTableIntervalUs. The media timeline (PCR/PTS) runs on
+// across publishers so a receiver sees one continuous program; a slow
+// output is moved to the next IDR by the buffer like any viewer.
+class TsOutput {
+public:
+    TsOutput(std::string streamId, std::shared_ptr<StreamBuffer> buffer, TsOutputTarget target);
+    ~TsOutput();
+
+    // Returns false if the destination can't be resolved.
+    bool start();
+    void stop();
+
+    uint64_t datagramsSent() const { return datagramsSent_; }
+
+private:
+    void outputLoop();
+    void handle(const NaluPtr& nalu);
+    void send();
+
+    const std::string streamId_;
+    std::shared_ptr<StreamBuffer> buffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
+    const TsOutputTarget target_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    int fd_ = -1;
+    struct sockaddr_in dest_{};
+    TsMuxer muxer_;
+    TsMuxer::Packets packets_;
+    std::vector<struct mmsghdr> messages_;
+    bool sendFailed_ = false;   // reported once until a send succeeds
+
+    AccessUnitBuilder units_;
+    NaluPtr lastSps_, lastPps_;
+    bool started_ = false;      // first IDR seen
+    uint64_t lastUnitUs_ = 0;
+    uint64_t frameUs_ = 33333;
+    int64_t offsetUs_ = 0;      // stream time -> media time
+    uint64_t mediaUs_ = 0;      // last access unit's media time
+    uint64_t lastTablesUs_ = 0;
+    uint32_t ingestSession_ = 0;
+    bool haveSession_ = false;
+    std::atomic<uint64_t> datagramsSent_{0};
+};
@@ -0,0 +1,182 @@
+#include "media/WsFragmenter.h"
+#include <algorithm>
+
+static constexpr int kPollMs = 500;
+// About 5 s at 30 fps: room for a client to lag one GOP and catch up.
+static constexpr size_t kRingMessages = 150;
+
+static bool sameBytes(const std::vector<uint8_t>& bytes, const NaluPtr& nalu) {
+    return nalu && std::equal(bytes.begin(), bytes.end(), nalu->payload(), nalu->payload() + nalu->payloadSize());
+}
+
+// RFC 6455 server frame header (FIN, no mask) with the shortest length form.
+static void appendFrameHeader(std::vector<uint8_t>& out, uint8_t opcode, size_t length) {
+    out.push_back(0x80 | opcode);
+    if (length < 126) {
+        out.push_back(static_cast<uint8_t>(length));
+    } else if (length < 65536) {
+        out.push_back(126);
+        out.push_back(static_cast<uint8_t>(length >> 8));
+        out.push_back(static_cast<uint8_t>(length));
+    } else {
+        out.push_back(127);
+        for (int shift = 56; shift >= 0; shift -= 8) out.push_back(static_cast<uint8_t>(length >> shift));
+    }
+}
+
+WsFragmenter::WsFragmenter(std::string streamId, std::shared_ptr<StreamBuffer> buffer, UpdateListener onUpdate)
+    : streamId_(std::move(streamId)), buffer_(std::move(buffer)), onUpdate_(std::move(onUpdate)) {}
+
+WsFragmenter::~WsFragmenter() {
+    stop();
+}
+
+void WsFragmenter::start() {
+    if (running_) return;
+    running_ = true;
+    reader_ = buffer_->subscribe();
+    thread_ = std::thread(&WsFragmenter::fragmentLoop, this);
+}
+
+void WsFragmenter::stop() {
+    if (!running_) return;
+    running_ = false;
+    buffer_->unsubscribe(reader_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    reader_.reset();
+}
+
+void WsFragmenter::fragmentLoop() {
+    while (running_) {
+        NaluPtr nalu = buffer_->pop(*reader_, kPollMs);
+        if (nalu && nalu->payloadSize() > 0) handle(nalu);
+    }
+}
+
+void WsFragmenter::handle(const NaluPtr& nalu) {
+    // A new publisher brings its own clock and maybe its own encoder
+    // settings: continue from its first IDR with a new init segment.
+    if (haveSession_ && nalu->ingestSession != ingestSession_) {
+        units_.reset();
+        lastSps_.reset();
+        lastPps_.reset();
+        lastUnitUs_ = 0;
+        haveInit_ = false;
+    }
+    ingestSession_ = nalu->ingestSession;
+    haveSession_ = true;
+
+    if (nalu->type == 7) lastSps_ = nalu;
+    if (nalu->type == 8) lastPps_ = nalu;
+
+    AccessUnit unit;
+    if (!units_.push(nalu, unit)) return;
+
+    // Same clamping as the recorder: decode times only move forward.
+    if (lastUnitUs_ != 0 && unit.timeUs <= lastUnitUs_) {
+        unit.timeUs = lastUnitUs_ + frameUs_;
+    } else if (lastUnitUs_ != 0 && unit.timeUs - lastUnitUs_ < 1000000) {
+        frameUs_ = unit.timeUs - lastUnitUs_;
+    }
+    lastUnitUs_ = unit.timeUs;
+
+    if (unit.keyframe) {
+        bool setsChanged = haveInit_ && ((lastSps_ && !sameBytes(initSps_, lastSps_)) ||
+                                         (lastPps_ && !sameBytes(initPps_, lastPps_)));
+        if ((!haveInit_ || setsChanged) && !prepareInit(unit.timeUs)) return;
+    } else if (!haveInit_) {
+        return;     // waiting for the first IDR
+    }
+    publish(unit);
+}
+
+bool WsFragmenter::prepareInit(uint64_t firstUs) {
+    if (lastSps_ && lastPps_) {
+        initSps_.assign(lastSps_->payload(), lastSps_->payload() + lastSps_->payloadSize());
+        initPps_.assign(lastPps_->payload(), lastPps_->payload() + lastPps_->payloadSize());
+    } else {
+        Nalu sets[2];
+        buffer_->getParameterSets(sets[0].data, sets[1].data);
+        for (Nalu& set : sets) classifyNalu(set);
+        initSps_.assign(sets[0].payload(), sets[0].payload() + sets[0].payloadSize());
+        initPps_.assign(sets[1].payload(), sets[1].payload() + sets[1].payloadSize());
+    }
+    if (!muxer_.init(initSps_.data(), initSps_.size(), initPps_.data(), initPps_.size())) {
+        return false;
+    }
+
+    originUs_ = firstUs >= timelineEndUs_ ? firstUs - timelineEndUs_ : firstUs;
+    muxer_.setTimelineOrigin(originUs_);
+
+    std::string mime = "video/mp4; codecs=\"" + muxer_.codecString() + "\"";
+    const std::vector<uint8_t>& init = muxer_.initSegment();
+    auto message = std::make_shared<std::vector<uint8_t>>();
+    message->reserve(mime.size() + init.size() + 20);
+    appendFrameHeader(*message, 0x1, mime.size());
+    message->insert(message->end(), mime.begin(), mime.end());
+    appendFrameHeader(*message, 0x2, init.size());
+    message->insert(message->end(), init.begin(), init.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    inits_.emplace_back(nextInitId_++, std::move(message));
+    haveInit_ = true;
+    return true;
+}
+
+void WsFragmenter::publish(const AccessUnit& unit) {
+    // The next sample's start isn't known yet; the last interval stands in
+    // for this one's duration, and each fragment carries its own decode time.
+    scratch_.clear();
+    scratch_.reserve(unit.sampleSize() + 256);
+    muxer_.writeFragment(&unit, 1, unit.timeUs + frameUs_, [this](const uint8_t* data, size_t size) {
+        scratch_.insert(scratch_.end(), data, data + size);
+    });
+    timelineEndUs_ = unit.timeUs + frameUs_ - originUs_;
+
+    auto data = std::make_shared<std::vector<uint8_t>>();
+    data->reserve(scratch_.size() + 10);
+    appendFrameHeader(*data, 0x2, scratch_.size());
+    data->insert(data->end(), scratch_.begin(), scratch_.end());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Message message;
+        message.seq = nextSeq_++;
+        message.initId = nextInitId_ - 1;
+        message.keyframe = unit.keyframe;
+        message.data = std::move(data);
+        messages_.push_back(std::move(message));
+        if (messages_.size() > kRingMessages) messages_.pop_front();
+        while (inits_.size() > 1 && inits_[1].first <= messages_.front().initId) inits_.pop_front();
+    }
+    if (onUpdate_ && clients_ > 0) onUpdate_();
+}
+
+WsFragmenter::Read WsFragmenter::read(uint64_t seq, Message& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (seq >= nextSeq_) return Read::Pending;
+    if (messages_.empty() || seq < messages_.front().seq) return Read::Lapped;
+    out = messages_[seq - messages_.front().seq];
+    return Read::Ready;
+}
+
+bool WsFragmenter::keyframeFrom(uint64_t from, uint64_t& seq) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = messages_.rbegin(); it != messages_.rend() && it->seq >= from; ++it) {
+        if (it->keyframe) {
+            seq = it->seq;
+            return true;
+        }
+    }
+    return false;
+}
+
+WsBytes WsFragmenter::initMessage(uint32_t initId) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& init : inits_) {
+        if (init.first == initId) return init.second;
+    }
+    return nullptr;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include "media/StreamBuffer.h"
+#include "media/AccessUnit.h"
+#include "media/Mp4Muxer.h"
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <cstdint>
+
+// Immutable WebSocket message bytes, frame header included, shared by every
+// client of a stream.
+using WsBytes = std::shared_ptr<const std::vector<uint8_t>>;
+
+// fMP4 over WebSocket for one stream: every access unit becomes one
+// moof/mdat fragment, ready for MediaSource Extensions in a browser.
+//
+// A buffer reader with its own thread, like HlsSegmenter. The fragments are
+// built and framed as binary WebSocket messages once, here, and kept in a
+// short ring with sequence numbers; HttpServer's connections just queue the
+// shared bytes. Each init segment goes out as a text message with the MIME
+// type for addSourceBuffer() followed by the binary init segment. A new
+// publisher or new SPS/PPS starts a new init; the media timeline runs on.
+//
+// The update listener fires after every fragment while there are clients.
+class WsFragmenter {
+public:
+    using UpdateListener = std::function<void()>;
+
+    struct Message {
+        uint64_t seq = 0;
+        uint32_t initId = 0;
+        bool keyframe = false;
+        WsBytes data;
+    };
+    enum class Read { Ready, Pending, Lapped };
+
+    WsFragmenter(std::string streamId, std::shared_ptr<StreamBuffer> buffer, UpdateListener onUpdate);
+    ~WsFragmenter();
+
+    void start();
+    void stop();
+
+    // Message `seq`; Lapped once it has left the ring.
+    Read read(uint64_t seq, Message& out);
+    // The newest keyframe message at or after `from`, where a client can
+    // (re)start. False while there is none yet.
+    bool keyframeFrom(uint64_t from, uint64_t& seq);
+    // MIME type text message + init segment binary message.
+    WsBytes initMessage(uint32_t initId);
+    // Sequence number of the next message; lock-free, for cheap polling.
+    uint64_t nextSeq() const { return nextSeq_; }
+
+    // WebSocket viewers, counted as stream viewers by the registry.
+    void addClient() { clients_++; }
+    void removeClient() { clients_--; }
+    size_t clientCount() const { return clients_; }
+
+private:
+    void fragmentLoop();
+    void handle(const NaluPtr& nalu);
+    bool prepareInit(uint64_t firstUs);
+    void publish(const AccessUnit& unit);
+
+    const std::string streamId_;
+    std::shared_ptr<StreamBuffer> buffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
+    UpdateListener onUpdate_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<size_t> clients_{0};
+
+    // Fragmenter thread only.
+    Mp4Muxer muxer_;
+    AccessUnitBuilder units_;
+    NaluPtr lastSps_, lastPps_;
+    std::vector<uint8_t> initSps_, initPps_;
+    std::vector<uint8_t> scratch_;      // fragment before framing
+    bool haveInit_ = false;
+    uint64_t lastUnitUs_ = 0;
+    uint64_t frameUs_ = 33333;
+    uint64_t originUs_ = 0;             // AccessUnit time of media time 0
+    uint64_t timelineEndUs_ = 0;        // media time the next init continues from
+    uint32_t ingestSession_ = 0;
+    bool haveSession_ = false;
+
+    // Shared with the HTTP thread.
+    std::mutex mutex_;
+    std::deque<Message> messages_;
+    std::deque<std::pair<uint32_t, WsBytes>> inits_;
+    std::atomic<uint64_t> nextSeq_{0};  // written under mutex_
+    uint32_t nextInitId_ = 0;
+};
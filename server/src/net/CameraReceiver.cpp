@@ -1,14 +1,30 @@
 #include "net/CameraReceiver.h"
-#include <iostream>
-#include <vector>
+#include "net/IngestConnection.h"
+#include "net/IoUring.h"
+#include "utils/Log.h"
+#include <map>
 #include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <cstring> // For strerror
 
-CameraReceiver::CameraReceiver(int port, std::shared_ptr<StreamBuffer> streamBuffer)
-    : port_(port), streamBuffer_(streamBuffer) {}
+#define MAX_EVENTS 64
+
+// io_uring worker: user_data is (fd << 8) | op; 0 is a buffer recycle.
+enum UringOp : uint64_t { kOpAccept = 1, kOpRecv = 2, kOpStop = 3, kOpCancel = 4 };
+static constexpr unsigned kUringEntries = 256;
+static constexpr uint16_t kBufferGroup = 0;
+static constexpr unsigned kBufferCount = 128;
+static constexpr unsigned kBufferSize = 16 * 1024;
+
+CameraReceiver::CameraReceiver(int port, std::shared_ptr<StreamRegistry> registry, int workerCount, IoEngine engine)
+    : port_(port), registry_(registry), workerCount_(workerCount > 0 ? workerCount : 1), engine_(engine),
+      loopTime_(metrics::Registry::instance().histogram(
+          "rtsp_reactor_loop_seconds", "Time a reactor thread spends handling one batch of events.",
+          metrics::latencyBoundsUs(), 1e-6, {{"loop", "ingest"}})) {}
 
 CameraReceiver::~CameraReceiver() {
     stop();
@@ -18,9 +34,33 @@ void CameraReceiver::start() {
     if (isRunning_) {
         return;
     }
+    if (!createServerSocket()) {
+        return;
+    }
     isRunning_ = true;
-    acceptThread_ = std::thread(&CameraReceiver::acceptLoop, this);
-    std::cout << "CameraReceiver started on port " << port_ << std::endl;
+
+    for (int i = 0; i < workerCount_; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+        ev.data.fd = serverSocket_;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, serverSocket_, &ev);
+        ev.events = EPOLLIN;
+        ev.data.fd = worker->stopFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->stopFd, &ev);
+
+        Worker* w = worker.get();
+        worker->thread = std::thread([this, w]() {
+            if (engine_ == IoEngine::IoUring && uringWorkerLoop(*w)) return;
+            workerLoop(*w);
+        });
+        workers_.push_back(std::move(worker));
+    }
+    LOG_INFO("CameraReceiver started on port {} with {} {} ingest threads", port_, workerCount_,
+             ioEngineName(engine_));
 }
 
 void CameraReceiver::stop() {
@@ -29,32 +69,41 @@ void CameraReceiver::stop() {
     }
     isRunning_ = false;
 
-    // Shutdown the socket to unblock accept()
+    for (auto& worker : workers_) {
+        uint64_t one = 1;
+        ssize_t ignored = write(worker->stopFd, &one, sizeof(one));
+        (void)ignored;
+    }
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+        close(worker->stopFd);
+        close(worker->epollFd);
+    }
+    workers_.clear();
+
     if (serverSocket_ != -1) {
-        shutdown(serverSocket_, SHUT_RDWR);
         close(serverSocket_);
         serverSocket_ = -1;
     }
-
-    if (acceptThread_.joinable()) {
-        acceptThread_.join();
-    }
-    std::cout << "CameraReceiver stopped." << std::endl;
+    LOG_INFO("CameraReceiver stopped.");
 }
 
-void CameraReceiver::acceptLoop() {
-    serverSocket_ = socket(AF_INET, SOCK_STREAM, 0);
+bool CameraReceiver::createServerSocket() {
+    serverSocket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     if (serverSocket_ < 0) {
-        std::cerr << "Failed to create CameraReceiver socket: " << strerror(errno) << std::endl;
-        return;
+        LOG_ERROR("Failed to create CameraReceiver socket: {}", strerror(errno));
+        return false;
     }
 
     // Set SO_REUSEADDR to allow immediate reuse of the port
     int opt = 1;
     if (setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
-        std::cerr << "setsockopt(SO_REUSEADDR) failed: " << strerror(errno) << std::endl;
+        LOG_ERROR("setsockopt(SO_REUSEADDR) failed: {}", strerror(errno));
         close(serverSocket_);
-        return;
+        serverSocket_ = -1;
+        return false;
     }
 
     sockaddr_in serverAddr{};
@@ -63,107 +112,223 @@ void CameraReceiver::acceptLoop() {
     serverAddr.sin_port = htons(port_);
 
     if (bind(serverSocket_, (struct sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
-        std::cerr << "Failed to bind CameraReceiver socket: " << strerror(errno) << std::endl;
+        LOG_ERROR("Failed to bind CameraReceiver socket: {}", strerror(errno));
         close(serverSocket_);
-        return;
+        serverSocket_ = -1;
+        return false;
     }
 
-    if (listen(serverSocket_, 1) < 0) {
-        std::cerr << "Failed to listen on CameraReceiver socket: " << strerror(errno) << std::endl;
+    if (listen(serverSocket_, SOMAXCONN) < 0) {
+        LOG_ERROR("Failed to listen on CameraReceiver socket: {}", strerror(errno));
         close(serverSocket_);
-        return;
+        serverSocket_ = -1;
+        return false;
     }
+    return true;
+}
+
+void CameraReceiver::workerLoop(Worker& worker) {
+    std::map<int, std::unique_ptr<IngestConnection>> connections;
+    struct epoll_event events[MAX_EVENTS];
 
     while (isRunning_) {
-        std::cout << "Waiting for camera client connection..." << std::endl;
-        sockaddr_in clientAddr{};
-        socklen_t clientLen = sizeof(clientAddr);
-        int clientSocket = accept(serverSocket_, (struct sockaddr*)&clientAddr, &clientLen);
-
-        if (clientSocket < 0) {
-            if (isRunning_) {
-                 std::cerr << "Accept failed on CameraReceiver socket: " << strerror(errno) << std::endl;
-            }
-            break; 
+        int nfds = epoll_wait(worker.epollFd, events, MAX_EVENTS, -1);
+        if (nfds < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("CameraReceiver epoll_wait failed: {}", strerror(errno));
+            break;
         }
+        metrics::ScopedTimerUs busy(*loopTime_);
 
-        char clientIp[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
-        std::cout << "Camera client connected from " << clientIp << ":" << ntohs(clientAddr.sin_port) << std::endl;
+        for (int i = 0; i < nfds; i++) {
+            int fd = events[i].data.fd;
 
-        // For this project, we handle one client at a time.
-        // To handle multiple clients, you would typically start a new thread here.
-        receiveLoop(clientSocket); 
+            if (fd == worker.stopFd) {
+                break;
+            }
 
-        close(clientSocket);
-        std::cout << "Camera client disconnected." << std::endl;
-    }
+            if (fd == serverSocket_) {
+                while (true) {
+                    sockaddr_in clientAddr{};
+                    socklen_t clientLen = sizeof(clientAddr);
+                    int clientSocket = accept4(serverSocket_, (struct sockaddr*)&clientAddr, &clientLen,
+                                               SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (clientSocket < 0) {
+                        if (errno == EINTR || errno == ECONNABORTED) continue;
+                        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                            LOG_RATE_LIMITED(logging::Level::Error, 1, "Accept failed on CameraReceiver socket: {}",
+                                             strerror(errno));
+                        }
+                        break;
+                    }
 
-    if(serverSocket_ != -1) {
-        close(serverSocket_);
-        serverSocket_ = -1;
+                    char clientIp[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+                    int clientPort = ntohs(clientAddr.sin_port);
+                    LOG_INFO("Camera client connected from {}:{}", clientIp, clientPort);
+
+                    struct epoll_event ev{};
+                    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                    ev.data.fd = clientSocket;
+                    epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, clientSocket, &ev);
+                    connections[clientSocket] =
+                        std::make_unique<IngestConnection>(clientSocket, clientIp, clientPort, registry_);
+                }
+                continue;
+            }
+
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            if (!it->second->onReadable(events[i].events)) {
+                epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                connections.erase(it);
+                LOG_INFO("Camera client disconnected.");
+            }
+        }
     }
+    // Remaining connections are closed by their destructors.
 }
 
-void CameraReceiver::receiveLoop(int clientSocket) {
-    int naluCount = 0;
-    while (isRunning_) {
-        uint32_t naluSize_n; // In network byte order
+bool CameraReceiver::uringWorkerLoop(Worker& worker) {
+    uint64_t stopValue = 0;     // outlives the ring and its pending read
+    IoUring ring;
+    if (!ring.init(kUringEntries) || !ring.provideBuffers(kBufferGroup, kBufferCount, kBufferSize)) {
+        LOG_WARN("CameraReceiver: io_uring unavailable ({}), falling back to epoll", strerror(errno));
+        return false;
+    }
+    // Accepts come from the ring now; leaving the listen socket in this
+    // worker's (unwatched) epoll set could swallow an exclusive wakeup.
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, serverSocket_, nullptr);
 
-        // 1. Read the 4-byte NALU size header
-        ssize_t bytesRead = recv(clientSocket, &naluSize_n, sizeof(naluSize_n), MSG_WAITALL);
-        if (bytesRead <= 0) {
-            if (bytesRead < 0) std::cerr << "[RECV] Recv header failed: " << strerror(errno) << std::endl;
-            else std::cout << "[RECV] Client closed connection." << std::endl;
-            break;
-        }
+    struct Connection {
+        std::unique_ptr<IngestConnection> ingest;
+        bool closing = false;
+    };
+    std::map<int, Connection> connections;
 
-        uint32_t naluSize = ntohl(naluSize_n);
-        if (naluSize == 0 || naluSize > 2000000) {
-            std::cerr << "[RECV] Invalid NALU size: " << naluSize << std::endl;
-            continue;
+    // Submission failures only happen when the SQ is full; flush and retry.
+    auto sqe = [&ring]() {
+        io_uring_sqe* entry = ring.getSqe();
+        if (!entry) {
+            ring.submit();
+            entry = ring.getSqe();
         }
+        return entry;
+    };
+    auto armAccept = [&]() {
+        io_uring_sqe* e = sqe();
+        e->opcode = IORING_OP_ACCEPT;
+        e->fd = serverSocket_;
+        e->ioprio = IORING_ACCEPT_MULTISHOT;
+        e->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        e->user_data = kOpAccept;
+    };
+    auto armRecv = [&](int fd) {
+        io_uring_sqe* e = sqe();
+        e->opcode = IORING_OP_RECV;
+        e->fd = fd;
+        e->ioprio = IORING_RECV_MULTISHOT;
+        e->flags = IOSQE_BUFFER_SELECT;
+        e->buf_group = kBufferGroup;
+        e->user_data = (uint64_t(fd) << 8) | kOpRecv;
+    };
+    auto cancelRecv = [&](int fd) {
+        io_uring_sqe* e = sqe();
+        e->opcode = IORING_OP_ASYNC_CANCEL;
+        e->fd = -1;
+        e->addr = (uint64_t(fd) << 8) | kOpRecv;
+        e->user_data = (uint64_t(fd) << 8) | kOpCancel;
+    };
 
-        // 2. Read the NALU data
-        std::vector<uint8_t> nalu(naluSize);
-        bytesRead = recv(clientSocket, nalu.data(), naluSize, MSG_WAITALL);
-        if (bytesRead <= 0) {
-             if (bytesRead < 0) std::cerr << "[RECV] Recv data failed: " << strerror(errno) << std::endl;
-             else std::cout << "[RECV] Client closed connection during data read." << std::endl;
+    armAccept();
+    io_uring_sqe* stop = sqe();
+    stop->opcode = IORING_OP_READ;
+    stop->fd = worker.stopFd;
+    stop->addr = reinterpret_cast<uint64_t>(&stopValue);
+    stop->len = sizeof(stopValue);
+    stop->user_data = kOpStop;
+
+    bool running = true;
+    while (running && isRunning_) {
+        int ret = ring.submitAndWait(-1);
+        if (ret < 0 && ret != -EBUSY) {
+            LOG_ERROR("CameraReceiver io_uring_enter failed: {}", strerror(-ret));
             break;
         }
+        metrics::ScopedTimerUs busy(*loopTime_);
 
-        // --- FIXED Logic: Correctly parse NALU type after start code ---
-        if (naluSize > 0) {
-            naluCount++;
-            
-            // Find start code offset within the received chunk
-            int offset = 0;
-            if (naluSize > 4 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 0 && nalu[3] == 1) {
-                offset = 4;
-            } else if (naluSize > 3 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 1) {
-                offset = 3;
-            }
+        while (io_uring_cqe* cqe = ring.peekCqe()) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            uint32_t flags = cqe->flags;
+            ring.cqeSeen();
+
+            int fd = static_cast<int>(data >> 8);
+            switch (data & 0xFF) {
+            case kOpStop:
+                running = false;
+                break;
+
+            case kOpAccept:
+                if (res >= 0) {
+                    sockaddr_in clientAddr{};
+                    socklen_t clientLen = sizeof(clientAddr);
+                    getpeername(res, (struct sockaddr*)&clientAddr, &clientLen);
+                    char clientIp[INET_ADDRSTRLEN];
+                    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+                    int clientPort = ntohs(clientAddr.sin_port);
+                    LOG_INFO("Camera client connected from {}:{}", clientIp, clientPort);
+
+                    connections[res].ingest =
+                        std::make_unique<IngestConnection>(res, clientIp, clientPort, registry_);
+                    armRecv(res);
+                } else if (res != -EAGAIN && res != -ECANCELED) {
+                    LOG_RATE_LIMITED(logging::Level::Error, 1, "Accept failed on CameraReceiver socket: {}",
+                                     strerror(-res));
+                }
+                if (!(flags & IORING_CQE_F_MORE) && running) armAccept();
+                break;
+
+            case kOpRecv: {
+                auto it = connections.find(fd);
+                if (it == connections.end()) break;
+                Connection& conn = it->second;
 
-            if (naluSize > offset) {
-                uint8_t naluType = nalu[offset] & 0x1F; // Read type AFTER the start code
-                
-                if (naluType == 7) { // SPS
-                    streamBuffer_->setSps(nalu);
-                    std::cout << "[RECV] SPS NALU captured (size: " << nalu.size() << ")" << std::endl;
-                } else if (naluType == 8) { // PPS
-                    streamBuffer_->setPps(nalu);
-                    std::cout << "[RECV] PPS NALU captured (size: " << nalu.size() << ")" << std::endl;
-                } else {
-                    if (naluCount % 30 == 1) {
-                         std::cout << "[RECV] NALU #" << naluCount 
-                                   << " (type: " << (int)naluType << ", size: " << nalu.size() << " bytes)" << std::endl;
+                if (flags & IORING_CQE_F_BUFFER) {
+                    uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+                    if (res > 0 && !conn.closing && !conn.ingest->onData(ring.buffer(bid), res)) {
+                        conn.closing = true;
+                        if (flags & IORING_CQE_F_MORE) cancelRecv(fd);
                     }
+                    ring.recycleBuffer(bid);
                 }
+                if (flags & IORING_CQE_F_MORE) break;
+
+                // The multishot recv has ended. Out of buffers is transient;
+                // anything else (EOF, error, our cancel) ends the connection.
+                if (res == -ENOBUFS && !conn.closing) {
+                    armRecv(fd);
+                    break;
+                }
+                if (res == 0) {
+                    LOG_INFO("[RECV] Camera {} closed connection.", conn.ingest->peer());
+                } else if (res < 0 && res != -ECANCELED) {
+                    LOG_ERROR("[RECV] Recv from {} failed: {}", conn.ingest->peer(), strerror(-res));
+                } else if (res > 0 && !conn.closing) {
+                    armRecv(fd);
+                    break;
+                }
+                connections.erase(it);
+                LOG_INFO("Camera client disconnected.");
+                break;
             }
-        }
 
-        // 3. Push the data to the buffer
-        streamBuffer_->push(std::move(nalu));
+            default:
+                break;
+            }
+        }
     }
+    // Ring teardown cancels outstanding requests; the connections' destructors
+    // then close their sockets.
+    return true;
 }
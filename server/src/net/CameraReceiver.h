@@ -1,26 +1,54 @@
 #pragma once
 
-#include "media/StreamBuffer.h"
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <vector>
 
+// Accepts camera_sender connections and feeds each one into its stream in
+// the registry. Which stream that is depends on the ingest protocol the
+// camera speaks; see IngestConnection.
+//
+// Ingest is event driven: a small pool of worker threads each run an epoll
+// loop over non-blocking sockets. The listen socket is registered in every
+// worker with EPOLLEXCLUSIVE, so a new camera wakes exactly one worker, which
+// accepts it and keeps it for the lifetime of the connection.
+//
+// With IoEngine::IoUring each worker instead owns an io_uring with a
+// multishot accept and one multishot recv per camera drawing from a
+// provided-buffer group (IORING_OP_PROVIDE_BUFFERS), so steady-state ingest
+// needs no syscall per read at all. A worker whose ring cannot be set up
+// falls back to the epoll loop.
 class CameraReceiver {
 public:
-    CameraReceiver(int port, std::shared_ptr<StreamBuffer> streamBuffer);
+    CameraReceiver(int port, std::shared_ptr<StreamRegistry> registry, int workerCount = 2,
+                   IoEngine engine = IoEngine::Epoll);
     ~CameraReceiver();
 
     void start();
     void stop();
 
 private:
-    void acceptLoop();
-    void receiveLoop(int clientSocket);
+    struct Worker {
+        int epollFd = -1;
+        int stopFd = -1;
+        std::thread thread;
+    };
+
+    bool createServerSocket();
+    void workerLoop(Worker& worker);
+    // Returns false without touching any socket if io_uring is unusable.
+    bool uringWorkerLoop(Worker& worker);
 
     int port_;
-    std::shared_ptr<StreamBuffer> streamBuffer_;
+    std::shared_ptr<StreamRegistry> registry_;
     int serverSocket_ = -1;
+    int workerCount_;
+    IoEngine engine_;
     
     std::atomic<bool> isRunning_{false};
-    std::thread acceptThread_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::shared_ptr<metrics::Histogram> loopTime_;   // shared by the workers
 };
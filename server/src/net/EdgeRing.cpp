@@ -0,0 +1,35 @@
+#include "net/EdgeRing.h"
+#include <algorithm>
+
+// FNV-1a with a splitmix64 finalizer: stable across processes and builds
+// (unlike std::hash), and well spread even for ids that differ by one digit.
+static uint64_t ringHash(std::string_view text) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (char c : text) {
+        h ^= static_cast<uint8_t>(c);
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+EdgeRing::EdgeRing(std::vector<std::string> edges) : edges_(std::move(edges)) {
+    points_.reserve(edges_.size() * kPointsPerEdge);
+    for (uint32_t i = 0; i < edges_.size(); i++) {
+        for (int point = 0; point < kPointsPerEdge; point++) {
+            points_.emplace_back(ringHash(edges_[i] + "#" + std::to_string(point)), i);
+        }
+    }
+    std::sort(points_.begin(), points_.end());
+}
+
+const std::string& EdgeRing::edgeFor(std::string_view id) const {
+    uint64_t h = ringHash(id);
+    auto it = std::lower_bound(points_.begin(), points_.end(), std::make_pair(h, uint32_t(0)));
+    if (it == points_.end()) it = points_.begin();
+    return edges_[it->second];
+}
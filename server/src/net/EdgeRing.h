@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+// Request header an edge puts on its pulls from the origin. The origin
+// serves such requests itself instead of redirecting them to an edge.
+inline constexpr std::string_view kEdgePullHeader = "X-Edge-Pull";
+
+// Consistent-hash placement of stream ids on edge servers.
+//
+// Every edge ("host:port") is hashed onto a 64-bit ring at kPointsPerEdge
+// positions; a stream belongs to the first point at or after its own hash.
+// All servers given the same edge list agree on the placement without
+// talking to each other, each edge gets about the same share of streams,
+// and adding or removing an edge moves only the streams on its share.
+class EdgeRing {
+public:
+    static constexpr int kPointsPerEdge = 100;
+
+    explicit EdgeRing(std::vector<std::string> edges);
+
+    bool empty() const { return edges_.empty(); }
+    // "host:port" of the edge serving stream `id`; the ring must not be empty.
+    const std::string& edgeFor(std::string_view id) const;
+
+private:
+    std::vector<std::string> edges_;
+    std::vector<std::pair<uint64_t, uint32_t>> points_;  // (hash, edge index), sorted
+};
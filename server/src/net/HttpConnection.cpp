@@ -0,0 +1,475 @@
+#include "net/HttpConnection.h"
+#include "utils/base64.h"
+#include "utils/sha1.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <cerrno>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static constexpr size_t kReadChunk = 4096;
+static constexpr size_t kMaxInputBuffer = 16 * 1024;
+// Responses queued behind a slow reader (pipelining) before it is dropped.
+static constexpr size_t kMaxQueuedResponses = 64;
+static constexpr auto kIdleTimeout = std::chrono::seconds(30);
+// WebSocket fragments queued before a client counts as slow (~1 s at 30 fps).
+static constexpr size_t kMaxQueuedFragments = 32;
+static constexpr std::string_view kWebSocketGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+namespace http_status {
+constexpr std::string_view kOk = "HTTP/1.1 200 OK\r\n";
+constexpr std::string_view kBadRequest = "HTTP/1.1 400 Bad Request\r\n";
+constexpr std::string_view kNotFound = "HTTP/1.1 404 Not Found\r\n";
+constexpr std::string_view kMethodNotAllowed = "HTTP/1.1 405 Method Not Allowed\r\n";
+constexpr std::string_view kServiceUnavailable = "HTTP/1.1 503 Service Unavailable\r\n";
+}
+
+static constexpr std::string_view kPlaylistType = "application/vnd.apple.mpegurl";
+static constexpr std::string_view kMediaType = "video/mp4";
+
+template <typename T>
+static bool parseNumber(std::string_view text, T& out) {
+    auto res = std::from_chars(text.data(), text.data() + text.size(), out);
+    return res.ec == std::errc() && res.ptr == text.data() + text.size() && !text.empty();
+}
+
+// Value of `key` in an URI query string ("a=1&b=2"); empty when absent.
+static std::string_view queryValue(std::string_view query, std::string_view key) {
+    while (!query.empty()) {
+        size_t amp = query.find('&');
+        std::string_view pair = query.substr(0, amp);
+        if (pair.size() > key.size() && pair.substr(0, key.size()) == key && pair[key.size()] == '=') {
+            return pair.substr(key.size() + 1);
+        }
+        if (amp == std::string_view::npos) break;
+        query.remove_prefix(amp + 1);
+    }
+    return {};
+}
+
+// "<prefix><number><suffix>" -> number
+template <typename T>
+static bool matchName(std::string_view name, std::string_view prefix, std::string_view suffix, T& out) {
+    if (name.size() <= prefix.size() + suffix.size() || name.substr(0, prefix.size()) != prefix ||
+        name.substr(name.size() - suffix.size()) != suffix) {
+        return false;
+    }
+    return parseNumber(name.substr(prefix.size(), name.size() - prefix.size() - suffix.size()), out);
+}
+
+HttpConnection::HttpConnection(int fd, std::string clientIp, std::shared_ptr<StreamRegistry> registry)
+    : fd_(fd), clientIp_(std::move(clientIp)), registry_(std::move(registry)) {
+    lastActivity_ = std::chrono::steady_clock::now();
+}
+
+HttpConnection::~HttpConnection() {
+    if (wsStream_) wsStream_->ws->removeClient();
+    close(fd_);
+}
+
+bool HttpConnection::handleEvent() {
+    lastActivity_ = std::chrono::steady_clock::now();
+    while (!closing_) {
+        ReadResult result = readInput();
+        if (result == ReadResult::Closed) return false;
+
+        size_t buffered = inEnd_ - inStart_;
+        if (!processInput()) {
+            closing_ = true;
+            break;
+        }
+        if (result != ReadResult::BufferFull) break;
+        // Parked: resumeParked() continues with the buffered requests.
+        if (inEnd_ - inStart_ == buffered) break;
+    }
+    return !shouldClose();
+}
+
+HttpConnection::ReadResult HttpConnection::readInput() {
+    while (true) {
+        if (inBuf_.size() - inEnd_ < kReadChunk) {
+            if (inStart_ > 0) {
+                memmove(inBuf_.data(), inBuf_.data() + inStart_, inEnd_ - inStart_);
+                inEnd_ -= inStart_;
+                inStart_ = 0;
+            }
+            if (inBuf_.size() - inEnd_ < kReadChunk) {
+                if (inBuf_.size() >= kMaxInputBuffer) return ReadResult::BufferFull;
+                inBuf_.resize(std::min(kMaxInputBuffer, std::max(inBuf_.size() * 2, kReadChunk)));
+            }
+        }
+
+        ssize_t n = recv(fd_, inBuf_.data() + inEnd_, inBuf_.size() - inEnd_, 0);
+        if (n > 0) {
+            inEnd_ += n;
+            continue;
+        }
+        if (n == 0) return ReadResult::Closed;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return ReadResult::Drained;
+        return ReadResult::Closed;
+    }
+}
+
+bool HttpConnection::processInput() {
+    while (!parked_ && !closing_ && !webSocket_ && inStart_ < inEnd_) {
+        RtspRequest req;
+        size_t consumed = 0;
+        RtspParser::Result result = parser_.parse(inBuf_.data() + inStart_, inEnd_ - inStart_, req, consumed);
+
+        if (result == RtspParser::Result::NeedMore) break;
+        if (result == RtspParser::Result::Error) {
+            closeAfter_ = true;
+            sendError(http_status::kBadRequest);
+            return false;
+        }
+
+        handleRequest(req);
+        inStart_ += consumed;
+        parser_.reset();
+    }
+    if (webSocket_ && !processWebSocketInput()) return false;
+
+    if (inStart_ == inEnd_) {
+        inStart_ = inEnd_ = 0;
+    }
+    return true;
+}
+
+void HttpConnection::handleRequest(const RtspRequest& req) {
+    // HTTP/1.0 closes after each response unless asked not to.
+    std::string_view connection = req.header("Connection");
+    closeAfter_ = req.version == "HTTP/1.0" ? connection != "keep-alive" && connection != "Keep-Alive"
+                                            : connection == "close" || connection == "Close";
+    headOnly_ = req.method == "HEAD";
+    if (req.method != "GET" && !headOnly_) {
+        sendError(http_status::kMethodNotAllowed);
+        return;
+    }
+
+    std::string_view path = req.uri;
+    std::string_view query;
+    size_t mark = path.find('?');
+    if (mark != std::string_view::npos) {
+        query = path.substr(mark + 1);
+        path = path.substr(0, mark);
+    }
+
+    // /live/<id>/<name>
+    std::string_view id = StreamRegistry::streamIdFromUri(path);
+    std::string_view prefix = StreamRegistry::kMountPrefix;
+    size_t nameStart = prefix.size() + 1 + id.size() + 1;
+    // Keeps a pulled stream wanted while players poll it.
+    registry_->requestSource(id);
+    stream_ = id.empty() || path.size() <= nameStart ? nullptr : registry_->find(id);
+    std::string_view name = stream_ ? path.substr(nameStart) : std::string_view();
+    if (name == "ws" && stream_->ws) {
+        upgradeWebSocket(req);
+        return;
+    }
+    if (!stream_ || !stream_->hls) {
+        sendError(http_status::kNotFound);
+        return;
+    }
+    if (!parseTarget(name, query)) return;
+
+    if (!answer(false)) {
+        parked_ = true;
+        parkDeadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(stream_->hls->blockTimeoutMs());
+    }
+}
+
+// Whether a comma separated header value (Connection, Upgrade) has `token`.
+static bool hasToken(std::string_view value, std::string_view token) {
+    while (!value.empty()) {
+        size_t comma = value.find(',');
+        std::string_view item = value.substr(0, comma);
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        if (item.size() == token.size() && strncasecmp(item.data(), token.data(), token.size()) == 0) return true;
+        if (comma == std::string_view::npos) break;
+        value.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+void HttpConnection::upgradeWebSocket(const RtspRequest& req) {
+    std::string_view key = req.header("Sec-WebSocket-Key");
+    if (headOnly_ || key.empty() || !hasToken(req.header("Upgrade"), "websocket") ||
+        !hasToken(req.header("Connection"), "upgrade") || req.header("Sec-WebSocket-Version") != "13") {
+        sendError(http_status::kBadRequest);
+        return;
+    }
+
+    std::string accept(key);
+    accept.append(kWebSocketGuid);
+    auto digest = sha1(reinterpret_cast<const uint8_t*>(accept.data()), accept.size());
+
+    std::string head("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n");
+    head.append("Sec-WebSocket-Accept: ").append(base64_encode(digest.data(), digest.size())).append("\r\n\r\n");
+    closeAfter_ = false;
+    queue(std::move(head), nullptr);
+
+    webSocket_ = true;
+    wsStream_ = std::move(stream_);
+    wsStream_->ws->addClient();
+    pumpWebSocket();
+}
+
+bool HttpConnection::processWebSocketInput() {
+    // Clients only ever send control frames that matter to us (close,
+    // ping); data frames are read and dropped.
+    while (!closing_ && inEnd_ - inStart_ >= 2) {
+        uint8_t* frame = reinterpret_cast<uint8_t*>(inBuf_.data()) + inStart_;
+        size_t available = inEnd_ - inStart_;
+        uint8_t opcode = frame[0] & 0x0F;
+        uint64_t length = frame[1] & 0x7F;
+        size_t header = 2;
+        if (length == 126) {
+            if (available < 4) break;
+            length = (frame[2] << 8) | frame[3];
+            header = 4;
+        } else if (length == 127) {
+            if (available < 10) break;
+            length = 0;
+            for (int i = 2; i < 10; i++) length = (length << 8) | frame[i];
+            header = 10;
+        }
+        // Client frames must be masked (RFC 6455 5.1), and nothing we care
+        // about is bigger than the input buffer.
+        if (!(frame[1] & 0x80) || length > kMaxInputBuffer - header - 4) return false;
+        header += 4;
+        if (available < header + length) break;
+
+        uint8_t* payload = frame + header;
+        for (size_t i = 0; i < length; i++) payload[i] ^= frame[header - 4 + (i & 3)];
+        if (opcode == 0x8) {
+            // Echo the status code and close once everything queued is out.
+            queueControlFrame(0x8, payload, std::min<uint64_t>(length, 2));
+            closing_ = true;
+        } else if (opcode == 0x9) {
+            queueControlFrame(0xA, payload, std::min<uint64_t>(length, 125));
+        }
+        inStart_ += header + length;
+    }
+    return true;
+}
+
+void HttpConnection::queueControlFrame(uint8_t opcode, const uint8_t* payload, size_t size) {
+    std::string frame;
+    frame.push_back(static_cast<char>(0x80 | opcode));
+    frame.push_back(static_cast<char>(size));
+    frame.append(reinterpret_cast<const char*>(payload), size);
+    queue(std::move(frame), nullptr);
+}
+
+bool HttpConnection::pumpWebSocket() {
+    if (!webSocket_ || closing_ || failed_) return !shouldClose();
+    WsFragmenter& ws = *wsStream_->ws;
+
+    while (wsNext_ < ws.nextSeq() || wsWaitKeyframe_) {
+        if (out_.size() >= kMaxQueuedFragments) {
+            // Too slow: drop what the client hasn't started receiving and
+            // pick up again at the next keyframe. The init segment is sent
+            // again in case it was among the dropped.
+            size_t keep = out_.front().sent > 0 ? 1 : 0;
+            out_.erase(out_.begin() + keep, out_.end());
+            wsWaitKeyframe_ = true;
+            wsInitId_ = -1;
+            LOG_RATE_LIMITED(logging::Level::Warn, 5,
+                             "[HTTP] WebSocket client {} too slow, skipping to the next keyframe", clientIp_);
+        }
+        if (wsWaitKeyframe_) {
+            if (!ws.keyframeFrom(wsNext_, wsNext_)) break;
+            wsWaitKeyframe_ = false;
+        }
+
+        WsFragmenter::Message message;
+        WsFragmenter::Read result = ws.read(wsNext_, message);
+        if (result == WsFragmenter::Read::Pending) break;
+        if (result == WsFragmenter::Read::Lapped) {
+            wsWaitKeyframe_ = true;
+            continue;
+        }
+        if (static_cast<int64_t>(message.initId) != wsInitId_) {
+            WsBytes init = ws.initMessage(message.initId);
+            if (!init) {
+                wsNext_++;
+                continue;
+            }
+            queue(std::string(), init);
+            wsInitId_ = message.initId;
+        }
+        queue(std::string(), message.data);
+        wsNext_++;
+    }
+    return !shouldClose();
+}
+
+bool HttpConnection::parseTarget(std::string_view name, std::string_view query) {
+    msn_ = -1;
+    part_ = -1;
+    if (name == "index.m3u8") {
+        target_ = Target::Playlist;
+        std::string_view msn = queryValue(query, "_HLS_msn");
+        std::string_view part = queryValue(query, "_HLS_part");
+        // _HLS_part alone is invalid; _HLS_skip is not supported and ignored.
+        if ((!msn.empty() && (!parseNumber(msn, msn_) || msn_ < 0)) || (!part.empty() && msn.empty()) ||
+            (!part.empty() && (!parseNumber(part, part_) || part_ < 0))) {
+            sendError(http_status::kBadRequest);
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t number = 0;
+    if (matchName(name, "init", ".mp4", number)) {
+        target_ = Target::Init;
+    } else if (matchName(name, "seg", ".m4s", number)) {
+        target_ = Target::Segment;
+    } else {
+        // part<msn>.<index>.m4s
+        size_t dot = name.find('.');
+        if (dot == std::string_view::npos || !matchName(name.substr(0, dot), "part", "", number) ||
+            !matchName(name.substr(dot), ".", ".m4s", part_) || part_ < 0) {
+            sendError(http_status::kNotFound);
+            return false;
+        }
+        target_ = Target::Part;
+    }
+    msn_ = static_cast<int64_t>(number);
+    return true;
+}
+
+bool HttpConnection::answer(bool expired) {
+    HlsSegmenter& hls = *stream_->hls;
+    HlsSegmenter::Wait state = HlsSegmenter::Wait::Ready;
+    if (target_ == Target::Playlist) {
+        state = hls.playlistState(msn_, part_);
+    } else if (target_ == Target::Part) {
+        state = hls.partState(static_cast<uint64_t>(msn_), static_cast<uint32_t>(part_));
+    }
+
+    if (state == HlsSegmenter::Wait::Pending) {
+        if (!expired) return false;
+        sendError(http_status::kServiceUnavailable);
+    } else if (state == HlsSegmenter::Wait::Gone) {
+        sendError(target_ == Target::Playlist ? http_status::kBadRequest : http_status::kNotFound);
+    } else if (target_ == Target::Playlist) {
+        sendBody(hls.playlist(), kPlaylistType, "no-cache");
+    } else {
+        HlsBytes body = target_ == Target::Init      ? hls.initSegment(static_cast<uint32_t>(msn_))
+                        : target_ == Target::Segment ? hls.segment(static_cast<uint64_t>(msn_))
+                                                     : hls.part(static_cast<uint64_t>(msn_), static_cast<uint32_t>(part_));
+        if (body) {
+            sendBody(body, kMediaType, "max-age=60");
+        } else {
+            sendError(http_status::kNotFound);
+        }
+    }
+    stream_.reset();
+    return true;
+}
+
+void HttpConnection::resumeParked(std::chrono::steady_clock::time_point now) {
+    if (!parked_ || !answer(now >= parkDeadline_)) return;
+    parked_ = false;
+    if (!processInput()) closing_ = true;
+    flushOutput();
+}
+
+void HttpConnection::sendBody(const HlsBytes& body, std::string_view contentType, std::string_view cacheControl) {
+    char length[24];
+    auto res = std::to_chars(length, length + sizeof(length), body ? body->size() : 0);
+
+    std::string head;
+    head.reserve(256);
+    head.append(http_status::kOk)
+        .append("Content-Type: ").append(contentType)
+        .append("\r\nContent-Length: ").append(length, res.ptr - length)
+        .append("\r\nCache-Control: ").append(cacheControl)
+        .append("\r\nAccess-Control-Allow-Origin: *\r\n");
+    if (closeAfter_) head.append("Connection: close\r\n");
+    head.append("\r\n");
+    queue(std::move(head), headOnly_ ? nullptr : body);
+}
+
+void HttpConnection::sendError(std::string_view statusLine) {
+    std::string head(statusLine);
+    head.append("Content-Length: 0\r\nAccess-Control-Allow-Origin: *\r\n");
+    if (closeAfter_) head.append("Connection: close\r\n");
+    head.append("\r\n");
+    queue(std::move(head), nullptr);
+    stream_.reset();
+}
+
+void HttpConnection::queue(std::string head, HlsBytes body) {
+    if (closeAfter_) closing_ = true;
+    if (out_.size() >= kMaxQueuedResponses) {
+        LOG_WARN("[HTTP] Output backlog exceeded for {}, dropping client", clientIp_);
+        failed_ = true;
+        return;
+    }
+    Output output;
+    output.head = std::move(head);
+    output.body = std::move(body);
+    out_.push_back(std::move(output));
+    if (out_.size() == 1) flushOutput();
+}
+
+bool HttpConnection::flushOutput() {
+    while (!failed_ && !out_.empty()) {
+        Output& output = out_.front();
+        size_t headSize = output.head.size();
+        size_t bodySize = output.body ? output.body->size() : 0;
+
+        struct iovec iov[2];
+        int count = 0;
+        if (output.sent < headSize) {
+            iov[count].iov_base = output.head.data() + output.sent;
+            iov[count].iov_len = headSize - output.sent;
+            count++;
+        }
+        size_t bodySent = output.sent > headSize ? output.sent - headSize : 0;
+        if (bodySent < bodySize) {
+            iov[count].iov_base = const_cast<uint8_t*>(output.body->data()) + bodySent;
+            iov[count].iov_len = bodySize - bodySent;
+            count++;
+        }
+        if (count == 0) {
+            out_.pop_front();
+            continue;
+        }
+
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t n = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            output.sent += n;
+            if (webSocket_) lastActivity_ = std::chrono::steady_clock::now();
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            failed_ = true;
+        }
+    }
+    return !shouldClose();
+}
+
+bool HttpConnection::shouldClose() const {
+    return failed_ || (closing_ && out_.empty());
+}
+
+bool HttpConnection::isIdle(std::chrono::steady_clock::time_point now) const {
+    // A WebSocket may wait for its camera indefinitely, but not for a
+    // client that stopped reading.
+    if (webSocket_) return !out_.empty() && now - lastActivity_ > kIdleTimeout;
+    return !parked_ && out_.empty() && now - lastActivity_ > kIdleTimeout;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "media/StreamRegistry.h"
+#include "net/RtspParser.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+
+// One HTTP/1.1 client of the LL-HLS and WebSocket outputs (see HttpServer).
+//
+// Requests are parsed in place like RTSP ones and answered from the
+// segmenter's cache: a response is a small header plus a reference to
+// shared playlist or media bytes, written with one sendmsg() and never
+// copied per client. A blocking playlist reload (_HLS_msn/_HLS_part) or a
+// request for the preload-hinted part that is not there yet parks the
+// connection until HttpServer calls resumeParked() after a segmenter update
+// or at the deadline. Pipelined requests behind a parked one wait, so
+// responses stay in request order.
+//
+// GET /live/<id>/ws upgrades the connection to a WebSocket that streams the
+// stream's fMP4 fragments (WsFragmenter). Its queue holds at most a second
+// or so of fragments; a client that falls further behind loses what it has
+// not started receiving and resumes at the next keyframe, like a slow RTP
+// viewer.
+class HttpConnection {
+public:
+    HttpConnection(int fd, std::string clientIp, std::shared_ptr<StreamRegistry> registry);
+    ~HttpConnection();
+
+    // Edge-triggered readiness handlers; false once the connection should
+    // be closed.
+    bool handleEvent();
+    bool flushOutput();
+    bool shouldClose() const;
+
+    bool isParked() const { return parked_; }
+    std::chrono::steady_clock::time_point parkDeadline() const { return parkDeadline_; }
+    // Answers the parked request if it can be answered now (503 once the
+    // deadline passed) and runs the requests queued behind it.
+    void resumeParked(std::chrono::steady_clock::time_point now);
+
+    bool isIdle(std::chrono::steady_clock::time_point now) const;
+
+    bool isWebSocket() const { return webSocket_; }
+    // Queues the fragments published since the last call; false once the
+    // connection should be closed.
+    bool pumpWebSocket();
+
+private:
+    enum class ReadResult { Drained, BufferFull, Closed };
+    enum class Target { Playlist, Init, Segment, Part };
+
+    ReadResult readInput();
+    bool processInput();
+    void handleRequest(const RtspRequest& request);
+    bool parseTarget(std::string_view name, std::string_view query);
+    bool answer(bool expired);
+    void sendBody(const HlsBytes& body, std::string_view contentType, std::string_view cacheControl);
+    void sendError(std::string_view statusLine);
+    void queue(std::string head, HlsBytes body);
+    void upgradeWebSocket(const RtspRequest& request);
+    bool processWebSocketInput();
+    void queueControlFrame(uint8_t opcode, const uint8_t* payload, size_t size);
+
+    int fd_;
+    std::string clientIp_;
+    std::shared_ptr<StreamRegistry> registry_;
+    std::chrono::steady_clock::time_point lastActivity_;
+
+    std::vector<char> inBuf_;
+    size_t inStart_ = 0;
+    size_t inEnd_ = 0;
+    RtspParser parser_{"HTTP/"};
+
+    struct Output {
+        std::string head;
+        HlsBytes body;          // null for bodiless responses and HEAD
+        size_t sent = 0;        // bytes of head + body already written
+    };
+    std::deque<Output> out_;
+    bool closing_ = false;      // close once out_ drains
+    bool failed_ = false;       // close immediately
+
+    // The request being answered; kept while it is parked.
+    std::shared_ptr<Stream> stream_;
+    Target target_ = Target::Playlist;
+    int64_t msn_ = -1;
+    int part_ = -1;
+    bool headOnly_ = false;
+    bool closeAfter_ = false;
+    bool parked_ = false;
+    std::chrono::steady_clock::time_point parkDeadline_;
+
+    // After a WebSocket upgrade.
+    bool webSocket_ = false;
+    std::shared_ptr<Stream> wsStream_;
+    uint64_t wsNext_ = 0;           // next fragment to queue
+    int64_t wsInitId_ = -1;         // init segment the client has
+    bool wsWaitKeyframe_ = true;
+};
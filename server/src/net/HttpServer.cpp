@@ -0,0 +1,239 @@
+#include "net/HttpServer.h"
+#include "utils/Log.h"
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <cstring>
+
+static constexpr int kMaxEvents = 256;
+static constexpr uint32_t kClientEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+static constexpr int kAcceptRetryMs = 100;
+static constexpr auto kReapInterval = std::chrono::seconds(1);
+
+HttpServer::HttpServer(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry)
+    : port_(config.hlsPort), listenBacklog_(config.listenBacklog), registry_(std::move(registry)),
+      connectionCount_(metrics::Registry::instance().gauge("rtsp_http_connections", "Open HTTP connections.")),
+      webSocketCount_(metrics::Registry::instance().gauge(
+          "rtsp_websocket_clients", "HTTP connections upgraded to WebSocket playback.")),
+      loopTime_(metrics::Registry::instance().histogram(
+          "rtsp_reactor_loop_seconds", "Time a reactor thread spends handling one batch of events.",
+          metrics::latencyBoundsUs(), 1e-6, {{"loop", "http"}})) {}
+
+HttpServer::~HttpServer() {
+    stop();
+    registry_->setHttpUpdateListener(nullptr);
+    connections_.clear();
+    if (serverFd_ != -1) close(serverFd_);
+    if (wakeFd_ != -1) close(wakeFd_);
+    if (epollFd_ != -1) close(epollFd_);
+}
+
+bool HttpServer::start() {
+    serverFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    setsockopt(serverFd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port_);
+    if (bind(serverFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(serverFd_, listenBacklog_) < 0) {
+        LOG_ERROR("[HTTP] bind/listen: {}", strerror(errno));
+        return false;
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = serverFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, serverFd_, &ev);
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    int wakeFd = wakeFd_;
+    registry_->setHttpUpdateListener([wakeFd]() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    });
+
+    running_ = true;
+    thread_ = std::thread(&HttpServer::run, this);
+    LOG_INFO("HTTP (LL-HLS, WebSocket) server started on port {}", port_);
+    return true;
+}
+
+void HttpServer::stop() {
+    if (!running_) return;
+    running_ = false;
+    uint64_t one = 1;
+    ssize_t ignored = write(wakeFd_, &one, sizeof(one));
+    (void)ignored;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void HttpServer::acceptConnections() {
+    acceptStalled_ = false;
+    while (true) {
+        struct sockaddr_in clientAddr;
+        socklen_t len = sizeof(clientAddr);
+        int fd = accept4(serverFd_, (struct sockaddr*)&clientAddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                LOG_ERROR("[HTTP] accept4: {}", strerror(errno));
+                acceptStalled_ = true;
+            }
+            break;
+        }
+        // Playlists and parts are small; don't let Nagle hold their tails.
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        struct epoll_event ev{};
+        ev.events = kClientEvents;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+
+        char clientIp[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+        connections_[fd] = std::make_unique<HttpConnection>(fd, clientIp, registry_);
+    }
+}
+
+void HttpServer::closeConnection(int fd) {
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    parked_.erase(fd);
+    webSockets_.erase(fd);
+    connections_.erase(fd);
+}
+
+void HttpServer::serviceParked(bool updated) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> finished;
+    for (auto it = parked_.begin(); it != parked_.end();) {
+        auto cit = connections_.find(*it);
+        if (cit == connections_.end()) {
+            it = parked_.erase(it);
+            continue;
+        }
+        HttpConnection* connection = cit->second.get();
+        if (updated || connection->parkDeadline() <= now) {
+            connection->resumeParked(now);
+        }
+        if (connection->shouldClose()) {
+            finished.push_back(*it);
+        }
+        if (!connection->isParked()) {
+            it = parked_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (int fd : finished) closeConnection(fd);
+}
+
+void HttpServer::pumpWebSockets() {
+    std::vector<int> finished;
+    for (int fd : webSockets_) {
+        auto it = connections_.find(fd);
+        if (it == connections_.end() || !it->second->pumpWebSocket()) finished.push_back(fd);
+    }
+    for (int fd : finished) closeConnection(fd);
+}
+
+void HttpServer::reapIdle() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> idle;
+    for (auto& entry : connections_) {
+        if (entry.second->isIdle(now)) idle.push_back(entry.first);
+    }
+    for (int fd : idle) closeConnection(fd);
+}
+
+int HttpServer::nextEpollTimeoutMs() const {
+    auto now = std::chrono::steady_clock::now();
+    auto earliest = nextReap_;
+    for (int fd : parked_) {
+        auto it = connections_.find(fd);
+        if (it != connections_.end() && it->second->parkDeadline() < earliest) {
+            earliest = it->second->parkDeadline();
+        }
+    }
+    if (earliest <= now) return 0;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - now).count();
+    if (acceptStalled_ && ms > kAcceptRetryMs) return kAcceptRetryMs;
+    return static_cast<int>(ms) + 1;
+}
+
+void HttpServer::run() {
+    struct epoll_event events[kMaxEvents];
+    nextReap_ = std::chrono::steady_clock::now() + kReapInterval;
+
+    while (running_) {
+        int nfds = epoll_wait(epollFd_, events, kMaxEvents, nextEpollTimeoutMs());
+        metrics::ScopedTimerUs busy(*loopTime_);
+        bool updated = false;
+
+        for (int i = 0; i < nfds; i++) {
+            int fd = events[i].data.fd;
+            uint32_t revents = events[i].events;
+
+            if (fd == serverFd_) {
+                acceptConnections();
+            } else if (fd == wakeFd_) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+                (void)ignored;
+                updated = true;
+            } else {
+                auto it = connections_.find(fd);
+                if (it == connections_.end()) continue;
+                HttpConnection* connection = it->second.get();
+
+                bool keepAlive = true;
+                if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    keepAlive = connection->handleEvent();
+                }
+                if (keepAlive && (revents & EPOLLOUT)) {
+                    keepAlive = connection->flushOutput();
+                    // Room again: refill from where the queue cap stopped.
+                    if (keepAlive && connection->isWebSocket()) keepAlive = connection->pumpWebSocket();
+                }
+                if (!keepAlive) {
+                    closeConnection(fd);
+                } else if (connection->isParked()) {
+                    parked_.insert(fd);
+                } else if (connection->isWebSocket()) {
+                    webSockets_.insert(fd);
+                }
+            }
+        }
+
+        if (acceptStalled_) {
+            acceptConnections();
+        }
+        if (!parked_.empty()) {
+            serviceParked(updated);
+        }
+        if (updated && !webSockets_.empty()) {
+            pumpWebSockets();
+        }
+        if (std::chrono::steady_clock::now() >= nextReap_) {
+            reapIdle();
+            nextReap_ = std::chrono::steady_clock::now() + kReapInterval;
+        }
+        connectionCount_->set(static_cast<int64_t>(connections_.size()));
+        webSocketCount_->set(static_cast<int64_t>(webSockets_.size()));
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "net/HttpConnection.h"
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
+#include "utils/Metrics.h"
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+// Embedded HTTP/1.1 server for the LL-HLS and WebSocket outputs, on its
+// own thread.
+//
+// Same shape as TcpServer: one edge-triggered epoll loop owning every
+// connection. Responses come straight from each stream's HlsSegmenter
+// cache, so one thread keeps up with thousands of players. Segmenters
+// signal new parts through an eventfd; the loop then re-checks the parked
+// (blocking) requests, which otherwise wait for their deadline. The same
+// wakeup, sent per fragment by WsFragmenter, has every WebSocket
+// connection queue the new fragments.
+class HttpServer {
+public:
+    HttpServer(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry);
+    ~HttpServer();
+
+    // Binds the port and starts serving. Returns false if it can't listen.
+    bool start();
+    void stop();
+
+private:
+    void run();
+    void acceptConnections();
+    void closeConnection(int fd);
+    void serviceParked(bool updated);
+    void pumpWebSockets();
+    void reapIdle();
+    int nextEpollTimeoutMs() const;
+
+    const int port_;
+    const int listenBacklog_;
+    std::shared_ptr<StreamRegistry> registry_;
+    int serverFd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;            // eventfd signalled by segmenters and stop()
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    std::unordered_map<int, std::unique_ptr<HttpConnection>> connections_;
+    std::set<int> parked_;
+    std::set<int> webSockets_;
+    std::chrono::steady_clock::time_point nextReap_;
+    bool acceptStalled_ = false;
+
+    std::shared_ptr<metrics::Gauge> connectionCount_;
+    std::shared_ptr<metrics::Gauge> webSocketCount_;
+    std::shared_ptr<metrics::Histogram> loopTime_;
+};
@@ -0,0 +1,309 @@
+#include "net/IngestConnection.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+static constexpr uint32_t kMinNaluSize = 4;           // 3-byte start code + NAL header
+static constexpr size_t kInitialBufferSize = 256 * 1024;
+static constexpr size_t kMinReadSpace = 64 * 1024;
+// A camera that loses power leaves a half-open connection behind. Its
+// reconnect takes the stream over (Stream::claimIngest()); probing idle
+// links is what eventually closes the old one.
+static constexpr int kKeepaliveIdleSec = 5;
+static constexpr int kKeepaliveIntervalSec = 2;
+static constexpr int kKeepaliveProbes = 3;
+
+IngestConnection::IngestConnection(int fd, std::string ip, int port, std::shared_ptr<StreamRegistry> registry)
+    : fd_(fd), ip_(std::move(ip)), port_(port), peer_(ip_ + ":" + std::to_string(port)),
+      registry_(std::move(registry)), buf_(kInitialBufferSize) {
+    int on = 1;
+    setsockopt(fd_, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPIDLE, &kKeepaliveIdleSec, sizeof(int));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPINTVL, &kKeepaliveIntervalSec, sizeof(int));
+    setsockopt(fd_, IPPROTO_TCP, TCP_KEEPCNT, &kKeepaliveProbes, sizeof(int));
+}
+
+IngestConnection::~IngestConnection() {
+    if (naluCount_ > 0) {
+        if (lostNalus_ > 0) {
+            LOG_INFO("[RECV] {}: {} NALUs in {} recv calls, {} lost", peer_, naluCount_, recvCalls_, lostNalus_);
+        } else {
+            LOG_INFO("[RECV] {}: {} NALUs in {} recv calls", peer_, naluCount_, recvCalls_);
+        }
+    }
+    if (stream_) stream_->releaseIngest();
+    close(fd_);
+}
+
+bool IngestConnection::onReadable(uint32_t events) {
+    // Under edge triggering the socket must be drained, but a short read
+    // already tells us the kernel queue is empty: any later data raises a
+    // new edge. Only when the peer has hung up do we keep reading until
+    // recv returns 0, since no further event would report the EOF.
+    bool peerClosed = events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+
+    while (true) {
+        reserveTail();
+        size_t space = buf_.size() - end_;
+        ssize_t n = recv(fd_, buf_.data() + end_, space, 0);
+        recvCalls_++;
+
+        if (n > 0) {
+            end_ += n;
+            parseRecords();
+            if (rejected_) return false;
+            if (static_cast<size_t>(n) < space && !peerClosed) return true;
+            continue;
+        }
+        if (n == 0) {
+            LOG_INFO("[RECV] Camera {} closed connection.", peer_);
+            return false;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+        LOG_ERROR("[RECV] Recv from {} failed: {}", peer_, strerror(errno));
+        return false;
+    }
+}
+
+bool IngestConnection::onData(const uint8_t* data, size_t size) {
+    recvCalls_++;
+    while (size > 0) {
+        reserveTail();
+        size_t n = std::min(size, buf_.size() - end_);
+        memcpy(buf_.data() + end_, data, n);
+        end_ += n;
+        data += n;
+        size -= n;
+        parseRecords();
+        if (rejected_) return false;
+    }
+    return true;
+}
+
+void IngestConnection::reserveTail() {
+    if (start_ == end_) {
+        start_ = end_ = 0;
+    }
+    bool recordFits = start_ + needed_ <= buf_.size();
+    if (buf_.size() - end_ >= kMinReadSpace && recordFits) {
+        return;
+    }
+    if (start_ > 0) {
+        memmove(buf_.data(), buf_.data() + start_, end_ - start_);
+        end_ -= start_;
+        start_ = 0;
+    }
+    // A record larger than the buffer is the only reason to grow it.
+    size_t want = std::max(needed_, end_ + kMinReadSpace);
+    if (want > buf_.size()) {
+        buf_.resize(std::max(want, buf_.size() * 2));
+    }
+}
+
+IngestConnection::Record IngestConnection::checkRecord(size_t offset, RecordInfo& info) const {
+    size_t avail = end_ - offset;
+    const uint8_t* p = buf_.data() + offset;
+
+    if (mode_ == Mode::V2) {
+        if (avail < ingest::kFrameHeaderSize) {
+            // Reject a wrong magic early so resync does not stall on it.
+            if (avail >= 2 && ingest::getBe16(p) != ingest::kFrameMagic) return Record::Invalid;
+            return Record::NeedMore;
+        }
+        if (!ingest::decodeFrameHeader(p, info.frame)) return Record::Invalid;
+        info.headerSize = info.frame.headerSize;
+        info.payloadSize = info.frame.payloadSize;
+    } else {
+        if (avail < 4) return Record::NeedMore;
+        info.headerSize = 4;
+        info.payloadSize = ingest::getBe32(p);
+        if (info.payloadSize > ingest::kMaxNaluSize) return Record::Invalid;
+    }
+    if (info.payloadSize < kMinNaluSize) return Record::Invalid;
+
+    if (avail < info.headerSize + kMinNaluSize) return Record::NeedMore;
+    p += info.headerSize;
+    if (p[0] != 0 || p[1] != 0) return Record::Invalid;
+    if (p[2] == 1) {
+        info.startCodeLength = 3;
+        return Record::Valid;
+    }
+    if (p[2] == 0 && p[3] == 1) {
+        info.startCodeLength = 4;
+        return Record::Valid;
+    }
+    return Record::Invalid;
+}
+
+bool IngestConnection::detectProtocol() {
+    if (end_ - start_ < sizeof(ingest::kHelloMagic)) return false;
+    if (ingest::isHelloMagic(buf_.data() + start_)) {
+        return handleHello();
+    }
+    attachLegacy();
+    return !rejected_;
+}
+
+bool IngestConnection::handleHello() {
+    size_t avail = end_ - start_;
+    if (avail < ingest::kHelloFixedSize) return false;
+    const uint8_t* p = buf_.data() + start_;
+    uint8_t version = p[4];
+    uint8_t codec = p[5];
+    size_t idLength = ingest::getBe16(p + 6);
+    if (idLength <= ingest::kMaxStreamIdLength && avail < ingest::kHelloFixedSize + idLength) return false;
+
+    std::string id;
+    if (idLength <= ingest::kMaxStreamIdLength) {
+        id.assign(reinterpret_cast<const char*>(p + ingest::kHelloFixedSize), idLength);
+    }
+
+    uint8_t status = ingest::kAckOk;
+    if (version != ingest::kVersion2 || codec != ingest::kCodecH264 || !ingest::isValidStreamId(id)) {
+        LOG_WARN("[RECV] Rejecting Hello from {} (version {}, codec {})", peer_, (int)version, (int)codec);
+        status = ingest::kAckBadRequest;
+    } else if (!attach(id)) {
+        LOG_WARN("[RECV] Rejecting {}: stream '{}' already has a publisher", peer_, id);
+        status = ingest::kAckStreamBusy;
+    }
+
+    // Six bytes on a fresh connection always fit in the socket send buffer.
+    uint8_t ack[ingest::kHelloAckSize];
+    ingest::encodeHelloAck(ack, ingest::kVersion2, status);
+    ssize_t ignored = send(fd_, ack, sizeof(ack), MSG_NOSIGNAL);
+    (void)ignored;
+
+    if (status != ingest::kAckOk) {
+        rejected_ = true;
+        return false;
+    }
+    mode_ = Mode::V2;
+    start_ += ingest::kHelloFixedSize + idLength;
+    return true;
+}
+
+bool IngestConnection::attach(const std::string& id) {
+    std::shared_ptr<Stream> stream = registry_->acquire(id);
+    session_ = stream->claimIngest(peer_);
+    if (session_ == 0) return false;
+    stream_ = std::move(stream);
+    LOG_INFO("Camera {} publishing to {}/{}", peer_, StreamRegistry::kMountPrefix, stream_->id);
+    return true;
+}
+
+void IngestConnection::attachLegacy() {
+    // The legacy wire format carries no stream id, so a camera is known by
+    // its address and served at /live/<ip>. A reconnect from the same node
+    // lands on the same stream, taking it over from the connection it left
+    // behind. A second publisher from the same address while the first is
+    // still sending (several encoders on one host) gets /live/<ip>-<port>.
+    mode_ = Mode::Legacy;
+    if (!attach(ip_) && !attach(ip_ + "-" + std::to_string(port_))) {
+        LOG_WARN("[RECV] Rejecting {}: no free stream for its address", peer_);
+        rejected_ = true;
+    }
+}
+
+bool IngestConnection::resync() {
+    // Emulation prevention keeps 00 00 01 out of NALU payloads, so a sane
+    // header immediately followed by a start code is a reliable anchor.
+    for (size_t pos = start_; pos < end_; pos++) {
+        RecordInfo info;
+        Record r = checkRecord(pos, info);
+        if (r == Record::Invalid) continue;
+
+        skippedBytes_ += pos - start_;
+        start_ = pos;
+        if (r == Record::NeedMore) return false;
+
+        LOG_RATE_LIMITED(logging::Level::Warn, 5, "[RECV] Resynchronized {} after skipping {} bytes", peer_,
+                         skippedBytes_);
+        resyncing_ = false;
+        skippedBytes_ = 0;
+        return true;
+    }
+    skippedBytes_ += end_ - start_;
+    start_ = end_;
+    return false;
+}
+
+void IngestConnection::parseRecords() {
+    if (mode_ == Mode::Detect && !detectProtocol()) return;
+
+    while (start_ < end_) {
+        if (resyncing_ && !resync()) break;
+
+        RecordInfo info;
+        Record r = checkRecord(start_, info);
+        if (r == Record::Invalid) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5, "[RECV] Invalid record from {} (length {}), resynchronizing",
+                             peer_, info.payloadSize);
+            resyncing_ = true;
+            needed_ = 0;
+            skippedBytes_ = 1;
+            start_++;
+            continue;
+        }
+        size_t recordSize = info.headerSize + info.payloadSize;
+        if (r == Record::NeedMore || end_ - start_ < recordSize) {
+            needed_ = (r == Record::Valid) ? recordSize : 0;
+            break;
+        }
+
+        if (!stream_->isPublisher(session_)) {
+            LOG_INFO("[RECV] {}: another connection took over {}/{}, closing", peer_, StreamRegistry::kMountPrefix,
+                     stream_->id);
+            rejected_ = true;
+            return;
+        }
+        publish(buf_.data() + start_ + info.headerSize, info);
+        start_ += recordSize;
+        needed_ = 0;
+    }
+}
+
+void IngestConnection::trackSequence(uint32_t sequence) {
+    if (haveSequence_ && sequence != nextSequence_) {
+        uint32_t gap = sequence - nextSequence_;
+        lostNalus_ += gap;
+        LOG_RATE_LIMITED(logging::Level::Warn, 5, "[RECV] {}: {} NALUs lost before seq {}", stream_->id, gap,
+                         sequence);
+    }
+    haveSequence_ = true;
+    nextSequence_ = sequence + 1;
+}
+
+void IngestConnection::publish(const uint8_t* data, const RecordInfo& info) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data.assign(data, data + info.payloadSize);
+    nalu->startCodeLength = info.startCodeLength;
+    if (mode_ == Mode::V2) {
+        // The camera already classified the NALU; no byte sniffing needed.
+        trackSequence(info.frame.sequence);
+        nalu->type = info.frame.nalType;
+        nalu->hasFrameInfo = true;
+        nalu->accessUnitEnd = info.frame.flags & ingest::kFlagAuEnd;
+        nalu->captureUs = info.frame.captureUs;
+    } else {
+        nalu->type = nalu->data[info.startCodeLength] & 0x1F;
+    }
+    naluCount_++;
+
+    if (nalu->type == 7) { // SPS
+        LOG_DEBUG("[RECV] {} SPS NALU captured (size: {})", stream_->id, nalu->data.size());
+    } else if (nalu->type == 8) { // PPS
+        LOG_DEBUG("[RECV] {} PPS NALU captured (size: {})", stream_->id, nalu->data.size());
+    } else if (naluCount_ % 30 == 1) {
+        LOG_DEBUG("[RECV] {} NALU #{} (type: {}, size: {} bytes)", stream_->id, naluCount_, (int)nalu->type,
+                  nalu->data.size());
+    }
+
+    stream_->publish(std::move(nalu));
+}
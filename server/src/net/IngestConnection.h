@@ -0,0 +1,90 @@
+#pragma once
+#include "media/StreamRegistry.h"
+#include "IngestProtocol.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// One camera_sender TCP connection on a non-blocking socket.
+//
+// The first bytes select the wire format (see common/IngestProtocol.h):
+// a v2 Hello names the stream and switches to framed NALUs with metadata,
+// anything else is the legacy [4-byte length][NALU] format, published under
+// the camera's IP address.
+//
+// onReadable() reads the socket in large chunks into a per-connection buffer
+// and parses every complete record in place, so a burst of small NALUs (SPS,
+// PPS, slices) costs one recv instead of two per NALU. Unparsed bytes are
+// moved to the front of the buffer only when its tail runs short, and the
+// buffer grows only for a NALU larger than itself.
+//
+// A record is accepted only if its header is sane and its payload begins
+// with an Annex B start code. When either check fails the connection scans
+// forward for the next position that passes both (resync) instead of
+// dropping the camera.
+class IngestConnection {
+public:
+    IngestConnection(int fd, std::string ip, int port, std::shared_ptr<StreamRegistry> registry);
+    ~IngestConnection();
+
+    // `events` is the epoll mask that woke us. Returns false when the
+    // connection is finished (EOF, a socket error or a rejected Hello) and
+    // should be closed.
+    bool onReadable(uint32_t events);
+
+    // Completion-based counterpart of onReadable() for the io_uring engine:
+    // the kernel already received `size` bytes into one of its buffers.
+    // Returns false if the connection should be closed (rejected Hello).
+    bool onData(const uint8_t* data, size_t size);
+
+    int fd() const { return fd_; }
+    const std::string& peer() const { return peer_; }
+
+private:
+    enum class Mode { Detect, Legacy, V2 };
+    enum class Record { Valid, Invalid, NeedMore };
+
+    struct RecordInfo {
+        size_t headerSize = 0;
+        uint32_t payloadSize = 0;
+        size_t startCodeLength = 0;
+        ingest::FrameHeader frame;
+    };
+
+    bool detectProtocol();
+    bool handleHello();
+    bool attach(const std::string& id);
+    void attachLegacy();
+
+    Record checkRecord(size_t offset, RecordInfo& info) const;
+    void parseRecords();
+    bool resync();
+    void reserveTail();
+    void publish(const uint8_t* data, const RecordInfo& info);
+    void trackSequence(uint32_t sequence);
+
+    int fd_;
+    std::string ip_;
+    int port_;
+    std::string peer_;
+    std::shared_ptr<StreamRegistry> registry_;
+    std::shared_ptr<Stream> stream_;
+    uint32_t session_ = 0;      // our Stream::claimIngest() session
+    Mode mode_ = Mode::Detect;
+    bool rejected_ = false;
+
+    std::vector<uint8_t> buf_;
+    size_t start_ = 0;     // first unparsed byte
+    size_t end_ = 0;       // one past the last received byte
+    size_t needed_ = 0;    // size of the incomplete record at start_, if known
+    bool resyncing_ = false;
+    uint64_t skippedBytes_ = 0;
+
+    bool haveSequence_ = false;
+    uint32_t nextSequence_ = 0;
+    uint64_t lostNalus_ = 0;
+
+    uint64_t naluCount_ = 0;
+    uint64_t recvCalls_ = 0;
+};
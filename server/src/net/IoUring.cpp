@@ -0,0 +1,199 @@
+#include "net/IoUring.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+static int sysSetup(unsigned entries, io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysRegister(int fd, unsigned op, const void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, op, arg, count));
+}
+
+template <typename T>
+static T* ringPtr(void* base, uint32_t offset) {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(base) + offset);
+}
+
+IoUring::~IoUring() {
+    if (bufferBase_) munmap(bufferBase_, bufferBytes_);
+    if (sqes_) munmap(sqes_, sqesSize_);
+    if (cqRing_ && cqRing_ != sqRing_) munmap(cqRing_, cqRingSize_);
+    if (sqRing_) munmap(sqRing_, sqRingSize_);
+    if (ringFd_ >= 0) close(ringFd_);
+}
+
+bool IoUring::init(unsigned entries) {
+    io_uring_params params{};
+    // Every ring here is driven by exactly one thread; these let the kernel
+    // skip cross-thread wakeups. Older kernels reject them, so retry bare.
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    int fd = sysSetup(entries, &params);
+    if (fd < 0 && errno == EINVAL) {
+        params = io_uring_params{};
+        fd = sysSetup(entries, &params);
+    }
+    if (fd < 0) return false;
+    ringFd_ = fd;
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap && cqRingSize_ > sqRingSize_) sqRingSize_ = cqRingSize_;
+
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+        sqRing_ = nullptr;
+        return false;
+    }
+    if (singleMmap) {
+        cqRing_ = sqRing_;
+    } else {
+        cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing_ == MAP_FAILED) {
+            cqRing_ = nullptr;
+            return false;
+        }
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqHead_ = ringPtr<unsigned>(sqRing_, params.sq_off.head);
+    sqTail_ = ringPtr<unsigned>(sqRing_, params.sq_off.tail);
+    sqMask_ = *ringPtr<unsigned>(sqRing_, params.sq_off.ring_mask);
+    sqEntries_ = params.sq_entries;
+    sqArray_ = ringPtr<unsigned>(sqRing_, params.sq_off.array);
+    sqFlags_ = ringPtr<unsigned>(sqRing_, params.sq_off.flags);
+    cqHead_ = ringPtr<unsigned>(cqRing_, params.cq_off.head);
+    cqTail_ = ringPtr<unsigned>(cqRing_, params.cq_off.tail);
+    cqMask_ = *ringPtr<unsigned>(cqRing_, params.cq_off.ring_mask);
+    cqes_ = ringPtr<io_uring_cqe>(cqRing_, params.cq_off.cqes);
+
+    // Identity mapping: SQE slot i is always submitted through array slot i.
+    for (unsigned i = 0; i < sqEntries_; i++) sqArray_[i] = i;
+    sqeTail_ = *sqTail_;
+    return true;
+}
+
+bool IoUring::supports(std::initializer_list<int> ops) {
+    IoUring ring;
+    if (!ring.init(2)) return false;
+
+    size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+    std::vector<uint8_t> storage(size, 0);
+    auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+    if (sysRegister(ring.ringFd_, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+
+    for (int op : ops) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+io_uring_sqe* IoUring::getSqe() {
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (sqeTail_ - head >= sqEntries_) return nullptr;
+    io_uring_sqe* sqe = &sqes_[sqeTail_ & sqMask_];
+    sqeTail_++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+unsigned IoUring::flushSq() {
+    unsigned pending = sqeTail_ - *sqTail_;
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    return pending;
+}
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize) {
+    int ret = static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize));
+    return ret < 0 ? -errno : ret;
+}
+
+int IoUring::submit(unsigned waitNr) {
+    unsigned pending = flushSq();
+    if (pending == 0 && waitNr == 0) return 0;
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret;
+    do {
+        ret = enter(pending, waitNr, flags, nullptr, 0);
+    } while (ret == -EINTR);
+    return ret;
+}
+
+int IoUring::submitAndWait(int timeoutMs) {
+    if (timeoutMs < 0) return submit(1);
+
+    unsigned pending = flushSq();
+    __kernel_timespec ts{};
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+    io_uring_getevents_arg arg{};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+    int ret = enter(pending, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    return (ret == -ETIME || ret == -EINTR) ? 0 : ret;
+}
+
+io_uring_cqe* IoUring::peekCqe() {
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return nullptr;
+    return &cqes_[head & cqMask_];
+}
+
+void IoUring::cqeSeen() {
+    __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::queueProvide(uint16_t bid, unsigned count) {
+    io_uring_sqe* sqe = getSqe();
+    if (!sqe) {
+        submit();
+        sqe = getSqe();
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(count);
+    sqe->addr = reinterpret_cast<uint64_t>(buffer(bid));
+    sqe->len = bufferSize_;
+    sqe->off = bid;
+    sqe->buf_group = bufferGroup_;
+    sqe->user_data = 0;
+}
+
+bool IoUring::provideBuffers(uint16_t group, unsigned count, unsigned bufSize) {
+    // The mapped buffer ring (IORING_REGISTER_PBUF_RING) would save the
+    // PROVIDE_BUFFERS request per recycle, but some kernels accept the
+    // registration and then never select from it. Classic provided buffers
+    // work everywhere multishot recv does.
+    if (count == 0 || count > 65536) return false;
+    bufferBytes_ = size_t(count) * bufSize;
+    void* base = mmap(nullptr, bufferBytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        bufferBytes_ = 0;
+        return false;
+    }
+    bufferBase_ = static_cast<uint8_t*>(base);
+    bufferSize_ = bufSize;
+    bufferGroup_ = group;
+
+    queueProvide(0, count);
+    if (submit(1) < 0) return false;
+    io_uring_cqe* cqe = peekCqe();
+    if (!cqe) return false;
+    int res = cqe->res;
+    cqeSeen();
+    if (res < 0) {
+        errno = -res;
+        return false;
+    }
+    return true;
+}
+
+void IoUring::recycleBuffer(uint16_t bid) {
+    queueProvide(bid, 1);
+}
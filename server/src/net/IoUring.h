@@ -0,0 +1,76 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <cstdint>
+#include <cstddef>
+#include <initializer_list>
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing dependency).
+//
+// One instance belongs to one thread: submission and completion rings are
+// accessed without locking. init() fails cleanly on kernels without
+// io_uring or where it is blocked (seccomp, sysctl io_uring_disabled), and
+// callers fall back to their plain-syscall path.
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    bool init(unsigned entries);
+    bool ok() const { return ringFd_ >= 0; }
+
+    // True if the running kernel supports every listed IORING_OP_*.
+    static bool supports(std::initializer_list<int> ops);
+
+    // Next free submission entry, zeroed; nullptr if the queue is full.
+    io_uring_sqe* getSqe();
+    // Submits queued entries and waits for at least waitNr completions.
+    // Returns the number submitted or -errno.
+    int submit(unsigned waitNr = 0);
+    // Like submit(1) but gives up after timeoutMs (-1 waits forever).
+    int submitAndWait(int timeoutMs);
+
+    io_uring_cqe* peekCqe();
+    void cqeSeen();
+
+    // Provided buffers: `count` buffers of bufSize bytes the kernel picks
+    // from for IOSQE_BUFFER_SELECT reads in group `group`. Completions of the
+    // internal IORING_OP_PROVIDE_BUFFERS requests carry user_data 0.
+    bool provideBuffers(uint16_t group, unsigned count, unsigned bufSize);
+    uint8_t* buffer(uint16_t bid) const { return bufferBase_ + size_t(bid) * bufferSize_; }
+    // Hands a consumed buffer back to the kernel with the next submit().
+    void recycleBuffer(uint16_t bid);
+
+private:
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags, const void* arg, size_t argSize);
+    unsigned flushSq();
+    void queueProvide(uint16_t bid, unsigned count);
+
+    int ringFd_ = -1;
+    void* sqRing_ = nullptr;
+    size_t sqRingSize_ = 0;
+    void* cqRing_ = nullptr;
+    size_t cqRingSize_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqesSize_ = 0;
+
+    unsigned* sqHead_ = nullptr;
+    unsigned* sqTail_ = nullptr;
+    unsigned sqMask_ = 0;
+    unsigned sqEntries_ = 0;
+    unsigned* sqArray_ = nullptr;
+    unsigned* sqFlags_ = nullptr;
+    unsigned sqeTail_ = 0;      // local tail, published by flushSq()
+
+    unsigned* cqHead_ = nullptr;
+    unsigned* cqTail_ = nullptr;
+    unsigned cqMask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    uint8_t* bufferBase_ = nullptr;
+    size_t bufferBytes_ = 0;
+    unsigned bufferSize_ = 0;
+    uint16_t bufferGroup_ = 0;
+};
@@ -0,0 +1,125 @@
+#include "net/MetricsServer.h"
+#include "utils/Metrics.h"
+#include "utils/Log.h"
+#include <string>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+// A scraper that doesn't finish its request (or stops reading the response)
+// within this long is dropped.
+static constexpr int kIoTimeoutMs = 2000;
+static constexpr size_t kMaxRequestSize = 8192;
+
+MetricsServer::MetricsServer(int port) : port_(port) {}
+
+MetricsServer::~MetricsServer() {
+    stop();
+    if (serverFd_ != -1) close(serverFd_);
+    if (stopFd_ != -1) close(stopFd_);
+}
+
+bool MetricsServer::start() {
+    serverFd_ = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    setsockopt(serverFd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port_);
+    if (bind(serverFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(serverFd_, 16) < 0) {
+        LOG_ERROR("[Metrics] bind/listen: {}", strerror(errno));
+        return false;
+    }
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    running_ = true;
+    thread_ = std::thread(&MetricsServer::run, this);
+    LOG_INFO("Metrics endpoint started on port {} (/metrics)", port_);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (!running_) return;
+    running_ = false;
+    uint64_t one = 1;
+    ssize_t ignored = write(stopFd_, &one, sizeof(one));
+    (void)ignored;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void MetricsServer::run() {
+    while (running_) {
+        struct pollfd fds[2] = {{serverFd_, POLLIN, 0}, {stopFd_, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("[Metrics] poll: {}", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int fd = accept4(serverFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        struct timeval timeout{kIoTimeoutMs / 1000, (kIoTimeoutMs % 1000) * 1000};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        serve(fd);
+        close(fd);
+    }
+}
+
+void MetricsServer::serve(int fd) {
+    // Only the request line matters; read up to the end of the headers.
+    std::string request;
+    char buf[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < kMaxRequestSize) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    std::string contentType = "text/plain; version=0.0.4; charset=utf-8";
+    size_t lineEnd = request.find("\r\n");
+    std::string line = request.substr(0, lineEnd);
+    size_t pathStart = line.find(' ');
+    size_t pathEnd = pathStart == std::string::npos ? std::string::npos : line.find(' ', pathStart + 1);
+    std::string method = line.substr(0, pathStart);
+    std::string path = pathEnd == std::string::npos ? "" : line.substr(pathStart + 1, pathEnd - pathStart - 1);
+    path = path.substr(0, path.find('?'));
+
+    if (method != "GET" && method != "HEAD") {
+        status = "405 Method Not Allowed";
+        body = "GET /metrics\n";
+        contentType = "text/plain";
+    } else if (path != "/metrics") {
+        status = "404 Not Found";
+        body = "GET /metrics\n";
+        contentType = "text/plain";
+    } else {
+        body = metrics::Registry::instance().render();
+    }
+
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: " + contentType + "\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n";
+    if (method != "HEAD") response += body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        sent += static_cast<size_t>(n);
+    }
+}
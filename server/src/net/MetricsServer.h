@@ -0,0 +1,30 @@
+#pragma once
+#include <thread>
+#include <atomic>
+
+// Prometheus scrape endpoint: GET /metrics on its own port returns
+// metrics::Registry::render().
+//
+// Scrapes come every few seconds from one or two collectors, so a single
+// thread answers them one at a time on blocking sockets (with a short
+// timeout), away from the RTSP and HTTP reactors. Every response closes the
+// connection.
+class MetricsServer {
+public:
+    explicit MetricsServer(int port);
+    ~MetricsServer();
+
+    // Binds the port and starts serving. Returns false if it can't listen.
+    bool start();
+    void stop();
+
+private:
+    void run();
+    void serve(int fd);
+
+    const int port_;
+    int serverFd_ = -1;
+    int stopFd_ = -1;            // eventfd, signalled by stop()
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+};
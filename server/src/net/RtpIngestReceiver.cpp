@@ -0,0 +1,392 @@
+#include "net/RtpIngestReceiver.h"
+#include "RtpIngestProtocol.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+// Our SSRC in feedback packets; the camera only looks at the media SSRC.
+static constexpr uint32_t kReceiverSsrc = 0x52545031;
+static constexpr int kBatchSize = 32;
+static constexpr int64_t kSourceTimeoutMs = 10000;
+// Senders without an accepted CNAME; beyond this, unknown SSRCs are ignored.
+static constexpr size_t kMaxCandidates = 64;
+static constexpr int64_t kPliIntervalMs = 500;
+static constexpr int kIdlePollMs = 1000;
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+RtpIngestReceiver::RtpIngestReceiver(int port, std::shared_ptr<StreamRegistry> registry, int latencyMs)
+    : port_(port), registry_(registry), latencyMs_(latencyMs > 0 ? latencyMs : 0),
+      loopTime_(metrics::Registry::instance().histogram(
+          "rtsp_reactor_loop_seconds", "Time a reactor thread spends handling one batch of events.",
+          metrics::latencyBoundsUs(), 1e-6, {{"loop", "rtp_ingest"}})) {}
+
+RtpIngestReceiver::~RtpIngestReceiver() {
+    stop();
+}
+
+void RtpIngestReceiver::start() {
+    if (isRunning_ || !createSocket()) {
+        return;
+    }
+    isRunning_ = true;
+    thread_ = std::thread(&RtpIngestReceiver::runLoop, this);
+    LOG_INFO("RtpIngestReceiver started on UDP port {} (latency {} ms)", port_, latencyMs_);
+}
+
+void RtpIngestReceiver::stop() {
+    if (!isRunning_) {
+        return;
+    }
+    isRunning_ = false;
+    // runLoop polls with a bounded timeout and notices the flag.
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (auto& entry : sources_) {
+        detach(*entry.second);
+    }
+    sources_.clear();
+    close(sockFd_);
+    sockFd_ = -1;
+}
+
+bool RtpIngestReceiver::createSocket() {
+    sockFd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockFd_ < 0) {
+        LOG_ERROR("Failed to create RTP ingest socket: {}", strerror(errno));
+        return false;
+    }
+
+    // Room for a burst of keyframe packets from several cameras.
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(sockFd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port_);
+    if (bind(sockFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        LOG_ERROR("Failed to bind RTP ingest socket: {}", strerror(errno));
+        close(sockFd_);
+        sockFd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+void RtpIngestReceiver::runLoop() {
+    static thread_local uint8_t buffers[kBatchSize][rtp_ingest::kMaxPacketSize];
+    struct mmsghdr msgs[kBatchSize];
+    struct iovec iovs[kBatchSize];
+    sockaddr_in addrs[kBatchSize];
+
+    while (isRunning_) {
+        struct pollfd pfd = {sockFd_, POLLIN, 0};
+        int ready = poll(&pfd, 1, pollTimeoutMs(steadyNowMs()));
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("RTP ingest poll failed: {}", strerror(errno));
+            break;
+        }
+        metrics::ScopedTimerUs busy(*loopTime_);
+
+        while (ready > 0) {
+            for (int i = 0; i < kBatchSize; i++) {
+                iovs[i].iov_base = buffers[i];
+                iovs[i].iov_len = sizeof(buffers[i]);
+                memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+                msgs[i].msg_hdr.msg_name = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            }
+            int n = recvmmsg(sockFd_, msgs, kBatchSize, MSG_DONTWAIT, nullptr);
+            if (n <= 0) break;
+
+            int64_t nowMs = steadyNowMs();
+            for (int i = 0; i < n; i++) {
+                handleDatagram(buffers[i], msgs[i].msg_len, addrs[i], nowMs);
+            }
+            if (n < kBatchSize) break;
+        }
+
+        int64_t nowMs = steadyNowMs();
+        for (auto& entry : sources_) {
+            drain(*entry.second, nowMs);
+        }
+        expireSources(nowMs);
+    }
+}
+
+int RtpIngestReceiver::pollTimeoutMs(int64_t nowMs) {
+    int64_t earliest = -1;
+    for (auto& entry : sources_) {
+        int64_t deadline = entry.second->jitter.nextDeadlineMs();
+        if (deadline >= 0 && (earliest < 0 || deadline < earliest)) {
+            earliest = deadline;
+        }
+    }
+    if (earliest < 0) return kIdlePollMs;
+    int64_t wait = earliest - nowMs;
+    if (wait < 0) return 0;
+    return wait < kIdlePollMs ? static_cast<int>(wait) : kIdlePollMs;
+}
+
+RtpIngestReceiver::Candidate* RtpIngestReceiver::candidateFor(uint32_t ssrc, const sockaddr_in& from) {
+    auto it = candidates_.find(ssrc);
+    if (it == candidates_.end()) {
+        if (candidates_.size() >= kMaxCandidates) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 1, "[RTP-IN] {} senders without a CNAME, not tracking ssrc={}",
+                             candidates_.size(), logging::Hex{ssrc});
+            return nullptr;
+        }
+        it = candidates_.emplace(ssrc, Candidate{}).first;
+        char ip[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &from.sin_addr, ip, sizeof(ip));
+        LOG_INFO("[RTP-IN] New sender {}:{} ssrc={}", ip, ntohs(from.sin_port), logging::Hex{ssrc});
+    }
+    it->second.addr = from;
+    return &it->second;
+}
+
+void RtpIngestReceiver::handleDatagram(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs) {
+    if (rtp_ingest::isRtcp(data, size)) {
+        handleRtcp(data, size, from, nowMs);
+    } else {
+        handleRtp(data, size, from, nowMs);
+    }
+}
+
+void RtpIngestReceiver::handleRtp(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs) {
+    if (size < 12 || (data[0] >> 6) != 2) return;
+
+    size_t headerSize = 12 + (data[0] & 0x0F) * 4;
+    if (data[0] & 0x10) { // header extension
+        if (size < headerSize + 4) return;
+        headerSize += 4 + size_t(rtp_ingest::getBe16(data + headerSize + 2)) * 4;
+    }
+    size_t padding = (data[0] & 0x20) ? data[size - 1] : 0;
+    if (size < headerSize + padding + 1) return;
+
+    uint32_t ssrc = rtp_ingest::getBe32(data + 8);
+    auto it = sources_.find(ssrc);
+    if (it == sources_.end()) {
+        // Waiting for SDES CNAME, or rejected: only remember the sender.
+        if (Candidate* candidate = candidateFor(ssrc, from)) candidate->lastPacketMs = nowMs;
+        return;
+    }
+    Source& source = *it->second;
+    if (!source.stream->isPublisher(source.session)) {
+        // Taken over while it was quiet; from here on it is an unknown sender.
+        LOG_INFO("[RTP-IN] ssrc={}: another publisher took over {}/{}", logging::Hex{ssrc},
+                 StreamRegistry::kMountPrefix, source.stream->id);
+        detach(source);
+        sources_.erase(it);
+        return;
+    }
+    // Feedback goes wherever the sender currently is (NAT rebinding).
+    source.addr = from;
+    source.lastPacketMs = nowMs;
+
+    JitterBuffer::Packet packet;
+    packet.seq = rtp_ingest::getBe16(data + 2);
+    packet.timestamp = rtp_ingest::getBe32(data + 4);
+    packet.marker = data[1] & 0x80;
+    packet.payload.assign(data + headerSize, data + size - padding);
+    if (source.jitter.insert(std::move(packet), nowMs)) {
+        source.packets++;
+    }
+}
+
+void RtpIngestReceiver::handleRtcp(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs) {
+    rtp_ingest::forEachRtcpPacket(data, size, [&](uint8_t type, uint8_t count, const uint8_t* body, size_t bodySize) {
+        if (type == rtp_ingest::kRtcpSdes) {
+            // Chunks: [ssrc][items...][0] padded to 32 bits.
+            size_t pos = 0;
+            for (uint8_t chunk = 0; chunk < count && pos + 4 <= bodySize; chunk++) {
+                uint32_t ssrc = rtp_ingest::getBe32(body + pos);
+                pos += 4;
+                while (pos < bodySize && body[pos] != 0) {
+                    if (pos + 2 > bodySize) return;
+                    uint8_t item = body[pos];
+                    size_t length = body[pos + 1];
+                    if (pos + 2 + length > bodySize) return;
+                    if (item == rtp_ingest::kSdesCname) {
+                        auto it = sources_.find(ssrc);
+                        if (it != sources_.end()) {
+                            it->second->addr = from;
+                            it->second->lastPacketMs = nowMs;
+                        } else {
+                            // Retried on every report, so a camera that was
+                            // turned away while its old connection lingered
+                            // gets in once that one is gone. A full candidate
+                            // table does not keep a CNAME from being tried.
+                            Candidate spare;
+                            spare.addr = from;
+                            Candidate* candidate = candidateFor(ssrc, from);
+                            if (!candidate) candidate = &spare;
+                            candidate->lastPacketMs = nowMs;
+                            attach(ssrc, *candidate,
+                                   std::string(reinterpret_cast<const char*>(body + pos + 2), length), nowMs);
+                        }
+                    }
+                    pos += 2 + length;
+                }
+                pos = (pos + 4) & ~size_t(3);
+            }
+        } else if (type == rtp_ingest::kRtcpBye) {
+            for (uint8_t i = 0; i < count && size_t(i) * 4 + 4 <= bodySize; i++) {
+                candidates_.erase(rtp_ingest::getBe32(body + i * 4));
+                auto it = sources_.find(rtp_ingest::getBe32(body + i * 4));
+                if (it == sources_.end()) continue;
+                LOG_INFO("[RTP-IN] {} sent BYE", it->second->cname);
+                detach(*it->second);
+                sources_.erase(it);
+            }
+        } else if (type == rtp_ingest::kRtcpSr && bodySize >= 4) {
+            uint32_t ssrc = rtp_ingest::getBe32(body);
+            auto it = sources_.find(ssrc);
+            if (it != sources_.end()) {
+                it->second->lastPacketMs = nowMs;
+            } else if (auto candidate = candidates_.find(ssrc); candidate != candidates_.end()) {
+                candidate->second.lastPacketMs = nowMs;
+            }
+        }
+    });
+}
+
+void RtpIngestReceiver::attach(uint32_t ssrc, Candidate& candidate, const std::string& cname, int64_t nowMs) {
+    if (!ingest::isValidStreamId(cname)) {
+        if (!candidate.rejected) {
+            LOG_WARN("[RTP-IN] Ignoring ssrc={}: CNAME '{}' is not a valid stream id", logging::Hex{ssrc}, cname);
+        }
+        candidate.rejected = true;
+        return;
+    }
+    std::shared_ptr<Stream> stream = registry_->acquire(cname);
+    uint32_t session = stream->claimIngest(cname);
+    if (session == 0) {
+        if (!candidate.rejected) {
+            LOG_WARN("[RTP-IN] Ignoring ssrc={}: stream '{}' already has a publisher", logging::Hex{ssrc}, cname);
+        }
+        candidate.rejected = true;
+        return;
+    }
+    auto source = std::make_unique<Source>(ssrc, latencyMs_);
+    source->addr = candidate.addr;
+    source->lastPacketMs = nowMs;
+    source->cname = cname;
+    source->stream = std::move(stream);
+    source->session = session;
+    candidates_.erase(ssrc);    // `candidate` dangles from here on
+    Source& attached = *sources_.emplace(ssrc, std::move(source)).first->second;
+    LOG_INFO("[RTP-IN] Camera ssrc={} publishing to {}/{}", logging::Hex{ssrc}, StreamRegistry::kMountPrefix,
+             attached.stream->id);
+}
+
+void RtpIngestReceiver::detach(Source& source) {
+    if (!source.stream) return;
+    LOG_INFO("[RTP-IN] {}: {} packets, {} lost, {} NACKs, {} NALUs dropped", source.stream->id, source.packets,
+             source.lostPackets, source.nacksSent, source.depacketizer.droppedNalus());
+    source.stream->releaseIngest();
+    source.stream.reset();
+}
+
+void RtpIngestReceiver::expireSources(int64_t nowMs) {
+    for (auto it = sources_.begin(); it != sources_.end();) {
+        if (nowMs - it->second->lastPacketMs > kSourceTimeoutMs) {
+            LOG_INFO("[RTP-IN] ssrc={} timed out", logging::Hex{it->first});
+            detach(*it->second);
+            it = sources_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = candidates_.begin(); it != candidates_.end();) {
+        if (nowMs - it->second.lastPacketMs > kSourceTimeoutMs) {
+            it = candidates_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RtpIngestReceiver::sendFeedback(Source& source, const uint8_t* packet, size_t size) {
+    sendto(sockFd_, packet, size, MSG_DONTWAIT, (struct sockaddr*)&source.addr, sizeof(source.addr));
+}
+
+void RtpIngestReceiver::drain(Source& source, int64_t nowMs) {
+    if (!source.stream) return;
+
+    nackScratch_.clear();
+    source.jitter.collectNacks(nowMs, nackScratch_);
+    // Keep each NACK well inside one datagram.
+    for (size_t i = 0; i < nackScratch_.size(); i += 64) {
+        uint8_t packet[12 + 64 * 4];
+        size_t count = std::min<size_t>(64, nackScratch_.size() - i);
+        size_t size = rtp_ingest::buildNack(packet, kReceiverSsrc, source.ssrc, nackScratch_.data() + i, count);
+        sendFeedback(source, packet, size);
+        source.nacksSent++;
+    }
+
+    JitterBuffer::Packet packet;
+    uint32_t lost = 0;
+    bool sendPli = false;
+    while (source.jitter.pop(nowMs, packet, lost)) {
+        if (lost > 0) {
+            source.lostPackets += lost;
+            sendPli = true;
+        }
+        naluScratch_.clear();
+        source.depacketizer.push(packet.payload.data(), packet.payload.size(), lost > 0, naluScratch_);
+        for (size_t i = 0; i < naluScratch_.size(); i++) {
+            // Only the NALU that completes a marked packet ends the access unit.
+            bool auEnd = packet.marker && i + 1 == naluScratch_.size();
+            publish(source, std::move(naluScratch_[i]), packet.timestamp, auEnd);
+        }
+    }
+
+    if (sendPli && nowMs - source.lastPliMs >= kPliIntervalMs) {
+        uint8_t pli[12];
+        sendFeedback(source, pli, rtp_ingest::buildPli(pli, kReceiverSsrc, source.ssrc));
+        source.lastPliMs = nowMs;
+    }
+}
+
+void RtpIngestReceiver::publish(Source& source, std::vector<uint8_t>&& data, uint32_t rtpTimestamp,
+                                bool accessUnitEnd) {
+    if (!source.haveTimestamp) {
+        source.extendedTimestamp = rtpTimestamp;
+        source.haveTimestamp = true;
+    } else {
+        source.extendedTimestamp += static_cast<int32_t>(rtpTimestamp - source.lastTimestamp);
+    }
+    source.lastTimestamp = rtpTimestamp;
+
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data = std::move(data);
+    nalu->startCodeLength = 4;
+    nalu->type = nalu->data.size() > 4 ? (nalu->data[4] & 0x1F) : 0;
+    nalu->hasFrameInfo = true;
+    nalu->accessUnitEnd = accessUnitEnd;
+    nalu->captureUs = source.extendedTimestamp * 1000000 / rtp_ingest::kClockRate;
+    source.naluCount++;
+
+    if (nalu->type == 7 || nalu->type == 8) {
+        LOG_DEBUG("[RTP-IN] {} {} NALU captured (size: {})", source.stream->id, nalu->type == 7 ? "SPS" : "PPS",
+                  nalu->data.size());
+    } else if (source.naluCount % 300 == 1) {
+        LOG_DEBUG("[RTP-IN] {} NALU #{} (type: {}, size: {} bytes)", source.stream->id, source.naluCount,
+                  (int)nalu->type, nalu->data.size());
+    }
+    source.stream->publish(std::move(nalu));
+}
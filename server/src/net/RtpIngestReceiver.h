@@ -0,0 +1,98 @@
+#pragma once
+
+#include "media/StreamRegistry.h"
+#include "media/JitterBuffer.h"
+#include "media/H264Depacketizer.h"
+#include <netinet/in.h>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+// Receives camera streams pushed as RTP over UDP (see
+// common/RtpIngestProtocol.h), the alternative to CameraReceiver's TCP ingest
+// for lossy uplinks where TCP retransmits stall the whole stream.
+//
+// Each sender (SSRC) gets a JitterBuffer that restores packet order and waits
+// at most latencyMs for a missing packet, NACKing it meanwhile; after that
+// the packet is given up, the camera is asked for a new IDR via PLI, and the
+// stream carries on. Added latency is therefore bounded by latencyMs rather
+// than by the uplink's retransmission behaviour.
+//
+// A sender only gets its Source (and jitter buffer) once its SDES CNAME has
+// attached it to a stream; until then it is a small Candidate entry, and the
+// number of those is capped so SSRCs sprayed at the port cannot grow memory.
+//
+// One thread serves every sender from a single socket with recvmmsg().
+class RtpIngestReceiver {
+public:
+    RtpIngestReceiver(int port, std::shared_ptr<StreamRegistry> registry, int latencyMs);
+    ~RtpIngestReceiver();
+
+    void start();
+    void stop();
+
+private:
+    // A sender seen but not yet attached: no CNAME yet, or turned away.
+    struct Candidate {
+        sockaddr_in addr{};
+        int64_t lastPacketMs = 0;
+        bool rejected = false;            // last attach failed (logged once)
+    };
+
+    struct Source {
+        Source(uint32_t ssrc, int latencyMs) : ssrc(ssrc), jitter(latencyMs) {}
+
+        uint32_t ssrc;
+        sockaddr_in addr{};
+        std::string cname;
+        std::shared_ptr<Stream> stream;   // null once detached
+        uint32_t session = 0;             // its Stream::claimIngest() session
+        JitterBuffer jitter;
+        H264Depacketizer depacketizer;
+        int64_t lastPacketMs = 0;
+
+        // RTP timestamp unwrapping for the capture clock.
+        bool haveTimestamp = false;
+        uint32_t lastTimestamp = 0;
+        uint64_t extendedTimestamp = 0;
+
+        uint64_t packets = 0;
+        uint64_t lostPackets = 0;
+        uint64_t nacksSent = 0;
+        uint64_t naluCount = 0;
+        int64_t lastPliMs = 0;
+    };
+
+    bool createSocket();
+    void runLoop();
+    void handleDatagram(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs);
+    void handleRtp(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs);
+    void handleRtcp(const uint8_t* data, size_t size, const sockaddr_in& from, int64_t nowMs);
+    // Attaches the candidate to stream `cname`, promoting it to a Source.
+    void attach(uint32_t ssrc, Candidate& candidate, const std::string& cname, int64_t nowMs);
+    void detach(Source& source);
+    void drain(Source& source, int64_t nowMs);
+    void publish(Source& source, std::vector<uint8_t>&& data, uint32_t rtpTimestamp, bool accessUnitEnd);
+    void sendFeedback(Source& source, const uint8_t* packet, size_t size);
+    int pollTimeoutMs(int64_t nowMs);
+    void expireSources(int64_t nowMs);
+
+    // Null when the candidate table is full.
+    Candidate* candidateFor(uint32_t ssrc, const sockaddr_in& from);
+
+    int port_;
+    std::shared_ptr<StreamRegistry> registry_;
+    int latencyMs_;
+    int sockFd_ = -1;
+    std::atomic<bool> isRunning_{false};
+    std::thread thread_;
+
+    std::unordered_map<uint32_t, std::unique_ptr<Source>> sources_;
+    std::unordered_map<uint32_t, Candidate> candidates_;
+    std::vector<uint16_t> nackScratch_;
+    std::vector<std::vector<uint8_t>> naluScratch_;
+    std::shared_ptr<metrics::Histogram> loopTime_;
+};
@@ -1,19 +1,16 @@
 #include "RtpSender.h"
-#include <iostream>
+#include "utils/Log.h"
+#include "utils/Metrics.h"
+#include <cerrno>
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <chrono>
 #include <vector>
-#include <fstream> // For file dump
+#include <mutex>
 
 #define RTP_MAX_PKT_SIZE 1400
 
-// --- Start of a static file stream for dumping. ---
-static std::ofstream g_dumpFile;
-static bool g_fileOpened = false;
-// --- End of static file stream. ---
-
 struct RtpHeader {
     uint8_t csrcCount : 4;
     uint8_t extension : 1;
@@ -26,100 +23,262 @@ struct RtpHeader {
     uint32_t ssrc;
 };
 
-RtpSender::RtpSender(std::shared_ptr<StreamBuffer> streamBuffer) 
-    : streamBuffer_(streamBuffer) 
-{
-    // Open dump file
-    if (!g_fileOpened) {
-        g_dumpFile.open("dump.h264", std::ios::binary | std::ios::out | std::ios::trunc);
-        if (g_dumpFile.is_open()) {
-            std::cout << "[DEBUG] dump.h264 file opened for writing." << std::endl;
-            g_fileOpened = true;
-        }
+// Process-wide RTP output counters; every sender adds into the same series.
+struct RtpSendMetrics {
+    std::shared_ptr<metrics::Counter> packets;
+    std::shared_ptr<metrics::Counter> bytes;
+    std::shared_ptr<metrics::Counter> eagain;
+    std::shared_ptr<metrics::Counter> enobufs;
+    std::shared_ptr<metrics::Counter> otherErrors;
+};
+
+static RtpSendMetrics& sendMetrics() {
+    static RtpSendMetrics m = [] {
+        metrics::Registry& registry = metrics::Registry::instance();
+        const char* errorsHelp = "RTP packets the kernel refused to send, by errno.";
+        return RtpSendMetrics{
+            registry.counter("rtsp_rtp_packets_sent_total", "RTP packets sent to UDP viewers."),
+            registry.counter("rtsp_rtp_bytes_sent_total", "RTP bytes sent to UDP viewers, headers included."),
+            registry.counter("rtsp_rtp_send_errors_total", errorsHelp, {{"errno", "EAGAIN"}}),
+            registry.counter("rtsp_rtp_send_errors_total", errorsHelp, {{"errno", "ENOBUFS"}}),
+            registry.counter("rtsp_rtp_send_errors_total", errorsHelp, {{"errno", "other"}}),
+        };
+    }();
+    return m;
+}
+
+static uint64_t steadyNowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// `result` is what the send returned: bytes, or a negative errno.
+static void countSend(ssize_t result) {
+    RtpSendMetrics& m = sendMetrics();
+    if (result >= 0) {
+        m.packets->inc();
+        m.bytes->inc(static_cast<uint64_t>(result));
+    } else if (result == -EAGAIN || result == -EWOULDBLOCK) {
+        m.eagain->inc();
+    } else if (result == -ENOBUFS) {
+        m.enobufs->inc();
+    } else {
+        m.otherErrors->inc();
     }
 }
 
+RtpSender::RtpSender(std::shared_ptr<StreamBuffer> streamBuffer, IoEngine engine)
+    : engine_(engine), streamBuffer_(streamBuffer)
+{
+}
+
 RtpSender::~RtpSender() {
     stop();
     if (sockFd != -1) close(sockFd);
-    if (g_dumpFile.is_open()) {
-        g_dumpFile.close();
-        g_fileOpened = false;
+    if (rtcpFd_ != -1) close(rtcpFd_);
+}
+
+bool RtpSender::bindPortPair(int portMin, int portMax) {
+    // Shared cursor so concurrent sessions don't all probe the same pair first.
+    static std::atomic<int> nextPort{0};
+
+    int pairs = (portMax - portMin + 1) / 2;
+    if (pairs <= 0) return false;
+
+    for (int attempt = 0; attempt < pairs; attempt++) {
+        int rtpPort = portMin + ((nextPort++ % pairs) * 2);
+        if (rtpPort % 2 != 0) rtpPort++;
+
+        int rtp = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int rtcp = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (rtp < 0 || rtcp < 0) {
+            LOG_ERROR("[RTP] Failed to create socket: {}", strerror(errno));
+            if (rtp >= 0) close(rtp);
+            if (rtcp >= 0) close(rtcp);
+            return false;
+        }
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(rtpPort);
+        bool ok = bind(rtp, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+        addr.sin_port = htons(rtpPort + 1);
+        ok = ok && bind(rtcp, (struct sockaddr*)&addr, sizeof(addr)) == 0;
+
+        if (ok) {
+            sockFd = rtp;
+            rtcpFd_ = rtcp;
+            serverRtpPort_ = rtpPort;
+            return true;
+        }
+        close(rtp);
+        close(rtcp);
     }
+    LOG_ERROR("[RTP] No free server port pair in {}-{}", portMin, portMax);
+    return false;
 }
 
-bool RtpSender::init(const std::string& ip, int port) {
-    sockFd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockFd < 0) {
-        perror("[RTP] Failed to create socket");
+bool RtpSender::init(const std::string& ip, int rtpPort, int portMin, int portMax) {
+    if (sockFd == -1 && !bindPortPair(portMin, portMax)) {
         return false;
     }
     memset(&destAddr, 0, sizeof(destAddr));
     destAddr.sin_family = AF_INET;
-    destAddr.sin_port = htons(port);
+    destAddr.sin_port = htons(rtpPort);
     inet_pton(AF_INET, ip.c_str(), &destAddr.sin_addr);
     return true;
 }
 
-void RtpSender::start() {
+void RtpSender::start(std::unique_ptr<TimeshiftReader> timeshift) {
     if (isRunning) return;
     isRunning = true;
+    if (started_) {
+        // Switching between live and the past: the viewer keeps its stream.
+        resync();
+    }
+    started_ = true;
+    bool live = !timeshift;
+    if (live) {
+        reader_ = streamBuffer_->subscribe();
+    } else {
+        timeshift_ = std::move(timeshift);
+        timeshifting_ = true;
+    }
+    // The viewer's SDP carries the parameter sets current as of now.
+    sentParameterSetVersion_ = streamBuffer_->parameterSetVersion();
     senderThread = std::thread(&RtpSender::sendLoop, this);
-    std::cout << "[RTP] Streaming started." << std::endl;
+    LOG_INFO("{}", live ? "[RTP] Streaming started." : "[RTP] Timeshift playback started.");
 }
 
 void RtpSender::stop() {
     if (!isRunning) return;
     isRunning = false;
-    if(streamBuffer_) {
-        streamBuffer_->push(std::vector<uint8_t>());
+    {
+        // Unblocks pop()/next() in sendLoop without disturbing other subscribers.
+        std::lock_guard<std::mutex> lock(sourceMutex_);
+        if (timeshift_) timeshift_->stop();
+        if (reader_) streamBuffer_->close(*reader_);
     }
     if (senderThread.joinable()) {
         senderThread.join();
     }
+    streamBuffer_->unsubscribe(reader_);
+    reader_.reset();
+    timeshift_.reset();
+    timeshifting_ = false;
 }
 
-void RtpSender::sendLoop() {
-    auto strip_start_code = [](const std::vector<uint8_t>& nalu) -> std::vector<uint8_t> {
-        if (nalu.size() > 4 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 0 && nalu[3] == 1) {
-            return {nalu.begin() + 4, nalu.end()};
+NaluPtr RtpSender::nextNalu(uint64_t& clockUs, bool& hasClock, bool& marker) {
+    if (timeshift_) {
+        TimeshiftReader::Item item;
+        TimeshiftReader::Result result = timeshift_->next(item);
+        if (result == TimeshiftReader::Result::Item) {
+            // Paced playback: the RTP clock follows the delivery schedule,
+            // so any player renders it at the requested speed.
+            clockUs = item.playUs;
+            hasClock = true;
+            marker = item.accessUnitEnd;
+            return item.nalu;
         }
-        if (nalu.size() > 3 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 1) {
-            return {nalu.begin() + 3, nalu.end()};
+        if (result == TimeshiftReader::Result::Stopped) return nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(sourceMutex_);
+            if (!isRunning) return nullptr;
+            timeshift_.reset();
+            reader_ = streamBuffer_->subscribe();
         }
-        return nalu;
-    };
+        timeshifting_ = false;
+        resync();
+        LOG_INFO("[RTP] Timeshift caught up, back to live");
+    }
 
-    const char start_code[4] = {0x00, 0x00, 0x00, 0x01};
+    NaluPtr nalu = streamBuffer_->pop(*reader_);
+    if (nalu) {
+        // Ingest v2 carries the capture clock and access unit boundaries,
+        // so every slice of a picture shares one timestamp and only the
+        // last one sets the marker bit.
+        hasClock = nalu->hasFrameInfo;
+        clockUs = nalu->captureUs;
+        marker = nalu->hasFrameInfo ? nalu->accessUnitEnd : nalu->isVcl();
+    }
+    return nalu;
+}
+
+void RtpSender::sendLoop() {
+    // The ring is created on this thread: it is single-issuer.
+    IoUring ring;
+    if (engine_ == IoEngine::IoUring) {
+        if (ring.init(kBatchSize)) {
+            ring_ = &ring;
+        } else {
+            LOG_WARN("[RTP] io_uring unavailable, sending with sendto");
+        }
+    }
 
     while (isRunning) {
-        std::vector<uint8_t> nalu_with_sc = streamBuffer_->pop();
-        
-        if (nalu_with_sc.empty() || !isRunning) {
+        uint64_t clockUs = 0;
+        bool hasClock = false;
+        bool marker = false;
+        NaluPtr nalu = nextNalu(clockUs, hasClock, marker);
+
+        if (!nalu || !isRunning) {
             break;
         }
+        // Timeshifted NALUs are old by design; only live ones are timed.
+        bool timed = latency_ && !timeshift_ && nalu->enqueuedUs != 0;
+        uint64_t dequeuedUs = timed ? steadyNowUs() : 0;
 
-        std::vector<uint8_t> clean_nalu = strip_start_code(nalu_with_sc);
-        if (clean_nalu.empty()) {
+        if (nalu->payloadSize() == 0) {
             continue;
         }
 
-        // --- DUMP TO FILE ---
-        if (g_dumpFile.is_open()) {
-            g_dumpFile.write(start_code, 4);
-            g_dumpFile.write((const char*)clean_nalu.data(), clean_nalu.size());
+        if (!timeshift_ && nalu->ingestSession != ingestSession_) {
+            bridgeIngestSession(*nalu);
+        }
+        if (awaitKeyframe_) {
+            // Inter frames from the new publisher reference pictures the
+            // viewer never got; skip them until it sends an IDR.
+            if (nalu->isVcl() && !nalu->isKeyframe()) continue;
+            if (nalu->isKeyframe()) awaitKeyframe_ = false;
         }
-        // --- END DUMP ---
 
-        int naluSize = clean_nalu.size();
-        uint8_t* naluData = clean_nalu.data();
+        int naluSize = nalu->payloadSize();
+        const uint8_t* naluData = nalu->payload();
         uint8_t naluHeader = naluData[0];
         uint8_t naluType = naluHeader & 0x1F;
         bool isVcl = (naluType >= 1 && naluType <= 5);
-        bool marker = isVcl; 
+
+        if (hasClock) {
+            if (!haveCaptureBase_) {
+                captureBaseUs_ = clockUs;
+                timestampBase_ = timestamp;
+                haveCaptureBase_ = true;
+            }
+            int64_t elapsedUs = static_cast<int64_t>(clockUs - captureBaseUs_);
+            timestamp = timestampBase_ + static_cast<uint32_t>(elapsedUs * 9 / 100);
+        }
+
+        if (naluType == 7) spsSent_ = true;
+        if (naluType == 8) ppsSent_ = true;
+        if (naluType == 5) {
+            // The viewer only has the parameter sets from its SDP and from
+            // what we sent in-band; make sure the IDR decodes with the
+            // current ones after a camera restart or an encoder change.
+            uint64_t version = streamBuffer_->parameterSetVersion();
+            if ((version != sentParameterSetVersion_ || sessionChanged_) && !(spsSent_ && ppsSent_)) {
+                sendParameterSets(timestamp);
+            }
+            sentParameterSetVersion_ = version;
+            sessionChanged_ = false;
+        }
+        if (isVcl) {
+            spsSent_ = ppsSent_ = false;
+        }
 
         if (naluSize <= RTP_MAX_PKT_SIZE) {
-            sendRtpPacket(naluData, naluSize, timestamp, marker);
+            queuePacket(nullptr, 0, naluData, naluSize, timestamp, marker);
         } else {
             const uint8_t* payload = naluData + 1;
             int payloadSize = naluSize - 1;
@@ -130,27 +289,66 @@ void RtpSender::sendLoop() {
                 if (isLastFragment) {
                     len = payloadSize - offset;
                 }
-                uint8_t fragBuf[1500];
-                fragBuf[0] = (naluHeader & 0xE0) | 28;
-                fragBuf[1] = naluType;
-                if (offset == 0) fragBuf[1] |= 0x80;
-                else if (isLastFragment) fragBuf[1] |= 0x40;
-                memcpy(fragBuf + 2, payload + offset, len);
+                uint8_t fuHeader[2];
+                fuHeader[0] = (naluHeader & 0xE0) | 28;
+                fuHeader[1] = naluType;
+                if (offset == 0) fuHeader[1] |= 0x80;
+                else if (isLastFragment) fuHeader[1] |= 0x40;
                 bool finalPacketMarker = isLastFragment && marker;
-                sendRtpPacket(fragBuf, len + 2, timestamp, finalPacketMarker);
+                queuePacket(fuHeader, 2, payload + offset, len, timestamp, finalPacketMarker);
                 offset += len;
             }
         }
+        uint64_t packetizedUs = timed ? steadyNowUs() : 0;
+        // The batch points into this NALU, so it goes out before we let go.
+        flushPackets();
+        if (timed) latency_->record(*nalu, dequeuedUs, packetizedUs, steadyNowUs());
 
-        if (isVcl) {
-            timestamp += 90000 / 30;
+        if (isVcl && !hasClock) {
+            timestamp += kFrameTicks;
         }
     }
-    std::cout << "[RTP] sendLoop stopped." << std::endl;
+    ring_ = nullptr;
+    LOG_INFO("[RTP] sendLoop stopped.");
 }
 
-void RtpSender::sendRtpPacket(const uint8_t* data, int size, uint32_t ts, bool mark) {
-    if (sockFd < 0) return;
+void RtpSender::bridgeIngestSession(const Nalu& nalu) {
+    bool reconnect = haveSession_;
+    ingestSession_ = nalu.ingestSession;
+    haveSession_ = true;
+    if (!reconnect) return;
+
+    resync();
+    LOG_INFO("[RTP] Publisher changed, continuing at seq {} ts {} from the next IDR", seqNum, timestamp);
+}
+
+void RtpSender::resync() {
+    // Keep SSRC and sequence numbers running so the viewer sees one stream.
+    // The new source's clock has an unrelated origin, so the RTP clock is
+    // re-anchored one frame after the last picture we sent.
+    if (haveCaptureBase_) {
+        timestamp += kFrameTicks;
+        haveCaptureBase_ = false;
+    }
+    awaitKeyframe_ = true;
+    sessionChanged_ = true;
+}
+
+void RtpSender::sendParameterSets(uint32_t ts) {
+    std::vector<uint8_t> sets[2];
+    streamBuffer_->getParameterSets(sets[0], sets[1]);
+    for (std::vector<uint8_t>& set : sets) {
+        Nalu ps;
+        ps.data = std::move(set);
+        classifyNalu(ps);
+        if (ps.payloadSize() == 0) continue;
+        queuePacket(nullptr, 0, ps.payload(), static_cast<int>(ps.payloadSize()), ts, false);
+        // queuePacket may only reference the payload; it dies with `ps`.
+        flushPackets();
+    }
+}
+
+void RtpSender::writeRtpHeader(uint8_t* out, uint32_t ts, bool mark) {
     RtpHeader header;
     header.version = 2;
     header.padding = 0;
@@ -161,9 +359,68 @@ void RtpSender::sendRtpPacket(const uint8_t* data, int size, uint32_t ts, bool m
     header.seq = htons(seqNum++);
     header.timestamp = htonl(ts);
     header.ssrc = htonl(0x12345678);
-    uint8_t buffer[1500];
-    memcpy(buffer, &header, sizeof(RtpHeader));
-    memcpy(buffer + sizeof(RtpHeader), data, size);
-    int totalLen = sizeof(RtpHeader) + size;
-    sendto(sockFd, buffer, totalLen, 0, (struct sockaddr*)&destAddr, sizeof(destAddr));
-}
\ No newline at end of file
+    memcpy(out, &header, sizeof(RtpHeader));
+}
+
+void RtpSender::queuePacket(const uint8_t* prefix, int prefixSize, const uint8_t* data, int size,
+                            uint32_t ts, bool mark) {
+    if (sockFd < 0) return;
+
+    if (!ring_) {
+        uint8_t buffer[1500];
+        writeRtpHeader(buffer, ts, mark);
+        memcpy(buffer + sizeof(RtpHeader), prefix, prefixSize);
+        memcpy(buffer + sizeof(RtpHeader) + prefixSize, data, size);
+        int totalLen = sizeof(RtpHeader) + prefixSize + size;
+        ssize_t sent = sendto(sockFd, buffer, totalLen, 0, (struct sockaddr*)&destAddr, sizeof(destAddr));
+        if (sent > 0) packetsSent_++;
+        countSend(sent < 0 ? -errno : sent);
+        return;
+    }
+
+    // io_uring: header and FU bytes live in the batch slot, the payload is
+    // referenced straight from the shared NALU.
+    BatchSlot& slot = batch_[batchCount_];
+    writeRtpHeader(slot.header, ts, mark);
+    memcpy(slot.header + sizeof(RtpHeader), prefix, prefixSize);
+    slot.iov[0].iov_base = slot.header;
+    slot.iov[0].iov_len = sizeof(RtpHeader) + prefixSize;
+    slot.iov[1].iov_base = const_cast<uint8_t*>(data);
+    slot.iov[1].iov_len = size;
+    memset(&slot.msg, 0, sizeof(slot.msg));
+    slot.msg.msg_name = &destAddr;
+    slot.msg.msg_namelen = sizeof(destAddr);
+    slot.msg.msg_iov = slot.iov;
+    slot.msg.msg_iovlen = 2;
+
+    io_uring_sqe* sqe = ring_->getSqe();
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = sockFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.msg);
+    sqe->len = 1;
+    batchCount_++;
+    if (batchCount_ == kBatchSize) {
+        flushPackets();
+    }
+}
+
+void RtpSender::flushPackets() {
+    if (!ring_ || batchCount_ == 0) return;
+
+    // One io_uring_enter submits the whole batch and waits for it, since the
+    // slots are reused for the next one.
+    ring_->submit(static_cast<unsigned>(batchCount_));
+    size_t reaped = 0;
+    while (reaped < batchCount_) {
+        io_uring_cqe* cqe = ring_->peekCqe();
+        if (!cqe) {
+            ring_->submit(1);
+            continue;
+        }
+        if (cqe->res > 0) packetsSent_++;
+        countSend(cqe->res);
+        ring_->cqeSeen();
+        reaped++;
+    }
+    batchCount_ = 0;
+}
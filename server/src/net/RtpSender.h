@@ -1,32 +1,110 @@
 #pragma once
 #include "media/StreamBuffer.h"
+#include "media/TimeshiftReader.h"
+#include "media/StageLatency.h"
+#include "net/IoUring.h"
+#include "ServerConfig.h"
 #include <string>
 #include <thread>
 #include <atomic>
 #include <netinet/in.h>
+#include <sys/socket.h>
 #include <vector>
 #include <memory>
+#include <mutex>
 
 class RtpSender {
 public:
-    RtpSender(std::shared_ptr<StreamBuffer> streamBuffer);
+    // With IoEngine::IoUring the packets of each NALU go out as one batch of
+    // IORING_OP_SENDMSG submissions instead of one sendto() per packet.
+    RtpSender(std::shared_ptr<StreamBuffer> streamBuffer, IoEngine engine = IoEngine::Epoll);
     ~RtpSender();
 
-    bool init(const std::string& ip, int port);
-    void start();
+    // Binds an even/odd server port pair within [portMin, portMax] and sets the
+    // client's RTP/RTCP destination.
+    bool init(const std::string& ip, int rtpPort, int portMin, int portMax);
+    // Plays the live stream, or with `timeshift` the past until that reader
+    // catches up with live. A restart keeps SSRC, sequence numbers and the
+    // RTP clock running, like a publisher change.
+    void start(std::unique_ptr<TimeshiftReader> timeshift = nullptr);
     void stop();
+    bool isTimeshifting() const { return timeshifting_; }
+
+    int serverRtpPort() const { return serverRtpPort_; }
+    // Non-blocking socket on serverRtpPort()+1 where receiver reports arrive.
+    int rtcpFd() const { return rtcpFd_; }
+
+    uint64_t packetsSent() const { return packetsSent_; }
+
+    // Records the ingest-to-send stages of every live NALU sent. Set before
+    // start().
+    void setLatency(std::shared_ptr<StageLatency> latency) { latency_ = std::move(latency); }
 
 private:
     void sendLoop();
-    void sendRtpPacket(const uint8_t* data, int size, uint32_t timestamp, bool mark);
+    // Called when a NALU comes from a different publisher than the last one.
+    void bridgeIngestSession(const Nalu& nalu);
+    // Re-anchors the RTP clock after a jump in the source and holds inter
+    // frames until the next IDR.
+    void resync();
+    // Next NALU from the live buffer or the timeshift reader; nullptr once
+    // stopped. `clockUs` is set when the source has its own clock.
+    NaluPtr nextNalu(uint64_t& clockUs, bool& hasClock, bool& marker);
+    // Sends the stream's current SPS and PPS ahead of an IDR.
+    void sendParameterSets(uint32_t timestamp);
+    void writeRtpHeader(uint8_t* out, uint32_t timestamp, bool mark);
+    // Sends (or, with io_uring, batches) one RTP packet: header, optional FU
+    // indicator/header bytes, then `data`, which must stay valid until
+    // flushPackets().
+    void queuePacket(const uint8_t* prefix, int prefixSize, const uint8_t* data, int size,
+                     uint32_t timestamp, bool mark);
+    void flushPackets();
+
+    bool bindPortPair(int portMin, int portMax);
 
     int sockFd = -1;
+    int rtcpFd_ = -1;
+    int serverRtpPort_ = 0;
     struct sockaddr_in destAddr{};
     std::thread senderThread;
     std::atomic<bool> isRunning{false};
     
     uint16_t seqNum = 0;
     uint32_t timestamp = 0;
+    bool haveCaptureBase_ = false;
+    uint64_t captureBaseUs_ = 0;
+    uint32_t timestampBase_ = 0;
+
+    // Default picture duration (30 fps) for legacy cameras and for the gap
+    // across a publisher change.
+    static constexpr uint32_t kFrameTicks = 90000 / 30;
+    uint32_t ingestSession_ = 0;
+    bool haveSession_ = false;
+    bool sessionChanged_ = false;
+    bool awaitKeyframe_ = false;
+    bool spsSent_ = false;      // since the last VCL NALU
+    bool ppsSent_ = false;
+    uint64_t sentParameterSetVersion_ = 0;
+    bool started_ = false;      // resync() on every start after the first
+
+    std::unique_ptr<TimeshiftReader> timeshift_;
+    std::atomic<bool> timeshifting_{false};
+    std::mutex sourceMutex_;    // reader_/timeshift_ vs. stop() from the reactor
+
+    std::atomic<uint64_t> packetsSent_{0};
+    std::shared_ptr<StageLatency> latency_;
+
+    struct BatchSlot {
+        uint8_t header[16];     // RTP header + FU indicator/header
+        iovec iov[2];
+        msghdr msg;
+    };
+    static constexpr size_t kBatchSize = 64;
+    IoEngine engine_;
+    IoUring* ring_ = nullptr;   // owned by sendLoop's stack while it runs
+    BatchSlot batch_[kBatchSize];
+    size_t batchCount_ = 0;
 
     std::shared_ptr<StreamBuffer> streamBuffer_;
+    std::shared_ptr<StreamBuffer::Reader> reader_;
 };
\ No newline at end of file
@@ -0,0 +1,156 @@
+#include "net/RtspParser.h"
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        char ca = a[i], cb = b[i];
+        if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+        if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+        if (ca != cb) return false;
+    }
+    return true;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r')) s.remove_suffix(1);
+    return s;
+}
+
+std::string_view RtspRequest::header(std::string_view name) const {
+    for (size_t i = 0; i < headerCount; i++) {
+        if (equalsIgnoreCase(headers[i].name, name)) return headers[i].value;
+    }
+    return {};
+}
+
+void RtspParser::reset() {
+    state_ = State::RequestLine;
+    error_ = Error::None;
+    scanPos_ = 0;
+    lineStart_ = 0;
+    requestStart_ = 0;
+    headerEnd_ = 0;
+    bodyLength_ = 0;
+}
+
+RtspParser::Result RtspParser::fail(Error e) {
+    error_ = e;
+    return Result::Error;
+}
+
+bool RtspParser::parseRequestLine(std::string_view line, RtspRequest& req) {
+    // METHOD SP URI SP RTSP/1.0 (or HTTP/1.1)
+    size_t sp1 = line.find(' ');
+    if (sp1 == std::string_view::npos || sp1 == 0) return false;
+    size_t sp2 = line.find(' ', sp1 + 1);
+    if (sp2 == std::string_view::npos || sp2 == sp1 + 1) return false;
+
+    req.method = line.substr(0, sp1);
+    req.uri = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    req.version = trim(line.substr(sp2 + 1));
+    if (req.version.substr(0, protocol_.size()) != protocol_) return false;
+
+    for (char c : req.method) {
+        if (c < 'A' || c > 'Z') {
+            if (c != '_') return false;
+        }
+    }
+    return true;
+}
+
+bool RtspParser::parseHeaderLine(std::string_view line, RtspRequest& req) {
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) return false;
+    if (req.headerCount >= RtspRequest::kMaxHeaders) {
+        error_ = Error::TooManyHeaders;
+        return false;
+    }
+    RtspRequest::Header& h = req.headers[req.headerCount++];
+    h.name = trim(line.substr(0, colon));
+    h.value = trim(line.substr(colon + 1));
+    return true;
+}
+
+bool RtspParser::fillRequest(const char* data, RtspRequest& req) {
+    req.headerCount = 0;
+    req.body = {};
+
+    bool first = true;
+    size_t start = requestStart_;
+    for (size_t i = requestStart_; i < headerEnd_; i++) {
+        if (data[i] != '\n') continue;
+        std::string_view line(data + start, i - start);
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        start = i + 1;
+
+        if (first) {
+            if (!parseRequestLine(line, req)) return false;
+            first = false;
+        } else if (!line.empty()) {
+            // Obsolete line folding is not supported.
+            if (line.front() == ' ' || line.front() == '\t') return false;
+            if (!parseHeaderLine(line, req)) return false;
+        }
+    }
+    return !first;
+}
+
+RtspParser::Result RtspParser::parse(const char* data, size_t len, RtspRequest& req, size_t& consumed) {
+    consumed = 0;
+
+    if (state_ != State::Body) {
+        // Scan for the blank line that terminates the header block, resuming
+        // where the previous call stopped.
+        bool headerComplete = false;
+        while (scanPos_ < len) {
+            if (data[scanPos_++] != '\n') continue;
+
+            size_t lineEnd = scanPos_ - 1;
+            if (lineEnd > lineStart_ && data[lineEnd - 1] == '\r') lineEnd--;
+            bool emptyLine = (lineEnd == lineStart_);
+
+            if (state_ == State::RequestLine) {
+                if (emptyLine) {
+                    // Stray CRLF between requests is tolerated and skipped.
+                    lineStart_ = requestStart_ = scanPos_;
+                    continue;
+                }
+                state_ = State::Headers;
+            } else if (emptyLine) {
+                headerEnd_ = scanPos_;
+                headerComplete = true;
+                break;
+            }
+            lineStart_ = scanPos_;
+        }
+
+        if (scanPos_ > kMaxHeaderBytes) return fail(Error::HeaderTooLarge);
+        if (!headerComplete) return Result::NeedMore;
+
+        if (!fillRequest(data, req)) {
+            return fail(error_ == Error::None ? Error::Malformed : error_);
+        }
+
+        bodyLength_ = 0;
+        std::string_view contentLength = req.header("Content-Length");
+        if (!contentLength.empty()) {
+            for (char c : contentLength) {
+                if (c < '0' || c > '9') return fail(Error::Malformed);
+                bodyLength_ = bodyLength_ * 10 + (c - '0');
+                if (bodyLength_ > kMaxBodyBytes) return fail(Error::BodyTooLarge);
+            }
+        }
+        state_ = State::Body;
+    } else if (!fillRequest(data, req)) {
+        // The caller may have moved the buffer since the header block was
+        // validated, so the views are rebuilt against the current pointer.
+        return fail(Error::Malformed);
+    }
+
+    if (len < headerEnd_ + bodyLength_) return Result::NeedMore;
+
+    req.body = std::string_view(data + headerEnd_, bodyLength_);
+    consumed = headerEnd_ + bodyLength_;
+    return Result::Complete;
+}
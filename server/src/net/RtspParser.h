@@ -0,0 +1,72 @@
+#pragma once
+#include <string_view>
+#include <cstddef>
+
+// A parsed RTSP request. All fields are views into the connection's input
+// buffer and stay valid only until that buffer is consumed or compacted.
+struct RtspRequest {
+    static constexpr size_t kMaxHeaders = 32;
+
+    struct Header {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    std::string_view method;
+    std::string_view uri;
+    std::string_view version;
+    Header headers[kMaxHeaders];
+    size_t headerCount = 0;
+    std::string_view body;
+
+    // Case-insensitive header lookup. Returns an empty view when absent.
+    std::string_view header(std::string_view name) const;
+};
+
+// Incremental RTSP/1.0 request parser.
+//
+// The parser never copies or allocates: feed it the unconsumed part of the
+// connection buffer, and on Complete it reports how many bytes the request
+// occupied so the caller can consume them and parse the next (pipelined)
+// request. On NeedMore the parser remembers how far it scanned, so calling it
+// again after more bytes arrive does not rescan the header block. The input
+// may be arbitrary bytes; it is safe to drive directly from a fuzzer.
+//
+// HTTP/1.1 requests have the same syntax; HttpServer parses them with a
+// parser constructed for the "HTTP/" version prefix.
+class RtspParser {
+public:
+    static constexpr size_t kMaxHeaderBytes = 8 * 1024;
+    static constexpr size_t kMaxBodyBytes = 64 * 1024;
+
+    enum class Result { NeedMore, Complete, Error };
+    enum class Error { None, Malformed, HeaderTooLarge, TooManyHeaders, BodyTooLarge };
+
+    explicit RtspParser(std::string_view protocol = "RTSP/") : protocol_(protocol) {}
+
+    // data/len must start at the beginning of the current request and contain
+    // every byte handed in on earlier NeedMore calls for that request.
+    Result parse(const char* data, size_t len, RtspRequest& req, size_t& consumed);
+
+    // Must be called after consuming a Complete request, or to abandon one.
+    void reset();
+
+    Error error() const { return error_; }
+
+private:
+    enum class State { RequestLine, Headers, Body };
+
+    Result fail(Error e);
+    bool fillRequest(const char* data, RtspRequest& req);
+    bool parseRequestLine(std::string_view line, RtspRequest& req);
+    bool parseHeaderLine(std::string_view line, RtspRequest& req);
+
+    std::string_view protocol_;  // version prefix a request line must carry
+    State state_ = State::RequestLine;
+    Error error_ = Error::None;
+    size_t scanPos_ = 0;       // next byte to examine
+    size_t lineStart_ = 0;     // start of the line being scanned
+    size_t requestStart_ = 0;  // first byte of the request line (after stray CRLFs)
+    size_t headerEnd_ = 0;     // offset of the first body byte
+    size_t bodyLength_ = 0;
+};
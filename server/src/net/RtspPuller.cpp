@@ -0,0 +1,807 @@
+#include "net/RtspPuller.h"
+#include "RtpIngestProtocol.h"
+#include "utils/base64.h"
+#include "utils/md5.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <strings.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+
+static constexpr int kConnectTimeoutMs = 5000;
+static constexpr int kResponseTimeoutMs = 5000;
+// No RTP for this long ends the session (and, for a first UDP attempt in
+// auto mode, means UDP doesn't get through).
+static constexpr int64_t kMediaTimeoutMs = 5000;
+static constexpr int64_t kReportIntervalMs = 5000;
+static constexpr int kIdlePollMs = 1000;
+static constexpr size_t kMaxControlBuffer = 4 * 1024 * 1024;
+// Our SSRC in receiver reports.
+static constexpr uint32_t kReceiverSsrc = 0x52545032;
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool startsWithNoCase(const std::string& text, const char* prefix) {
+    return strncasecmp(text.c_str(), prefix, strlen(prefix)) == 0;
+}
+
+static std::string trim(const std::string& text) {
+    size_t begin = text.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return {};
+    size_t end = text.find_last_not_of(" \t\r\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+static std::string percentDecode(const std::string& text) {
+    std::string out;
+    for (size_t i = 0; i < text.size(); i++) {
+        if (text[i] == '%' && i + 2 < text.size() && isxdigit(text[i + 1]) && isxdigit(text[i + 2])) {
+            out.push_back(static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        } else {
+            out.push_back(text[i]);
+        }
+    }
+    return out;
+}
+
+// Value of `key=...` inside a header such as Transport or a fmtp line.
+static std::string parameter(const std::string& text, const std::string& key) {
+    size_t pos = 0;
+    while ((pos = text.find(key + "=", pos)) != std::string::npos) {
+        if (pos == 0 || text[pos - 1] == ';' || text[pos - 1] == ' ') {
+            size_t begin = pos + key.size() + 1;
+            size_t end = text.find(';', begin);
+            return trim(text.substr(begin, end == std::string::npos ? std::string::npos : end - begin));
+        }
+        pos += key.size();
+    }
+    return {};
+}
+
+// Value of `key="..."` (or unquoted) in a WWW-Authenticate challenge.
+static std::string challengeParameter(const std::string& text, const std::string& key) {
+    size_t pos = 0;
+    while ((pos = text.find(key, pos)) != std::string::npos) {
+        size_t eq = pos + key.size();
+        bool boundary = pos == 0 || text[pos - 1] == ' ' || text[pos - 1] == ',';
+        if (!boundary || eq >= text.size() || text[eq] != '=') {
+            pos = eq;
+            continue;
+        }
+        if (eq + 1 < text.size() && text[eq + 1] == '"') {
+            size_t end = text.find('"', eq + 2);
+            return text.substr(eq + 2, end == std::string::npos ? std::string::npos : end - eq - 2);
+        }
+        size_t end = text.find(',', eq + 1);
+        return trim(text.substr(eq + 1, end == std::string::npos ? std::string::npos : end - eq - 1));
+    }
+    return {};
+}
+
+// RFC 2326 C.1.1: a relative a=control is taken against the base URL.
+static std::string resolveControl(const std::string& base, const std::string& control) {
+    if (control.empty() || control == "*") return base;
+    if (startsWithNoCase(control, "rtsp://")) return control;
+    if (!base.empty() && base.back() == '/') return base + control;
+    return base + "/" + control;
+}
+
+std::string RtspPuller::Response::header(const std::string& name) const {
+    for (const auto& entry : headers) {
+        if (strcasecmp(entry.first.c_str(), name.c_str()) == 0) return entry.second;
+    }
+    return {};
+}
+
+RtspPuller::RtspPuller(std::shared_ptr<StreamRegistry> registry, std::string streamId, std::string url,
+                       PullTransport transport, int latencyMs)
+    : registry_(std::move(registry)), streamId_(std::move(streamId)), urlText_(std::move(url)),
+      transport_(transport), jitter_(latencyMs) {}
+
+RtspPuller::~RtspPuller() {
+    stop();
+}
+
+void RtspPuller::start() {
+    if (running_) return;
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    running_ = true;
+    finished_ = false;
+    thread_ = std::thread(&RtspPuller::run, this);
+}
+
+void RtspPuller::stop() {
+    if (!running_) {
+        if (thread_.joinable()) thread_.join();
+        return;
+    }
+    running_ = false;
+    uint64_t one = 1;
+    if (write(wakeFd_, &one, sizeof(one)) < 0) {
+        // The thread still notices running_ at its next timeout.
+    }
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    close(wakeFd_);
+    wakeFd_ = -1;
+}
+
+bool RtspPuller::parseUrl(const std::string& text, Url& out) {
+    if (!startsWithNoCase(text, "rtsp://")) return false;
+    size_t authority = 7;
+    size_t pathStart = text.find('/', authority);
+    std::string host = text.substr(authority, pathStart == std::string::npos ? std::string::npos
+                                                                           : pathStart - authority);
+    std::string path = pathStart == std::string::npos ? "/" : text.substr(pathStart);
+
+    size_t at = host.rfind('@');
+    if (at != std::string::npos) {
+        std::string credentials = host.substr(0, at);
+        host = host.substr(at + 1);
+        size_t colon = credentials.find(':');
+        out.user = percentDecode(credentials.substr(0, colon));
+        if (colon != std::string::npos) out.password = percentDecode(credentials.substr(colon + 1));
+    }
+    size_t colon = host.rfind(':');
+    if (colon != std::string::npos) {
+        out.port = atoi(host.c_str() + colon + 1);
+        host = host.substr(0, colon);
+    }
+    if (host.empty() || out.port <= 0 || out.port > 65535) return false;
+    out.host = host;
+    out.uri = "rtsp://" + host + ":" + std::to_string(out.port) + path;
+    return true;
+}
+
+void RtspPuller::run() {
+    if (!parseUrl(urlText_, url_)) {
+        LOG_ERROR("[PULL] {}: not an rtsp:// URL: {}", streamId_, urlText_);
+        finished_ = true;
+        return;
+    }
+
+    bool tcp = transport_ == PullTransport::Tcp;
+    if (!session(tcp) && !tcp && transport_ == PullTransport::Auto && udpFailed_ && running_) {
+        LOG_INFO("[PULL] {}: UDP does not work with {}, retrying interleaved over TCP", streamId_, url_.host);
+        session(true);
+    }
+
+    detach();
+    finished_ = true;
+}
+
+bool RtspPuller::session(bool tcp) {
+    closeSockets();
+    ctrlBuf_.clear();
+    responses_.clear();
+    sessionId_.clear();
+    authScheme_.clear();
+    jitter_.reset();
+    haveTimestamp_ = false;
+    if (!connectControl()) return false;
+
+    Response response;
+    bool ok = false;
+    if (!request("DESCRIBE", url_.uri, "Accept: application/sdp\r\n", response)) {
+        // Timed out or the connection dropped; already logged.
+    } else if (response.status != 200) {
+        LOG_WARN("[PULL] {}: DESCRIBE {} answered {}", streamId_, url_.uri, response.status);
+    } else if (!parseSdp(response)) {
+        LOG_WARN("[PULL] {}: no H.264 track in the SDP of {}", streamId_, url_.uri);
+    } else if (attach() && setup(tcp)) {
+        std::string extra = "Range: npt=0.000-\r\n";
+        if (!request("PLAY", baseUri_, extra, response)) {
+            // Already logged.
+        } else if (response.status != 200) {
+            LOG_WARN("[PULL] {}: PLAY answered {}", streamId_, response.status);
+        } else {
+            LOG_INFO("[PULL] {}: playing {} over {}", streamId_, url_.uri, tcp ? "TCP" : "UDP");
+            mediaLoop(tcp);
+            ok = !udpFailed_ || tcp;
+        }
+    }
+
+    if (!sessionId_.empty()) {
+        // Best effort; the server reaps the session on its own otherwise.
+        sendRequest("TEARDOWN", baseUri_, "");
+    }
+    closeSockets();
+    return ok;
+}
+
+bool RtspPuller::connectControl() {
+    struct addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    int rc = getaddrinfo(url_.host.c_str(), nullptr, &hints, &result);
+    if (rc != 0 || !result) {
+        LOG_ERROR("[PULL] {}: cannot resolve {}: {}", streamId_, url_.host, gai_strerror(rc));
+        return false;
+    }
+    sockaddr_in addr = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+    addr.sin_port = htons(url_.port);
+    freeaddrinfo(result);
+
+    ctrlFd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ctrlFd_ < 0) return false;
+    int one = 1;
+    setsockopt(ctrlFd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    // Interleaved media shares this socket; give keyframe bursts room.
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(ctrlFd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    if (connect(ctrlFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        LOG_ERROR("[PULL] {}: connect to {}:{}: {}", streamId_, url_.host, url_.port, strerror(errno));
+        return false;
+    }
+    struct pollfd fds[2] = {{ctrlFd_, POLLOUT, 0}, {wakeFd_, POLLIN, 0}};
+    int ready = poll(fds, 2, kConnectTimeoutMs);
+    int error = ready > 0 ? 0 : ETIMEDOUT;
+    if (!running_) return false;
+    if (ready > 0) {
+        socklen_t len = sizeof(error);
+        getsockopt(ctrlFd_, SOL_SOCKET, SO_ERROR, &error, &len);
+    }
+    if (error != 0) {
+        LOG_ERROR("[PULL] {}: connect to {}:{}: {}", streamId_, url_.host, url_.port, strerror(error));
+        return false;
+    }
+    return true;
+}
+
+bool RtspPuller::request(const std::string& method, const std::string& uri, const std::string& extra,
+                         Response& out) {
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!sendRequest(method, uri, extra)) return false;
+        if (!waitResponse(cseq_, kResponseTimeoutMs, out)) {
+            if (running_) LOG_WARN("[PULL] {}: no answer to {}", streamId_, method);
+            return false;
+        }
+        // One retry with credentials; a second 401 means they are wrong.
+        if (out.status == 401 && attempt == 0 && !url_.user.empty() && setAuthentication(out)) continue;
+        if (out.status == 401) {
+            LOG_WARN("[PULL] {}: {} wants {}", streamId_, url_.host,
+                     (url_.user.empty() ? "credentials in the URL" : "other credentials"));
+        }
+        return true;
+    }
+    return true;
+}
+
+bool RtspPuller::sendRequest(const std::string& method, const std::string& uri, const std::string& extra) {
+    std::string text = method + " " + uri + " RTSP/1.0\r\n"
+                       "CSeq: " + std::to_string(++cseq_) + "\r\n"
+                       "User-Agent: rtsp_server\r\n";
+    text += authorization(method, uri);
+    if (!sessionId_.empty()) text += "Session: " + sessionId_ + "\r\n";
+    text += requestHeaders_;
+    text += extra;
+    text += "\r\n";
+
+    size_t sent = 0;
+    while (sent < text.size()) {
+        ssize_t n = send(ctrlFd_, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        // A request is tiny; a full send buffer only happens on a stuck
+        // connection, so wait briefly rather than forever.
+        struct pollfd pfd = {ctrlFd_, POLLOUT, 0};
+        if (n < 0 && errno == EAGAIN && poll(&pfd, 1, kResponseTimeoutMs) > 0) continue;
+        return false;
+    }
+    return true;
+}
+
+bool RtspPuller::waitResponse(int cseq, int timeoutMs, Response& out) {
+    int64_t deadline = steadyNowMs() + timeoutMs;
+    while (running_) {
+        while (!responses_.empty()) {
+            Response response = std::move(responses_.front());
+            responses_.pop_front();
+            if (response.cseq == cseq) {
+                out = std::move(response);
+                return true;
+            }
+        }
+        int64_t remaining = deadline - steadyNowMs();
+        if (remaining <= 0 || !readControl(static_cast<int>(remaining))) return false;
+    }
+    return false;
+}
+
+bool RtspPuller::readControl(int timeoutMs) {
+    struct pollfd fds[2] = {{ctrlFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}};
+    int ready = poll(fds, 2, timeoutMs);
+    if (ready < 0) return errno == EINTR;
+    if (!running_) return false;
+    if (ready == 0 || !(fds[0].revents & (POLLIN | POLLHUP | POLLERR))) return true;
+
+    char chunk[65536];
+    for (;;) {
+        ssize_t n = recv(ctrlFd_, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (n > 0) {
+            ctrlBuf_.append(chunk, n);
+            if (static_cast<size_t>(n) < sizeof(chunk)) break;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && errno == EAGAIN) break;
+        return false;   // closed or reset
+    }
+    parseControl();
+    return ctrlBuf_.size() <= kMaxControlBuffer;
+}
+
+void RtspPuller::parseControl() {
+    size_t pos = 0;
+    int64_t nowMs = steadyNowMs();
+    while (pos < ctrlBuf_.size()) {
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(ctrlBuf_.data()) + pos;
+        size_t available = ctrlBuf_.size() - pos;
+
+        // RFC 2326 10.12: '$', channel, 16-bit length, packet.
+        if (data[0] == '$') {
+            if (available < 4) break;
+            size_t length = (size_t(data[2]) << 8) | data[3];
+            if (available < 4 + length) break;
+            if (data[1] == rtpChannel_) handleRtp(data + 4, length, nowMs);
+            pos += 4 + length;
+            continue;
+        }
+
+        size_t headerEnd = ctrlBuf_.find("\r\n\r\n", pos);
+        if (headerEnd == std::string::npos) break;
+        Response response;
+        size_t contentLength = 0;
+        size_t lineStart = pos;
+        bool statusLine = true;
+        while (lineStart < headerEnd) {
+            size_t lineEnd = ctrlBuf_.find("\r\n", lineStart);
+            std::string line = ctrlBuf_.substr(lineStart, lineEnd - lineStart);
+            lineStart = lineEnd + 2;
+            if (statusLine) {
+                // Requests from the server (RFC 2326 lets it send some) have
+                // no status and are consumed without an answer.
+                if (line.compare(0, 5, "RTSP/") == 0 && line.size() > 12) response.status = atoi(line.c_str() + 9);
+                statusLine = false;
+                continue;
+            }
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string name = trim(line.substr(0, colon));
+            std::string value = trim(line.substr(colon + 1));
+            if (strcasecmp(name.c_str(), "CSeq") == 0) response.cseq = atoi(value.c_str());
+            if (strcasecmp(name.c_str(), "Content-Length") == 0) contentLength = strtoul(value.c_str(), nullptr, 10);
+            response.headers.emplace_back(std::move(name), std::move(value));
+        }
+        size_t bodyStart = headerEnd + 4;
+        if (ctrlBuf_.size() < bodyStart + contentLength) break;
+        response.body = ctrlBuf_.substr(bodyStart, contentLength);
+        pos = bodyStart + contentLength;
+        if (response.status > 0) responses_.push_back(std::move(response));
+    }
+    ctrlBuf_.erase(0, pos);
+}
+
+bool RtspPuller::setAuthentication(const Response& challenge) {
+    std::string basic;
+    for (const auto& entry : challenge.headers) {
+        if (strcasecmp(entry.first.c_str(), "WWW-Authenticate") != 0) continue;
+        if (startsWithNoCase(entry.second, "Digest ")) {
+            // Digest beats Basic: the password never crosses the wire.
+            std::string params = entry.second.substr(7);
+            authScheme_ = "Digest";
+            realm_ = challengeParameter(params, "realm");
+            nonce_ = challengeParameter(params, "nonce");
+            opaque_ = challengeParameter(params, "opaque");
+            qopAuth_ = challengeParameter(params, "qop").find("auth") != std::string::npos;
+            nonceCount_ = 0;
+            return !nonce_.empty();
+        }
+        if (startsWithNoCase(entry.second, "Basic")) basic = entry.second;
+    }
+    if (basic.empty()) return false;
+    authScheme_ = "Basic";
+    return true;
+}
+
+std::string RtspPuller::authorization(const std::string& method, const std::string& uri) {
+    if (authScheme_ == "Basic") {
+        std::string credentials = url_.user + ":" + url_.password;
+        return "Authorization: Basic " +
+               base64_encode(reinterpret_cast<const uint8_t*>(credentials.data()), credentials.size()) + "\r\n";
+    }
+    if (authScheme_ != "Digest") return {};
+
+    // RFC 2617 3.2.2.
+    std::string ha1 = md5Hex(url_.user + ":" + realm_ + ":" + url_.password);
+    std::string ha2 = md5Hex(method + ":" + uri);
+    std::string header = "Authorization: Digest username=\"" + url_.user + "\", realm=\"" + realm_ +
+                         "\", nonce=\"" + nonce_ + "\", uri=\"" + uri + "\"";
+    if (qopAuth_) {
+        char nc[9];
+        snprintf(nc, sizeof(nc), "%08x", ++nonceCount_);
+        std::string cnonce = md5Hex(std::to_string(steadyNowMs()) + nonce_).substr(0, 16);
+        std::string response = md5Hex(ha1 + ":" + nonce_ + ":" + nc + ":" + cnonce + ":auth:" + ha2);
+        header += ", response=\"" + response + "\", qop=auth, nc=" + nc + ", cnonce=\"" + cnonce + "\"";
+    } else {
+        header += ", response=\"" + md5Hex(ha1 + ":" + nonce_ + ":" + ha2) + "\"";
+    }
+    if (!opaque_.empty()) header += ", opaque=\"" + opaque_ + "\"";
+    return header + "\r\n";
+}
+
+bool RtspPuller::parseSdp(const Response& describe) {
+    std::string base = describe.header("Content-Base");
+    if (base.empty()) base = describe.header("Content-Location");
+    if (base.empty()) base = url_.uri;
+
+    std::string sessionControl, videoControl;
+    std::vector<std::pair<int, std::string>> fmtps;
+    bool inMedia = false, inVideo = false, videoDone = false;
+    payloadType_ = -1;
+
+    size_t lineStart = 0;
+    while (lineStart < describe.body.size()) {
+        size_t lineEnd = describe.body.find('\n', lineStart);
+        if (lineEnd == std::string::npos) lineEnd = describe.body.size();
+        std::string line = trim(describe.body.substr(lineStart, lineEnd - lineStart));
+        lineStart = lineEnd + 1;
+
+        if (line.compare(0, 2, "m=") == 0) {
+            // Only the first video section is used.
+            if (inVideo) videoDone = true;
+            inMedia = true;
+            inVideo = !videoDone && line.compare(0, 8, "m=video ") == 0;
+        } else if (line.compare(0, 10, "a=control:") == 0) {
+            if (!inMedia) sessionControl = line.substr(10);
+            else if (inVideo) videoControl = line.substr(10);
+        } else if (inVideo && line.compare(0, 9, "a=rtpmap:") == 0) {
+            int pt = atoi(line.c_str() + 9);
+            size_t space = line.find(' ');
+            if (payloadType_ < 0 && space != std::string::npos && startsWithNoCase(line.substr(space + 1), "H264/")) {
+                payloadType_ = pt;
+            }
+        } else if (inVideo && line.compare(0, 7, "a=fmtp:") == 0) {
+            size_t space = line.find(' ');
+            if (space != std::string::npos) fmtps.emplace_back(atoi(line.c_str() + 7), line.substr(space + 1));
+        }
+    }
+    if (payloadType_ < 0) return false;
+
+    baseUri_ = resolveControl(base, sessionControl);
+    trackUri_ = resolveControl(base, videoControl);
+
+    spropSets_.clear();
+    for (const auto& fmtp : fmtps) {
+        if (fmtp.first != payloadType_) continue;
+        std::string sets = parameter(fmtp.second, "sprop-parameter-sets");
+        size_t start = 0;
+        while (start <= sets.size() && !sets.empty()) {
+            size_t comma = sets.find(',', start);
+            std::vector<uint8_t> nal;
+            if (base64_decode(sets.substr(start, comma == std::string::npos ? std::string::npos : comma - start), nal) &&
+                !nal.empty()) {
+                std::vector<uint8_t> annexB = {0, 0, 0, 1};
+                annexB.insert(annexB.end(), nal.begin(), nal.end());
+                spropSets_.push_back(std::move(annexB));
+            }
+            if (comma == std::string::npos) break;
+            start = comma + 1;
+        }
+    }
+    return true;
+}
+
+bool RtspPuller::setup(bool tcp) {
+    std::string transport;
+    if (tcp) {
+        transport = "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n";
+    } else {
+        // An even RTP port with RTCP right above it (RFC 3550 11).
+        for (int attempt = 0; attempt < 16 && rtcpFd_ < 0; attempt++) {
+            closeMediaSockets();
+            rtpFd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = INADDR_ANY;
+            socklen_t len = sizeof(addr);
+            if (rtpFd_ < 0 || bind(rtpFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+                getsockname(rtpFd_, (struct sockaddr*)&addr, &len) < 0) {
+                continue;
+            }
+            uint16_t port = ntohs(addr.sin_port);
+            if (port % 2 != 0 || port == 65534) continue;
+            rtcpFd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            addr.sin_port = htons(port + 1);
+            if (rtcpFd_ >= 0 && bind(rtcpFd_, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+                int rcvbuf = 4 * 1024 * 1024;
+                setsockopt(rtpFd_, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+                transport = "Transport: RTP/AVP;unicast;client_port=" + std::to_string(port) + "-" +
+                            std::to_string(port + 1) + "\r\n";
+            } else if (rtcpFd_ >= 0) {
+                close(rtcpFd_);
+                rtcpFd_ = -1;
+            }
+        }
+        if (transport.empty()) {
+            LOG_ERROR("[PULL] {}: no free UDP port pair", streamId_);
+            return false;
+        }
+    }
+
+    Response response;
+    if (!request("SETUP", trackUri_, transport, response)) return false;
+    if (response.status != 200) {
+        LOG_WARN("[PULL] {}: SETUP ({}) answered {}", streamId_, tcp ? "TCP" : "UDP", response.status);
+        if (!tcp && response.status == 461) udpFailed_ = true;
+        return false;
+    }
+
+    std::string session = response.header("Session");
+    sessionId_ = trim(session.substr(0, session.find(';')));
+    std::string timeout = parameter(session, "timeout");
+    sessionTimeoutSec_ = timeout.empty() ? 60 : std::max(atoi(timeout.c_str()), 2);
+
+    std::string reply = response.header("Transport");
+    if (tcp) {
+        std::string interleaved = parameter(reply, "interleaved");
+        rtpChannel_ = interleaved.empty() ? 0 : static_cast<uint8_t>(atoi(interleaved.c_str()));
+    } else {
+        // RTCP goes to the server's second port at the control address.
+        sockaddr_in peer{};
+        socklen_t len = sizeof(peer);
+        getpeername(ctrlFd_, (struct sockaddr*)&peer, &len);
+        serverRtcp_ = peer;
+        std::string ports = parameter(reply, "server_port");
+        size_t dash = ports.find('-');
+        int rtcpPort = dash != std::string::npos ? atoi(ports.c_str() + dash + 1) : atoi(ports.c_str()) + 1;
+        serverRtcp_.sin_port = htons(static_cast<uint16_t>(rtcpPort));
+    }
+    return true;
+}
+
+void RtspPuller::mediaLoop(bool tcp) {
+    int64_t nowMs = steadyNowMs();
+    int64_t lastMediaMs = nowMs;
+    int64_t nextKeepaliveMs = nowMs + sessionTimeoutSec_ * 1000 / 2;
+    int64_t nextReportMs = nowMs + kReportIntervalMs;
+    uint64_t seen = packets_;
+    bool gotMedia = false;
+
+    uint8_t datagram[rtp_ingest::kMaxPacketSize];
+    while (running_) {
+        int64_t wake = std::min({nextKeepaliveMs, lastMediaMs + kMediaTimeoutMs, nowMs + kIdlePollMs});
+        if (!tcp) wake = std::min(wake, nextReportMs);
+        int64_t deadline = jitter_.nextDeadlineMs();
+        if (deadline >= 0) wake = std::min(wake, deadline);
+
+        struct pollfd fds[4] = {{ctrlFd_, POLLIN, 0}, {wakeFd_, POLLIN, 0}, {rtpFd_, POLLIN, 0}, {rtcpFd_, POLLIN, 0}};
+        int ready = poll(fds, tcp ? 2 : 4, static_cast<int>(std::max<int64_t>(wake - nowMs, 0)));
+        if (ready < 0 && errno != EINTR) break;
+        if (!running_) break;
+
+        if (ready > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            if (!readControl(0)) {
+                LOG_WARN("[PULL] {}: {} closed the connection", streamId_, url_.host);
+                break;
+            }
+            // Keepalive answers; nothing to act on.
+            responses_.clear();
+        }
+        if (!tcp && ready > 0) {
+            if (fds[2].revents & POLLIN) {
+                int64_t arrivalMs = steadyNowMs();
+                ssize_t n;
+                while ((n = recv(rtpFd_, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0) {
+                    handleRtp(datagram, n, arrivalMs);
+                }
+            }
+            if (fds[3].revents & POLLIN) {
+                bool bye = false;
+                ssize_t n;
+                while ((n = recv(rtcpFd_, datagram, sizeof(datagram), MSG_DONTWAIT)) > 0) {
+                    rtp_ingest::forEachRtcpPacket(datagram, n, [&](uint8_t type, uint8_t, const uint8_t*, size_t) {
+                        if (type == rtp_ingest::kRtcpBye) bye = true;
+                    });
+                }
+                if (bye) {
+                    LOG_INFO("[PULL] {}: {} sent BYE", streamId_, url_.host);
+                    break;
+                }
+            }
+        }
+
+        nowMs = steadyNowMs();
+        drain(nowMs);
+        if (packets_ != seen) {
+            seen = packets_;
+            lastMediaMs = nowMs;
+            gotMedia = true;
+        }
+        if (nowMs - lastMediaMs >= kMediaTimeoutMs) {
+            if (!gotMedia && !tcp && transport_ == PullTransport::Auto) {
+                udpFailed_ = true;
+            } else {
+                LOG_WARN("[PULL] {}: no media from {} for {} ms", streamId_, url_.host, kMediaTimeoutMs);
+            }
+            break;
+        }
+        if (nowMs >= nextKeepaliveMs) {
+            sendRequest("GET_PARAMETER", baseUri_, "");
+            nextKeepaliveMs = nowMs + sessionTimeoutSec_ * 1000 / 2;
+        }
+        if (!tcp && nowMs >= nextReportMs) {
+            sendReceiverReport();
+            nextReportMs = nowMs + kReportIntervalMs;
+        }
+    }
+    LOG_INFO("[PULL] {}: {} packets, {} lost, {} NALUs dropped", streamId_, packets_.load(), lostPackets_,
+             depacketizer_.droppedNalus());
+}
+
+void RtspPuller::handleRtp(const uint8_t* data, size_t size, int64_t nowMs) {
+    if (size < 12 || (data[0] >> 6) != 2) return;
+    if ((data[1] & 0x7F) != payloadType_) return;   // other tracks, RTCP on a shared port
+
+    size_t headerSize = 12 + (data[0] & 0x0F) * 4;
+    if (data[0] & 0x10) {
+        if (size < headerSize + 4) return;
+        headerSize += 4 + size_t(rtp_ingest::getBe16(data + headerSize + 2)) * 4;
+    }
+    size_t padding = (data[0] & 0x20) ? data[size - 1] : 0;
+    if (size < headerSize + padding + 1) return;
+
+    remoteSsrc_ = rtp_ingest::getBe32(data + 8);
+    JitterBuffer::Packet packet;
+    packet.seq = rtp_ingest::getBe16(data + 2);
+    packet.timestamp = rtp_ingest::getBe32(data + 4);
+    packet.marker = data[1] & 0x80;
+    packet.payload.assign(data + headerSize, data + size - padding);
+    if (jitter_.insert(std::move(packet), nowMs)) {
+        packets_++;
+    }
+}
+
+void RtspPuller::drain(int64_t nowMs) {
+    JitterBuffer::Packet packet;
+    uint32_t lost = 0;
+    while (jitter_.pop(nowMs, packet, lost)) {
+        lostPackets_ += lost;
+        highestSeq_ = packet.seq;
+        naluScratch_.clear();
+        depacketizer_.push(packet.payload.data(), packet.payload.size(), lost > 0, naluScratch_);
+        for (size_t i = 0; i < naluScratch_.size(); i++) {
+            bool auEnd = packet.marker && i + 1 == naluScratch_.size();
+            publish(std::move(naluScratch_[i]), packet.timestamp, auEnd);
+        }
+    }
+}
+
+void RtspPuller::publish(std::vector<uint8_t>&& data, uint32_t rtpTimestamp, bool accessUnitEnd) {
+    if (!stream_) return;
+    if (!stream_->isPublisher(session_)) {
+        // A camera took the stream over while the source was quiet.
+        LOG_INFO("[PULL] {}: another publisher took over the stream, stopping", streamId_);
+        detach();
+        running_ = false;
+        return;
+    }
+    if (!haveTimestamp_) {
+        extendedTimestamp_ = rtpTimestamp;
+        haveTimestamp_ = true;
+    } else {
+        extendedTimestamp_ += static_cast<int32_t>(rtpTimestamp - lastTimestamp_);
+    }
+    lastTimestamp_ = rtpTimestamp;
+    uint64_t captureUs = extendedTimestamp_ * 1000000 / rtp_ingest::kClockRate;
+
+    uint8_t type = data.size() > 4 ? (data[4] & 0x1F) : 0;
+    if (type == 7) inbandSets_ = true;
+    if (type == 5 && !inbandSets_) {
+        // Some sources only put SPS/PPS in the SDP; consumers that mux
+        // (recorder, TS) want them in-band in front of each IDR.
+        for (const std::vector<uint8_t>& set : spropSets_) {
+            auto nalu = std::make_shared<Nalu>();
+            nalu->data = set;
+            classifyNalu(*nalu);
+            nalu->hasFrameInfo = true;
+            nalu->captureUs = captureUs;
+            stream_->publish(std::move(nalu));
+        }
+    }
+
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data = std::move(data);
+    nalu->startCodeLength = 4;
+    nalu->type = type;
+    nalu->hasFrameInfo = true;
+    nalu->accessUnitEnd = accessUnitEnd;
+    nalu->captureUs = captureUs;
+    naluCount_++;
+
+    if (naluCount_ % 300 == 1) {
+        LOG_DEBUG("[PULL] {} NALU #{} (type: {}, size: {} bytes)", streamId_, naluCount_, (int)nalu->type,
+                  nalu->data.size());
+    }
+    stream_->publish(std::move(nalu));
+}
+
+void RtspPuller::sendReceiverReport() {
+    // RR with one report block + SDES CNAME, the minimal compound packet.
+    uint8_t packet[64] = {};
+    rtp_ingest::putRtcpHeader(packet, 1, rtp_ingest::kRtcpRr, 32);
+    rtp_ingest::putBe32(packet + 4, kReceiverSsrc);
+    rtp_ingest::putBe32(packet + 8, remoteSsrc_);
+    rtp_ingest::putBe32(packet + 12, static_cast<uint32_t>(std::min<uint64_t>(lostPackets_, 0x7FFFFF)));
+    rtp_ingest::putBe32(packet + 16, highestSeq_);
+
+    static const char kCname[] = "rtsp_server";
+    size_t itemBytes = 2 + sizeof(kCname) - 1;
+    size_t sdesBytes = (4 + 4 + itemBytes + 1 + 3) & ~size_t(3);
+    uint8_t* sdes = packet + 32;
+    rtp_ingest::putRtcpHeader(sdes, 1, rtp_ingest::kRtcpSdes, sdesBytes);
+    rtp_ingest::putBe32(sdes + 4, kReceiverSsrc);
+    sdes[8] = rtp_ingest::kSdesCname;
+    sdes[9] = sizeof(kCname) - 1;
+    memcpy(sdes + 10, kCname, sizeof(kCname) - 1);
+
+    sendto(rtcpFd_, packet, 32 + sdesBytes, MSG_DONTWAIT, (struct sockaddr*)&serverRtcp_, sizeof(serverRtcp_));
+}
+
+bool RtspPuller::attach() {
+    if (stream_) return true;
+    std::shared_ptr<Stream> stream = registry_->acquire(streamId_);
+    session_ = stream->claimIngest(url_.host + ":" + std::to_string(url_.port));
+    if (session_ == 0) {
+        LOG_WARN("[PULL] {}: stream already has a publisher, not pulling", streamId_);
+        return false;
+    }
+    stream_ = std::move(stream);
+    inbandSets_ = false;
+
+    // Known before the first IDR, so local DESCRIBEs needn't wait for it.
+    for (const std::vector<uint8_t>& set : spropSets_) {
+        uint8_t type = set.size() > 4 ? (set[4] & 0x1F) : 0;
+        if (type == 7) stream_->buffer->setSps(set);
+        if (type == 8) stream_->buffer->setPps(set);
+    }
+    return true;
+}
+
+void RtspPuller::detach() {
+    if (!stream_) return;
+    stream_->releaseIngest();
+    stream_.reset();
+}
+
+void RtspPuller::closeSockets() {
+    if (ctrlFd_ >= 0) close(ctrlFd_);
+    ctrlFd_ = -1;
+    closeMediaSockets();
+}
+
+void RtspPuller::closeMediaSockets() {
+    if (rtpFd_ >= 0) close(rtpFd_);
+    if (rtcpFd_ >= 0) close(rtcpFd_);
+    rtpFd_ = -1;
+    rtcpFd_ = -1;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
+#include "media/JitterBuffer.h"
+#include "media/H264Depacketizer.h"
+#include <netinet/in.h>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// An RTSP client that plays one remote rtsp:// URL into a local stream, so
+// the stream is re-served here like any camera (RTSP, HLS, WebSocket, TS).
+//
+// One thread per session runs the whole exchange: DESCRIBE (with Basic or
+// Digest authentication when the URL carries credentials), SETUP of the
+// H.264 video track, PLAY, then the media loop. Received RTP goes through a
+// JitterBuffer and the H264Depacketizer, the same path as RtpIngestReceiver,
+// and is published to the stream as its ingest. sprop-parameter-sets from
+// the SDP are published up front so local DESCRIBEs can be answered before
+// the first IDR. The session is kept alive with GET_PARAMETER and, over UDP,
+// RTCP receiver reports.
+//
+// The puller does not retry: when the session fails or the remote side goes
+// quiet, running() turns false and RtspRelay decides whether to start a new
+// one.
+class RtspPuller {
+public:
+    RtspPuller(std::shared_ptr<StreamRegistry> registry, std::string streamId, std::string url,
+               PullTransport transport, int latencyMs);
+    ~RtspPuller();
+
+    // Added to every request, e.g. the edge marker; call before start().
+    void setRequestHeaders(std::string headers) { requestHeaders_ = std::move(headers); }
+
+    void start();
+    // Sends TEARDOWN (best effort) and detaches from the stream.
+    void stop();
+
+    bool running() const { return !finished_; }
+    // True once media has flowed; the relay resets its backoff on it.
+    bool receivedMedia() const { return packets_ > 0; }
+    // Auto mode: UDP SETUP was refused or carried nothing, so the next
+    // session should go straight to TCP.
+    bool preferTcp() const { return udpFailed_; }
+
+private:
+    struct Url {
+        std::string host;
+        int port = 554;
+        std::string user, password;
+        std::string uri;    // the URL without credentials, used in requests
+    };
+    struct Response {
+        int status = 0;
+        int cseq = -1;
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+        std::string header(const std::string& name) const;
+    };
+
+    void run();
+    bool session(bool tcp);
+    bool connectControl();
+    bool request(const std::string& method, const std::string& uri, const std::string& extra,
+                 Response& out);
+    bool sendRequest(const std::string& method, const std::string& uri, const std::string& extra);
+    bool waitResponse(int cseq, int timeoutMs, Response& out);
+    bool readControl(int timeoutMs);
+    void parseControl();
+    bool setAuthentication(const Response& challenge);
+    std::string authorization(const std::string& method, const std::string& uri);
+    bool parseSdp(const Response& describe);
+    bool setup(bool tcp);
+    void mediaLoop(bool tcp);
+    void handleRtp(const uint8_t* data, size_t size, int64_t nowMs);
+    void drain(int64_t nowMs);
+    void publish(std::vector<uint8_t>&& data, uint32_t rtpTimestamp, bool accessUnitEnd);
+    void sendReceiverReport();
+    bool attach();
+    void detach();
+    void closeSockets();
+    void closeMediaSockets();
+
+    static bool parseUrl(const std::string& text, Url& out);
+
+    std::shared_ptr<StreamRegistry> registry_;
+    const std::string streamId_;
+    const std::string urlText_;
+    const PullTransport transport_;
+    std::string requestHeaders_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> finished_{false};
+    std::atomic<bool> udpFailed_{false};
+    std::atomic<uint64_t> packets_{0};
+    int wakeFd_ = -1;   // eventfd: stop() interrupts any wait
+
+    // Puller thread only.
+    Url url_;
+    int ctrlFd_ = -1;
+    int rtpFd_ = -1, rtcpFd_ = -1;
+    sockaddr_in serverRtcp_{};
+    std::string ctrlBuf_;
+    std::deque<Response> responses_;
+    int cseq_ = 0;
+    std::string sessionId_;
+    int sessionTimeoutSec_ = 60;
+    uint8_t rtpChannel_ = 0;    // interleaved channel of RTP (TCP)
+    int payloadType_ = -1;
+    std::string trackUri_;
+    std::string baseUri_;
+    std::vector<std::vector<uint8_t>> spropSets_;
+
+    // Authentication state from the last 401.
+    std::string authScheme_;    // "", "Basic" or "Digest"
+    std::string realm_, nonce_, opaque_;
+    bool qopAuth_ = false;
+    uint32_t nonceCount_ = 0;
+
+    std::shared_ptr<Stream> stream_;
+    uint32_t session_ = 0;      // our Stream::claimIngest() session
+    JitterBuffer jitter_;
+    H264Depacketizer depacketizer_;
+    std::vector<std::vector<uint8_t>> naluScratch_;
+    uint32_t remoteSsrc_ = 0;
+    uint16_t highestSeq_ = 0;
+    bool inbandSets_ = false;   // the source sends SPS in-band itself
+    bool haveTimestamp_ = false;
+    uint32_t lastTimestamp_ = 0;
+    uint64_t extendedTimestamp_ = 0;
+    uint64_t lostPackets_ = 0;
+    uint64_t naluCount_ = 0;
+};
@@ -0,0 +1,161 @@
+#include "net/RtspRelay.h"
+#include "net/EdgeRing.h"
+#include "IngestProtocol.h"
+#include "utils/Log.h"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// A pulled stream with no viewers for this long is released upstream.
+static constexpr int64_t kLingerMs = 10000;
+static constexpr int64_t kSuperviseIntervalMs = 1000;
+static constexpr int64_t kMinBackoffMs = 2000;
+static constexpr int64_t kMaxBackoffMs = 30000;
+
+static int64_t steadyNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The URL for logs: user:password@ taken out.
+static std::string withoutCredentials(const std::string& url) {
+    size_t authority = url.find("://");
+    size_t at = url.find('@');
+    size_t path = url.find('/', authority == std::string::npos ? 0 : authority + 3);
+    if (authority == std::string::npos || at == std::string::npos || (path != std::string::npos && at > path)) {
+        return url;
+    }
+    return url.substr(0, authority + 3) + url.substr(at + 1);
+}
+
+RtspRelay::RtspRelay(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry)
+    : registry_(std::move(registry)), transport_(config.pullTransport), latencyMs_(config.rtpIngestLatencyMs) {
+    for (const PullSpec& spec : config.pulls) {
+        sources_[spec.streamId].url = spec.url;
+    }
+    originUrl_ = config.originUrl;
+    while (!originUrl_.empty() && originUrl_.back() == '/') originUrl_.pop_back();
+}
+
+RtspRelay::~RtspRelay() {
+    stop();
+}
+
+void RtspRelay::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) return;
+        running_ = true;
+    }
+    thread_ = std::thread(&RtspRelay::superviseLoop, this);
+    registry_->setSourceRequester([this](const std::string& id) { demand(id); });
+    if (originUrl_.empty()) {
+        LOG_INFO("RtspRelay started: {} pulled stream(s), transport {}", sources_.size(),
+                 pullTransportName(transport_));
+    } else {
+        LOG_INFO("RtspRelay started: {} pulled stream(s), edge of {}, transport {}", sources_.size(),
+                 withoutCredentials(originUrl_), pullTransportName(transport_));
+    }
+}
+
+void RtspRelay::stop() {
+    registry_->setSourceRequester(nullptr);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (auto& entry : sources_) {
+        if (entry.second.puller) entry.second.puller->stop();
+        entry.second.puller.reset();
+    }
+}
+
+void RtspRelay::demand(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) return;
+    auto it = sources_.find(id);
+    if (it == sources_.end()) {
+        if (originUrl_.empty() || !ingest::isValidStreamId(id)) return;
+        it = sources_.emplace(id, Source()).first;
+        it->second.url = originUrl_ + std::string(StreamRegistry::kMountPrefix) + "/" + id;
+        it->second.fromOrigin = true;
+    }
+    Source& source = it->second;
+    int64_t nowMs = steadyNowMs();
+    source.demandMs = nowMs;
+    // Starting is only a thread spawn, fine on the caller's reactor thread.
+    if (!source.puller && nowMs >= source.retryAtMs) startPuller(id, source, nowMs);
+}
+
+void RtspRelay::startPuller(const std::string& id, Source& source, int64_t nowMs) {
+    std::shared_ptr<Stream> stream = registry_->find(id);
+    if (stream && stream->ingestConnections > 0) {
+        // Published here directly; nothing to pull.
+        source.retryAtMs = nowMs + kMinBackoffMs;
+        return;
+    }
+    PullTransport transport = transport_ == PullTransport::Auto && source.preferTcp ? PullTransport::Tcp
+                                                                                      : transport_;
+    LOG_INFO("[RELAY] {}: pulling {} ({})", id, withoutCredentials(source.url), pullTransportName(transport));
+    source.puller = std::make_unique<RtspPuller>(registry_, id, source.url, transport, latencyMs_);
+    if (source.fromOrigin) source.puller->setRequestHeaders(std::string(kEdgePullHeader) + ": 1\r\n");
+    source.puller->start();
+    source.retryAtMs = nowMs;
+}
+
+void RtspRelay::superviseLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        cv_.wait_for(lock, std::chrono::milliseconds(kSuperviseIntervalMs));
+        if (!running_) break;
+
+        int64_t nowMs = steadyNowMs();
+        std::vector<std::unique_ptr<RtspPuller>> finished;
+        for (auto it = sources_.begin(); it != sources_.end();) {
+            const std::string& id = it->first;
+            Source& source = it->second;
+
+            if (source.puller) {
+                std::shared_ptr<Stream> stream = registry_->find(id);
+                if (stream && stream->viewerCount() > 0) source.demandMs = nowMs;
+            }
+            bool wanted = nowMs - source.demandMs < kLingerMs;
+
+            if (source.puller && !wanted) {
+                LOG_INFO("[RELAY] {}: no viewers for {} s, stopping pull", id, kLingerMs / 1000);
+                finished.push_back(std::move(source.puller));
+                source.failures = 0;
+                source.retryAtMs = 0;
+            } else if (source.puller && !source.puller->running()) {
+                // Media flowed: a fresh failure; otherwise back off further.
+                source.failures = source.puller->receivedMedia() ? 1 : source.failures + 1;
+                source.preferTcp = source.preferTcp || source.puller->preferTcp();
+                int64_t backoff = std::min(kMaxBackoffMs, kMinBackoffMs << std::min(source.failures - 1, 4));
+                source.retryAtMs = nowMs + backoff;
+                LOG_INFO("[RELAY] {}: pull ended, retrying in {} s", id, backoff / 1000);
+                finished.push_back(std::move(source.puller));
+            } else if (!source.puller && wanted && nowMs >= source.retryAtMs) {
+                startPuller(id, source, nowMs);
+            }
+
+            if (source.fromOrigin && !source.puller && !wanted) {
+                it = sources_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        // Stopping joins the puller's thread (and sends TEARDOWN); don't
+        // hold up viewer requests meanwhile.
+        if (!finished.empty()) {
+            lock.unlock();
+            finished.clear();
+            lock.lock();
+        }
+    }
+}
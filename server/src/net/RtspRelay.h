@@ -0,0 +1,58 @@
+#pragma once
+
+#include "net/RtspPuller.h"
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <string>
+
+// Pull/relay mode: streams configured with --pull are played from a remote
+// RTSP server only while someone here wants them. In edge mode (--origin)
+// every valid stream id is such a stream, pulled from the origin's /live/<id>
+// with kEdgePullHeader so the origin serves it instead of redirecting.
+//
+// A viewer request for such a stream (StreamRegistry::requestSource) starts
+// an RtspPuller right away; the DESCRIBE meanwhile waits for SPS/PPS like
+// any DESCRIBE for a camera that hasn't connected yet. A supervisor thread
+// checks the pulled streams once a second: a pull whose stream had no
+// viewers for kLingerMs is stopped, and one that failed is started again
+// with exponential backoff for as long as there is demand.
+class RtspRelay {
+public:
+    RtspRelay(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry);
+    ~RtspRelay();
+
+    // Registers as the registry's source requester.
+    void start();
+    void stop();
+
+private:
+    struct Source {
+        std::string url;
+        std::unique_ptr<RtspPuller> puller;
+        int64_t demandMs = 0;       // last viewer request or viewer seen
+        int64_t retryAtMs = 0;
+        int failures = 0;
+        bool preferTcp = false;     // auto mode found UDP not working
+        bool fromOrigin = false;    // edge mode; dropped once it's stopped
+    };
+
+    void demand(const std::string& id);
+    void superviseLoop();
+    void startPuller(const std::string& id, Source& source, int64_t nowMs);
+
+    std::shared_ptr<StreamRegistry> registry_;
+    const PullTransport transport_;
+    std::string originUrl_;
+    const int latencyMs_;
+    std::thread thread_;
+    bool running_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, Source> sources_;
+};
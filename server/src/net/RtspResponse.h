@@ -0,0 +1,70 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <charconv>
+
+// Pre-rendered status lines. A response is assembled by appending these
+// constant fragments and a few dynamic values into a reused buffer, so
+// building a reply is a handful of memcpy()s with no allocation once the
+// buffer has grown to its working size.
+namespace rtsp_status {
+inline constexpr std::string_view kOk = "RTSP/1.0 200 OK\r\n";
+inline constexpr std::string_view kMovedTemporarily = "RTSP/1.0 302 Moved Temporarily\r\n";
+inline constexpr std::string_view kBadRequest = "RTSP/1.0 400 Bad Request\r\n";
+inline constexpr std::string_view kNotFound = "RTSP/1.0 404 Stream Not Found\r\n";
+inline constexpr std::string_view kRequestTooLarge = "RTSP/1.0 413 Request Entity Too Large\r\n";
+inline constexpr std::string_view kSessionNotFound = "RTSP/1.0 454 Session Not Found\r\n";
+inline constexpr std::string_view kMethodNotValidInState = "RTSP/1.0 455 Method Not Valid in This State\r\n";
+inline constexpr std::string_view kInvalidRange = "RTSP/1.0 457 Invalid Range\r\n";
+inline constexpr std::string_view kAggregateNotAllowed = "RTSP/1.0 459 Aggregate Operation Not Allowed\r\n";
+inline constexpr std::string_view kUnsupportedTransport = "RTSP/1.0 461 Unsupported Transport\r\n";
+inline constexpr std::string_view kNotImplemented = "RTSP/1.0 501 Not Implemented\r\n";
+inline constexpr std::string_view kServiceUnavailable = "RTSP/1.0 503 Service Unavailable\r\n";
+}
+
+class RtspResponse {
+public:
+    RtspResponse() { buf_.reserve(1024); }
+
+    // Starts a new response: status line followed by the echoed CSeq.
+    RtspResponse& start(std::string_view statusLine, std::string_view cseq) {
+        buf_.clear();
+        buf_.append(statusLine);
+        return header("CSeq", cseq);
+    }
+
+    RtspResponse& header(std::string_view name, std::string_view value) {
+        buf_.append(name).append(": ", 2).append(value).append("\r\n", 2);
+        return *this;
+    }
+
+    RtspResponse& header(std::string_view name, long long value) {
+        char num[24];
+        auto res = std::to_chars(num, num + sizeof(num), value);
+        return header(name, std::string_view(num, res.ptr - num));
+    }
+
+    // Appends pre-rendered bytes verbatim (header lines, blank line + body, ...).
+    RtspResponse& raw(std::string_view bytes) {
+        buf_.append(bytes);
+        return *this;
+    }
+
+    RtspResponse& number(long long value) {
+        char num[24];
+        auto res = std::to_chars(num, num + sizeof(num), value);
+        buf_.append(num, res.ptr - num);
+        return *this;
+    }
+
+    // Terminates the header block. Returns the finished bytes.
+    const std::string& end() {
+        buf_.append("\r\n", 2);
+        return buf_;
+    }
+
+    const std::string& str() const { return buf_; }
+
+private:
+    std::string buf_;
+};
@@ -1,21 +1,29 @@
 #include "RtspSession.h"
 #include "RtpSender.h"
-#include "utils/base64.h"
-#include <iostream>
-#include <sstream>
+#include "utils/Log.h"
 #include <vector>
 #include <unistd.h>
 #include <cstring>
+#include <cerrno>
+#include <algorithm>
 #include <sys/socket.h>
-#include <thread>
+#include <sys/random.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <ctime>
 
-RtspSession::RtspSession(int fd, std::string ip, std::shared_ptr<StreamBuffer> streamBuffer) 
+RtspSession::RtspSession(int fd, std::string ip, std::shared_ptr<StreamRegistry> registry,
+                         const ServerConfig& config, const EdgeRing* edges)
     : clientFd(fd), 
       clientIp(ip), 
-      streamBuffer_(streamBuffer) 
+      registry_(registry),
+      config_(config),
+      edges_(edges)
 {
-    rtpSender_ = std::make_unique<RtpSender>(streamBuffer_);
-    std::cout << "[RTSP] Session created for " << clientIp << std::endl;
+    lastActivity_ = std::chrono::steady_clock::now();
+    LOG_INFO("[RTSP] Session created for {}", clientIp);
 }
 
 RtspSession::~RtspSession() {
@@ -23,153 +31,544 @@ RtspSession::~RtspSession() {
         rtpSender_->stop();
     }
     close(clientFd);
-    std::cout << "[RTSP] Session closed for " << clientIp << std::endl;
+    LOG_INFO("[RTSP] Session closed for {}", clientIp);
+}
+
+static constexpr size_t kReadChunk = 4096;
+static constexpr size_t kMaxInputBuffer = RtspParser::kMaxHeaderBytes + RtspParser::kMaxBodyBytes + kReadChunk;
+// A client that stops reading while it keeps sending requests is dropped
+// rather than letting its replies pile up in server memory.
+static constexpr size_t kMaxOutputBuffer = 256 * 1024;
+
+static int parseInt(std::string_view s) {
+    int value = 0;
+    size_t i = 0;
+    while (i < s.size() && s[i] >= '0' && s[i] <= '9' && value < 1000000) {
+        value = value * 10 + (s[i++] - '0');
+    }
+    return value;
+}
+
+// Where a PLAY starts. npt counts from the beginning of the oldest recording
+// of the stream; clock= is absolute UTC.
+struct PlayRange {
+    enum Kind { Live, Offset, Utc } kind = Live;
+    int64_t us = 0;
+};
+
+static bool parseDigits(std::string_view s, size_t& pos, int count, int& value) {
+    value = 0;
+    for (int i = 0; i < count; i++, pos++) {
+        if (pos >= s.size() || s[pos] < '0' || s[pos] > '9') return false;
+        value = value * 10 + (s[pos] - '0');
+    }
+    return true;
+}
+
+// "npt=now-", "npt=<seconds>-[end]" or "clock=YYYYMMDDThhmmss[.fraction]Z-[end]".
+// Only the start matters: playback runs until the client stops it.
+static bool parseRange(std::string_view value, PlayRange& range) {
+    if (value.substr(0, 4) == "npt=") {
+        std::string_view start = value.substr(4, value.find('-') - 4);
+        if (start == "now") {
+            range.kind = PlayRange::Live;
+            return true;
+        }
+        std::string text(start);
+        char* end = nullptr;
+        double seconds = strtod(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !std::isfinite(seconds) || seconds < 0) return false;
+        range.kind = PlayRange::Offset;
+        range.us = static_cast<int64_t>(seconds * 1e6);
+        return true;
+    }
+    if (value.substr(0, 6) == "clock=") {
+        size_t pos = 6;
+        struct tm t = {};
+        int year, month, day, hour, minute, second;
+        if (!parseDigits(value, pos, 4, year) || !parseDigits(value, pos, 2, month) ||
+            !parseDigits(value, pos, 2, day) || pos >= value.size() || value[pos++] != 'T' ||
+            !parseDigits(value, pos, 2, hour) || !parseDigits(value, pos, 2, minute) ||
+            !parseDigits(value, pos, 2, second)) {
+            return false;
+        }
+        int64_t fractionUs = 0;
+        if (pos < value.size() && value[pos] == '.') {
+            int64_t scale = 100000;
+            for (pos++; pos < value.size() && value[pos] >= '0' && value[pos] <= '9'; pos++) {
+                fractionUs += (value[pos] - '0') * scale;
+                scale /= 10;
+            }
+        }
+        if (pos >= value.size() || value[pos] != 'Z') return false;
+        t.tm_year = year - 1900;
+        t.tm_mon = month - 1;
+        t.tm_mday = day;
+        t.tm_hour = hour;
+        t.tm_min = minute;
+        t.tm_sec = second;
+        range.kind = PlayRange::Utc;
+        range.us = static_cast<int64_t>(timegm(&t)) * 1000000 + fractionUs;
+        return true;
+    }
+    return false;
+}
+
+// 64 random bits as 16 hex digits. Session ids must not be guessable, since
+// they are the only thing authorizing PLAY/TEARDOWN on a connection.
+static std::string generateSessionId() {
+    uint64_t id = 0;
+    if (getrandom(&id, sizeof(id), 0) != sizeof(id)) {
+        std::random_device rd;
+        id = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llX", static_cast<unsigned long long>(id));
+    return buf;
 }
 
 bool RtspSession::handleEvent() {
-    char buffer[4096] = {0};
-    int n = recv(clientFd, buffer, sizeof(buffer), 0);
-    
-    if (n <= 0) return false; 
-    
-    std::string request(buffer, n);
-    // std::cout << "[RTSP] Request:\n" << request << std::endl;
-    
-    handleRequest(request);
+    // The socket is edge-triggered: keep reading until the kernel buffer is
+    // drained, or until our input buffer is full and parsing frees no space.
+    while (!closing_) {
+        ReadResult result = readInput();
+        if (result == ReadResult::Closed) return false;
+
+        size_t buffered = inEnd_ - inStart_;
+        if (!processInput()) {
+            // Protocol error: the error reply is queued; close once it is out.
+            closing_ = true;
+            break;
+        }
+        if (result != ReadResult::BufferFull) break;
+        // Nothing consumed (e.g. a DESCRIBE is parked): resumeDescribe()
+        // calls back in here once the buffer can move again.
+        if (inEnd_ - inStart_ == buffered) break;
+    }
+    return !shouldClose();
+}
+
+RtspSession::ReadResult RtspSession::readInput() {
+    while (true) {
+        if (inBuf_.size() - inEnd_ < kReadChunk) {
+            // Slide the unparsed tail to the front before growing. The parser
+            // keeps offsets relative to the request start, so this is safe.
+            if (inStart_ > 0) {
+                memmove(inBuf_.data(), inBuf_.data() + inStart_, inEnd_ - inStart_);
+                inEnd_ -= inStart_;
+                inStart_ = 0;
+            }
+            if (inBuf_.size() - inEnd_ < kReadChunk) {
+                if (inBuf_.size() >= kMaxInputBuffer) return ReadResult::BufferFull;
+                inBuf_.resize(std::min(kMaxInputBuffer, std::max(inBuf_.size() * 2, kReadChunk)));
+            }
+        }
+
+        size_t space = inBuf_.size() - inEnd_;
+        ssize_t n = recv(clientFd, inBuf_.data() + inEnd_, space, 0);
+        if (n > 0) {
+            inEnd_ += n;
+            continue;
+        }
+        if (n == 0) return ReadResult::Closed;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return ReadResult::Drained;
+        return ReadResult::Closed;
+    }
+}
+
+bool RtspSession::processInput() {
+    // While a DESCRIBE is parked, later pipelined requests stay buffered so
+    // responses go out in request order.
+    while (!describePending_ && !closing_ && inStart_ < inEnd_) {
+        RtspRequest req;
+        size_t consumed = 0;
+        RtspParser::Result result = parser_.parse(inBuf_.data() + inStart_, inEnd_ - inStart_, req, consumed);
+
+        if (result == RtspParser::Result::NeedMore) break;
+        if (result == RtspParser::Result::Error) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5, "[RTSP] Rejecting malformed request from {}", clientIp);
+            sendError(req.header("CSeq"),
+                      parser_.error() == RtspParser::Error::BodyTooLarge ? rtsp_status::kRequestTooLarge
+                                                                          : rtsp_status::kBadRequest);
+            return false;
+        }
+
+        handleRequest(req);
+        inStart_ += consumed;
+        parser_.reset();
+    }
+
+    if (inStart_ == inEnd_) {
+        inStart_ = inEnd_ = 0;
+    }
     return true;
 }
 
-void RtspSession::sendResponse(const std::string& response) {
+void RtspSession::sendResponse(std::string_view response) {
     // std::cout << "[RTSP] Response:\n" << response << std::endl;
-    send(clientFd, response.c_str(), response.size(), 0);
-}
-
-void RtspSession::handleRequest(const std::string& req) {
-    std::stringstream ss(req);
-    std::string method, url, version;
-    ss >> method >> url >> version;
-
-    std::string line, cseq;
-    size_t cseq_pos = req.find("CSeq:");
-    if (cseq_pos != std::string::npos) {
-        size_t end_pos = req.find("\r\n", cseq_pos);
-        cseq = req.substr(cseq_pos + 5, end_pos - (cseq_pos + 5));
-        cseq.erase(0, cseq.find_first_not_of(" \t\r\n"));
-        cseq.erase(cseq.find_last_not_of(" \t\r\n") + 1);
-    }
-
-    if (method == "OPTIONS") handleOptions(cseq);
-    else if (method == "DESCRIBE") handleDescribe(cseq);
-    else if (method == "SETUP") {
-        size_t transport_pos = req.find("Transport:");
-        std::string transport;
-        if (transport_pos != std::string::npos) {
-            size_t end_pos = req.find("\r\n", transport_pos);
-            transport = req.substr(transport_pos, end_pos - transport_pos);
+    if (failed_) return;
+
+    size_t sent = 0;
+    if (outStart_ == outBuf_.size()) {
+        // Nothing queued: write straight from the caller's buffer.
+        while (sent < response.size()) {
+            ssize_t n = send(clientFd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                failed_ = true;
+                return;
+            }
+        }
+        if (sent == response.size()) return;
+    }
+
+    // Socket is full: keep the rest and let EPOLLOUT drive flushOutput().
+    outBuf_.append(response.substr(sent));
+    if (outBuf_.size() - outStart_ > kMaxOutputBuffer) {
+        LOG_WARN("[RTSP] Output backlog exceeded for {}, dropping client", clientIp);
+        failed_ = true;
+    }
+}
+
+bool RtspSession::flushOutput() {
+    while (!failed_ && outStart_ < outBuf_.size()) {
+        ssize_t n = send(clientFd, outBuf_.data() + outStart_, outBuf_.size() - outStart_, MSG_NOSIGNAL);
+        if (n > 0) {
+            outStart_ += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            failed_ = true;
         }
-        handleSetup(cseq, transport);
     }
-    else if (method == "PLAY") handlePlay(cseq);
+    if (outStart_ == outBuf_.size()) {
+        outBuf_.clear();
+        outStart_ = 0;
+    }
+    return !shouldClose();
+}
+
+bool RtspSession::shouldClose() const {
+    return failed_ || (closing_ && outStart_ == outBuf_.size());
 }
 
-void RtspSession::handleOptions(const std::string& cseq) {
-    std::stringstream ss;
-    ss << "RTSP/1.0 200 OK\r\n"
-       << "CSeq: " << cseq << "\r\n"
-       << "Public: DESCRIBE, SETUP, TEARDOWN, PLAY, OPTIONS\r\n\r\n";
-    sendResponse(ss.str());
+void RtspSession::sendError(std::string_view cseq, std::string_view statusLine) {
+    response_.start(statusLine, cseq);
+    sendResponse(response_.end());
 }
 
-void RtspSession::handleDescribe(const std::string& cseq) {
-    std::cout << "[RTSP] Waiting for SPS/PPS from stream..." << std::endl;
-    while (!streamBuffer_->hasSpsPps()) {
-        if (clientFd < 0) return; // Connection closed
-        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+void RtspSession::handleRequest(const RtspRequest& req) {
+    // Any request counts as a keepalive (VLC uses GET_PARAMETER or OPTIONS).
+    lastActivity_ = std::chrono::steady_clock::now();
+
+    std::string_view cseq = req.header("CSeq");
+    std::string_view session = req.header("Session");
+    if (!session.empty()) {
+        session = session.substr(0, session.find(';'));
+        if (session != sessionId_) {
+            sendError(cseq, rtsp_status::kSessionNotFound);
+            return;
+        }
     }
-    std::cout << "[RTSP] SPS/PPS are available. Generating SDP." << std::endl;
 
-    auto strip_start_code = [](const std::vector<uint8_t>& nalu) -> std::vector<uint8_t> {
-        if (nalu.size() > 4 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 0 && nalu[3] == 1) {
-            return {nalu.begin() + 4, nalu.end()};
+    if (req.method == "OPTIONS") handleOptions(cseq);
+    else if (req.method == "DESCRIBE") handleDescribe(cseq, req.uri, !req.header(kEdgePullHeader).empty());
+    else if (req.method == "SETUP") handleSetup(cseq, req.uri, req.header("Transport"));
+    else if (req.method == "PLAY") handlePlay(cseq, req.uri, req.header("Range"), req.header("Scale"));
+    else if (req.method == "TEARDOWN") handleTeardown(cseq);
+    else if (req.method == "GET_PARAMETER") handleGetParameter(cseq);
+    else sendError(cseq, rtsp_status::kNotImplemented);
+}
+
+bool RtspSession::isExpired(std::chrono::steady_clock::time_point now) const {
+    return now - lastActivity_ > std::chrono::seconds(config_.sessionTimeoutSec);
+}
+
+int RtspSession::rtcpFd() const {
+    return rtpSender_ ? rtpSender_->rtcpFd() : -1;
+}
+
+void RtspSession::handleRtcp() {
+    uint8_t buf[1500];
+    while (true) {
+        ssize_t n = recv(rtcpFd(), buf, sizeof(buf), 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
-        if (nalu.size() > 3 && nalu[0] == 0 && nalu[1] == 0 && nalu[2] == 1) {
-            return {nalu.begin() + 3, nalu.end()};
+        // Any well-formed RTCP packet from the client proves it is still
+        // there; a compound packet carrying BYE means it has left.
+        if (n < 4 || (buf[0] >> 6) != 2 || buf[1] < 200 || buf[1] > 207) continue;
+        lastActivity_ = std::chrono::steady_clock::now();
+
+        size_t offset = 0;
+        while (offset + 4 <= static_cast<size_t>(n)) {
+            uint8_t pt = buf[offset + 1];
+            size_t len = (((buf[offset + 2] << 8) | buf[offset + 3]) + 1) * 4;
+            if (pt == 203 && playing_) { // BYE
+                LOG_INFO("[RTSP] RTCP BYE from {}, stopping stream", clientIp);
+                rtpSender_->stop();
+                playing_ = false;
+            }
+            offset += len;
         }
-        return nalu;
-    };
-
-    std::vector<uint8_t> sps = streamBuffer_->getSps();
-    std::vector<uint8_t> pps = streamBuffer_->getPps();
-    
-    std::vector<uint8_t> clean_sps = strip_start_code(sps);
-    std::vector<uint8_t> clean_pps = strip_start_code(pps);
-
-    std::string sps_b64 = base64_encode(clean_sps);
-    std::string pps_b64 = base64_encode(clean_pps);
-
-    std::stringstream sdp;
-    sdp << "v=0\r\n"
-        << "o=- 12345 67890 IN IP4 " << "0.0.0.0" << "\r\n"
-        << "s=Live H.264 Stream\r\n"
-        << "c=IN IP4 " << "0.0.0.0" << "\r\n"
-        << "t=0 0\r\n"
-        << "m=video 0 RTP/AVP 96\r\n"
-        << "a=rtpmap:96 H264/90000\r\n"
-        << "a=fmtp:96 packetization-mode=1;sprop-parameter-sets=" 
-        << sps_b64 << "," << pps_b64 << ";\r\n"
-        << "a=control:trackID=0\r\n";
-
-    std::string sdpStr = sdp.str();
-
-    std::stringstream res;
-    res << "RTSP/1.0 200 OK\r\n"
-        << "CSeq: " << cseq << "\r\n"
-        << "Content-Type: application/sdp\r\n"
-        << "Content-Length: " << sdpStr.size() << "\r\n\r\n"
-        << sdpStr;
-    
-    sendResponse(res.str());
-}
-
-void RtspSession::handleSetup(const std::string& cseq, const std::string& transport) {
-    if (transport.find("interleaved=") != std::string::npos) {
-        std::stringstream res;
-        res << "RTSP/1.0 461 Unsupported Transport\r\n"
-            << "CSeq: " << cseq << "\r\n\r\n";
-        sendResponse(res.str());
+    }
+}
+
+// Static header lines, rendered once.
+static constexpr std::string_view kPublicMethods =
+    "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n";
+static constexpr std::string_view kPlayHeaders = "Range: npt=0.000-\r\n";
+static constexpr double kMaxScale = 32.0;
+
+void RtspSession::handleOptions(std::string_view cseq) {
+    response_.start(rtsp_status::kOk, cseq).raw(kPublicMethods);
+    if (!sessionId_.empty()) response_.raw(sessionHeader_);
+    sendResponse(response_.end());
+}
+
+void RtspSession::handleGetParameter(std::string_view cseq) {
+    // Empty GET_PARAMETER is the RFC 2326 keepalive; we expose no parameters.
+    response_.start(rtsp_status::kOk, cseq);
+    if (!sessionId_.empty()) response_.raw(sessionHeader_);
+    sendResponse(response_.end());
+}
+
+void RtspSession::handleTeardown(std::string_view cseq) {
+    if (sessionId_.empty() || !rtpSender_) {
+        sendError(cseq, rtsp_status::kSessionNotFound);
+        return;
+    }
+    // The server port pair is kept so a later SETUP on this connection can
+    // reuse it; only the stream and the session identity go away.
+    rtpSender_->stop();
+    playing_ = false;
+    LOG_INFO("[RTSP] Session {} on {}/{} torn down by {}", sessionId_, StreamRegistry::kMountPrefix, stream_->id,
+             clientIp);
+
+    response_.start(rtsp_status::kOk, cseq).raw(sessionHeader_);
+    sendResponse(response_.end());
+    sessionId_.clear();
+    sessionHeader_.clear();
+}
+
+void RtspSession::handleDescribe(std::string_view cseq, std::string_view uri, bool fromEdge) {
+    std::string_view id = StreamRegistry::streamIdFromUri(uri);
+    if (edges_ && !fromEdge && !id.empty()) {
+        // Origin: viewers go to the stream's edge, which pulls it from here
+        // once for all of its viewers. RFC 2326 11.3.3; players follow a
+        // 302 to DESCRIBE, which they don't do for a REDIRECT request.
+        size_t scheme = uri.find("://");
+        size_t path = scheme == std::string_view::npos ? 0 : uri.find('/', scheme + 3);
+        response_.start(rtsp_status::kMovedTemporarily, cseq)
+                 .raw("Location: rtsp://").raw(edges_->edgeFor(id))
+                 .raw(path == std::string_view::npos ? std::string_view("/") : uri.substr(path)).raw("\r\n");
+        sendResponse(response_.end());
+        return;
+    }
+
+    // A pulled stream may not exist yet; this starts it, and the wait for
+    // SPS/PPS below covers the time until it does.
+    registry_->requestSource(id);
+    std::shared_ptr<Stream> stream = registry_->resolve(uri);
+    if (stream && stream->buffer->hasSpsPps()) {
+        sendDescribeResponse(cseq, uri, *stream);
+        return;
+    }
+    if (!stream && id.empty() && registry_->size() > 1) {
+        // Not a /live/<id> mount and several streams it could mean. With
+        // none yet, wait below: a single camera may still be starting.
+        sendError(cseq, rtsp_status::kNotFound);
         return;
     }
 
+    // Never wait inside the reactor: park the request and let TcpServer
+    // finish it when the camera publishes SPS/PPS (or the deadline passes).
+    LOG_INFO("[RTSP] Waiting for SPS/PPS from stream {}...", uri);
+    describePending_ = true;
+    pendingDescribeCseq_ = cseq;
+    pendingDescribeUri_ = uri;
+    describeDeadline_ = std::chrono::steady_clock::now()
+                      + std::chrono::milliseconds(config_.describeTimeoutMs);
+}
+
+bool RtspSession::resumeDescribe() {
+    if (!describePending_) return false;
+    std::shared_ptr<Stream> stream = registry_->resolve(pendingDescribeUri_);
+    if (!stream || !stream->buffer->hasSpsPps()) return false;
+
+    describePending_ = false;
+    LOG_INFO("[RTSP] SPS/PPS are available. Generating SDP.");
+    sendDescribeResponse(pendingDescribeCseq_, pendingDescribeUri_, *stream);
+
+    // Requests pipelined behind the DESCRIBE were held back; run them now.
+    if (!handleEvent()) failed_ = true;
+    return true;
+}
+
+void RtspSession::expireDescribe() {
+    if (!describePending_) return;
+    describePending_ = false;
+    LOG_WARN("[RTSP] No SPS/PPS within {} ms, answering 503 to {}", config_.describeTimeoutMs, clientIp);
+
+    response_.start(rtsp_status::kServiceUnavailable, pendingDescribeCseq_).header("Retry-After", 1);
+    sendResponse(response_.end());
+
+    if (!handleEvent()) failed_ = true;
+}
+
+void RtspSession::sendDescribeResponse(std::string_view cseq, std::string_view uri, const Stream& stream) {
+    std::shared_ptr<const SdpDescription> sdp = stream.sdp->get();
+    if (!sdp) {
+        sendError(cseq, rtsp_status::kServiceUnavailable);
+        return;
+    }
+
+    // Status line + CSeq + Content-Base (so a=control:trackID=0 resolves under
+    // the requested mount) + the cached "Content-Type/Length + SDP" tail.
+    response_.start(rtsp_status::kOk, cseq).raw("Content-Base: ").raw(uri);
+    if (uri.empty() || uri.back() != '/') response_.raw("/");
+    response_.raw("\r\n").raw(sdp->describeTail);
+    sendResponse(response_.str());
+}
+
+void RtspSession::handleSetup(std::string_view cseq, std::string_view uri, std::string_view transport) {
+    if (transport.find("interleaved=") != std::string_view::npos) {
+        sendError(cseq, rtsp_status::kUnsupportedTransport);
+        return;
+    }
+
+    std::shared_ptr<Stream> stream = registry_->resolve(uri);
+    if (!stream) {
+        sendError(cseq, rtsp_status::kNotFound);
+        return;
+    }
+    if (stream_ && stream_ != stream) {
+        // One session carries one stream; aggregate control is not supported.
+        sendError(cseq, rtsp_status::kAggregateNotAllowed);
+        return;
+    }
+    if (!rtpSender_) {
+        stream_ = stream;
+        rtpSender_ = std::make_unique<RtpSender>(stream_->buffer, config_.ioEngine);
+        rtpSender_->setLatency(stream_->latency);
+    }
+
     size_t pos = transport.find("client_port=");
-    if (pos != std::string::npos) {
-        std::string ports = transport.substr(pos + 12);
-        clientRtpPort = std::stoi(ports);
+    if (pos != std::string_view::npos) {
+        clientRtpPort = parseInt(transport.substr(pos + 12));
     }
 
     if (clientRtpPort == 0) {
-        std::cerr << "[RTSP-ERROR] Could not parse client_port from: " << transport << std::endl;
+        LOG_WARN("[RTSP-ERROR] Could not parse client_port from: {}", transport);
+        sendError(cseq, rtsp_status::kUnsupportedTransport);
         return;
     }
 
-    rtpSender_->init(clientIp, clientRtpPort);
+    if (!rtpSender_->init(clientIp, clientRtpPort, config_.rtpPortMin, config_.rtpPortMax)) {
+        sendError(cseq, rtsp_status::kServiceUnavailable);
+        return;
+    }
 
-    std::stringstream res;
-    res << "RTSP/1.0 200 OK\r\n"
-        << "CSeq: " << cseq << "\r\n"
-        << "Transport: RTP/AVP;unicast;client_port=" << clientRtpPort << "-" << clientRtpPort + 1 
-        << ";server_port=30000-30001\r\n" // Example dummy server ports
-        << "Session: 12345678\r\n\r\n";
-    sendResponse(res.str());
+    if (sessionId_.empty()) {
+        sessionId_ = generateSessionId();
+        sessionHeader_ = "Session: " + sessionId_ + ";timeout=" +
+                         std::to_string(config_.sessionTimeoutSec) + "\r\n";
+    }
+
+    int serverPort = rtpSender_->serverRtpPort();
+    response_.start(rtsp_status::kOk, cseq)
+             .raw("Transport: RTP/AVP;unicast;client_port=").number(clientRtpPort)
+             .raw("-").number(clientRtpPort + 1)
+             .raw(";server_port=").number(serverPort)
+             .raw("-").number(serverPort + 1).raw("\r\n")
+             .raw(sessionHeader_);
+    sendResponse(response_.end());
 }
 
-void RtspSession::handlePlay(const std::string& cseq) {
-    std::stringstream res;
-    res << "RTSP/1.0 200 OK\r\n"
-        << "CSeq: " << cseq << "\r\n"
-        << "Range: npt=0.000-\r\n"
-        << "Session: 12345678\r\n"
-        << "RTP-Info: url=rtsp://0.0.0.0/live/trackID=0\r\n\r\n";
-    sendResponse(res.str());
+void RtspSession::handlePlay(std::string_view cseq, std::string_view uri, std::string_view rangeHeader,
+                             std::string_view scaleHeader) {
+    if (sessionId_.empty() || !rtpSender_) {
+        sendError(cseq, rtsp_status::kMethodNotValidInState);
+        return;
+    }
+
+    PlayRange range;
+    if (!rangeHeader.empty() && !parseRange(rangeHeader, range)) {
+        sendError(cseq, rtsp_status::kInvalidRange);
+        return;
+    }
+    double scale = 1.0;
+    if (!scaleHeader.empty()) {
+        std::string text(scaleHeader);
+        char* end = nullptr;
+        scale = strtod(text.c_str(), &end);
+        if (end == text.c_str() || !std::isfinite(scale) || scale == 0) {
+            sendError(cseq, rtsp_status::kBadRequest);
+            return;
+        }
+        scale = std::max(-kMaxScale, std::min(kMaxScale, scale));
+    }
+
+    // Players send npt=0 with the first PLAY of any stream; for a live
+    // stream that means "now", not the oldest recording.
+    if (range.kind == PlayRange::Offset && range.us == 0 && !playing_) {
+        range.kind = PlayRange::Live;
+    }
+    if (range.kind == PlayRange::Live && scale < 1) {
+        // Rewind or slow motion from the live edge.
+        range.kind = PlayRange::Utc;
+        range.us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    } else if (range.kind == PlayRange::Live) {
+        scale = 1.0;    // nothing to fast-forward into
+    }
+
+    std::unique_ptr<TimeshiftReader> timeshift;
+    if (range.kind != PlayRange::Live) {
+        std::string dir;
+        if (!config_.recordDir.empty() && config_.recordFormat == "mp4") {
+            dir = config_.recordDir + "/" + stream_->id;
+        }
+        timeshift = std::make_unique<TimeshiftReader>(dir, stream_->buffer);
+        if (range.kind == PlayRange::Offset) {
+            timeshift->startAtOffset(range.us, scale);
+        } else {
+            timeshift->startAtUtc(range.us, scale);
+        }
+        LOG_INFO("[RTSP] Session {} timeshift to {} at scale {}", sessionId_, rangeHeader, scale);
+    }
 
-    rtpSender_->start();
-}
\ No newline at end of file
+    response_.start(rtsp_status::kOk, cseq);
+    if (timeshift) {
+        response_.header("Range", rangeHeader.empty() ? std::string_view("npt=now-") : rangeHeader);
+    } else {
+        response_.raw(kPlayHeaders);
+    }
+    if (!scaleHeader.empty()) {
+        char text[32];
+        snprintf(text, sizeof(text), "%g", scale);
+        response_.header("Scale", text);
+    }
+    response_.raw(sessionHeader_).raw("RTP-Info: url=").raw(uri);
+    if (uri.find("trackID=") == std::string_view::npos) {
+        response_.raw(uri.empty() || uri.back() != '/' ? "/trackID=0" : "trackID=0");
+    }
+    response_.raw("\r\n");
+    sendResponse(response_.end());
+
+    // A PLAY while playing seeks; a plain PLAY while live changes nothing.
+    if (timeshift || rtpSender_->isTimeshifting()) {
+        rtpSender_->stop();
+    }
+    rtpSender_->start(std::move(timeshift));
+    playing_ = true;
+}
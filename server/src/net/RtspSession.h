@@ -1,31 +1,97 @@
 #pragma once
-#include "media/StreamBuffer.h"
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
+#include "net/RtspParser.h"
+#include "net/RtspResponse.h"
+#include "net/EdgeRing.h"
 #include <string>
+#include <string_view>
+#include <vector>
 #include <memory>
+#include <chrono>
 
 class RtpSender; // Forward declaration
 
 class RtspSession {
 public:
-    RtspSession(int fd, std::string clientIp, std::shared_ptr<StreamBuffer> streamBuffer);
+    // `edges`, when set, makes this an origin: viewers' DESCRIBEs are
+    // redirected to the edge that owns the stream.
+    RtspSession(int fd, std::string clientIp, std::shared_ptr<StreamRegistry> registry,
+                const ServerConfig& config, const EdgeRing* edges = nullptr);
     ~RtspSession();
 
+    // Edge-triggered readiness handlers. Both return false once the
+    // connection should be closed (peer gone, write error, or a protocol
+    // error whose reply has been fully flushed).
     bool handleEvent(); 
+    bool flushOutput();
+    bool shouldClose() const;
+
+    // A DESCRIBE that arrived before its stream registered or published SPS/PPS
+    // is parked instead of blocking the reactor. TcpServer completes it via
+    // resumeDescribe() when parameter sets are published on any stream, or
+    // expireDescribe() once the deadline passes.
+    bool isDescribePending() const { return describePending_; }
+    std::chrono::steady_clock::time_point describeDeadline() const { return describeDeadline_; }
+    bool resumeDescribe();
+    void expireDescribe();
+
+    // Liveness: every RTSP request and every RTCP packet from the client
+    // refreshes the session. TcpServer reaps sessions idle for longer than
+    // ServerConfig::sessionTimeoutSec.
+    bool isExpired(std::chrono::steady_clock::time_point now) const;
+    int rtcpFd() const;
+    void handleRtcp();
 
 private:
-    void handleRequest(const std::string& request);
-    void sendResponse(const std::string& response);
+    enum class ReadResult { Drained, BufferFull, Closed };
+
+    ReadResult readInput();
+    bool processInput();
+    void handleRequest(const RtspRequest& request);
+    void sendResponse(std::string_view response);
+    void sendError(std::string_view cseq, std::string_view statusLine);
     
-    void handleOptions(const std::string& cseq);
-    void handleDescribe(const std::string& cseq);
-    void handleSetup(const std::string& cseq, const std::string& transport);
-    void handlePlay(const std::string& cseq);
+    void handleOptions(std::string_view cseq);
+    void handleDescribe(std::string_view cseq, std::string_view uri, bool fromEdge);
+    void handleSetup(std::string_view cseq, std::string_view uri, std::string_view transport);
+    void handlePlay(std::string_view cseq, std::string_view uri, std::string_view range, std::string_view scale);
+    void handleTeardown(std::string_view cseq);
+    void handleGetParameter(std::string_view cseq);
+    void sendDescribeResponse(std::string_view cseq, std::string_view uri, const Stream& stream);
 
     int clientFd;
     std::string clientIp;
     
-    std::unique_ptr<RtpSender> rtpSender_;
-    std::shared_ptr<StreamBuffer> streamBuffer_;
+    std::unique_ptr<RtpSender> rtpSender_;  // created by the first SETUP
+    std::shared_ptr<StreamRegistry> registry_;
+    std::shared_ptr<Stream> stream_;        // stream bound by SETUP
 
     int clientRtpPort = 0;
+
+    std::string sessionId_;      // empty until the first SETUP
+    std::string sessionHeader_;  // pre-rendered "Session: <id>;timeout=N\r\n"
+    bool playing_ = false;
+    std::chrono::steady_clock::time_point lastActivity_;
+
+    // Per-connection input buffer. Requests may arrive split across reads or
+    // several per read (pipelining); bytes [inStart_, inEnd_) are unparsed.
+    std::vector<char> inBuf_;
+    size_t inStart_ = 0;
+    size_t inEnd_ = 0;
+    RtspParser parser_;
+    RtspResponse response_;
+
+    // Replies that did not fit in the socket buffer, flushed on EPOLLOUT.
+    std::string outBuf_;
+    size_t outStart_ = 0;
+    bool closing_ = false;   // close once outBuf_ drains
+    bool failed_ = false;    // close immediately
+
+    const ServerConfig& config_;
+    const EdgeRing* edges_;
+    bool describePending_ = false;
+    std::string pendingDescribeCseq_;
+    std::string pendingDescribeUri_;
+    std::chrono::steady_clock::time_point describeDeadline_;
 };
\ No newline at end of file
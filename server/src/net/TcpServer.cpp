@@ -1,29 +1,69 @@
 #include "TcpServer.h"
-#include <iostream>
+#include "utils/Log.h"
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <fcntl.h>
+#include <cerrno>
+#include <cstdio>
 #include <unistd.h>
+#include <vector>
+#include <cstring>
 
-#define MAX_EVENTS 10
+// Events handled per epoll_wait(). Large enough that a busy loop doesn't
+// need several wakeups to get through one batch of ready sockets.
+#define MAX_EVENTS 256
 
-TcpServer::TcpServer(int p, std::shared_ptr<StreamBuffer> streamBuffer) 
-    : port(p), streamBuffer_(streamBuffer) {}
+// Client sockets are edge-triggered: each handler drains its socket until
+// EAGAIN, and EPOLLOUT only fires when a full socket becomes writable again.
+static constexpr uint32_t kClientEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+// Retry delay after accept4() failed for lack of file descriptors.
+static constexpr int kAcceptRetryMs = 100;
+
+// How often idle sessions are looked for. The session timeout itself is
+// ServerConfig::sessionTimeoutSec; this only bounds how late a reap can be.
+static constexpr auto kReapInterval = std::chrono::seconds(1);
+
+TcpServer::TcpServer(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry) 
+    : config_(config), port(config.rtspPort), registry_(registry),
+      sessionCount_(metrics::Registry::instance().gauge("rtsp_sessions", "Open RTSP connections.")),
+      loopTime_(metrics::Registry::instance().histogram(
+          "rtsp_reactor_loop_seconds", "Time a reactor thread spends handling one batch of events.",
+          metrics::latencyBoundsUs(), 1e-6, {{"loop", "rtsp"}})) {
+    if (!config.edges.empty()) edges_ = std::make_unique<EdgeRing>(config.edges);
+    retireThread_ = std::thread(&TcpServer::retireLoop, this);
+}
 
 TcpServer::~TcpServer() {
-    close(serverFd);
-    close(epollFd);
+    {
+        std::lock_guard<std::mutex> lock(retireMutex_);
+        retireStop_ = true;
+    }
+    retireCv_.notify_one();
+    retireThread_.join();
+    registry_->setParameterSetListener(nullptr);
+    if (serverFd != -1) close(serverFd);
+    if (wakeFd_ != -1) close(wakeFd_);
+    if (epollFd != -1) close(epollFd);
 }
 
-void TcpServer::setNonBlocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+void TcpServer::retireLoop() {
+    std::unique_lock<std::mutex> lock(retireMutex_);
+    while (true) {
+        retireCv_.wait(lock, [this] { return retireStop_ || !retired_.empty(); });
+        if (retired_.empty()) return;
+        std::vector<std::shared_ptr<Stream>> streams;
+        streams.swap(retired_);
+        lock.unlock();
+        // Sessions may still hold a stream; then it goes when they do.
+        streams.clear();
+        lock.lock();
+    }
 }
 
 int TcpServer::createServerSocket() {
-    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     int opt = 1;
     setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
 
@@ -33,58 +73,227 @@ int TcpServer::createServerSocket() {
     addr.sin_port = htons(port);
 
     if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        perror("Bind failed");
+        LOG_ERROR("Bind failed: {}", strerror(errno));
         exit(1);
     }
-    if (listen(fd, 10) < 0) {
-        perror("Listen failed");
+    // The kernel clamps this to net.core.somaxconn.
+    if (listen(fd, config_.listenBacklog) < 0) {
+        LOG_ERROR("Listen failed: {}", strerror(errno));
         exit(1);
     }
     return fd;
 }
 
+void TcpServer::acceptConnections() {
+    // Edge-triggered listen socket: take every queued connection now, or the
+    // rest would wait for the next connection to arrive.
+    acceptStalled_ = false;
+    while (true) {
+        struct sockaddr_in clientAddr;
+        socklen_t len = sizeof(clientAddr);
+        int clientFd = accept4(serverFd, (struct sockaddr*)&clientAddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientFd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                LOG_ERROR("[RTSP] accept4: {}", strerror(errno));
+                acceptStalled_ = true;
+            }
+            break; // EAGAIN: backlog drained
+        }
+
+        struct epoll_event ev{};
+        ev.events = kClientEvents;
+        ev.data.fd = clientFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &ev);
+
+        char clientIp[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
+        sessions[clientFd] = std::make_unique<RtspSession>(clientFd, clientIp, registry_, config_, edges_.get());
+    }
+}
+
+void TcpServer::closeSession(int fd) {
+    auto rit = registeredRtcp_.find(fd);
+    if (rit != registeredRtcp_.end()) {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, rit->second, nullptr);
+        rtcpOwners_.erase(rit->second);
+        registeredRtcp_.erase(rit);
+    }
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    pendingDescribes_.erase(fd);
+    sessions.erase(fd); // closes the socket and stops the RtpSender
+}
+
+void TcpServer::syncRtcpRegistration(int fd) {
+    // A SETUP binds the session's RTCP socket; start watching it so receiver
+    // reports keep the session alive.
+    int rtcpFd = sessions[fd]->rtcpFd();
+    if (rtcpFd == -1 || registeredRtcp_.count(fd)) return;
+
+    struct epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = rtcpFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, rtcpFd, &ev) == 0) {
+        rtcpOwners_[rtcpFd] = fd;
+        registeredRtcp_[fd] = rtcpFd;
+    }
+}
+
+void TcpServer::reapExpiredSessions() {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> expired;
+    for (auto& entry : sessions) {
+        if (entry.second->isExpired(now)) expired.push_back(entry.first);
+    }
+    for (int fd : expired) {
+        LOG_INFO("[RTSP] Session on fd {} timed out (no RTSP/RTCP activity), reaping", fd);
+        closeSession(fd);
+    }
+}
+
+int TcpServer::nextEpollTimeoutMs() const {
+    auto now = std::chrono::steady_clock::now();
+    auto earliest = nextReap_;
+    for (int fd : pendingDescribes_) {
+        auto it = sessions.find(fd);
+        if (it != sessions.end() && it->second->describeDeadline() < earliest) {
+            earliest = it->second->describeDeadline();
+        }
+    }
+    if (earliest <= now) return 0;
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - now).count();
+    if (acceptStalled_ && ms > kAcceptRetryMs) return kAcceptRetryMs;
+    return static_cast<int>(ms) + 1;
+}
+
+void TcpServer::servicePendingDescribes(bool parameterSetsPublished) {
+    auto now = std::chrono::steady_clock::now();
+    std::vector<int> finished;
+    std::vector<int> deferred;
+    for (auto it = pendingDescribes_.begin(); it != pendingDescribes_.end();) {
+        auto sit = sessions.find(*it);
+        if (sit == sessions.end() || !sit->second->isDescribePending()) {
+            it = pendingDescribes_.erase(it);
+            continue;
+        }
+        RtspSession* session = sit->second.get();
+        bool resolved = false;
+        if (parameterSetsPublished && session->resumeDescribe()) {
+            resolved = true;
+        } else if (session->describeDeadline() <= now) {
+            session->expireDescribe();
+            resolved = true;
+        }
+        if (!resolved) {
+            ++it;
+            continue;
+        }
+
+        // Completing the DESCRIBE also ran any requests queued behind it,
+        // which may have parked another DESCRIBE or ended the connection.
+        int fd = *it;
+        it = pendingDescribes_.erase(it);
+        if (session->shouldClose()) finished.push_back(fd);
+        else if (session->isDescribePending()) deferred.push_back(fd);
+    }
+    for (int fd : deferred) pendingDescribes_.insert(fd);
+    for (int fd : finished) closeSession(fd);
+}
+
 void TcpServer::start() {
     serverFd = createServerSocket();
-    epollFd = epoll_create1(0);
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
 
     struct epoll_event ev{}, events[MAX_EVENTS];
-    ev.events = EPOLLIN; 
+    ev.events = EPOLLIN | EPOLLET; 
     ev.data.fd = serverFd;
     epoll_ctl(epollFd, EPOLL_CTL_ADD, serverFd, &ev);
 
-    std::cout << "RTSP Server started on port " << port << std::endl;
+    nextReap_ = std::chrono::steady_clock::now() + kReapInterval;
+    nextLatencyLog_ = std::chrono::steady_clock::now() + std::chrono::seconds(config_.latencyLogSec);
+
+    // The ingest thread publishes SPS/PPS; it wakes us through an eventfd so
+    // parked DESCRIBE requests can be answered from the reactor thread.
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.fd = wakeFd_;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd_, &ev);
+    int wakeFd = wakeFd_;
+    registry_->setParameterSetListener([wakeFd]() {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    });
+
+    LOG_INFO("RTSP Server started on port {}", port);
 
     while (true) {
-        int nfds = epoll_wait(epollFd, events, MAX_EVENTS, -1);
-        
+        int nfds = epoll_wait(epollFd, events, MAX_EVENTS, nextEpollTimeoutMs());
+        metrics::ScopedTimerUs busy(*loopTime_);
+        bool parameterSetsPublished = false;
+
         for (int i = 0; i < nfds; i++) {
             int fd = events[i].data.fd;
+            uint32_t revents = events[i].events;
 
             if (fd == serverFd) { 
-                struct sockaddr_in clientAddr;
-                socklen_t len = sizeof(clientAddr);
-                int clientFd = accept(serverFd, (struct sockaddr*)&clientAddr, &len);
-                
-                if (clientFd >= 0) {
-                    setNonBlocking(clientFd);
-                    
-                    ev.events = EPOLLIN;
-                    ev.data.fd = clientFd;
-                    epoll_ctl(epollFd, EPOLL_CTL_ADD, clientFd, &ev);
-                    
-                    char clientIp[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &clientAddr.sin_addr, clientIp, INET_ADDRSTRLEN);
-                    sessions[clientFd] = std::make_unique<RtspSession>(clientFd, clientIp, streamBuffer_);
-                }
+                acceptConnections();
+            } else if (fd == wakeFd_) {
+                uint64_t count;
+                ssize_t ignored = read(wakeFd_, &count, sizeof(count));
+                (void)ignored;
+                parameterSetsPublished = true;
+            } else if (rtcpOwners_.count(fd)) {
+                sessions[rtcpOwners_[fd]]->handleRtcp();
             } else { 
-                if (sessions.find(fd) != sessions.end()) {
-                    bool keepAlive = sessions[fd]->handleEvent();
-                    if (!keepAlive) {
-                        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
-                        sessions.erase(fd);
-                    }
+                auto it = sessions.find(fd);
+                if (it == sessions.end()) continue;
+                RtspSession* session = it->second.get();
+
+                bool keepAlive = true;
+                if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    // A hangup still goes through handleEvent() so buffered
+                    // requests are answered before recv() reports EOF.
+                    keepAlive = session->handleEvent();
+                }
+                if (keepAlive && (revents & EPOLLOUT)) {
+                    keepAlive = session->flushOutput();
+                }
+
+                if (!keepAlive) {
+                    closeSession(fd);
+                } else {
+                    if (session->isDescribePending()) pendingDescribes_.insert(fd);
+                    syncRtcpRegistration(fd);
                 }
             }
         }
+
+        if (acceptStalled_) {
+            acceptConnections();
+        }
+
+        if (!pendingDescribes_.empty()) {
+            servicePendingDescribes(parameterSetsPublished);
+        }
+
+        if (std::chrono::steady_clock::now() >= nextReap_) {
+            reapExpiredSessions();
+            std::vector<std::shared_ptr<Stream>> idle = registry_->collectIdle(config_.streamIdleTimeoutSec);
+            if (!idle.empty()) {
+                {
+                    std::lock_guard<std::mutex> lock(retireMutex_);
+                    retired_.insert(retired_.end(), std::make_move_iterator(idle.begin()),
+                                    std::make_move_iterator(idle.end()));
+                }
+                retireCv_.notify_one();
+            }
+            nextReap_ = std::chrono::steady_clock::now() + kReapInterval;
+        }
+        if (config_.latencyLogSec > 0 && std::chrono::steady_clock::now() >= nextLatencyLog_) {
+            for (const auto& stream : registry_->snapshot()) stream->latency->logSummary();
+            nextLatencyLog_ = std::chrono::steady_clock::now() + std::chrono::seconds(config_.latencyLogSec);
+        }
+        sessionCount_->set(static_cast<int64_t>(sessions.size()));
     }
-}
\ No newline at end of file
+}
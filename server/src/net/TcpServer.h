@@ -1,22 +1,61 @@
 #pragma once
 #include <map>
+#include <set>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
 #include "RtspSession.h"
-#include "media/StreamBuffer.h"
+#include "net/EdgeRing.h"
+#include "media/StreamRegistry.h"
+#include "ServerConfig.h"
+#include "utils/Metrics.h"
 
 class TcpServer {
 public:
-    TcpServer(int port, std::shared_ptr<StreamBuffer> streamBuffer);
+    TcpServer(const ServerConfig& config, std::shared_ptr<StreamRegistry> registry);
     ~TcpServer();
     void start(); 
 
 private:
     int createServerSocket();
-    void setNonBlocking(int fd);
+    void acceptConnections();
 
+    void closeSession(int fd);
+    void syncRtcpRegistration(int fd);
+    void reapExpiredSessions();
+
+    // Deferred DESCRIBE handling (see RtspSession::isDescribePending)
+    int nextEpollTimeoutMs() const;
+    void servicePendingDescribes(bool parameterSetsPublished);
+
+    // Streams removed by collectIdle() are destroyed on this thread: their
+    // recorders, segmenters and outputs join threads and flush files on
+    // the way out, which must not stall the reactor.
+    void retireLoop();
+
+    const ServerConfig& config_;
     int port;
-    int serverFd;
-    int epollFd;
+    int serverFd = -1;
+    int epollFd = -1;
+    int wakeFd_ = -1;            // eventfd signalled by any stream on SPS/PPS publish
     std::map<int, std::unique_ptr<RtspSession>> sessions;
-    std::shared_ptr<StreamBuffer> streamBuffer_;
-};
\ No newline at end of file
+    std::set<int> pendingDescribes_;
+    std::map<int, int> rtcpOwners_;      // RTCP socket fd -> RTSP connection fd
+    std::map<int, int> registeredRtcp_;  // RTSP connection fd -> RTCP socket fd
+    std::chrono::steady_clock::time_point nextReap_;
+    std::chrono::steady_clock::time_point nextLatencyLog_;
+    bool acceptStalled_ = false;         // hit EMFILE; retry accept on the next tick
+    std::shared_ptr<StreamRegistry> registry_;
+    std::unique_ptr<EdgeRing> edges_;   // origin mode: where viewers are redirected
+
+    std::thread retireThread_;
+    std::mutex retireMutex_;
+    std::condition_variable retireCv_;
+    std::vector<std::shared_ptr<Stream>> retired_;
+    bool retireStop_ = false;
+
+    std::shared_ptr<metrics::Gauge> sessionCount_;
+    std::shared_ptr<metrics::Histogram> loopTime_;
+};
@@ -0,0 +1,359 @@
+#include "net/UnixIngestReceiver.h"
+#include "UnixIngestProtocol.h"
+#include "utils/Log.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+static constexpr int kMaxEvents = 32;
+// Messages taken from one connection per wakeup before the others get a turn.
+static constexpr int kMessagesPerWakeup = 64;
+
+// Start code at p (3 or 4 bytes), or 0.
+static size_t startCodeAt(const uint8_t* p, size_t size) {
+    if (size >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1) return 4;
+    if (size >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1) return 3;
+    return 0;
+}
+
+UnixIngestReceiver::UnixIngestReceiver(std::string path, std::shared_ptr<StreamRegistry> registry)
+    : path_(std::move(path)), registry_(std::move(registry)),
+      loopTime_(metrics::Registry::instance().histogram(
+          "rtsp_reactor_loop_seconds", "Time a reactor thread spends handling one batch of events.",
+          metrics::latencyBoundsUs(), 1e-6, {{"loop", "unix_ingest"}})) {}
+
+UnixIngestReceiver::~UnixIngestReceiver() {
+    stop();
+}
+
+void UnixIngestReceiver::start() {
+    if (isRunning_ || !createSocket()) {
+        return;
+    }
+    buf_.resize(unix_ingest::kMaxMessageSize);
+    isRunning_ = true;
+    thread_ = std::thread(&UnixIngestReceiver::runLoop, this);
+    LOG_INFO("UnixIngestReceiver started on {}", path_);
+}
+
+void UnixIngestReceiver::stop() {
+    if (!isRunning_) {
+        return;
+    }
+    isRunning_ = false;
+    uint64_t one = 1;
+    ssize_t ignored = write(stopFd_, &one, sizeof(one));
+    (void)ignored;
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    while (!connections_.empty()) {
+        closeConnection(connections_.begin()->first);
+    }
+    close(listenFd_);
+    close(epollFd_);
+    close(stopFd_);
+    listenFd_ = epollFd_ = stopFd_ = -1;
+    unlink(path_.c_str());
+}
+
+bool UnixIngestReceiver::createSocket() {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path_.empty() || path_.size() >= sizeof(addr.sun_path)) {
+        LOG_ERROR("Unix ingest socket path too long: {}", path_);
+        return false;
+    }
+    memcpy(addr.sun_path, path_.c_str(), path_.size() + 1);
+
+    listenFd_ = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd_ < 0) {
+        LOG_ERROR("Failed to create unix ingest socket: {}", strerror(errno));
+        return false;
+    }
+    // A socket left behind by an earlier run would make bind fail; anything
+    // that isn't a socket is not ours to remove.
+    struct stat st{};
+    if (lstat(path_.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        unlink(path_.c_str());
+    }
+    if (bind(listenFd_, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listenFd_, 16) < 0) {
+        LOG_ERROR("Failed to bind unix ingest socket {}: {}", path_, strerror(errno));
+        close(listenFd_);
+        listenFd_ = -1;
+        return false;
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev);
+    ev.data.fd = stopFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, stopFd_, &ev);
+    return true;
+}
+
+void UnixIngestReceiver::runLoop() {
+    struct epoll_event events[kMaxEvents];
+    while (isRunning_) {
+        int n = epoll_wait(epollFd_, events, kMaxEvents, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Unix ingest epoll_wait failed: {}", strerror(errno));
+            break;
+        }
+        metrics::ScopedTimerUs busy(*loopTime_);
+        for (int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if (fd == stopFd_) continue;
+            if (fd == listenFd_) {
+                accept();
+                continue;
+            }
+            auto it = connections_.find(fd);
+            if (it == connections_.end()) continue;
+            if (!onReadable(*it->second)) closeConnection(fd);
+        }
+    }
+}
+
+void UnixIngestReceiver::accept() {
+    while (true) {
+        int fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_RATE_LIMITED(logging::Level::Error, 1, "Unix ingest accept failed: {}", strerror(errno));
+            }
+            return;
+        }
+        auto conn = std::make_unique<Connection>();
+        conn->fd = fd;
+        // Local encoders have no address; the process id names them in logs.
+        struct ucred cred{};
+        socklen_t len = sizeof(cred);
+        if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0) {
+            conn->peer = "unix:pid" + std::to_string(cred.pid);
+        } else {
+            conn->peer = "unix:fd" + std::to_string(fd);
+        }
+
+        struct epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+        connections_.emplace(fd, std::move(conn));
+    }
+}
+
+bool UnixIngestReceiver::onReadable(Connection& conn) {
+    for (int i = 0; i < kMessagesPerWakeup; i++) {
+        struct iovec iov = {buf_.data(), buf_.size()};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 4)];
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t n = recvmsg(conn.fd, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        if (n == 0) return false;   // the encoder closed the socket
+
+        // Take ownership of every descriptor that came along; only the first
+        // one means anything.
+        int passedFd = -1;
+        for (struct cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t k = 0; k < count; k++) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(c) + k * sizeof(int), sizeof(int));
+                if (passedFd < 0) {
+                    passedFd = fd;
+                } else {
+                    close(fd);
+                }
+            }
+        }
+
+        bool ok = true;
+        if (msg.msg_flags & MSG_TRUNC) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: message over {} bytes dropped", conn.peer,
+                             buf_.size());
+        } else if (!conn.stream) {
+            ok = handleHello(conn, buf_.data(), static_cast<size_t>(n));
+        } else if (!conn.stream->isPublisher(conn.session)) {
+            LOG_INFO("[UNIX-IN] {}: another connection took over {}/{}, closing", conn.peer,
+                     StreamRegistry::kMountPrefix, conn.stream->id);
+            ok = false;
+        } else {
+            handleFrame(conn, buf_.data(), static_cast<size_t>(n), passedFd);
+        }
+        if (passedFd >= 0) close(passedFd);
+        if (!ok) return false;
+    }
+    return true;    // more may be queued; level triggering brings us back
+}
+
+bool UnixIngestReceiver::handleHello(Connection& conn, const uint8_t* data, size_t size) {
+    uint8_t status = ingest::kAckOk;
+    std::string id;
+    if (size < ingest::kHelloFixedSize || !ingest::isHelloMagic(data) ||
+        ingest::kHelloFixedSize + ingest::getBe16(data + 6) != size) {
+        LOG_WARN("[UNIX-IN] {}: expected a Hello", conn.peer);
+        status = ingest::kAckBadRequest;
+    } else {
+        id.assign(reinterpret_cast<const char*>(data + ingest::kHelloFixedSize), size - ingest::kHelloFixedSize);
+        if (data[4] != ingest::kVersion2 || data[5] != ingest::kCodecH264 || !ingest::isValidStreamId(id)) {
+            LOG_WARN("[UNIX-IN] Rejecting Hello from {} (version {}, codec {})", conn.peer, (int)data[4],
+                     (int)data[5]);
+            status = ingest::kAckBadRequest;
+        }
+    }
+    if (status == ingest::kAckOk) {
+        std::shared_ptr<Stream> stream = registry_->acquire(id);
+        conn.session = stream->claimIngest(conn.peer);
+        if (conn.session == 0) {
+            LOG_WARN("[UNIX-IN] Rejecting {}: stream '{}' already has a publisher", conn.peer, id);
+            status = ingest::kAckStreamBusy;
+        } else {
+            conn.stream = std::move(stream);
+        }
+    }
+
+    uint8_t ack[ingest::kHelloAckSize];
+    ingest::encodeHelloAck(ack, ingest::kVersion2, status);
+    ssize_t ignored = send(conn.fd, ack, sizeof(ack), MSG_NOSIGNAL);
+    (void)ignored;
+    if (status != ingest::kAckOk) return false;
+
+    LOG_INFO("Camera {} publishing to {}/{}", conn.peer, StreamRegistry::kMountPrefix, conn.stream->id);
+    return true;
+}
+
+void UnixIngestReceiver::handleFrame(Connection& conn, const uint8_t* data, size_t size, int passedFd) {
+    ingest::FrameHeader frame;
+    if (size < ingest::kFrameHeaderSize || !ingest::decodeFrameHeader(data, frame) || frame.headerSize > size) {
+        LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: bad frame header, message dropped", conn.peer);
+        return;
+    }
+    conn.messages++;
+
+    const uint8_t* payload = data + frame.headerSize;
+    void* mapping = MAP_FAILED;
+    if (frame.flags & unix_ingest::kFlagMemfd) {
+        struct stat st{};
+        if (passedFd < 0 || fstat(passedFd, &st) != 0 || static_cast<uint64_t>(st.st_size) < frame.payloadSize) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: memfd frame without a large enough descriptor",
+                             conn.peer);
+            return;
+        }
+        // The bytes are validated and then copied out of a shared mapping: a
+        // sender that could still shrink the file would turn that copy into
+        // a SIGBUS, and one that could write would change them in between.
+        int seals = fcntl(passedFd, F_GET_SEALS);
+        if (seals < 0 || (seals & (F_SEAL_SHRINK | F_SEAL_WRITE)) != (F_SEAL_SHRINK | F_SEAL_WRITE)) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5,
+                             "[UNIX-IN] {}: memfd frame dropped, descriptor not sealed against shrink and write",
+                             conn.peer);
+            return;
+        }
+        mapping = mmap(nullptr, frame.payloadSize, PROT_READ, MAP_SHARED, passedFd, 0);
+        if (mapping == MAP_FAILED) {
+            LOG_RATE_LIMITED(logging::Level::Error, 5, "[UNIX-IN] {}: mmap of memfd failed: {}", conn.peer,
+                             strerror(errno));
+            return;
+        }
+        payload = static_cast<const uint8_t*>(mapping);
+        conn.memfdMessages++;
+    } else if (size - frame.headerSize != frame.payloadSize) {
+        LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: payload size {} but message carries {} bytes",
+                         conn.peer, frame.payloadSize, size - frame.headerSize);
+        return;
+    }
+
+    if (conn.haveSequence && frame.sequence != conn.nextSequence) {
+        uint32_t gap = frame.sequence - conn.nextSequence;
+        conn.lostNalus += gap;
+        LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: {} messages lost before seq {}", conn.stream->id, gap,
+                         frame.sequence);
+    }
+    conn.haveSequence = true;
+    conn.nextSequence = frame.sequence + 1;
+
+    if (frame.flags & unix_ingest::kFlagAccessUnit) {
+        // Split the picture at its start codes. Emulation prevention keeps
+        // 00 00 01 out of NALU payloads, so every match is a boundary; a
+        // 4-byte start code is found at its first zero.
+        size_t pos = 0;
+        while (pos < frame.payloadSize && startCodeAt(payload + pos, frame.payloadSize - pos) == 0) pos++;
+        while (pos < frame.payloadSize) {
+            size_t startCode = startCodeAt(payload + pos, frame.payloadSize - pos);
+            size_t end = pos + startCode;
+            while (end < frame.payloadSize && startCodeAt(payload + end, frame.payloadSize - end) == 0) end++;
+            if (end > pos + startCode) {
+                publish(conn, payload + pos, end - pos, startCode, frame, end >= frame.payloadSize);
+            }
+            pos = end;
+        }
+    } else {
+        size_t startCode = startCodeAt(payload, frame.payloadSize);
+        if (startCode == 0 || frame.payloadSize <= startCode) {
+            LOG_RATE_LIMITED(logging::Level::Warn, 5, "[UNIX-IN] {}: NALU without start code dropped", conn.peer);
+        } else {
+            publish(conn, payload, frame.payloadSize, startCode, frame, frame.flags & ingest::kFlagAuEnd);
+        }
+    }
+
+    if (mapping != MAP_FAILED) munmap(mapping, frame.payloadSize);
+}
+
+void UnixIngestReceiver::publish(Connection& conn, const uint8_t* data, size_t size, size_t startCodeLength,
+                                 const ingest::FrameHeader& frame, bool accessUnitEnd) {
+    auto nalu = std::make_shared<Nalu>();
+    nalu->data.assign(data, data + size);
+    nalu->startCodeLength = startCodeLength;
+    nalu->type = nalu->data[startCodeLength] & 0x1F;
+    nalu->hasFrameInfo = true;
+    nalu->accessUnitEnd = accessUnitEnd;
+    nalu->captureUs = frame.captureUs;
+    conn.naluCount++;
+
+    if (nalu->type == 7) { // SPS
+        LOG_DEBUG("[UNIX-IN] {} SPS NALU captured (size: {})", conn.stream->id, size);
+    } else if (nalu->type == 8) { // PPS
+        LOG_DEBUG("[UNIX-IN] {} PPS NALU captured (size: {})", conn.stream->id, size);
+    }
+    conn.stream->publish(std::move(nalu));
+}
+
+void UnixIngestReceiver::closeConnection(int fd) {
+    auto it = connections_.find(fd);
+    if (it == connections_.end()) return;
+    Connection& conn = *it->second;
+    if (conn.naluCount > 0) {
+        if (conn.lostNalus > 0) {
+            LOG_INFO("[UNIX-IN] {}: {} NALUs in {} messages ({} via memfd), {} lost", conn.peer, conn.naluCount,
+                     conn.messages, conn.memfdMessages, conn.lostNalus);
+        } else {
+            LOG_INFO("[UNIX-IN] {}: {} NALUs in {} messages ({} via memfd)", conn.peer, conn.naluCount,
+                     conn.messages, conn.memfdMessages);
+        }
+    }
+    if (conn.stream) conn.stream->releaseIngest();
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    connections_.erase(it);
+}
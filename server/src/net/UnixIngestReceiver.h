@@ -0,0 +1,70 @@
+#pragma once
+
+#include "media/StreamRegistry.h"
+#include "IngestProtocol.h"
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// Ingest for encoders on the same host over an AF_UNIX SOCK_SEQPACKET
+// socket (see common/UnixIngestProtocol.h), instead of TCP over loopback.
+//
+// The socket keeps message boundaries, so each NALU or whole access unit
+// arrives with one recvmsg() straight into a receive buffer, with no length
+// prefix, stream parsing or resync as in IngestConnection. Pictures handed
+// over as a memfd are mapped read-only and taken from the mapping, skipping
+// the socket copy altogether.
+//
+// One thread serves the listener and every connection with an epoll loop;
+// an appliance has a handful of local encoders at most.
+class UnixIngestReceiver {
+public:
+    UnixIngestReceiver(std::string path, std::shared_ptr<StreamRegistry> registry);
+    ~UnixIngestReceiver();
+
+    void start();
+    void stop();
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string peer;
+        std::shared_ptr<Stream> stream;   // null until the Hello is accepted
+        uint32_t session = 0;             // its Stream::claimIngest() session
+
+        bool haveSequence = false;
+        uint32_t nextSequence = 0;
+        uint64_t lostNalus = 0;
+        uint64_t messages = 0;
+        uint64_t memfdMessages = 0;
+        uint64_t naluCount = 0;
+    };
+
+    bool createSocket();
+    void runLoop();
+    void accept();
+    // Returns false when the connection is finished and should be closed.
+    bool onReadable(Connection& conn);
+    bool handleHello(Connection& conn, const uint8_t* data, size_t size);
+    // A malformed message is dropped; the socket keeps the next one intact.
+    void handleFrame(Connection& conn, const uint8_t* data, size_t size, int passedFd);
+    void publish(Connection& conn, const uint8_t* data, size_t size, size_t startCodeLength,
+                 const ingest::FrameHeader& frame, bool accessUnitEnd);
+    void closeConnection(int fd);
+
+    const std::string path_;
+    std::shared_ptr<StreamRegistry> registry_;
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int stopFd_ = -1;
+    std::atomic<bool> isRunning_{false};
+    std::thread thread_;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::vector<uint8_t> buf_;      // one message, reused
+    std::shared_ptr<metrics::Histogram> loopTime_;
+};
@@ -0,0 +1,356 @@
+#include "utils/Log.h"
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <ctime>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace logging {
+
+std::atomic<Level> g_level{Level::Info};
+
+namespace {
+
+// Per-thread capacity. 64 KiB of address space per logging thread, but only
+// the pages of slots actually written become resident.
+constexpr size_t kSlots = 256;
+constexpr auto kDrainInterval = std::chrono::milliseconds(10);
+
+// Single producer (the owning thread), single consumer (whoever holds
+// Logger::drainMutex_).
+struct Ring {
+    std::unique_ptr<Record[]> slots{new Record[kSlots]};
+    alignas(64) std::atomic<uint64_t> head{0};     // written by the owner
+    alignas(64) std::atomic<uint64_t> tail{0};     // written by the drainer
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> abandoned{false};            // the owner has exited
+    long tid = 0;
+};
+
+struct Pending {
+    int64_t timeUs;
+    const Record* record;
+    long tid;
+};
+
+class Logger {
+public:
+    static Logger& instance() {
+        // Never destroyed: threads may still log during static destruction.
+        static Logger* logger = new Logger;
+        return *logger;
+    }
+
+    std::shared_ptr<Ring> newRing() {
+        auto ring = std::make_shared<Ring>();
+        ring->tid = syscall(SYS_gettid);
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    void start() {
+        std::call_once(started_, [this] {
+            std::atexit([] { Logger::instance().drain(); });
+            thread_ = std::thread([this] { run(); });
+            thread_.detach();
+        });
+    }
+
+    void drain();
+
+private:
+    void run() {
+        // A signal handler that exits on this thread would otherwise find
+        // drainMutex_ held by itself in the atexit flush.
+        sigset_t all;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, nullptr);
+        while (true) {
+            std::this_thread::sleep_for(kDrainInterval);
+            drain();
+        }
+    }
+
+    std::once_flag started_;
+    std::thread thread_;
+    std::mutex ringsMutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    std::mutex drainMutex_;
+    // Drainer state, reused across drains; guarded by drainMutex_.
+    std::vector<std::shared_ptr<Ring>> draining_;
+    std::vector<Pending> pending_;
+    std::deque<Record> notes_;
+    std::string out_;
+    std::string err_;
+};
+
+// The calling thread's ring; marked abandoned when the thread exits so the
+// drainer can free it once it is empty.
+struct LocalRing {
+    std::shared_ptr<Ring> ring;
+    uint64_t head = 0;
+    uint64_t tail = 0;      // last tail seen; re-read only when the ring looks full
+    ~LocalRing() {
+        if (ring) ring->abandoned.store(true, std::memory_order_release);
+    }
+};
+thread_local LocalRing t_ring;
+
+const char* levelName(Level level) {
+    switch (level) {
+    case Level::Debug: return "DEBUG";
+    case Level::Info: return "INFO ";
+    case Level::Warn: return "WARN ";
+    case Level::Error: return "ERROR";
+    }
+    return "?    ";
+}
+
+template <typename T>
+void appendNumber(std::string& out, T value) {
+    char buf[24];
+    auto result = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, result.ptr);
+}
+
+// Appends the next argument of `record` at `pos`, advancing it.
+bool appendArg(const Record& record, size_t& pos, std::string& out) {
+    if (pos >= record.argBytes) return false;
+    const uint8_t* in = record.args + pos;
+    char buf[32];
+    switch (in[0]) {
+    case detail::kSigned: {
+        int64_t v;
+        memcpy(&v, in + 1, sizeof(v));
+        appendNumber(out, v);
+        pos += 1 + sizeof(v);
+        break;
+    }
+    case detail::kUnsigned: {
+        uint64_t v;
+        memcpy(&v, in + 1, sizeof(v));
+        appendNumber(out, v);
+        pos += 1 + sizeof(v);
+        break;
+    }
+    case detail::kHex: {
+        uint64_t v;
+        memcpy(&v, in + 1, sizeof(v));
+        out += "0x";
+        auto result = std::to_chars(buf, buf + sizeof(buf), v, 16);
+        out.append(buf, result.ptr);
+        pos += 1 + sizeof(v);
+        break;
+    }
+    case detail::kDouble: {
+        double v;
+        memcpy(&v, in + 1, sizeof(v));
+        int n = snprintf(buf, sizeof(buf), "%g", v);
+        out.append(buf, static_cast<size_t>(n));
+        pos += 1 + sizeof(v);
+        break;
+    }
+    case detail::kBool:
+        out += in[1] ? "true" : "false";
+        pos += 2;
+        break;
+    case detail::kChar:
+        out += static_cast<char>(in[1]);
+        pos += 2;
+        break;
+    case detail::kString: {
+        uint16_t n;
+        memcpy(&n, in + 1, sizeof(n));
+        out.append(reinterpret_cast<const char*>(in + 3), n);
+        pos += 3 + n;
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Appends one line for `record` to `out`.
+void formatRecord(const Record& record, long tid, std::string& out) {
+    // The date is formatted once per distinct second; the drainer is the
+    // only caller.
+    static int64_t cachedSecond = -1;
+    static char secondText[32];
+    int64_t second = record.timeUs / 1000000;
+    if (second != cachedSecond) {
+        time_t t = static_cast<time_t>(second);
+        struct tm tm{};
+        localtime_r(&t, &tm);
+        strftime(secondText, sizeof(secondText), "%Y-%m-%d %H:%M:%S", &tm);
+        cachedSecond = second;
+    }
+    char prefix[64];
+    int n = snprintf(prefix, sizeof(prefix), "%s.%03d %s %5ld ", secondText,
+                     static_cast<int>(record.timeUs / 1000 % 1000), levelName(record.level), tid);
+    out.append(prefix, static_cast<size_t>(n));
+
+    size_t pos = 0;
+    const char* text = record.format;
+    for (const char* p = text; *p; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            out.append(text, p);
+            if (!appendArg(record, pos, out)) out += "{}";
+            text = ++p + 1;
+        }
+    }
+    out.append(text);
+    if (record.truncated) out += " [truncated]";
+    if (record.suppressed > 0) {
+        out += " (";
+        appendNumber(out, record.suppressed);
+        out += " similar suppressed)";
+    }
+    out += '\n';
+}
+
+void Logger::drain() {
+    std::lock_guard<std::mutex> drainLock(drainMutex_);
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        draining_.swap(rings_);
+    }
+
+    // Index every pending record, order them by time across threads, format
+    // them in that order, and only then hand the slots back.
+    pending_.clear();
+    notes_.clear();
+    std::vector<uint64_t> heads(draining_.size());
+    std::vector<bool> abandoned(draining_.size());
+    for (size_t i = 0; i < draining_.size(); i++) {
+        Ring& ring = *draining_[i];
+        // Read before the head: once abandoned, nothing more is coming.
+        abandoned[i] = ring.abandoned.load(std::memory_order_acquire);
+        heads[i] = ring.head.load(std::memory_order_acquire);
+        for (uint64_t seq = ring.tail.load(std::memory_order_relaxed); seq != heads[i]; seq++) {
+            const Record* record = &ring.slots[seq % kSlots];
+            pending_.push_back({record->timeUs, record, ring.tid});
+        }
+        if (uint64_t dropped = ring.dropped.exchange(0, std::memory_order_relaxed)) {
+            Record& note = notes_.emplace_back();
+            note.timeUs = detail::nowUs();
+            note.format = "[Log] {} records lost, the thread logged faster than they were written out";
+            note.suppressed = 0;
+            note.argBytes = 0;
+            note.level = Level::Warn;
+            note.truncated = false;
+            detail::ArgWriter(note).add(dropped);
+            pending_.push_back({note.timeUs, &note, ring.tid});
+        }
+    }
+
+    if (!pending_.empty()) {
+        std::stable_sort(pending_.begin(), pending_.end(),
+                         [](const Pending& a, const Pending& b) { return a.timeUs < b.timeUs; });
+        out_.clear();
+        err_.clear();
+        for (const Pending& entry : pending_) {
+            formatRecord(*entry.record, entry.tid, entry.record->level >= Level::Warn ? err_ : out_);
+        }
+        if (!out_.empty()) {
+            fwrite(out_.data(), 1, out_.size(), stdout);
+            fflush(stdout);
+        }
+        if (!err_.empty()) {
+            fwrite(err_.data(), 1, err_.size(), stderr);
+            fflush(stderr);
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < draining_.size(); i++) {
+        draining_[i]->tail.store(heads[i], std::memory_order_release);
+        if (!abandoned[i]) draining_[kept++] = std::move(draining_[i]);
+    }
+    draining_.resize(kept);
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex_);
+        rings_.insert(rings_.end(), draining_.begin(), draining_.end());
+    }
+    draining_.clear();
+}
+
+} // namespace
+
+void setLevel(Level level) {
+    g_level.store(level, std::memory_order_relaxed);
+}
+
+bool parseLevel(const std::string& name, Level& level) {
+    if (name == "debug") level = Level::Debug;
+    else if (name == "info") level = Level::Info;
+    else if (name == "warn") level = Level::Warn;
+    else if (name == "error") level = Level::Error;
+    else return false;
+    return true;
+}
+
+void start() {
+    Logger::instance().start();
+}
+
+void flush() {
+    Logger::instance().drain();
+}
+
+namespace detail {
+
+Record* claim() {
+    LocalRing& local = t_ring;
+    if (!local.ring) local.ring = Logger::instance().newRing();
+    Ring& ring = *local.ring;
+    if (local.head - local.tail == kSlots) {
+        local.tail = ring.tail.load(std::memory_order_acquire);
+        if (local.head - local.tail == kSlots) {
+            ring.dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+    }
+    return &ring.slots[local.head % kSlots];
+}
+
+void publish() {
+    LocalRing& local = t_ring;
+    local.ring->head.store(++local.head, std::memory_order_release);
+}
+
+int64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace detail
+
+bool RateLimiter::allow(uint32_t& suppressed) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    int64_t second = ts.tv_sec;
+    int64_t current = second_.load(std::memory_order_relaxed);
+    if (second != current && second_.compare_exchange_strong(current, second, std::memory_order_relaxed)) {
+        count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < perSecond_) {
+        suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+} // namespace logging
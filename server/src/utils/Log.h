@@ -0,0 +1,202 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Asynchronous logging for the server's worker threads.
+//
+//   LOG_INFO("[RTP] {}: started on port {}", id, port);
+//   LOG_RATE_LIMITED(logging::Level::Warn, 1, "[RECV] {}: {} NALUs lost", id, gap);
+//
+// A call checks the level, then copies the format pointer and its arguments
+// in binary (integers, floats, strings by value) into a slot of the calling
+// thread's own ring and returns; there is no lock, allocation, formatting or
+// syscall on the calling thread. A background thread drains every ring a
+// hundred times a second, substitutes the arguments for the {} placeholders
+// and writes the lines, Info and Debug to stdout and Warn and Error to
+// stderr, in timestamp order.
+//
+// The format must be a string literal: only its address is kept. A thread
+// that outruns the drainer loses records rather than block; the loss is
+// reported in the log. Strings longer than a slot has room for are cut.
+namespace logging {
+
+enum class Level : uint8_t { Debug, Info, Warn, Error };
+
+// An integer argument written as 0x-prefixed hex, e.g. an SSRC.
+struct Hex {
+    uint64_t value;
+};
+
+extern std::atomic<Level> g_level;
+
+inline bool enabled(Level level) {
+    return level >= g_level.load(std::memory_order_relaxed);
+}
+void setLevel(Level level);
+// "debug", "info", "warn" or "error".
+bool parseLevel(const std::string& name, Level& level);
+
+// Starts the background writer (idempotent) and has flush() run at exit.
+// Records written before that wait in their rings.
+void start();
+// Writes out everything logged so far, on the calling thread.
+void flush();
+
+// One log call, as the background thread receives it.
+struct Record {
+    static constexpr size_t kSize = 256;
+    static constexpr size_t kArgBytes = kSize - 24;
+
+    // No initializers: a ring's slots stay untouched (and unpaged) until used.
+    int64_t timeUs;              // CLOCK_REALTIME
+    const char* format;
+    uint32_t suppressed;         // rate-limited calls skipped before this one
+    uint16_t argBytes;
+    Level level;
+    bool truncated;
+    uint8_t args[kArgBytes];
+};
+static_assert(sizeof(Record) == Record::kSize, "log record layout");
+
+namespace detail {
+
+enum ArgType : uint8_t { kSigned, kUnsigned, kHex, kDouble, kBool, kChar, kString };
+
+// Appends arguments to a record, each as a type byte and its value.
+class ArgWriter {
+public:
+    explicit ArgWriter(Record& record) : record_(record) {}
+
+    template <typename T>
+    void add(const T& value) {
+        using U = std::decay_t<T>;
+        if constexpr (std::is_same_v<U, bool>) {
+            scalar(kBool, static_cast<uint8_t>(value));
+        } else if constexpr (std::is_same_v<U, char>) {
+            scalar(kChar, value);
+        } else if constexpr (std::is_same_v<U, Hex>) {
+            scalar(kHex, value.value);
+        } else if constexpr (std::is_enum_v<U>) {
+            scalar(kSigned, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+            scalar(kSigned, static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<U>) {
+            scalar(kUnsigned, static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<U>) {
+            scalar(kDouble, static_cast<double>(value));
+        } else if constexpr (std::is_array_v<T>) {
+            // A literal or a char buffer: never null, so no check (which
+            // -Waddress would flag).
+            string(std::string_view(value));
+        } else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+            string(value ? std::string_view(value) : std::string_view("(null)"));
+        } else {
+            string(std::string_view(value));
+        }
+    }
+
+private:
+    template <typename V>
+    void scalar(ArgType type, V value) {
+        if (record_.argBytes + 1 + sizeof(V) > Record::kArgBytes) {
+            record_.truncated = true;
+            return;
+        }
+        uint8_t* out = record_.args + record_.argBytes;
+        out[0] = type;
+        memcpy(out + 1, &value, sizeof(V));
+        record_.argBytes += 1 + sizeof(V);
+    }
+
+    void string(std::string_view s) {
+        size_t room = Record::kArgBytes - record_.argBytes;
+        if (room < 3) {
+            record_.truncated = true;
+            return;
+        }
+        size_t length = s.size();
+        if (length > room - 3) {
+            length = room - 3;
+            record_.truncated = true;
+        }
+        uint8_t* out = record_.args + record_.argBytes;
+        out[0] = kString;
+        uint16_t n = static_cast<uint16_t>(length);
+        memcpy(out + 1, &n, sizeof(n));
+        memcpy(out + 3, s.data(), length);
+        record_.argBytes += static_cast<uint16_t>(3 + length);
+    }
+
+    Record& record_;
+};
+
+// The calling thread's next free slot, or nullptr if its ring is full.
+Record* claim();
+// Hands the slot from claim() to the background thread.
+void publish();
+int64_t nowUs();
+
+} // namespace detail
+
+template <typename... Args>
+void write(Level level, uint32_t suppressed, const char* format, const Args&... args) {
+    Record* record = detail::claim();
+    if (!record) return;
+    record->timeUs = detail::nowUs();
+    record->format = format;
+    record->suppressed = suppressed;
+    record->argBytes = 0;
+    record->level = level;
+    record->truncated = false;
+    detail::ArgWriter writer(*record);
+    (writer.add(args), ...);
+    detail::publish();
+}
+
+// Lets at most `perSecond` calls a second through one call site and counts
+// the rest, so a flood of identical warnings costs a few atomics per call.
+class RateLimiter {
+public:
+    explicit RateLimiter(uint32_t perSecond) : perSecond_(perSecond) {}
+
+    // On true, `suppressed` is how many calls were refused since the last
+    // one let through.
+    bool allow(uint32_t& suppressed);
+
+private:
+    const uint32_t perSecond_;
+    std::atomic<int64_t> second_{0};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint32_t> suppressed_{0};
+};
+
+} // namespace logging
+
+#define LOG_AT(level, ...)                                            \
+    do {                                                              \
+        if (::logging::enabled(level)) ::logging::write(level, 0, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DEBUG(...) LOG_AT(::logging::Level::Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(::logging::Level::Info, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(::logging::Level::Warn, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(::logging::Level::Error, __VA_ARGS__)
+
+// At most `perSecond` records a second from this call site; the next record
+// let through says how many were skipped.
+#define LOG_RATE_LIMITED(level, perSecond, ...)                                   \
+    do {                                                                          \
+        if (::logging::enabled(level)) {                                          \
+            static ::logging::RateLimiter logLimiter_(perSecond);                 \
+            uint32_t logSuppressed_ = 0;                                          \
+            if (logLimiter_.allow(logSuppressed_)) {                              \
+                ::logging::write(level, logSuppressed_, __VA_ARGS__);             \
+            }                                                                     \
+        }                                                                         \
+    } while (0)
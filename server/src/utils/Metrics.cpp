@@ -0,0 +1,310 @@
+#include "utils/Metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace metrics {
+
+uint64_t Counter::value() const {
+    uint64_t total = 0;
+    for (const Cell& cell : cells_) total += cell.value.load(std::memory_order_relaxed);
+    return total;
+}
+
+Histogram::Histogram(std::vector<uint64_t> bounds, double unit)
+    : bounds_(std::move(bounds)), unit_(unit) {
+    if (bounds_.size() > kMaxBuckets) throw std::invalid_argument("metrics: too many histogram buckets");
+}
+
+std::vector<uint64_t> Histogram::counts() const {
+    std::vector<uint64_t> counts(bounds_.size() + 1, 0);
+    for (const Shard& shard : shards_) {
+        for (size_t i = 0; i < counts.size(); i++) counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+    }
+    return counts;
+}
+
+uint64_t Histogram::sum() const {
+    uint64_t total = 0;
+    for (const Shard& shard : shards_) total += shard.sum.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t LogHistogram::bucketUpper(size_t i) {
+    if (i < kSubBuckets) return i;
+    unsigned exponent = static_cast<unsigned>(i / kSubBuckets) + kSubBucketBits - 1;
+    uint64_t sub = i % kSubBuckets;
+    return ((kSubBuckets + sub + 1) << (exponent - kSubBucketBits)) - 1;
+}
+
+LogHistogram::Snapshot LogHistogram::snapshot() const {
+    Snapshot snapshot;
+    for (const Shard& shard : shards_) {
+        for (size_t i = 0; i < kBuckets; i++) snapshot.counts[i] += shard.buckets[i].load(std::memory_order_relaxed);
+        snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+uint64_t LogHistogram::Snapshot::total() const {
+    uint64_t total = 0;
+    for (uint64_t count : counts) total += count;
+    return total;
+}
+
+uint64_t LogHistogram::Snapshot::percentile(double p) const {
+    uint64_t n = total();
+    if (n == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(p * n));
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; i++) {
+        seen += counts[i];
+        if (seen >= rank) return bucketUpper(i);
+    }
+    return bucketUpper(kBuckets - 1);
+}
+
+LogHistogram::Snapshot LogHistogram::Snapshot::since(const Snapshot& earlier) const {
+    Snapshot delta;
+    for (size_t i = 0; i < kBuckets; i++) delta.counts[i] = counts[i] - earlier.counts[i];
+    delta.sum = sum - earlier.sum;
+    return delta;
+}
+
+std::vector<uint64_t> latencyBoundsUs() {
+    return {10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000};
+}
+
+namespace {
+
+std::string escapeLabel(const std::string& value) {
+    std::string out;
+    out.reserve(value.size());
+    for (char c : value) {
+        if (c == '\\' || c == '"') out += '\\';
+        if (c == '\n') {
+            out += "\\n";
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+std::string labelSet(const Labels& labels) {
+    if (labels.empty()) return {};
+    std::string out = "{";
+    for (const auto& [name, value] : labels) {
+        if (out.size() > 1) out += ',';
+        out += name + "=\"" + escapeLabel(value) + "\"";
+    }
+    return out + "}";
+}
+
+// Adds le="..." to an already rendered label set.
+std::string withBucket(const std::string& labels, const std::string& le) {
+    std::string bucket = "le=\"" + le + "\"";
+    if (labels.empty()) return "{" + bucket + "}";
+    return labels.substr(0, labels.size() - 1) + "," + bucket + "}";
+}
+
+std::string formatValue(double v) {
+    if (std::isnan(v)) return "NaN";
+    if (std::isinf(v)) return v > 0 ? "+Inf" : "-Inf";
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.12g", v);
+    return buf;
+}
+
+} // namespace
+
+const char* Registry::typeName(Type type) {
+    switch (type) {
+    case Type::Counter: return "counter";
+    case Type::Gauge: return "gauge";
+    case Type::Histogram: return "histogram";
+    }
+    return "untyped";
+}
+
+Registry& Registry::instance() {
+    // Never destroyed: handles held by static objects may outlive main().
+    static Registry* registry = new Registry;
+    return *registry;
+}
+
+Registry::Family& Registry::family(const std::string& name, const std::string& help, Type type) {
+    auto [it, inserted] = families_.try_emplace(name);
+    Family& f = it->second;
+    if (inserted) {
+        f.type = type;
+        f.help = help;
+    } else if (f.type != type) {
+        throw std::invalid_argument("metrics: " + name + " registered with two types");
+    }
+    return f;
+}
+
+std::shared_ptr<Counter> Registry::counter(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<Counter>& slot = family(name, help, Type::Counter).counters[labelSet(labels)];
+    std::shared_ptr<Counter> series = slot.lock();
+    if (!series) {
+        series = std::make_shared<Counter>();
+        slot = series;
+    }
+    return series;
+}
+
+std::shared_ptr<Gauge> Registry::gauge(const std::string& name, const std::string& help, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<Gauge>& slot = family(name, help, Type::Gauge).gauges[labelSet(labels)];
+    std::shared_ptr<Gauge> series = slot.lock();
+    if (!series) {
+        series = std::make_shared<Gauge>();
+        slot = series;
+    }
+    return series;
+}
+
+std::shared_ptr<Histogram> Registry::histogram(const std::string& name, const std::string& help,
+                                               std::vector<uint64_t> bounds, double unit, const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<Histogram>& slot = family(name, help, Type::Histogram).histograms[labelSet(labels)];
+    std::shared_ptr<Histogram> series = slot.lock();
+    if (!series) {
+        series = std::make_shared<Histogram>(std::move(bounds), unit);
+        slot = series;
+    }
+    return series;
+}
+
+std::shared_ptr<LogHistogram> Registry::logHistogram(const std::string& name, const std::string& help, double unit,
+                                                     const Labels& labels) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::weak_ptr<LogHistogram>& slot = family(name, help, Type::Histogram).logHistograms[labelSet(labels)];
+    std::shared_ptr<LogHistogram> series = slot.lock();
+    if (!series) {
+        series = std::make_shared<LogHistogram>(unit);
+        slot = series;
+    }
+    return series;
+}
+
+CallbackHandle Registry::addCallback(const std::string& name, const std::string& help, Type type,
+                                     const Labels& labels, std::function<double()> read) {
+    auto callback = std::make_shared<std::function<double()>>(std::move(read));
+    std::string key = labelSet(labels);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A later registration for the same series replaces the earlier one.
+        family(name, help, type).callbacks[key] = callback;
+    }
+    // render() calls the callback under mutex_, so taking it here is what
+    // makes releasing the handle wait for a scrape in progress.
+    return CallbackHandle(callback.get(), [this, name, key, callback](void*) mutable {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto f = families_.find(name);
+        if (f == families_.end()) return;
+        auto it = f->second.callbacks.find(key);
+        if (it != f->second.callbacks.end() && it->second == callback) f->second.callbacks.erase(it);
+        callback.reset();
+    });
+}
+
+CallbackHandle Registry::counterCallback(const std::string& name, const std::string& help, const Labels& labels,
+                                         std::function<double()> read) {
+    return addCallback(name, help, Type::Counter, labels, std::move(read));
+}
+
+CallbackHandle Registry::gaugeCallback(const std::string& name, const std::string& help, const Labels& labels,
+                                       std::function<double()> read) {
+    return addCallback(name, help, Type::Gauge, labels, std::move(read));
+}
+
+std::string Registry::render() {
+    std::string out;
+    out.reserve(16 * 1024);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = families_.begin(); it != families_.end();) {
+        const std::string& name = it->first;
+        Family& f = it->second;
+        std::string body;
+        // `counts` are per bucket, one more than `bounds` for +Inf.
+        auto emitHistogram = [&](const std::string& labels, const std::vector<double>& bounds,
+                                 const std::vector<uint64_t>& counts, double sum) {
+            uint64_t cumulative = 0;
+            for (size_t i = 0; i < bounds.size(); i++) {
+                cumulative += counts[i];
+                body += name + "_bucket" + withBucket(labels, formatValue(bounds[i])) + " " +
+                        std::to_string(cumulative) + "\n";
+            }
+            cumulative += counts.back();
+            body += name + "_bucket" + withBucket(labels, "+Inf") + " " + std::to_string(cumulative) + "\n";
+            body += name + "_sum" + labels + " " + formatValue(sum) + "\n";
+            body += name + "_count" + labels + " " + std::to_string(cumulative) + "\n";
+        };
+
+        for (auto s = f.counters.begin(); s != f.counters.end();) {
+            auto series = s->second.lock();
+            if (!series) { s = f.counters.erase(s); continue; }
+            body += name + s->first + " " + std::to_string(series->value()) + "\n";
+            ++s;
+        }
+        for (auto s = f.gauges.begin(); s != f.gauges.end();) {
+            auto series = s->second.lock();
+            if (!series) { s = f.gauges.erase(s); continue; }
+            body += name + s->first + " " + std::to_string(series->value()) + "\n";
+            ++s;
+        }
+        for (const auto& [labels, read] : f.callbacks) {
+            body += name + labels + " " + formatValue((*read)()) + "\n";
+        }
+        for (auto s = f.histograms.begin(); s != f.histograms.end();) {
+            auto series = s->second.lock();
+            if (!series) { s = f.histograms.erase(s); continue; }
+            std::vector<double> bounds;
+            for (uint64_t bound : series->bounds()) bounds.push_back(bound * series->unit());
+            emitHistogram(s->first, bounds, series->counts(), series->sum() * series->unit());
+            ++s;
+        }
+        for (auto s = f.logHistograms.begin(); s != f.logHistograms.end();) {
+            auto series = s->second.lock();
+            if (!series) { s = f.logHistograms.erase(s); continue; }
+            // Folded into powers of two: observations are integers, so
+            // "< 2^k" is exactly "<= 2^k - 1".
+            LogHistogram::Snapshot snapshot = series->snapshot();
+            std::vector<double> bounds;
+            std::vector<uint64_t> counts;
+            size_t bucket = 0;
+            for (unsigned k = LogHistogram::kSubBucketBits + 1; k <= LogHistogram::kMaxExponent + 1; k++) {
+                uint64_t upper = (uint64_t(1) << k) - 1;
+                uint64_t count = 0;
+                while (bucket < LogHistogram::kBuckets && LogHistogram::bucketUpper(bucket) <= upper) {
+                    count += snapshot.counts[bucket++];
+                }
+                bounds.push_back(upper * series->unit());
+                counts.push_back(count);
+            }
+            uint64_t rest = 0;
+            while (bucket < LogHistogram::kBuckets) rest += snapshot.counts[bucket++];
+            counts.push_back(rest);
+            emitHistogram(s->first, bounds, counts, snapshot.sum * series->unit());
+            ++s;
+        }
+
+        if (body.empty()) {
+            // Every series of the family is gone (its streams were removed).
+            it = families_.erase(it);
+            continue;
+        }
+        out += "# HELP " + name + " " + f.help + "\n";
+        out += "# TYPE " + name + " " + typeName(f.type) + "\n";
+        out += body;
+        ++it;
+    }
+    return out;
+}
+
+} // namespace metrics
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Process-wide metrics, rendered in the Prometheus text exposition format
+// (served by MetricsServer on --metrics-port).
+//
+// Updates are lock-free and cheap enough for per-packet paths: a counter or
+// histogram is split into kShards cache-line sized cells and each thread
+// adds into its own cell with one relaxed atomic add, so threads never share
+// a written cache line until there are more than kShards of them. Reads
+// (a scrape) sum the cells.
+//
+// Components own their series through the shared_ptr the registry hands
+// out; the registry only keeps weak references, so a stream's series
+// disappear from the output once the stream is gone. Registration takes a
+// lock and belongs in constructors, never on a hot path.
+namespace metrics {
+
+constexpr size_t kShards = 16;
+
+// This thread's cell, assigned round robin on first use.
+inline size_t shardIndex() {
+    static std::atomic<size_t> next{0};
+    static thread_local size_t index = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return index;
+}
+
+using Labels = std::vector<std::pair<std::string, std::string>>;
+
+class Counter {
+public:
+    void inc(uint64_t n = 1) { cells_[shardIndex()].value.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const;
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<uint64_t> value{0};
+    };
+    Cell cells_[kShards];
+};
+
+// A value that goes up and down, usually written by one owner.
+class Gauge {
+public:
+    void set(int64_t v) { value_.store(v, std::memory_order_relaxed); }
+    void add(int64_t n) { value_.fetch_add(n, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+// Cumulative-bucket histogram of integer observations (e.g. microseconds).
+// `unit` converts them to the exported base unit (1e-6 for seconds).
+class Histogram {
+public:
+    Histogram(std::vector<uint64_t> bounds, double unit);
+
+    void observe(uint64_t v) {
+        size_t bucket = 0;
+        while (bucket < bounds_.size() && v > bounds_[bucket]) bucket++;
+        Shard& shard = shards_[shardIndex()];
+        shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    const std::vector<uint64_t>& bounds() const { return bounds_; }
+    double unit() const { return unit_; }
+    // Per-bucket (not cumulative) counts, the last one past every bound.
+    std::vector<uint64_t> counts() const;
+    uint64_t sum() const;
+
+private:
+    static constexpr size_t kMaxBuckets = 23;
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[kMaxBuckets + 1] = {};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    const std::vector<uint64_t> bounds_;
+    const double unit_;
+    Shard shards_[kShards];
+};
+
+// HDR-style log-linear histogram of integer observations: every power of
+// two is split into kSubBuckets equal buckets, so any value is known to
+// within 1/kSubBuckets (12.5%) from 1 up to 2^(kMaxExponent+1) without
+// choosing bounds in advance (larger values land in the last bucket).
+// Percentiles come from snapshots; the exported Prometheus buckets are the
+// powers of two.
+class LogHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 3;
+    static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+    static constexpr unsigned kMaxExponent = 26;    // 134 s in microseconds
+    static constexpr size_t kBuckets = (kMaxExponent - kSubBucketBits + 2) * kSubBuckets;
+
+    explicit LogHistogram(double unit) : unit_(unit) {}
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < kSubBuckets) return static_cast<size_t>(v);
+        unsigned exponent = 63 - __builtin_clzll(v);
+        if (exponent > kMaxExponent) return kBuckets - 1;
+        return (exponent - kSubBucketBits + 1) * kSubBuckets +
+               ((v >> (exponent - kSubBucketBits)) & (kSubBuckets - 1));
+    }
+    // Largest value counted in bucket i.
+    static uint64_t bucketUpper(size_t i);
+
+    void observe(uint64_t v) {
+        Shard& shard = shards_[shardIndex()];
+        shard.buckets[bucketOf(v)].fetch_add(1, std::memory_order_relaxed);
+        shard.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+
+    struct Snapshot {
+        std::vector<uint64_t> counts = std::vector<uint64_t>(kBuckets, 0);
+        uint64_t sum = 0;
+
+        uint64_t total() const;
+        // Upper edge of the bucket holding the p-th fraction (0..1) of the
+        // observations; 0 when there are none.
+        uint64_t percentile(double p) const;
+        // What was observed since `earlier`.
+        Snapshot since(const Snapshot& earlier) const;
+    };
+    Snapshot snapshot() const;
+    double unit() const { return unit_; }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> buckets[kBuckets] = {};
+        std::atomic<uint64_t> sum{0};
+    };
+
+    const double unit_;
+    Shard shards_[kShards];
+};
+
+// Microsecond bounds from 10 us to 1 s, for loop and send latencies.
+std::vector<uint64_t> latencyBoundsUs();
+
+// Times a scope into a histogram in microseconds.
+class ScopedTimerUs {
+public:
+    explicit ScopedTimerUs(Histogram& histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimerUs() {
+        histogram_.observe(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+    }
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Keeps a scrape-time callback registered for as long as it is held.
+// Releasing it waits for a scrape that is running the callback, so an
+// owner that drops its handles first may then tear down what they read.
+using CallbackHandle = std::shared_ptr<void>;
+
+class Registry {
+public:
+    static Registry& instance();
+
+    // The same name and labels return the same live series.
+    std::shared_ptr<Counter> counter(const std::string& name, const std::string& help, const Labels& labels = {});
+    std::shared_ptr<Gauge> gauge(const std::string& name, const std::string& help, const Labels& labels = {});
+    std::shared_ptr<Histogram> histogram(const std::string& name, const std::string& help,
+                                         std::vector<uint64_t> bounds, double unit, const Labels& labels = {});
+    // Exported as a histogram with power-of-two buckets.
+    std::shared_ptr<LogHistogram> logHistogram(const std::string& name, const std::string& help, double unit,
+                                               const Labels& labels = {});
+
+    // A counter or gauge whose value is read from `read` at scrape time, for
+    // figures a component already keeps. `read` runs on the scraping thread
+    // and must be thread-safe.
+    CallbackHandle counterCallback(const std::string& name, const std::string& help, const Labels& labels,
+                                   std::function<double()> read);
+    CallbackHandle gaugeCallback(const std::string& name, const std::string& help, const Labels& labels,
+                                 std::function<double()> read);
+
+    // Every live series in the text exposition format, version 0.0.4.
+    std::string render();
+
+private:
+    enum class Type { Counter, Gauge, Histogram };
+    struct Family {
+        Type type;
+        std::string help;
+        // Rendered label set ("{stream=\"cam1\"}") -> series.
+        std::map<std::string, std::weak_ptr<Counter>> counters;
+        std::map<std::string, std::weak_ptr<Gauge>> gauges;
+        std::map<std::string, std::weak_ptr<Histogram>> histograms;
+        std::map<std::string, std::weak_ptr<LogHistogram>> logHistograms;
+        std::map<std::string, std::shared_ptr<std::function<double()>>> callbacks;
+    };
+
+    static const char* typeName(Type type);
+    Family& family(const std::string& name, const std::string& help, Type type);
+    CallbackHandle addCallback(const std::string& name, const std::string& help, Type type, const Labels& labels,
+                               std::function<double()> read);
+
+    std::mutex mutex_;
+    std::map<std::string, Family> families_;
+};
+
+} // namespace metrics
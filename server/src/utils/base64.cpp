@@ -9,15 +9,17 @@ static const std::string base64_chars =
 
 // This implementation is a common and standard way to perform Base64 encoding.
 std::string base64_encode(const std::vector<uint8_t>& data) {
+    return base64_encode(data.data(), data.size());
+}
+
+std::string base64_encode(const uint8_t* bytes_to_encode, size_t in_len) {
     std::string ret;
+    ret.reserve((in_len + 2) / 3 * 4);
     int i = 0;
     int j = 0;
     uint8_t char_array_3[3];
     uint8_t char_array_4[4];
 
-    const uint8_t* bytes_to_encode = data.data();
-    size_t in_len = data.size();
-
     while (in_len--) {
         char_array_3[i++] = *(bytes_to_encode++);
         if (i == 3) {
@@ -50,3 +52,32 @@ std::string base64_encode(const std::vector<uint8_t>& data) {
 
     return ret;
 }
+
+bool base64_decode(const std::string& text, std::vector<uint8_t>& out) {
+    out.clear();
+    out.reserve(text.size() / 4 * 3);
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : text) {
+        if (c == '=') break;
+        size_t value = base64_chars.find(c);
+        if (value == std::string::npos) return false;
+        bits = (bits << 6) | static_cast<uint32_t>(value);
+        if (++count == 4) {
+            out.push_back(static_cast<uint8_t>(bits >> 16));
+            out.push_back(static_cast<uint8_t>(bits >> 8));
+            out.push_back(static_cast<uint8_t>(bits));
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (count == 2) {
+        out.push_back(static_cast<uint8_t>(bits >> 4));
+    } else if (count == 3) {
+        out.push_back(static_cast<uint8_t>(bits >> 10));
+        out.push_back(static_cast<uint8_t>(bits >> 2));
+    } else if (count == 1) {
+        return false;
+    }
+    return true;
+}
@@ -6,3 +6,7 @@
 
 // Encodes a vector of bytes into a Base64 string.
 std::string base64_encode(const std::vector<uint8_t>& data);
+std::string base64_encode(const uint8_t* data, size_t len);
+
+// Decodes Base64 (padding optional). Returns false on invalid characters.
+bool base64_decode(const std::string& text, std::vector<uint8_t>& out);
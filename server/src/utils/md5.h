@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// MD5 digest (RFC 1321) as 32 lowercase hex digits. Only for protocol
+// handshakes such as RTSP Digest authentication.
+std::string md5Hex(const std::string& text);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// SHA-1 digest (FIPS 180-4). Only for protocol handshakes such as
+// Sec-WebSocket-Accept; not for anything that needs to be secure.
+std::array<uint8_t, 20> sha1(const uint8_t* data, size_t len);